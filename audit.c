@@ -0,0 +1,684 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+Chunk audit.  For archives, a CRC-32C of the data of every ##dc, ##db,
+##wb and ##tx chunk is written to a manifest, so that bit rot can be
+found later by checking the file against it.  The CRC-32C is done with
+the SSE4.2 crc32 instruction when the program is built for it, such as
+with -msse4.2, and eight bytes at a time with tables otherwise.
+
+The chunks come from the index like everywhere else, or the movi list
+when there is none, and are sorted into file order.  Runs of them are
+then cut into jobs of up to AUDIT_JOB bytes of the file, which is read
+in one go, and ThreadRunOrdered() runs the jobs on a pool of threads.
+Each thread reads and hashes a job of its own, so the reads of some
+overlap the hashing of others, and the disk is kept busy however fast
+it is.  The jobs write their lines of the manifest, or of the report
+when checking, and those come out in file order.
+
+Each thread needs a handle of its own, so handles and buffers are kept
+in a pool and reused by the jobs.  The first one uses the file that is
+already open, which is all there is when running on one thread.
+
+The manifest is plain text.  After a few header lines, each chunk has
+a line with its id, the hex file location of its data, its size and its
+CRC-32C:
+
+    01wb 000000000000A1F4 1764 5C1F39A0
+
+Checking reads the chunks at the locations in the manifest, so the index
+of the file is not needed or trusted then.
+
+*/
+
+#include "rdavi2.h"
+
+#if defined(__SSE4_2__)
+  #include <nmmintrin.h>
+#endif
+
+#define AUDIT_JOB       0x01000000UL    // most bytes of the file read by a job, 16MB
+#define AUDIT_GROW      0x10000         // chunks added to the list at a time
+#define AUDIT_NAME      1024            // longest manifest name
+#define AUDIT_LINE      128             // longest manifest line but File:
+#define CRC32C_POLY     0x82F63B78UL    // Castagnoli, bit reversed
+
+static char AuditTitle[] = "RdAvi2 chunk audit, CRC-32C";
+
+
+typedef struct
+{
+    QWORD   Pos;        // location of the chunk data
+    DWORD   Size;       // bytes of chunk data
+    DWORD   Crc;        // CRC-32C, from the manifest when checking
+    char    Id[4];      // '01wb' and so on, with the stream in hex
+} AUDITCHUNK;
+
+typedef struct
+{
+    DWORD   First;      // first chunk of the job
+    DWORD   Count;      // chunks in it
+    QWORD   End;        // end of the last byte of chunk data in it
+    DWORD   Bad;        // chunks that did not match, or could not be read
+    QWORD   Bytes;      // bytes hashed
+} AUDITJOB;
+
+typedef struct AUDITSLOT
+{
+    FILE64 *in;                 // handle of the thread doing the job
+    BYTE   *Buf;                // AUDIT_JOB bytes
+    struct AUDITSLOT *Next;     // next free one
+} AUDITSLOT;
+
+typedef struct
+{
+    AVICTX     *ctx;
+    AVIINDEX   *ix;
+    int         Check;          // checking against a manifest, not writing one
+    AUDITCHUNK *Chunk;
+    DWORD       Count;          // chunks in Chunk
+    DWORD       Alloc;
+    AUDITJOB   *Job;
+    DWORD       Jobs;
+    MUTEX       Lock;           // protects Free and SlotCount
+    AUDITSLOT  *Free;           // slots not in use
+    int         SlotCount;      // slots made
+    QWORD       FileSize;
+    DWORD       Torn;           // chunks cut off by the end of the file
+    int         OutOfMemory;
+    DWORD       Table[8][256];  // CRC-32C of a byte, then of a byte and 1 to 7 zeros
+} AUDIT;
+
+
+// Fill in the tables of the CRC-32C.  Table[0] is the usual one, and
+// Table[n] is the CRC of a byte followed by n zero bytes, so that eight
+// bytes can be done with eight lookups.
+
+static void AuditCrcTable(AUDIT *au)
+{
+    DWORD c;
+    int i, k;
+
+    for (i = 0; i < 256; i++)
+    {
+        c = i;
+        for (k = 0; k < 8; k++)
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        au->Table[0][i] = c;
+    }
+    for (i = 0; i < 256; i++)
+        for (k = 1; k < 8; k++)
+            au->Table[k][i] = (au->Table[k - 1][i] >> 8) ^
+                              au->Table[0][au->Table[k - 1][i] & 0xFF];
+}
+
+
+// Carry on the CRC-32C crc, which is 0 to start with, over len bytes.
+
+static DWORD AuditCrc(AUDIT *au, DWORD crc, BYTE *p, size_t len)
+{
+#if defined(__SSE4_2__)
+  #if defined(__x86_64__)
+    QWORD q;
+  #endif
+    DWORD d;
+
+    crc = ~crc;
+  #if defined(__x86_64__)
+    for (; len >= 8; p += 8, len -= 8)
+    {
+        memcpy(&q, p, 8);
+        crc = (DWORD) _mm_crc32_u64(crc, q);
+    }
+  #endif
+    for (; len >= 4; p += 4, len -= 4)
+    {
+        memcpy(&d, p, 4);
+        crc = _mm_crc32_u32(crc, d);
+    }
+    while (len--)
+        crc = _mm_crc32_u8(crc, *p++);
+#else
+    DWORD lo, hi;
+
+    crc = ~crc;
+    for (; len >= 8; p += 8, len -= 8)
+    {
+        lo = crc ^ (p[0] | ((DWORD) p[1] << 8) | ((DWORD) p[2] << 16) | ((DWORD) p[3] << 24));
+        hi = p[4] | ((DWORD) p[5] << 8) | ((DWORD) p[6] << 16) | ((DWORD) p[7] << 24);
+        crc = au->Table[7][lo & 0xFF] ^ au->Table[6][(lo >> 8) & 0xFF] ^
+              au->Table[5][(lo >> 16) & 0xFF] ^ au->Table[4][lo >> 24] ^
+              au->Table[3][hi & 0xFF] ^ au->Table[2][(hi >> 8) & 0xFF] ^
+              au->Table[1][(hi >> 16) & 0xFF] ^ au->Table[0][hi >> 24];
+    }
+    while (len--)
+        crc = (crc >> 8) ^ au->Table[0][(crc ^ *p++) & 0xFF];
+#endif
+
+    return(~crc);
+}
+
+
+// Add a chunk to the list.
+
+static void AuditAdd(AUDIT *au, QWORD pos, DWORD size, char *id)
+{
+    AUDITCHUNK *p;
+
+    if (au->Count == au->Alloc)
+    {
+        p = (AUDITCHUNK *) realloc(au->Chunk, (au->Alloc + AUDIT_GROW) * sizeof(AUDITCHUNK));
+        if (p == NULL)
+        {
+            au->OutOfMemory = TRUE;
+            return;
+        }
+        au->Chunk = p;
+        au->Alloc += AUDIT_GROW;
+    }
+
+    p = au->Chunk + au->Count++;
+    p->Pos = pos;
+    p->Size = size;
+    p->Crc = 0;
+    memcpy(p->Id, id, 4);
+}
+
+
+static void AuditEntry(void *arg, int stream, AVIENTRY *e)
+{
+    AUDIT *au = (AUDIT *) arg;
+    QWORD pos = e->Pos;
+    FOURCC fcc;
+    char id[8];
+    int s;
+
+    fcc = ParseFCC(&e->FCC, &s);
+    if (fcc != MKFCC('#','#','d','c') && fcc != MKFCC('#','#','d','b') &&
+        fcc != MKFCC('#','#','w','b') && fcc != MKFCC('#','#','t','x')) return;
+    if (au->OutOfMemory) return;
+
+    if (pos + e->Size > au->FileSize)
+    {
+        au->Torn++;
+        return;
+    }
+
+    sprintf(id, "%02X%.2s", stream & 0xFF, (char *) &e->FCC + 2);
+    AuditAdd(au, pos, e->Size, id);
+}
+
+
+static int AuditCompare(const void *a, const void *b)
+{
+    QWORD pa = ((AUDITCHUNK *) a)->Pos, pb = ((AUDITCHUNK *) b)->Pos;
+
+    return(pa < pb ? -1 : pa > pb ? 1 : 0);
+}
+
+
+// Cut the chunks, which are in file order, into jobs.  A job ends before
+// a chunk that would take it past AUDIT_JOB bytes of the file, so only a
+// job with one big chunk in it is any longer.
+// Returns 0 on success or -1 if out of memory.
+
+static int AuditPlan(AUDIT *au)
+{
+    AUDITJOB *jb;
+    QWORD start = 0, end;
+    DWORD i;
+
+    au->Job = (AUDITJOB *) calloc(au->Count ? au->Count : 1, sizeof(AUDITJOB));
+    if (au->Job == NULL) return(-1);
+
+    for (i = 0; i < au->Count; i++)
+    {
+        jb = au->Job + au->Jobs;
+        end = au->Chunk[i].Pos + au->Chunk[i].Size;
+        if (jb->Count && (end > jb->End ? end : jb->End) - start > AUDIT_JOB)
+        {
+            au->Jobs++;
+            jb++;
+        }
+        if (jb->Count == 0)
+        {
+            jb->First = i;
+            start = au->Chunk[i].Pos;
+        }
+        if (end > jb->End) jb->End = end;
+        jb->Count++;
+    }
+    if (au->Count) au->Jobs++;
+
+    return(0);
+}
+
+
+// Get a handle and buffer for a job, from the pool or new.
+// Returns NULL if out of memory or the file cannot be opened again.
+
+static AUDITSLOT *AuditGetSlot(AUDIT *au)
+{
+    AUDITSLOT *sl;
+
+    MutexLock(&au->Lock);
+    sl = au->Free;
+    if (sl) au->Free = sl->Next;
+    else
+    {
+        sl = (AUDITSLOT *) calloc(1, sizeof(AUDITSLOT));
+        if (sl)
+        {
+            sl->Buf = (BYTE *) malloc(AUDIT_JOB);
+            if (au->SlotCount == 0) sl->in = au->ctx->in;
+            else if (au->ctx->Name) sl->in = File64Open(au->ctx->Name, "rb");
+            if (sl->Buf == NULL || sl->in == NULL)
+            {
+                free(sl->Buf);
+                free(sl);
+                sl = NULL;
+            }
+            else au->SlotCount++;
+        }
+    }
+    MutexUnlock(&au->Lock);
+
+    return(sl);
+}
+
+
+static void AuditPutSlot(AUDIT *au, AUDITSLOT *sl)
+{
+    MutexLock(&au->Lock);
+    sl->Next = au->Free;
+    au->Free = sl;
+    MutexUnlock(&au->Lock);
+}
+
+
+// Work out the CRC-32C of a chunk too big to fit in the buffer with the
+// rest of its job, a buffer full at a time.
+// Returns 0 on success or -1 if it could not all be read.
+
+static int AuditBigChunk(AUDIT *au, AUDITSLOT *sl, AUDITCHUNK *ck, DWORD *crc)
+{
+    QWORD pos = ck->Pos, end = ck->Pos + ck->Size;
+    BYTE *p;
+    int n;
+
+    *crc = 0;
+    while (pos < end)
+    {
+        n = (end - pos > AUDIT_JOB) ? AUDIT_JOB : (int)(end - pos);
+        p = (BYTE *) File64ViewAt(sl->in, pos, sl->Buf, &n);
+        if (n <= 0) return(-1);
+        *crc = AuditCrc(au, *crc, p, n);
+        pos += n;
+    }
+
+    return(0);
+}
+
+
+// Line of the report for a chunk that did not match.
+
+static void AuditBadLine(OUTBUF *ob, AUDITCHUNK *ck, DWORD crc, int got)
+{
+    OutPrintf(ob, "*** %.4s at ", ck->Id);
+    OutHex64(ob, ck->Pos);
+    OutStr(ob, ", ");
+    OutQDec(ob, ck->Size);
+    if (got)
+    {
+        OutPrintf(ob, " bytes, CRC-32C %08X, manifest has %08X ***\n", crc, ck->Crc);
+    }
+    else OutStr(ob, " bytes, could not be read ***\n");
+}
+
+
+// Read and hash the chunks of job num, and write their lines of the
+// manifest, or report the ones that do not match, to out.
+
+static int AuditJob(void *arg, int num, FILE *out)
+{
+    AUDIT *au = (AUDIT *) arg;
+    AUDITJOB *jb = au->Job + num;
+    AUDITCHUNK *ck;
+    AUDITSLOT *sl;
+    OUTBUF ob;
+    QWORD start;
+    BYTE *p;
+    DWORD crc, i;
+    int n, got;
+
+    sl = AuditGetSlot(au);
+    if (sl == NULL)
+    {
+        jb->Bad = jb->Count;
+        au->OutOfMemory = TRUE;
+        return(-1);
+    }
+    OutInit(&ob, out);
+
+    // the whole job is read at once, unless it is one chunk too big for that
+
+    ck = au->Chunk + jb->First;
+    start = ck->Pos;
+    n = 0;
+    p = NULL;
+    if (jb->End - start <= AUDIT_JOB)
+    {
+        n = (int)(jb->End - start);
+        p = (BYTE *) File64ViewAt(sl->in, start, sl->Buf, &n);
+    }
+
+    for (i = 0; i < jb->Count; i++, ck++)
+    {
+        crc = 0;
+        if (p == NULL)
+            got = (AuditBigChunk(au, sl, ck, &crc) == 0);
+        else if ((got = (ck->Pos + ck->Size - start <= (QWORD) n)) != 0)
+            crc = AuditCrc(au, 0, p + (size_t)(ck->Pos - start), ck->Size);
+
+        if (got) jb->Bytes += ck->Size;
+        if (au->Check)
+        {
+            if (!got || crc != ck->Crc)
+            {
+                jb->Bad++;
+                AuditBadLine(&ob, ck, crc, got);
+            }
+            continue;
+        }
+
+        if (!got)
+        {
+            jb->Bad++;
+            continue;
+        }
+        OutMem(&ob, ck->Id, 4);
+        OutChar(&ob, ' ');
+        OutHex64(&ob, ck->Pos);
+        OutChar(&ob, ' ');
+        OutQDec(&ob, ck->Size);
+        OutChar(&ob, ' ');
+        OutHex(&ob, crc, 8);
+        OutChar(&ob, '\n');
+    }
+
+    OutClose(&ob);
+    AuditPutSlot(au, sl);
+
+    return(0);
+}
+
+
+// Read a hex or decimal number from *s, moving it past the number.
+// Returns FALSE if there is none.
+
+static int AuditNumber(char **s, QWORD *val, int hex)
+{
+    char *p = *s;
+    int d;
+
+    while (*p == ' ') p++;
+    *val = 0;
+    for (*s = p; ; p++)
+    {
+        if (*p >= '0' && *p <= '9') d = *p - '0';
+        else if (hex && *p >= 'A' && *p <= 'F') d = *p - 'A' + 10;
+        else if (hex && *p >= 'a' && *p <= 'f') d = *p - 'a' + 10;
+        else break;
+        *val = *val * (hex ? 16 : 10) + d;
+    }
+    if (p == *s) return(FALSE);
+    *s = p;
+
+    return(TRUE);
+}
+
+
+// Read the chunks of the manifest fp into the list.
+// Returns 0 on success, or -1 if it is not a manifest, in which case the
+// reason has been reported.
+
+static int AuditReadManifest(AUDIT *au, FILE *fp, QWORD *size)
+{
+    OUTBUF *out = au->ctx->out;
+    char line[AUDIT_LINE], *p;
+    QWORD pos, len, crc;
+    DWORD count = 0xFFFFFFFFUL;
+
+    *size = 0;
+    if (fgets(line, sizeof(line), fp) == NULL ||
+        strncmp(line, AuditTitle, strlen(AuditTitle)))
+    {
+        OutPrintf(out, "*** This is not an audit manifest ***\n");
+        return(-1);
+    }
+
+    while (fgets(line, sizeof(line), fp) && !au->OutOfMemory)
+    {
+        p = line + 5;
+        if (strncmp(line, "Size:", 5) == 0) AuditNumber(&p, size, FALSE);
+        else if (strncmp(line, "File:", 5) == 0)
+        {
+            while (strchr(line, '\n') == NULL && fgets(line, sizeof(line), fp));
+        }
+        else if (strncmp(line, "Chunks:", 7) == 0)
+        {
+            p = line + 7;
+            if (AuditNumber(&p, &len, FALSE)) count = (DWORD) len;
+        }
+        else if (strlen(line) > 5 && line[4] == ' ' && AuditNumber(&p, &pos, TRUE) &&
+                 AuditNumber(&p, &len, FALSE) && AuditNumber(&p, &crc, TRUE) &&
+                 len <= 0xFFFFFFFFUL)
+        {
+            AuditAdd(au, pos, (DWORD) len, line);
+            if (!au->OutOfMemory) au->Chunk[au->Count - 1].Crc = (DWORD) crc;
+        }
+        else
+        {
+            OutPrintf(out, "*** The manifest has a bad line: %.40s ***\n", line);
+            return(-1);
+        }
+    }
+
+    if (!au->OutOfMemory && au->Count != count)
+    {
+        OutPrintf(out, "*** The manifest is not complete ***\n");
+        return(-1);
+    }
+
+    return(0);
+}
+
+
+static void AuditLine(OUTBUF *out, char *label, QWORD val)
+{
+    OutPrintf(out, "%16s: ", label);
+    OutQDec(out, val);
+    OutChar(out, '\n');
+}
+
+
+// Write a manifest of the CRC-32C of every chunk to the file named by
+// ctx->Query, or with AVI_CHECK check the chunks against it.  The jobs
+// are run on ctx->Threads threads.
+// Returns 0 on success, 1 if any chunk did not match, or -1 if the file
+// or the manifest could not be read or written.
+
+int AuditReport(AVICTX *ctx)
+{
+    AUDIT *au;
+    AUDITSLOT *sl;
+    OUTBUF *out = ctx->out, ob;
+    FILE *fp = NULL;
+    QWORD size, bytes = 0;
+    DWORD bad = 0, i;
+    char *name = NULL, *tmpname = NULL;
+    int ret = 0;
+
+    OutPrintf(out, "Chunk audit\n");
+
+    // A new manifest is written under a temporary name and renamed when it
+    // is complete.  Neither name may be the AVI file, however it is reached.
+
+    au = (AUDIT *) calloc(1, sizeof(AUDIT));
+    if (ctx->Query) name = MakeFileName(ctx->Query, ctx->Name, AUDIT_NAME);
+    if (name && !(ctx->Flags & AVI_CHECK)) tmpname = File64TempName(name);
+    if (au == NULL || name == NULL || (!(ctx->Flags & AVI_CHECK) && tmpname == NULL))
+    {
+        OutPrintf(out, "*** Out of memory, or no manifest named ***\n");
+        free(au);
+        free(name);
+        free(tmpname);
+        return(-1);
+    }
+    if (tmpname && (File64SameFile(ctx->in, name) || File64SameFile(ctx->in, tmpname)))
+    {
+        OutPrintf(out, "*** The manifest %s is the file being read ***\n", name);
+        free(au);
+        free(name);
+        free(tmpname);
+        return(-1);
+    }
+    au->ctx = ctx;
+    au->Check = (ctx->Flags & AVI_CHECK) != 0;
+    au->FileSize = File64Size(ctx->in);
+    AuditCrcTable(au);
+    MutexInit(&au->Lock);
+
+    fp = au->Check ? fopen(name, "r") : fopen(tmpname, "w");
+    if (fp == NULL)
+    {
+        OutPrintf(out, "*** Could not open %s ***\n", au->Check ? name : tmpname);
+        ret = -1;
+    }
+    else if (au->Check)
+    {
+        ret = AuditReadManifest(au, fp, &size);
+        if (ret == 0 && size != au->FileSize)
+            OutPrintf(out, "*** The file is not the size it was ***\n");
+    }
+    else
+    {
+        au->ix = (AVIINDEX *) malloc(sizeof(AVIINDEX));
+        if (au->ix == NULL) au->OutOfMemory = TRUE;
+        else
+        {
+            au->ix->arg = au;
+            au->ix->Entry = AuditEntry;
+            au->ix->Error = NULL;
+            au->ix->Sources = 0;
+            if (AviIndexRead(ctx->in, au->ix) == -2) au->OutOfMemory = TRUE;
+            OutPrintf(out, "%16s: %s\n", "Chunks From", au->ix->Source == INDEX_ODML ?
+                      "Open-DML" : au->ix->Source == INDEX_IDX1 ? "idx1" : "movi list");
+        }
+    }
+
+    if (ret == 0 && !au->OutOfMemory)
+    {
+        qsort(au->Chunk, au->Count, sizeof(AUDITCHUNK), AuditCompare);
+        if (AuditPlan(au)) au->OutOfMemory = TRUE;
+    }
+
+    if (ret == 0 && !au->OutOfMemory)
+    {
+        if (!au->Check)
+        {
+            OutInit(&ob, fp);
+            OutPrintf(&ob, "%s\nFile: %s\nSize: ", AuditTitle, ctx->Name ? ctx->Name : "");
+            OutQDec(&ob, au->FileSize);
+            OutChar(&ob, '\n');
+            OutClose(&ob);
+        }
+
+        OutFlush(out);
+        ThreadRunOrdered((int) au->Jobs, ctx->Threads, AuditJob, au,
+                         au->Check ? out->fp : fp);
+
+        for (i = 0; i < au->Jobs; i++)
+        {
+            bad += au->Job[i].Bad;
+            bytes += au->Job[i].Bytes;
+        }
+
+        // The count goes last, so that a manifest cut short is seen to be.
+
+        if (!au->Check)
+        {
+            OutInit(&ob, fp);
+            OutStr(&ob, "Chunks: ");
+            OutQDec(&ob, au->Count - bad);
+            OutChar(&ob, '\n');
+            OutClose(&ob);
+        }
+    }
+
+    if (fp && fclose(fp) && !au->Check)
+    {
+        OutPrintf(out, "*** Could not write %s ***\n", tmpname);
+        ret = -1;
+    }
+    if (fp && !au->Check)
+    {
+        if (ret || au->OutOfMemory) remove(tmpname);
+        else if (File64Replace(tmpname, name))
+        {
+            OutPrintf(out, "*** Could not rename %s to %s ***\n", tmpname, name);
+            ret = -1;
+        }
+    }
+
+    if (au->OutOfMemory)
+    {
+        OutPrintf(out, "*** Out of memory ***\n");
+        ret = -1;
+    }
+    else if (ret == 0)
+    {
+        AuditLine(out, au->Check ? "Chunks Checked" : "Chunks", au->Count);
+        if (au->Torn) AuditLine(out, "Chunks Torn", au->Torn);
+        if (au->Check || bad)
+            AuditLine(out, au->Check ? "Chunks Bad" : "Chunks Unread", bad);
+        AuditLine(out, "Bytes Hashed", bytes);
+        AuditLine(out, "Jobs", au->Jobs);
+        OutPrintf(out, "%16s: %s\n", au->Check ? "Checked With" : "Written To", name);
+        if (bad) ret = 1;
+    }
+
+    while ((sl = au->Free) != NULL)
+    {
+        au->Free = sl->Next;
+        if (sl->in != ctx->in) File64Close(sl->in);
+        free(sl->Buf);
+        free(sl);
+    }
+    MutexFree(&au->Lock);
+    free(au->Chunk);
+    free(au->Job);
+    free(au->ix);
+    free(au);
+    free(name);
+    free(tmpname);
+
+    return(ret);
+}
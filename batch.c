@@ -0,0 +1,291 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+Batch mode.  Many files can be given on the command line, as the names
+of directories to look in, or as a list of names read from a file or
+stdin.  Each file is parsed by a pool of worker threads into a report
+of its own, and the reports are written to stdout one after the other
+in the same order that the files were given, so the output looks just
+as if the files had been done one at a time.
+
+Nothing about a file is shared between the workers.  Each one opens its
+own FILE64 handle and has its own AVICTX.
+
+*/
+
+#include "rdavi2.h"
+
+#if !defined(__WIN32__)
+  #include <dirent.h>
+#endif
+
+#define MAX_NAME_LEN    4096    // longest name accepted from a list
+
+
+// Add one name to the list.
+// Returns 0 on success, -1 if out of memory.
+
+static int NameListAppend(NAMELIST *nl, char *name)
+{
+    char **p;
+
+    if (nl->Count == nl->Alloc)
+    {
+        p = (char **) realloc(nl->Name, (nl->Alloc + 256) * sizeof(char *));
+        if (p == NULL) return(-1);
+        nl->Name = p;
+        nl->Alloc += 256;
+    }
+
+    nl->Name[nl->Count] = (char *) malloc(strlen(name) + 1);
+    if (nl->Name[nl->Count] == NULL) return(-1);
+    strcpy(nl->Name[nl->Count], name);
+    nl->Count++;
+
+    return(0);
+}
+
+
+// Returns TRUE if the name ends in ".avi", in any case.
+
+static int IsAviName(char *name)
+{
+    int len = strlen(name);
+
+    return(len > 4 && name[len-4] == '.' &&
+           toupper(name[len-3]) == 'A' &&
+           toupper(name[len-2]) == 'V' &&
+           toupper(name[len-1]) == 'I');
+}
+
+
+static int CompareNames(const void *a, const void *b)
+{
+    return(strcmp(*(char **) a, *(char **) b));
+}
+
+
+// Add every .avi file in a directory to the list, sorted by name so the
+// output does not depend on the order the file system keeps them in.
+// Subdirectories are not searched.
+// Returns 0 on success, 1 if name is not a directory, -1 on error.
+
+static int NameListAddDir(NAMELIST *nl, char *dir)
+{
+    char path[MAX_NAME_LEN];
+    int first = nl->Count;
+#if defined(__WIN32__)
+    WIN32_FIND_DATA fd;
+    HANDLE hFind;
+    DWORD attr;
+
+    attr = GetFileAttributes(dir);
+    if (attr == 0xFFFFFFFF || !(attr & FILE_ATTRIBUTE_DIRECTORY)) return(1);
+
+    if (strlen(dir) + 3 > sizeof(path)) return(-1);
+    sprintf(path, "%s\\*", dir);
+    hFind = FindFirstFile(path, &fd);
+    if (hFind != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+            if (!IsAviName(fd.cFileName)) continue;
+            if (strlen(dir) + strlen(fd.cFileName) + 2 > sizeof(path)) continue;
+            sprintf(path, "%s\\%s", dir, fd.cFileName);
+            if (NameListAppend(nl, path)) break;
+        } while (FindNextFile(hFind, &fd));
+        FindClose(hFind);
+    }
+#else
+    struct stat st;
+    struct dirent *de;
+    DIR *dp;
+
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) return(1);
+
+    dp = opendir(dir);
+    if (dp == NULL) return(-1);
+    while ((de = readdir(dp)) != NULL)
+    {
+        if (!IsAviName(de->d_name)) continue;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, de->d_name) >= (int) sizeof(path))
+            continue;   // name too long
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        if (NameListAppend(nl, path)) break;
+    }
+    closedir(dp);
+#endif
+
+    qsort(nl->Name + first, nl->Count - first, sizeof(char *), CompareNames);
+
+    return(0);
+}
+
+
+// Add a file, or all the .avi files in a directory, to the list.
+// Returns 0 if a file was added, 1 if a directory was, or -1 on error.
+
+int NameListAdd(NAMELIST *nl, char *name)
+{
+    int rc = NameListAddDir(nl, name);
+
+    if (rc == 0) return(1);
+    if (rc == 1) rc = NameListAppend(nl, name);
+
+    return(rc);
+}
+
+
+// Read a list of names, one per line, and add them to the list.
+// Blank lines are skipped.  Directories are expanded the same as on the
+// command line.
+// Returns 0 on success, -1 on error.
+
+int NameListRead(NAMELIST *nl, FILE *fp)
+{
+    char line[MAX_NAME_LEN];
+    int len;
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        len = strlen(line);
+        while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+            line[--len] = 0;
+        if (len == 0) continue;
+
+        if (NameListAdd(nl, line) < 0) return(-1);
+    }
+
+    return(0);
+}
+
+
+void NameListFree(NAMELIST *nl)
+{
+    int i;
+
+    for (i = 0; i < nl->Count; i++)
+        free(nl->Name[i]);
+
+    free(nl->Name);
+    memset(nl, 0, sizeof(NAMELIST));
+}
+
+
+
+// Write the report for one file to out.  flags are the AVI_* report
+// options.  With AVI_SEGMENTS, the RIFF segments of the file are read by
+// threads at the same time, and the audit is split up over them too.
+// cachedir is the chunk tree cache, or NULL.  query is what to look up
+// with AVI_FRAME, AVI_SEEK or AVI_GOP, the file AVI_REPAIR writes, the
+// stream and file for AVI_DEMUX, the manifest for AVI_AUDIT or AVI_CHECK,
+// or NULL.  lim are the limits of the parse of each file.
+// Returns 0 on success, -1 if the file could not be opened.
+
+static int BatchFile(char *name, FILE *out, DWORD flags, int threads, char *cachedir,
+                     char *query, AVILIMITS *lim)
+{
+    FILE64 *in;
+    AVICTX ctx;
+
+    if (!(flags & AVI_JSON)) fprintf(out, "File: %s\n\n", name);
+
+    in = File64Open(name, "rb");
+    if (in == 0)
+    {
+        if (flags & AVI_JSON)
+            JsonFileError(out, name, "Could not open");
+        else
+            fprintf(out, "Could not open %s for input\n\n", name);
+        return(-1);
+    }
+
+    AviInitContext(&ctx, in, out, flags);
+    ctx.Name = name;
+    ctx.CacheDir = cachedir;
+    ctx.Query = query;
+    ctx.Threads = threads;
+    ctx.Limits = *lim;
+    if (flags & AVI_SEGMENTS)
+        AviParseSegments(&ctx, name, threads);
+    else
+        AviParse(&ctx);
+    AviFreeContext(&ctx);
+    if (!(flags & AVI_JSON)) fprintf(out, "\n");
+
+    File64Close(in);
+
+    return(0);
+}
+
+
+typedef struct
+{
+    NAMELIST *nl;       // files to do
+    DWORD     Flags;    // report options
+    char     *CacheDir; // chunk tree cache or NULL
+    char     *Query;    // AVI_FRAME, AVI_SEEK or AVI_GOP lookup, AVI_REPAIR, AVI_DEMUX or AVI_AUDIT file
+    AVILIMITS *Limits;  // limits of the parse of each file
+} BATCHJOBS;
+
+static int BatchJob(void *arg, int num, FILE *out)
+{
+    BATCHJOBS *bj = (BATCHJOBS *) arg;
+
+    // the files are already spread over the threads
+
+    return(BatchFile(bj->nl->Name[num], out, bj->Flags, 1, bj->CacheDir,
+                      bj->Query, bj->Limits));
+}
+
+
+// Parse every file in the list and write the reports to stdout in order.
+// threads is the number of worker threads to use, or 0 for one per CPU.
+// With AVI_SEGMENTS in flags, the files are done one at a time and the
+// threads are used on the RIFF segments within each file instead.
+// cachedir is the chunk tree cache, or NULL, and query is what to look
+// up with AVI_FRAME, AVI_SEEK or AVI_GOP, the file AVI_REPAIR writes, the
+// stream and file for AVI_DEMUX, the manifest for AVI_AUDIT or AVI_CHECK,
+// or NULL.  lim are the limits of the parse of each file.
+// Returns 0 if all the files were read, 1 if any could not be.
+
+int BatchRun(NAMELIST *nl, int threads, DWORD flags, char *cachedir, char *query,
+             AVILIMITS *lim)
+{
+    BATCHJOBS bj;
+    int i, rc = 0;
+
+    if (!(flags & AVI_SEGMENTS))
+    {
+        bj.nl = nl;
+        bj.Flags = flags;
+        bj.CacheDir = cachedir;
+        bj.Query = query;
+        bj.Limits = lim;
+        return(ThreadRunOrdered(nl->Count, threads, BatchJob, &bj, stdout) ? 1 : 0);
+    }
+
+    for (i = 0; i < nl->Count; i++)
+        if (BatchFile(nl->Name[i], stdout, flags, threads, cachedir, query, lim)) rc = 1;
+
+    return(rc);
+}
+
@@ -0,0 +1,543 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+Chunk tree cache.  Walking the movi list of a big file touches headers
+spread over the whole disk, and the same archive files get looked at
+again and again.  So the chunk tree of a file can be saved in a cache
+directory and read back the next time instead of reading the file.
+
+A cache file belongs to one AVI file, and is only used if that file
+still has the same path, size and time of last write, and the first and
+last CACHE_BLOCK bytes still hash to the same value.  Anything else is a
+miss and the tree is built again from the file.
+
+The cache file is a header followed by fixed size records: the path, a
+table of nodes in file order, a table of index entries and the decoded
+headers.  Records only hold file offsets and node numbers, never
+pointers, all fields are aligned to their size and all numbers are
+little endian, so a cache file can be memory mapped and used in place.
+Any change to the layout must bump CACHE_VERSION.
+
+The header holds a hash of itself and of all the records, so a cache
+file that was damaged on disk is found out when it is read, and is
+treated as a miss rather than handed out as the tree of the file.
+
+*/
+
+#include "rdavi2.h"
+
+#define CACHE_VERSION   2
+#define CACHE_BLOCK     0x10000     // bytes hashed at each end of the file
+#define CACHE_BATCH     1024        // records read or written at once
+
+static char CacheMagic[8] = "RDAVI2C";
+
+
+typedef struct
+{
+    char   Magic[8];        // CacheMagic
+    DWORD  Version;         // CACHE_VERSION
+    DWORD  HeaderSize;      // sizeof(CACHEHDR)
+    QWORD  FileSize;        // key: size of the AVI file
+    QWORD  MTime;           // key: File64MTime() of the AVI file
+    QWORD  Hash;            // key: hash of the first and last blocks
+    QWORD  PathOff;         // key: path of the AVI file, no NUL
+    DWORD  PathLen;
+    LONG   Result;          // what AviWalk() returned
+    QWORD  NodeOff;         // table of CACHENODE, the root first
+    DWORD  NodeCount;
+    DWORD  NodeSize;        // sizeof(CACHENODE)
+    QWORD  EntryOff;        // table of CACHEENTRY
+    DWORD  EntryCount;
+    DWORD  EntrySize;       // sizeof(CACHEENTRY)
+    QWORD  DataOff;         // decoded headers, each aligned to 8 bytes
+    QWORD  DataLen;
+    QWORD  Check;           // CacheHash() of the header with this 0, then
+                            // the path, nodes, entries and headers
+} CACHEHDR;
+
+typedef struct
+{
+    QWORD  Pos;             // absolute file location of the chunk
+    QWORD  DataOff;         // from the start of the decoded headers
+    QWORD  EntryFirst;      // number of the first entry in the table
+    FOURCC FCC;
+    FOURCC Type;
+    DWORD  Size;
+    LONG   StreamNum;
+    LONG   Kind;
+    LONG   Depth;
+    DWORD  Parent;          // node numbers, 0 is the root
+    DWORD  Child;           // 0 if none
+    DWORD  Next;            // 0 if none
+    DWORD  DataLen;         // 0 if no decoded header
+    DWORD  EntryCount;
+    DWORD  Reserved;
+} CACHENODE;
+
+typedef struct
+{
+    QWORD  Pos;
+    QWORD  Pos2;
+    FOURCC FCC;
+    DWORD  Num;
+    DWORD  Size;
+    DWORD  Flags;
+    WORD   Kind;
+    WORD   KeyFrame;
+    DWORD  Reserved;
+} CACHEENTRY;
+
+
+#define ALIGN8(x)   (((x) + 7) & ~(QWORD) 7)
+
+#define CACHE_HASH_INIT   (((QWORD) 0xCBF29CE4 << 32) | 0x84222325)
+
+
+// 64 bit FNV-1a hash of len bytes, continuing from hash.
+
+static QWORD CacheHash(QWORD hash, BYTE *p, int len)
+{
+    QWORD prime = ((QWORD) 1 << 40) | 0x1B3;
+
+    while (len--)
+    {
+        hash ^= *p++;
+        hash *= prime;
+    }
+
+    return(hash);
+}
+
+
+// Fill in the key of the AVI file in hdr.  Returns 0 on success or -1 if
+// the file cannot be identified, such as a pipe.
+
+static int CacheKey(FILE64 *in, char *fname, CACHEHDR *hdr)
+{
+    BYTE *buf;
+    QWORD hash = CACHE_HASH_INIT;
+    int len;
+
+    memset(hdr, 0, sizeof(CACHEHDR));
+    memcpy(hdr->Magic, CacheMagic, sizeof(hdr->Magic));
+    hdr->Version = CACHE_VERSION;
+    hdr->HeaderSize = sizeof(CACHEHDR);
+    hdr->NodeSize = sizeof(CACHENODE);
+    hdr->EntrySize = sizeof(CACHEENTRY);
+    hdr->PathLen = strlen(fname);
+    hdr->FileSize = File64Size(in);
+    hdr->MTime = File64MTime(in);
+    if (hdr->FileSize == 0 || hdr->MTime == 0) return(-1);
+
+    buf = (BYTE *) malloc(CACHE_BLOCK);
+    if (buf == NULL) return(-1);
+
+    len = (int) File64ReadAt(in, 0, buf, CACHE_BLOCK);
+    hash = CacheHash(hash, buf, len);
+    if (hdr->FileSize > CACHE_BLOCK)
+    {
+        len = (int) File64ReadAt(in, hdr->FileSize - CACHE_BLOCK, buf, CACHE_BLOCK);
+        hash = CacheHash(hash, buf, len);
+    }
+    hdr->Hash = hash;
+
+    free(buf);
+    return(0);
+}
+
+
+// Make the name of the cache file for fname in dir.  The name is the hash
+// of the path, so the path is also kept in the cache file to tell apart
+// two paths that hash the same.
+// Returns a string that must be freed, or NULL if out of memory.
+
+static char *CacheName(char *dir, char *fname)
+{
+    QWORD hash = CACHE_HASH_INIT;
+    char *name;
+    int len = strlen(dir);
+
+    hash = CacheHash(hash, (BYTE *) fname, strlen(fname));
+
+    name = (char *) malloc(len + 22);
+    if (name == NULL) return(NULL);
+
+    strcpy(name, dir);
+    if (len && name[len - 1] != '/' && name[len - 1] != '\\')
+        name[len++] = '/';
+    QWORD2HEX(hash, name + len);
+    strcpy(name + len + 16, ".rdc");
+
+    return(name);
+}
+
+
+// Read the tree from the cache file cname if its key matches key.
+// Returns the tree, or NULL if it is a miss or the cache file is bad.
+
+static AVITREE *CacheLoad(char *cname, char *fname, CACHEHDR *key)
+{
+    FILE64 *cf;
+    CACHEHDR hdr;
+    CACHENODE *cn, *buf;
+    CACHEENTRY *ce, *ebuf;
+    AVITREE *t;
+    AVITREENODE *n, *node;
+    AVIENTRY *e, *entry;
+    BYTE *data;
+    char *path;
+    QWORD size, check, sum;
+    DWORD i, j, cnt;
+    int stream[CACHE_BATCH];
+    int ok;
+
+    cf = File64Open(cname, "rb");
+    if (cf == NULL) return(NULL);
+
+    size = File64Size(cf);
+    ok = File64ReadAt(cf, 0, &hdr, sizeof(CACHEHDR)) == sizeof(CACHEHDR) &&
+         memcmp(hdr.Magic, key->Magic, sizeof(hdr.Magic)) == 0 &&
+         hdr.Version == key->Version && hdr.HeaderSize == key->HeaderSize &&
+         hdr.NodeSize == key->NodeSize && hdr.EntrySize == key->EntrySize &&
+         hdr.FileSize == key->FileSize && hdr.MTime == key->MTime &&
+         hdr.Hash == key->Hash && hdr.PathLen == key->PathLen &&
+         hdr.NodeCount > 0 &&
+         hdr.PathOff + hdr.PathLen <= size &&
+         hdr.NodeOff + (QWORD) hdr.NodeCount * sizeof(CACHENODE) <= size &&
+         hdr.EntryOff + (QWORD) hdr.EntryCount * sizeof(CACHEENTRY) <= size &&
+         hdr.DataOff + hdr.DataLen <= size && hdr.DataLen < 0x80000000UL;
+
+    if (ok)
+    {
+        path = (char *) malloc(hdr.PathLen + 1);
+        ok = path && File64ReadAt(cf, hdr.PathOff, path, hdr.PathLen) == hdr.PathLen &&
+             memcmp(path, fname, hdr.PathLen) == 0;
+        free(path);
+    }
+
+    // the check is done in the order the records are in the file, the
+    // decoded headers last even though they are read first
+
+    check = hdr.Check;
+    hdr.Check = 0;
+    sum = CacheHash(CACHE_HASH_INIT, (BYTE *) &hdr, sizeof(CACHEHDR));
+    sum = CacheHash(sum, (BYTE *) fname, (int) hdr.PathLen);
+
+    t = NULL;
+    buf = NULL;
+    ebuf = NULL;
+    if (ok)
+    {
+        t = (AVITREE *) malloc(sizeof(AVITREE));
+        buf = (CACHENODE *) malloc(CACHE_BATCH * sizeof(CACHENODE));
+        ebuf = (CACHEENTRY *) malloc(CACHE_BATCH * sizeof(CACHEENTRY));
+        ok = t && buf && ebuf;
+    }
+
+    if (ok)
+    {
+        // One arena allocation each for the nodes, the entries and the
+        // decoded headers.
+
+        memset(t, 0, sizeof(AVITREE));
+        node = (AVITREENODE *) ArenaAlloc(&t->Arena, hdr.NodeCount * sizeof(AVITREENODE));
+        entry = (AVIENTRY *) ArenaAlloc(&t->Arena, (hdr.EntryCount + 1) * sizeof(AVIENTRY));
+        data = (BYTE *) ArenaAlloc(&t->Arena, (size_t) hdr.DataLen + 1);
+        ok = node && entry && data &&
+             File64ReadAt(cf, hdr.DataOff, data, (int) hdr.DataLen) == hdr.DataLen;
+    }
+
+    for (i = 0; ok && i < hdr.NodeCount; i += cnt)
+    {
+        cnt = hdr.NodeCount - i;
+        if (cnt > CACHE_BATCH) cnt = CACHE_BATCH;
+        if (File64ReadAt(cf, hdr.NodeOff + (QWORD) i * sizeof(CACHENODE), buf,
+                         cnt * sizeof(CACHENODE)) != cnt * sizeof(CACHENODE))
+        {
+            ok = FALSE;
+            break;
+        }
+        sum = CacheHash(sum, (BYTE *) buf, cnt * sizeof(CACHENODE));
+
+        for (j = 0, cn = buf; j < cnt; j++, cn++)
+        {
+            // node numbers only ever point back to the root, and forward
+            // to nodes that are in the table
+
+            if ((i + j && cn->Parent >= i + j) || cn->Child >= hdr.NodeCount ||
+                cn->Next >= hdr.NodeCount ||
+                (cn->Child && cn->Child <= i + j) || (cn->Next && cn->Next <= i + j) ||
+                cn->DataOff > hdr.DataLen || cn->DataLen > hdr.DataLen - cn->DataOff ||
+                cn->EntryFirst > hdr.EntryCount ||
+                cn->EntryCount > hdr.EntryCount - cn->EntryFirst ||
+                ((cn->Kind == NODE_STRING || cn->Kind == NODE_ERROR) ?
+                 (cn->DataLen == 0 || data[cn->DataOff + cn->DataLen - 1] != 0) :
+                 cn->DataLen != AviTreeDataSize(cn->Kind, NULL)))
+            {
+                ok = FALSE;
+                break;
+            }
+
+            n = node + i + j;
+            n->Parent = (i + j) ? node + cn->Parent : NULL;
+            n->Child = cn->Child ? node + cn->Child : NULL;
+            n->Next = cn->Next ? node + cn->Next : NULL;
+            n->FCC = cn->FCC;
+            n->Type = cn->Type;
+            n->StreamNum = cn->StreamNum;
+            n->Kind = cn->Kind;
+            n->Depth = cn->Depth;
+            n->Pos = cn->Pos;
+            n->Size = cn->Size;
+            n->Data = cn->DataLen ? data + cn->DataOff : NULL;
+            n->Num = i + j;
+            n->Entry = entry + cn->EntryFirst;
+            n->EntryCount = n->EntryAlloc = cn->EntryCount;
+        }
+    }
+
+    for (i = 0; ok && i < hdr.EntryCount; i += cnt)
+    {
+        cnt = hdr.EntryCount - i;
+        if (cnt > CACHE_BATCH) cnt = CACHE_BATCH;
+        if (File64ReadAt(cf, hdr.EntryOff + (QWORD) i * sizeof(CACHEENTRY), ebuf,
+                         cnt * sizeof(CACHEENTRY)) != cnt * sizeof(CACHEENTRY))
+        {
+            ok = FALSE;
+            break;
+        }
+        sum = CacheHash(sum, (BYTE *) ebuf, cnt * sizeof(CACHEENTRY));
+
+        // the stream numbers are not kept, they come from the chunk ids
+        ParseFCCs(&ebuf->FCC, sizeof(CACHEENTRY), (int) cnt, NULL, stream);
+
+        for (j = 0, ce = ebuf, e = entry + i; j < cnt; j++, ce++, e++)
+        {
+            e->Kind = ce->Kind;
+            e->FCC = ce->FCC;
+            e->StreamNum = stream[j];
+            e->Num = ce->Num;
+            e->Pos = ce->Pos;
+            e->Pos2 = ce->Pos2;
+            e->Size = ce->Size;
+            e->Flags = ce->Flags;
+            e->KeyFrame = ce->KeyFrame;
+        }
+    }
+
+    free(buf);
+    free(ebuf);
+    File64Close(cf);
+
+    if (ok) ok = CacheHash(sum, data, (int) hdr.DataLen) == check;
+    if (!ok)
+    {
+        AviTreeFree(t);
+        return(NULL);
+    }
+
+    t->Root = node;
+    t->FileSize = hdr.FileSize;
+    t->NodeCount = hdr.NodeCount - 1;
+    t->Result = hdr.Result;
+
+    return(t);
+}
+
+
+// Write len bytes to fp and carry on the hash sum over them.
+
+static QWORD CacheWrite(FILE *fp, void *p, size_t len, QWORD sum)
+{
+    fwrite(p, len, 1, fp);
+
+    return(CacheHash(sum, (BYTE *) p, (int) len));
+}
+
+
+// Write the tree to the cache file cname.  It is written under a name of
+// its own first and then renamed, so that a reader never sees half a
+// file and two writers of the same cache file do not mix their output.
+// Returns 0 on success or -1 on failure.
+
+static int CacheSave(AVITREE *t, char *cname, char *fname, CACHEHDR *hdr)
+{
+    FILE *fp;
+    AVITREENODE *n;
+    CACHENODE *buf, *cn;
+    CACHEENTRY *ebuf, *ce;
+    AVIENTRY *e;
+    static BYTE zero[8];
+    char *tmpname;
+    QWORD dataoff, entryfirst, sum;
+    DWORD i, cnt, ecnt;
+    int ok;
+
+    hdr->Result = t->Result;
+    hdr->NodeCount = t->NodeCount + 1;
+    hdr->PathOff = sizeof(CACHEHDR);
+    hdr->NodeOff = ALIGN8(hdr->PathOff + hdr->PathLen);
+    for (n = t->Root; n; n = AviTreeNext(n))
+    {
+        hdr->EntryCount += n->EntryCount;
+        hdr->DataLen += ALIGN8(AviTreeDataSize(n->Kind, n->Data));
+    }
+    hdr->EntryOff = hdr->NodeOff + (QWORD) hdr->NodeCount * sizeof(CACHENODE);
+    hdr->DataOff = hdr->EntryOff + (QWORD) hdr->EntryCount * sizeof(CACHEENTRY);
+
+    tmpname = File64TempName(cname);
+    buf = (CACHENODE *) malloc(CACHE_BATCH * sizeof(CACHENODE));
+    ebuf = (CACHEENTRY *) malloc(CACHE_BATCH * sizeof(CACHEENTRY));
+    fp = NULL;
+    ok = tmpname && buf && ebuf;
+    if (ok)
+    {
+        fp = fopen(tmpname, "wb");
+        ok = fp != NULL;
+    }
+
+    if (ok)
+    {
+        // the header is written again at the end, with the check filled in
+
+        hdr->Check = 0;
+        sum = CacheWrite(fp, hdr, sizeof(CACHEHDR), CACHE_HASH_INIT);
+        sum = CacheWrite(fp, fname, hdr->PathLen, sum);
+        fwrite(zero, (size_t) (hdr->NodeOff - hdr->PathOff - hdr->PathLen), 1, fp);
+
+        // the nodes, in the order they are numbered
+
+        memset(buf, 0, CACHE_BATCH * sizeof(CACHENODE));
+        dataoff = entryfirst = 0;
+        cnt = 0;
+        for (n = t->Root; n; n = AviTreeNext(n))
+        {
+            cn = buf + cnt;
+            cn->Pos = n->Pos;
+            cn->DataOff = dataoff;
+            cn->EntryFirst = entryfirst;
+            cn->FCC = n->FCC;
+            cn->Type = n->Type;
+            cn->Size = n->Size;
+            cn->StreamNum = n->StreamNum;
+            cn->Kind = n->Kind;
+            cn->Depth = n->Depth;
+            cn->Parent = n->Parent ? n->Parent->Num : 0;
+            cn->Child = n->Child ? n->Child->Num : 0;
+            cn->Next = n->Next ? n->Next->Num : 0;
+            cn->DataLen = AviTreeDataSize(n->Kind, n->Data);
+            cn->EntryCount = n->EntryCount;
+            dataoff += ALIGN8(cn->DataLen);
+            entryfirst += n->EntryCount;
+
+            if (++cnt == CACHE_BATCH)
+            {
+                sum = CacheWrite(fp, buf, cnt * sizeof(CACHENODE), sum);
+                cnt = 0;
+            }
+        }
+        sum = CacheWrite(fp, buf, cnt * sizeof(CACHENODE), sum);
+
+        // the index entries, in the same order
+
+        memset(ebuf, 0, CACHE_BATCH * sizeof(CACHEENTRY));
+        ecnt = 0;
+        for (n = t->Root; n; n = AviTreeNext(n))
+        {
+            for (i = 0, e = n->Entry; i < n->EntryCount; i++, e++)
+            {
+                ce = ebuf + ecnt;
+                ce->Pos = e->Pos;
+                ce->Pos2 = e->Pos2;
+                ce->FCC = e->FCC;
+                ce->Num = e->Num;
+                ce->Size = e->Size;
+                ce->Flags = e->Flags;
+                ce->Kind = (WORD) e->Kind;
+                ce->KeyFrame = (WORD) e->KeyFrame;
+
+                if (++ecnt == CACHE_BATCH)
+                {
+                    sum = CacheWrite(fp, ebuf, ecnt * sizeof(CACHEENTRY), sum);
+                    ecnt = 0;
+                }
+            }
+        }
+        sum = CacheWrite(fp, ebuf, ecnt * sizeof(CACHEENTRY), sum);
+
+        // the decoded headers
+
+        for (n = t->Root; n; n = AviTreeNext(n))
+        {
+            cnt = AviTreeDataSize(n->Kind, n->Data);
+            if (cnt == 0) continue;
+            sum = CacheWrite(fp, n->Data, cnt, sum);
+            sum = CacheWrite(fp, zero, (size_t) (ALIGN8(cnt) - cnt), sum);
+        }
+
+        hdr->Check = sum;
+        ok = fseek(fp, 0, SEEK_SET) == 0 && fwrite(hdr, sizeof(CACHEHDR), 1, fp) == 1 &&
+             !ferror(fp);
+        if (fclose(fp)) ok = FALSE;
+
+        if (ok) ok = File64Replace(tmpname, cname) == 0;
+        if (!ok) remove(tmpname);
+    }
+
+    free(tmpname);
+    free(buf);
+    free(ebuf);
+
+    return(ok ? 0 : -1);
+}
+
+
+// Return the chunk tree of the file fname, open as in, from the cache in
+// dir if it is there and still good.  Otherwise build it from the file
+// and save it in the cache for next time.  The file is read from the
+// start.
+// Returns the tree, or NULL if out of memory.
+
+AVITREE *CacheTree(FILE64 *in, char *fname, char *dir)
+{
+    CACHEHDR key;
+    AVITREE *t;
+    char *cname;
+
+    if (CacheKey(in, fname, &key) || (cname = CacheName(dir, fname)) == NULL)
+    {
+        File64SetAbsPos(in, 0);
+        return(AviTreeBuild(in));
+    }
+
+    t = CacheLoad(cname, fname, &key);
+    if (t == NULL)
+    {
+        File64SetAbsPos(in, 0);
+        t = AviTreeBuild(in);
+        if (t) CacheSave(t, cname, fname, &key);
+    }
+
+    free(cname);
+
+    return(t);
+}
+
@@ -40,131 +40,131 @@ typedef struct
 static CODEC_DESC CodecTbl[] =
 {
     { 0,      "NONE Specified" },
-    { 'ANIM', "Intel RDX" },
-    { 'AUR2', "AuraVision Aura 2" },
-    { 'AURA', "AuraVision Aura 1" },
-    { 'BT20', "Brooktree MediaStream" },
-    { 'BTCV', "Brooktree Composite Video" },
-    { 'CC12', "Intel YUV12" },
-    { 'CDVC', "Canopus DV" },
-    { 'CHAM', "Winnov Caviara Cham" },
-    { 'CLJR', "Proprietary YUV 4 pixels" },
-    { 'CMYK', "Common Data Format in Printing" },
-    { 'CPLA', "Weitek 4:2:0 YUV Planar" },
-    { 'CVID', "Cinepak by Supermac" },
-    { 'CWLT', "Microsoft Color WLT DIB" },
-    { 'CYUV', "Creative Labs YUV" },
-    { 'D261', "H.261" },
-    { 'D263', "H.263" },
-    { 'DIV3', "Low motion DivX MPEG-4" },
-    { 'DIV4', "Fast motion DivX MPEG-4" },
-    { 'DUCK', "True Motion 1.0" },
-    { 'DVE2', "DVE-2 Videoconferencing" },
-    { 'FLJP', "Field Encoded Motion JPEG" },
-    { 'FVF1', "Fractal Video Frame" },
-    { 'GWLT', "Microsoft Greyscale WLT DIB" },
-    { 'H260', "H.260" },
-    { 'H261', "H.261" },
-    { 'H262', "H.262" },
-    { 'H263', "H.263" },
-    { 'H264', "H.264" },
-    { 'H265', "H.265" },
-    { 'H266', "H.266" },
-    { 'H267', "H.267" },
-    { 'H268', "H.268" },
-    { 'H269', "H.260" },
-    { 'I263', "I263" },
-    { 'I420', "Intel Indeo 4" },
-    { 'IAN ', "Intel RDX" },
-    { 'ICLB', "CellB Videoconferencing Codec" },
-    { 'ILVC', "Intel Layered Video" },
-    { 'ILVR', "ITU-T H.263+" },
-    { 'IRAW', "Intel YUV Uncompressed" },
-    { 'IV30', "Intel Indeo Video 3" },
-    { 'IV31', "Intel Indeo Video 3.1" },
-    { 'IV32', "Intel Indeo Video 3.2" },
-    { 'IV33', "Intel Indeo Video 3.3" },
-    { 'IV34', "Intel Indeo Video 3.4" },
-    { 'IV35', "Intel Indeo Video 3.5" },
-    { 'IV36', "Intel Indeo Video 3.6" },
-    { 'IV37', "Intel Indeo Video 3.7" },
-    { 'IV38', "Intel Indeo Video 3.8" },
-    { 'IV39', "Intel Indeo Video 3.9" },
-    { 'IV40', "Intel Indeo Video 4.0" },
-    { 'IV41', "Intel Indeo Video 4.1" },
-    { 'IV42', "Intel Indeo Video 4.2" },
-    { 'IV43', "Intel Indeo Video 4.3" },
-    { 'IV44', "Intel Indeo Video 4.4" },
-    { 'IV45', "Intel Indeo Video 4.5" },
-    { 'IV46', "Intel Indeo Video 4.6" },
-    { 'IV47', "Intel Indeo Video 4.7" },
-    { 'IV48', "Intel Indeo Video 4.8" },
-    { 'IV49', "Intel Indeo Video 4.9" },
-    { 'IV50', "Intel Indeo Video 5.0" },
-    { 'JPEG', "Still Image JPEG DIB" },
-    { 'MJPG', "Motion JPEG DIB" },
-    { 'MP42', "Microsoft MPEG-4 Video Codec" },
-    { 'MPEG', "MPEG 1 Video Frame" },
-    { 'MRCA', "MR Codec" },
-    { 'MRLE', "Run Length Encoding" },
-    { 'MSVC', "Video 1" },
-    { 'PHMO', "Photomotion" },
-    { 'QPEQ', "QPEG 1.1 Format Video" },
-    { 'RGBT', "RGBT" },
-    { 'RLE4', "Run Length Encoded 4" },
-    { 'RLE8', "Run Length Encoded 8" },
-    { 'RT21', "Indeo 2.1" },
-    { 'RVX ', "Intel RDX" },
-    { 'SDCC', "Sun Digital Camera Codec" },
-    { 'SFMC', "Crystal Net SFM Codec" },
-    { 'SMSC', "SMSC" },
-    { 'SMSD', "SMSD" },
-    { 'SPLC', "Splash Studios ACM Audio Codec" },
-    { 'SQZ2', "Microsoft VXtreme Video Codec" },
-    { 'SV10', "Sorenson Video R1" },
-    { 'TLMS', "TeraLogic Motion Infraframe Codec A" },
-    { 'TLST', "TeraLogic Motion Infraframe Codec B" },
-    { 'TM20', "TrueMotion 2.0" },
-    { 'TMIC', "TeraLogic Motion Intraframe Codec 2" },
-    { 'TMOT', "TrueMotion Video Compression" },
-    { 'TR20', "TrueMotion RT 2.0" },
-    { 'ULTI', "Ultimotion" },
-    { 'UYVY', "UYVY 4:2:2 byte ordering" },
-    { 'V422', "24 bit YUV 4:2:2 Format" },
-    { 'V655', "16 bit YUV 4:2:2 Format" },
-    { 'VCR1', "ATI VCR 1.0" },
-    { 'VCR2', "ATI VCR 2.0" },
-    { 'VCR3', "ATI VCR 3.0" },
-    { 'VCR4', "ATI VCR 4.0" },
-    { 'VCR5', "ATI VCR 5.0" },
-    { 'VCR6', "ATI VCR 6.0" },
-    { 'VCR7', "ATI VCR 7.0" },
-    { 'VCR8', "ATI VCR 8.0" },
-    { 'VCR9', "ATI VCR 9.0" },
-    { 'VDCT', "Video Maker Pro DIB" },
-    { 'VIDS', "YUV 4:2:2 CCIR 601 for V422" },
-    { 'VIVO', "Vivo H.263" },
-    { 'VIXL', "VIXL" },
-    { 'VLV1', "VLCAP.DRV" },
-    { 'WBVC', "W9960" },
-    { 'X263', "X263" },
-    { 'XLV0', "XL Video Decoder" },
-    { 'Y211', "YUV 2:1:1 Packed" },
-    { 'Y411', "YUV 4:1:1 Packed" },
-    { 'Y41B', "YUV 4:1:1 Planar" },
-    { 'Y41P', "PC1 4:1:1" },
-    { 'Y41T', "PC1 4:1:1 with transparency" },
-    { 'Y42B', "YUV 4:2:2 Planar" },
-    { 'Y42T', "PCI 4:2:2 with transparency" },
-    { 'YC12', "Intel YUV12 Codec" },
-    { 'YUV8', "Winnov Caviar YUV8" },
-    { 'YUV9', "YUV9" },
-    { 'YUY2', "YUYV 4:2:2 byte ordering packed" },
-    { 'YUYV', "BI_YUYV, Canopus" },
-    { 'YV12', "YVU12 Planar" },
-    { 'YVU9', "YVU9 Planar" },
-    { 'YVYU', "YVYU 4:2:2 byte ordering" },
-    { 'ZPEG', "Video Zipper" },
+    { MKFCC('A','N','I','M'), "Intel RDX" },
+    { MKFCC('A','U','R','2'), "AuraVision Aura 2" },
+    { MKFCC('A','U','R','A'), "AuraVision Aura 1" },
+    { MKFCC('B','T','2','0'), "Brooktree MediaStream" },
+    { MKFCC('B','T','C','V'), "Brooktree Composite Video" },
+    { MKFCC('C','C','1','2'), "Intel YUV12" },
+    { MKFCC('C','D','V','C'), "Canopus DV" },
+    { MKFCC('C','H','A','M'), "Winnov Caviara Cham" },
+    { MKFCC('C','L','J','R'), "Proprietary YUV 4 pixels" },
+    { MKFCC('C','M','Y','K'), "Common Data Format in Printing" },
+    { MKFCC('C','P','L','A'), "Weitek 4:2:0 YUV Planar" },
+    { MKFCC('C','V','I','D'), "Cinepak by Supermac" },
+    { MKFCC('C','W','L','T'), "Microsoft Color WLT DIB" },
+    { MKFCC('C','Y','U','V'), "Creative Labs YUV" },
+    { MKFCC('D','2','6','1'), "H.261" },
+    { MKFCC('D','2','6','3'), "H.263" },
+    { MKFCC('D','I','V','3'), "Low motion DivX MPEG-4" },
+    { MKFCC('D','I','V','4'), "Fast motion DivX MPEG-4" },
+    { MKFCC('D','U','C','K'), "True Motion 1.0" },
+    { MKFCC('D','V','E','2'), "DVE-2 Videoconferencing" },
+    { MKFCC('F','L','J','P'), "Field Encoded Motion JPEG" },
+    { MKFCC('F','V','F','1'), "Fractal Video Frame" },
+    { MKFCC('G','W','L','T'), "Microsoft Greyscale WLT DIB" },
+    { MKFCC('H','2','6','0'), "H.260" },
+    { MKFCC('H','2','6','1'), "H.261" },
+    { MKFCC('H','2','6','2'), "H.262" },
+    { MKFCC('H','2','6','3'), "H.263" },
+    { MKFCC('H','2','6','4'), "H.264" },
+    { MKFCC('H','2','6','5'), "H.265" },
+    { MKFCC('H','2','6','6'), "H.266" },
+    { MKFCC('H','2','6','7'), "H.267" },
+    { MKFCC('H','2','6','8'), "H.268" },
+    { MKFCC('H','2','6','9'), "H.260" },
+    { MKFCC('I','2','6','3'), "I263" },
+    { MKFCC('I','4','2','0'), "Intel Indeo 4" },
+    { MKFCC('I','A','N',' '), "Intel RDX" },
+    { MKFCC('I','C','L','B'), "CellB Videoconferencing Codec" },
+    { MKFCC('I','L','V','C'), "Intel Layered Video" },
+    { MKFCC('I','L','V','R'), "ITU-T H.263+" },
+    { MKFCC('I','R','A','W'), "Intel YUV Uncompressed" },
+    { MKFCC('I','V','3','0'), "Intel Indeo Video 3" },
+    { MKFCC('I','V','3','1'), "Intel Indeo Video 3.1" },
+    { MKFCC('I','V','3','2'), "Intel Indeo Video 3.2" },
+    { MKFCC('I','V','3','3'), "Intel Indeo Video 3.3" },
+    { MKFCC('I','V','3','4'), "Intel Indeo Video 3.4" },
+    { MKFCC('I','V','3','5'), "Intel Indeo Video 3.5" },
+    { MKFCC('I','V','3','6'), "Intel Indeo Video 3.6" },
+    { MKFCC('I','V','3','7'), "Intel Indeo Video 3.7" },
+    { MKFCC('I','V','3','8'), "Intel Indeo Video 3.8" },
+    { MKFCC('I','V','3','9'), "Intel Indeo Video 3.9" },
+    { MKFCC('I','V','4','0'), "Intel Indeo Video 4.0" },
+    { MKFCC('I','V','4','1'), "Intel Indeo Video 4.1" },
+    { MKFCC('I','V','4','2'), "Intel Indeo Video 4.2" },
+    { MKFCC('I','V','4','3'), "Intel Indeo Video 4.3" },
+    { MKFCC('I','V','4','4'), "Intel Indeo Video 4.4" },
+    { MKFCC('I','V','4','5'), "Intel Indeo Video 4.5" },
+    { MKFCC('I','V','4','6'), "Intel Indeo Video 4.6" },
+    { MKFCC('I','V','4','7'), "Intel Indeo Video 4.7" },
+    { MKFCC('I','V','4','8'), "Intel Indeo Video 4.8" },
+    { MKFCC('I','V','4','9'), "Intel Indeo Video 4.9" },
+    { MKFCC('I','V','5','0'), "Intel Indeo Video 5.0" },
+    { MKFCC('J','P','E','G'), "Still Image JPEG DIB" },
+    { MKFCC('M','J','P','G'), "Motion JPEG DIB" },
+    { MKFCC('M','P','4','2'), "Microsoft MPEG-4 Video Codec" },
+    { MKFCC('M','P','E','G'), "MPEG 1 Video Frame" },
+    { MKFCC('M','R','C','A'), "MR Codec" },
+    { MKFCC('M','R','L','E'), "Run Length Encoding" },
+    { MKFCC('M','S','V','C'), "Video 1" },
+    { MKFCC('P','H','M','O'), "Photomotion" },
+    { MKFCC('Q','P','E','Q'), "QPEG 1.1 Format Video" },
+    { MKFCC('R','G','B','T'), "RGBT" },
+    { MKFCC('R','L','E','4'), "Run Length Encoded 4" },
+    { MKFCC('R','L','E','8'), "Run Length Encoded 8" },
+    { MKFCC('R','T','2','1'), "Indeo 2.1" },
+    { MKFCC('R','V','X',' '), "Intel RDX" },
+    { MKFCC('S','D','C','C'), "Sun Digital Camera Codec" },
+    { MKFCC('S','F','M','C'), "Crystal Net SFM Codec" },
+    { MKFCC('S','M','S','C'), "SMSC" },
+    { MKFCC('S','M','S','D'), "SMSD" },
+    { MKFCC('S','P','L','C'), "Splash Studios ACM Audio Codec" },
+    { MKFCC('S','Q','Z','2'), "Microsoft VXtreme Video Codec" },
+    { MKFCC('S','V','1','0'), "Sorenson Video R1" },
+    { MKFCC('T','L','M','S'), "TeraLogic Motion Infraframe Codec A" },
+    { MKFCC('T','L','S','T'), "TeraLogic Motion Infraframe Codec B" },
+    { MKFCC('T','M','2','0'), "TrueMotion 2.0" },
+    { MKFCC('T','M','I','C'), "TeraLogic Motion Intraframe Codec 2" },
+    { MKFCC('T','M','O','T'), "TrueMotion Video Compression" },
+    { MKFCC('T','R','2','0'), "TrueMotion RT 2.0" },
+    { MKFCC('U','L','T','I'), "Ultimotion" },
+    { MKFCC('U','Y','V','Y'), "UYVY 4:2:2 byte ordering" },
+    { MKFCC('V','4','2','2'), "24 bit YUV 4:2:2 Format" },
+    { MKFCC('V','6','5','5'), "16 bit YUV 4:2:2 Format" },
+    { MKFCC('V','C','R','1'), "ATI VCR 1.0" },
+    { MKFCC('V','C','R','2'), "ATI VCR 2.0" },
+    { MKFCC('V','C','R','3'), "ATI VCR 3.0" },
+    { MKFCC('V','C','R','4'), "ATI VCR 4.0" },
+    { MKFCC('V','C','R','5'), "ATI VCR 5.0" },
+    { MKFCC('V','C','R','6'), "ATI VCR 6.0" },
+    { MKFCC('V','C','R','7'), "ATI VCR 7.0" },
+    { MKFCC('V','C','R','8'), "ATI VCR 8.0" },
+    { MKFCC('V','C','R','9'), "ATI VCR 9.0" },
+    { MKFCC('V','D','C','T'), "Video Maker Pro DIB" },
+    { MKFCC('V','I','D','S'), "YUV 4:2:2 CCIR 601 for V422" },
+    { MKFCC('V','I','V','O'), "Vivo H.263" },
+    { MKFCC('V','I','X','L'), "VIXL" },
+    { MKFCC('V','L','V','1'), "VLCAP.DRV" },
+    { MKFCC('W','B','V','C'), "W9960" },
+    { MKFCC('X','2','6','3'), "X263" },
+    { MKFCC('X','L','V','0'), "XL Video Decoder" },
+    { MKFCC('Y','2','1','1'), "YUV 2:1:1 Packed" },
+    { MKFCC('Y','4','1','1'), "YUV 4:1:1 Packed" },
+    { MKFCC('Y','4','1','B'), "YUV 4:1:1 Planar" },
+    { MKFCC('Y','4','1','P'), "PC1 4:1:1" },
+    { MKFCC('Y','4','1','T'), "PC1 4:1:1 with transparency" },
+    { MKFCC('Y','4','2','B'), "YUV 4:2:2 Planar" },
+    { MKFCC('Y','4','2','T'), "PCI 4:2:2 with transparency" },
+    { MKFCC('Y','C','1','2'), "Intel YUV12 Codec" },
+    { MKFCC('Y','U','V','8'), "Winnov Caviar YUV8" },
+    { MKFCC('Y','U','V','9'), "YUV9" },
+    { MKFCC('Y','U','Y','2'), "YUYV 4:2:2 byte ordering packed" },
+    { MKFCC('Y','U','Y','V'), "BI_YUYV, Canopus" },
+    { MKFCC('Y','V','1','2'), "YVU12 Planar" },
+    { MKFCC('Y','V','U','9'), "YVU9 Planar" },
+    { MKFCC('Y','V','Y','U'), "YVYU 4:2:2 byte ordering" },
+    { MKFCC('Z','P','E','G'), "Video Zipper" },
     { 0,   NULL }
 };
 
@@ -286,29 +286,29 @@ CODEC_DESC AudTbl[] =
 static CODEC_DESC InfoTbl[] =
 {
     { 0,      "None Specified" },
-    { 'IARL', "Archival Location" },
-    { 'IART', "Artist" },
-    { 'ICMS', "Commissioned" },
-    { 'ICMT', "Comment" },
-    { 'ICOP', "Copyright" },
-    { 'ICRD', "Creation date" },
-    { 'ICRP', "Cropped" },
-    { 'IDIM', "Dimensions" },
-    { 'IDPI', "Dots Per Inch" },
-    { 'IENG', "Engineer" },
-    { 'IGNR', "Genre" },
-    { 'IKEY', "Keywords" },
-    { 'ILGT', "Lightness" },
-    { 'IMED', "Storage Medium" },
-    { 'INAM', "Name" },
-    { 'IPLT', "Num Palette Colors" },
-    { 'IPRD', "Product" },
-    { 'ISBJ', "Subject" },
-    { 'ISFT', "Software" },
-    { 'ISHP', "Sharpness" },
-    { 'ISRC', "Source" },
-    { 'ISRF', "Source Form" },
-    { 'ITCH', "Technician" },
+    { MKFCC('I','A','R','L'), "Archival Location" },
+    { MKFCC('I','A','R','T'), "Artist" },
+    { MKFCC('I','C','M','S'), "Commissioned" },
+    { MKFCC('I','C','M','T'), "Comment" },
+    { MKFCC('I','C','O','P'), "Copyright" },
+    { MKFCC('I','C','R','D'), "Creation date" },
+    { MKFCC('I','C','R','P'), "Cropped" },
+    { MKFCC('I','D','I','M'), "Dimensions" },
+    { MKFCC('I','D','P','I'), "Dots Per Inch" },
+    { MKFCC('I','E','N','G'), "Engineer" },
+    { MKFCC('I','G','N','R'), "Genre" },
+    { MKFCC('I','K','E','Y'), "Keywords" },
+    { MKFCC('I','L','G','T'), "Lightness" },
+    { MKFCC('I','M','E','D'), "Storage Medium" },
+    { MKFCC('I','N','A','M'), "Name" },
+    { MKFCC('I','P','L','T'), "Num Palette Colors" },
+    { MKFCC('I','P','R','D'), "Product" },
+    { MKFCC('I','S','B','J'), "Subject" },
+    { MKFCC('I','S','F','T'), "Software" },
+    { MKFCC('I','S','H','P'), "Sharpness" },
+    { MKFCC('I','S','R','C'), "Source" },
+    { MKFCC('I','S','R','F'), "Source Form" },
+    { MKFCC('I','T','C','H'), "Technician" },
     { 0, NULL }
 };
 
@@ -342,7 +342,7 @@ char *LookupFourCC(DWORD inFcc)
     for (i = 0; i < 4; i++)
         str[i] = (char) toupper(str[i]);
 
-    return(LookupFCCsub(FIX_LIT(inFcc), CodecTbl, "Unknown FourCC"));
+    return(LookupFCCsub(inFcc, CodecTbl, "Unknown FourCC"));
 }
 
 // lookup audio handler
@@ -357,7 +357,7 @@ char *LookupFormat(DWORD FmtNum)
 
 char *LookupINFO(DWORD inInfo)
 {
-    return(LookupFCCsub(FIX_LIT(inInfo), InfoTbl, "Unknown INFO element"));
+    return(LookupFCCsub(inInfo, InfoTbl, "Unknown INFO element"));
 }
 
 
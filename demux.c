@@ -0,0 +1,229 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+Stream demuxer.  DemuxReport() writes the data of every chunk of one
+stream, with no chunk headers, to a raw file or to a file per chunk, so
+that the audio of a capture can be handed to an encoder as it is.
+
+The chunks are found the same way the summary finds them, with
+AviIndexRead(), which reads the index and only falls back to the movi
+list when there is none.  Each chunk is copied with File64Copy() as soon
+as its entry is seen, so nothing is kept however long the file is, and
+on Linux the data never leaves the kernel.
+
+In the name of the file written, * is the name of the AVI file without
+its directory or extension, so that many files can be done at once, and
+a run of # is the chunk number with that many digits, which writes a
+file per chunk.
+
+*/
+
+#include "rdavi2.h"
+
+#define DEMUX_BUFFER    0x00100000UL    // for copies the kernel cannot do, 1MB
+#define DEMUX_NAME      1024            // longest file name written
+
+
+typedef struct
+{
+    AVICTX   *ctx;
+    int       Stream;       // stream to write
+    char     *Name;         // file name with * filled in
+    int       HashPos;      // where the run of # starts in Name
+    int       Digits;       // length of the run, 0 for one file
+    FILE64   *out;          // the one file, once it is open
+    BYTE     *Buf;          // DEMUX_BUFFER bytes
+    QWORD     FileSize;
+    DWORD     Chunks;       // chunks of the stream
+    DWORD     Files;        // files written
+    QWORD     Bytes;        // bytes written
+    DWORD     Torn;         // chunks cut off by the end of the file
+    int       WriteError;   // a file could not be written, stop
+} DEMUX;
+
+
+// Open the next file to write, and leave it in dm->out.  Returns 0 on
+// success, or -1 if it could not be created or is the AVI file itself.
+
+static int DemuxOpen(DEMUX *dm)
+{
+    char name[DEMUX_NAME + 16];
+
+    if (dm->Digits == 0)
+    {
+        if (dm->out) return(0);
+        strcpy(name, dm->Name);
+    }
+    else sprintf(name, "%.*s%0*lu%s", dm->HashPos, dm->Name, dm->Digits,
+                 (unsigned long) dm->Chunks, dm->Name + dm->HashPos + dm->Digits);
+
+    // never write over the file being read, by whatever name
+    if (File64SameFile(dm->ctx->in, name))
+    {
+        OutPrintf(dm->ctx->out, "*** %s is the file being read ***\n", name);
+        dm->WriteError = TRUE;
+        return(-1);
+    }
+
+    dm->out = File64Open(name, "wb");
+    if (dm->out == NULL)
+    {
+        OutPrintf(dm->ctx->out, "*** Could not create %s ***\n", name);
+        dm->WriteError = TRUE;
+        return(-1);
+    }
+    dm->Files++;
+
+    return(0);
+}
+
+
+static void DemuxEntry(void *arg, int stream, AVIENTRY *e)
+{
+    DEMUX *dm = (DEMUX *) arg;
+    QWORD pos = e->Pos, len = e->Size;
+    FOURCC fcc;
+    int s;
+
+    if (stream != dm->Stream || dm->WriteError) return;
+
+    // only the data chunks, not palette changes or indexes
+
+    fcc = ParseFCC(&e->FCC, &s);
+    if (fcc != MKFCC('#','#','d','c') && fcc != MKFCC('#','#','d','b') &&
+        fcc != MKFCC('#','#','w','b') && fcc != MKFCC('#','#','t','x')) return;
+
+    if (pos >= dm->FileSize) len = 0;
+    else if (len > dm->FileSize - pos) len = dm->FileSize - pos;
+    if (len < e->Size) dm->Torn++;
+
+    // With a file per chunk, an empty chunk still uses up its number.
+
+    if (len && DemuxOpen(dm) == 0)
+    {
+        if (File64Copy(dm->out, dm->ctx->in, pos, len, dm->Buf, DEMUX_BUFFER) != len)
+            dm->WriteError = TRUE;
+        dm->Bytes += len;
+        if (dm->Digits)
+        {
+            if (fflush(dm->out->fp)) dm->WriteError = TRUE;
+            File64Close(dm->out);
+            dm->out = NULL;
+        }
+    }
+    dm->Chunks++;
+}
+
+
+static void DemuxLine(OUTBUF *out, char *label, QWORD val)
+{
+    OutPrintf(out, "%16s: ", label);
+    OutQDec(out, val);
+    OutChar(out, '\n');
+}
+
+
+// Write the chunks of the stream given in ctx->Query as "stream:file".
+// Returns 0 on success, 1 if the stream has no chunks, or -1 if the file
+// could not be read or written.
+
+int DemuxReport(AVICTX *ctx)
+{
+    DEMUX dm;
+    AVIINDEX *ix;
+    OUTBUF *out = ctx->out;
+    char *p = ctx->Query;
+    int ret;
+
+    memset(&dm, 0, sizeof(DEMUX));
+    dm.ctx = ctx;
+    while (p && *p >= '0' && *p <= '9')
+        dm.Stream = dm.Stream * 10 + (*p++ - '0');
+    if (p == NULL || p == ctx->Query || *p++ != ':' || *p == 0 || dm.Stream >= MAX_STREAMS)
+    {
+        OutPrintf(out, "*** Demux must be given as <stream>:<file> ***\n");
+        return(-1);
+    }
+
+    ix = (AVIINDEX *) malloc(sizeof(AVIINDEX));
+    dm.Buf = (BYTE *) malloc(DEMUX_BUFFER);
+    dm.Name = MakeFileName(p, ctx->Name, DEMUX_NAME);
+    if (ix == NULL || dm.Buf == NULL || dm.Name == NULL)
+    {
+        OutPrintf(out, "*** Out of memory, or the file name is too long ***\n");
+        free(ix);
+        free(dm.Buf);
+        free(dm.Name);
+        return(-1);
+    }
+    p = strchr(dm.Name, '#');
+    if (p)
+    {
+        dm.HashPos = (int)(p - dm.Name);
+        while (p[dm.Digits] == '#') dm.Digits++;
+    }
+
+    OutPrintf(out, "Stream demux\n");
+
+    dm.FileSize = File64Size(ctx->in);
+    ix->arg = &dm;
+    ix->Entry = DemuxEntry;
+    ix->Error = NULL;
+    ix->Sources = 0;
+    ret = AviIndexRead(ctx->in, ix);
+
+    OutPrintf(out, "%16s: %02X", "Stream", dm.Stream);
+    if (dm.Stream < ix->StreamCount)
+        OutPrintf(out, " (%.4s)", (char *) &ix->Strh[dm.Stream].fccType);
+    OutChar(out, '\n');
+
+    if (ret == -2)
+        OutPrintf(out, "*** Out of memory ***\n");
+    else if (dm.Chunks == 0)
+    {
+        OutPrintf(out, "*** There are no chunks of this stream ***\n");
+        ret = 1;
+    }
+    else
+    {
+        OutPrintf(out, "%16s: %s\n", "Chunks From", ix->Source == INDEX_ODML ? "Open-DML" :
+                  ix->Source == INDEX_IDX1 ? "idx1" : "movi list");
+        DemuxLine(out, "Chunks", dm.Chunks);
+        if (dm.Torn) DemuxLine(out, "Chunks Torn", dm.Torn);
+        DemuxLine(out, "Bytes Written", dm.Bytes);
+        if (dm.Digits) DemuxLine(out, "Files Written", dm.Files);
+        else if (!dm.WriteError) OutPrintf(out, "%16s: %s\n", "Written To", dm.Name);
+        ret = 0;
+    }
+
+    if (dm.out && fflush(dm.out->fp)) dm.WriteError = TRUE;
+    if (dm.WriteError)
+    {
+        OutPrintf(out, "*** The data could not all be written ***\n");
+        ret = -1;
+    }
+
+    if (dm.out) File64Close(dm.out);
+    free(ix);
+    free(dm.Buf);
+    free(dm.Name);
+
+    return(ret);
+}
@@ -20,18 +20,61 @@ used by others.
 
 This is a library extension to enable reading and writing AVI files
 larger than 4GB.  Because Borland C does not handle 64 bit files directly,
-we are forced to call the Windows API for this.
+we are forced to call the Windows API for this.  On Linux and other Unix
+systems, 64 bit positional reads (pread) are used instead, so there is no
+shared file cursor to move around.
+
+Whenever possible, the file is also memory mapped so that the parser can
+look at headers and index entries in place by calling File64View() rather
+than copying them out a few bytes at a time with File64Read().  Files that
+cannot be mapped, such as pipes, fall back to the original fread() or
+ReadFile() calls.
+
+File64Copy() moves chunk data from one file to another.  On Linux it is
+done inside the kernel with copy_file_range() or sendfile(), so the bytes
+never come into the program at all.  Elsewhere it writes straight out of
+the mapping, which at least saves reading them into a buffer first.
 
 */
 
+
 // Define NO_HUGE_FILES in rdavi2.h to only use 32bit file addressing.
 
+#if defined(__linux__)
+  #define _GNU_SOURCE       // copy_file_range()
+#endif
+
 #include "rdavi2.h"
 
+#if !defined(__WIN32__)
+  #include <sys/mman.h>
+  #include <unistd.h>
+  #include <errno.h>
+  #include <signal.h>
+  #if !defined(MAP_ANONYMOUS)
+    #define MAP_ANONYMOUS  MAP_ANON
+  #endif
+#endif
 
-// SeekBase is an unsigned 64 value that gets added to the offset to form
-// the absolute seek location.  The SeekBase is the location of the first
-// byte of the RIFF chunk.
+#if defined(__linux__) && !defined(NO_HUGE_FILES)
+  #include <sys/sendfile.h>
+  #define KERNEL_COPY       // copy between files without a buffer
+  #define COPY_MAX     0x40000000   // bytes a system call is asked to copy
+#endif
+
+// Pick the backend used when the file is not memory mapped.
+#if defined(NO_HUGE_FILES)
+  #define STDIO_FILES       // plain fread/fseek, 32 bit only
+#elif defined(__WIN32__)
+  #define WIN32_FILES       // Windows API with 64 bit file pointers
+#else
+  #define PREAD_FILES       // 64 bit positional reads
+#endif
+
+
+// Each FILE64 has a SeekBase.  It is an unsigned 64 value that gets added
+// to the offset to form the absolute seek location.  The SeekBase is the
+// location of the first byte of the RIFF chunk.
 // For AVI 1.0 files, this is always zero.  Any File64SetPos(DWORD) will
 // get added to SeekBase to seek to the address.  Calls to GetPos() will
 // return a DWORD value from the current SeekBase.  It is important to
@@ -39,81 +82,729 @@ we are forced to call the Windows API for this.
 // File64SetBase() and File64GetBase() to set/get the SeekBase value.
 // It is not set automatically.
 
-static QWORD SeekBase = 0;   // base of file pos, gets added to seeks.
 
+// The mapping is done through a window that slides along the file.  On
+// 64 bit systems the window is simply the entire file.  On 32 bit systems
+// there is not enough address space for that, so a window of MAP_WINDOW
+// bytes is mapped and moved whenever a view falls outside of it.  Window
+// starts must be a multiple of MAP_ALIGN, which covers both the Windows
+// allocation granularity and the page size of any sane Unix.
 
+#define MAP_WINDOW   0x04000000     // 64MB
+#define MAP_ALIGN    0x00010000     // 64K
 
-// Set the SeekBase to the current file location + delta
-// File postions will be based off this location until changed.
-// Delta can be negative.
 
+// A mapped file that is cut shorter by someone else while we read it
+// raises SIGBUS when a page past the new end is touched.  Windows does not
+// allow a mapped file to be cut, but Unix does, so the fault is caught
+// here.  Every map window is listed in MapRange[], and only a fault in
+// one of them is ours: the page is replaced by one of zeros so the read
+// can finish, and MapFaults is counted up.  The next File64 call on the
+// file then sees that it changed, takes the new size and drops the
+// mapping, so from there on the missing bytes are read errors like for
+// any other short file.  Any other SIGBUS goes to the handler that was
+// there before us, as the program using the library may have its own.
+// A window that does not fit in MapRange[] is not mapped at all.
 
-void File64SetBase(FILE *fp, int delta)
+#if defined(__WIN32__)
+  #define MapChanged(fp)   FALSE
+#else
+
+#define MAP_RANGES   256        // map windows that can be open at once
+
+typedef struct
 {
-#if defined(NO_HUGE_FILES)
-    SeekBase = (DWORD)(ftell(fp) & 0xFFFFFFFF) + delta;
-#elif defined(__TINYC__)
-    SeekBase = ftell(fp) + delta;
+    BYTE   *volatile Base;      // NULL if the slot is free
+    size_t  Len;
+} MAPRANGE;
+
+static MAPRANGE MapRange[MAP_RANGES];
+static pthread_mutex_t MapLock = PTHREAD_MUTEX_INITIALIZER;
+static struct sigaction MapOld; // SIGBUS action from before ours
+static int MapHandler;          // 1 once installed, -1 if that failed
+static volatile sig_atomic_t MapFaults;
+
+
+static void MapFault(int sig, siginfo_t *si, void *context)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    BYTE *addr = (BYTE *) si->si_addr, *base;
+    int i;
+
+    for (i = 0; si->si_code == BUS_ADRERR && i < MAP_RANGES; i++)
+    {
+        base = MapRange[i].Base;
+        if (base == NULL || addr < base || addr >= base + MapRange[i].Len)
+            continue;
+        if (mmap((void *)((size_t) addr & ~(page - 1)), page, PROT_READ,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+            break;
+        MapFaults++;
+        return;
+    }
+
+    // not ours, so do what would have been done without us
+    if (MapOld.sa_flags & SA_SIGINFO)
+        MapOld.sa_sigaction(sig, si, context);
+    else if (MapOld.sa_handler != SIG_DFL && MapOld.sa_handler != SIG_IGN)
+        MapOld.sa_handler(sig);
+    else
+        sigaction(sig, &MapOld, NULL);  // fault again, and die this time
+}
+
+
+// Install the handler the first time a file is mapped.  Returns TRUE if
+// it is in place.
+
+static int MapCatchFaults(void)
+{
+    struct sigaction sa;
+
+    pthread_mutex_lock(&MapLock);
+    if (MapHandler == 0)
+    {
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = MapFault;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        MapHandler = (sigaction(SIGBUS, &sa, &MapOld) == 0) ? 1 : -1;
+    }
+    pthread_mutex_unlock(&MapLock);
+
+    return(MapHandler > 0);
+}
+
+
+// Add a map window to MapRange[].  Returns FALSE if there is no room.
+
+static int MapRegister(BYTE *base, size_t len)
+{
+    int i;
+
+    pthread_mutex_lock(&MapLock);
+    for (i = 0; i < MAP_RANGES && MapRange[i].Base != NULL; i++) ;
+    if (i < MAP_RANGES)
+    {
+        MapRange[i].Len = len;
+        MapRange[i].Base = base;
+    }
+    pthread_mutex_unlock(&MapLock);
+
+    return(i < MAP_RANGES);
+}
+
+
+static void MapUnregister(BYTE *base)
+{
+    int i;
+
+    pthread_mutex_lock(&MapLock);
+    for (i = 0; i < MAP_RANGES; i++)
+        if (MapRange[i].Base == base) MapRange[i].Base = NULL;
+    pthread_mutex_unlock(&MapLock);
+}
+
+
+// Check whether a fault was caught since the last look, and if so whether
+// this file got shorter.  A file that did loses its mapping and its new
+// size is used.  Returns TRUE if that happened.
+
+static int MapChanged(FILE64 *fp)
+{
+    struct stat st;
+
+    if (fp->Faults == MapFaults) return(FALSE);
+    fp->Faults = MapFaults;
+
+    if (fstat(fileno(fp->fp), &st) != 0) return(FALSE);
+    if ((QWORD) st.st_size >= fp->FileSize) return(FALSE);
+
+    fp->FileSize = (QWORD) st.st_size;
+    File64Unmap(fp);
+    return(TRUE);
+}
+
+#endif
+
+
+
+// Release the current map window, if any.
+
+static void UnmapWindow(FILE64 *fp)
+{
+    if (fp->MapBase == NULL) return;
+
+#if defined(__WIN32__)
+    UnmapViewOfFile(fp->MapBase);
+#else
+    MapUnregister(fp->MapBase);
+    munmap(fp->MapBase, fp->MapLen);
+#endif
+
+    fp->MapBase = NULL;
+    fp->MapLen = 0;
+}
+
+
+// Move the stream's file pointer to the absolute location pos.
+
+static void StreamSeek(FILE64 *fp, QWORD pos)
+{
+#if defined(STDIO_FILES)
+    fseek(fp->fp, (long int) pos, SEEK_SET);
+#elif defined(WIN32_FILES)
+    HANDLE hFile = (HANDLE)_get_osfhandle(fileno(fp->fp));
+    LONG OfsHigh = (LONG)(pos >> 32);
+
+    SetFilePointer(hFile, (LONG)(pos & 0xFFFFFFFF), &OfsHigh, FILE_BEGIN);
 #else
-    HANDLE hFile = (HANDLE)_get_osfhandle(fileno(fp));
+    fseeko(fp->fp, (off_t) pos, SEEK_SET);
+#endif
+}
+
+
+// Return the absolute location of the stream's file pointer.
+
+static QWORD StreamTell(FILE64 *fp)
+{
+#if defined(STDIO_FILES)
+    return((DWORD)(ftell(fp->fp) & 0xFFFFFFFF));
+#elif defined(WIN32_FILES)
+    HANDLE hFile = (HANDLE)_get_osfhandle(fileno(fp->fp));
     DWORD offset;
     LONG OfsHigh = 0;
 
     // Get current file location as a two part pointer
     offset = SetFilePointer(hFile, 0, (LONG *) &OfsHigh, FILE_CURRENT);
 
-    SeekBase = ((QWORD) OfsHigh << 32) | (offset + delta);
+    return(((QWORD) OfsHigh << 32) | offset);
+#else
+    return((QWORD) ftello(fp->fp));
+#endif
+}
+
+
+// Make sure that len bytes starting at the absolute file location pos are
+// inside the map window, moving the window if needed.
+// Returns TRUE if they are, or FALSE if the bytes go past the end of the
+// file or the window could not be mapped.  In the latter case, or if the
+// file was cut shorter since the last call, the mapping is abandoned and
+// the file reverts to normal reads.
+
+static int MapWindow(FILE64 *fp, QWORD pos, DWORD len)
+{
+    QWORD start;
+    size_t winlen;
+
+    if (MapChanged(fp)) return(FALSE);
+    if (pos + len > fp->FileSize) return(FALSE);   // past EOF
+
+    if (fp->MapBase && pos >= fp->MapStart &&
+        pos + len <= fp->MapStart + fp->MapLen)
+            return(TRUE);    // already in the window
+
+    UnmapWindow(fp);
 
+    start = pos & ~((QWORD) MAP_ALIGN - 1);
+    winlen = fp->WinSize;
+    if (winlen < (pos - start) + len) winlen = (size_t)(pos - start) + len;
+    if (start + winlen > fp->FileSize) winlen = (size_t)(fp->FileSize - start);
+
+#if defined(__WIN32__)
+    fp->MapBase = (BYTE *) MapViewOfFile(fp->hMap, FILE_MAP_READ,
+                   (DWORD)(start >> 32), (DWORD)(start & 0xFFFFFFFF), winlen);
+#else
+    fp->MapBase = (BYTE *) mmap(NULL, winlen, PROT_READ, MAP_SHARED,
+                                fileno(fp->fp), (off_t) start);
+    if (fp->MapBase == (BYTE *) MAP_FAILED) fp->MapBase = NULL;
+    else if (!MapRegister(fp->MapBase, winlen))
+    {
+        munmap(fp->MapBase, winlen);
+        fp->MapBase = NULL;
+    }
+#endif
+
+    if (fp->MapBase == NULL)
+    {
+        // give up and use the normal reads
+#if defined(PREAD_FILES)
+        fp->Method = FILE64_PREAD;
+#else
+        fp->Method = FILE64_STREAM;
+        StreamSeek(fp, fp->Pos);
+#endif
+        return(FALSE);
+    }
+
+    fp->MapStart = start;
+    fp->MapLen = winlen;
+    fp->MapGen++;          // any old views are now invalid
+
+    return(TRUE);
+}
+
+
+// Decide how the file is going to be read.  Regular files are memory
+// mapped, although nothing is actually mapped until the first view is
+// requested.  On Unix, anything else that can seek, such as a block
+// device, uses positional reads.  Whatever is left, like a pipe, goes
+// through the stream.
+
+static void SelectMethod(FILE64 *fp)
+{
+#if defined(__WIN32__)
+    HANDLE hFile = (HANDLE)_get_osfhandle(fileno(fp->fp));
+    DWORD SizeLow, SizeHigh = 0;
+
+    fp->Method = FILE64_STREAM;
+
+    if (GetFileType(hFile) != FILE_TYPE_DISK) return;
+    SizeLow = GetFileSize(hFile, &SizeHigh);
+    if (SizeLow == 0xFFFFFFFF && GetLastError() != NO_ERROR) return;
+    fp->FileSize = ((QWORD) SizeHigh << 32) | SizeLow;
+    if (fp->FileSize == 0) return;     // cannot map an empty file
+
+    fp->hMap = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (fp->hMap == NULL) return;
+#else
+    struct stat st;
+
+    fp->Method = FILE64_STREAM;
+    if (fstat(fileno(fp->fp), &st) != 0) return;
+
+    fp->FileSize = (QWORD) st.st_size;
+
+  #if defined(PREAD_FILES)
+    if (!S_ISREG(st.st_mode))    // maybe a device that can seek
+    {
+        off_t end = lseek(fileno(fp->fp), 0, SEEK_END);
+
+        if (end == (off_t) -1) return;
+        fp->FileSize = (QWORD) end;
+        lseek(fileno(fp->fp), 0, SEEK_SET);
+    }
+    fp->Method = FILE64_PREAD;
+  #endif
+
+    if (!S_ISREG(st.st_mode)) return;
+    if (fp->FileSize == 0) return;     // cannot map an empty file
+#endif
+
+    // Map the whole file at once if the address space allows it.
+    if (sizeof(void *) >= 8) fp->WinSize = (size_t) fp->FileSize;
+    else fp->WinSize = MAP_WINDOW;
+
+#if !defined(__WIN32__)
+    if (!MapCatchFaults()) return;      // mapping is not safe then
+    fp->Faults = MapFaults;
+#endif
+    fp->Method = FILE64_MAPPED;
+}
+
+
+// Return the absolute file position, ignoring SeekBase.
+
+QWORD File64GetAbsPos(FILE64 *fp)
+{
+    if (fp->Method == FILE64_STREAM) return(StreamTell(fp));
+
+    return(fp->Pos);
+}
+
+
+// Set the absolute file position, ignoring SeekBase.
+
+void File64SetAbsPos(FILE64 *fp, QWORD pos)
+{
+    if (fp->Method == FILE64_STREAM) StreamSeek(fp, pos);
+    else fp->Pos = pos;
+}
+
+
+// Set the SeekBase to the current file location + delta
+// File postions will be based off this location until changed.
+// Delta can be negative.
+
+
+void File64SetBase(FILE64 *fp, int delta)
+{
+#if defined(NO_HUGE_FILES)
+    fp->SeekBase = (DWORD)((File64GetAbsPos(fp) + delta) & 0xFFFFFFFF);
+#else
+    fp->SeekBase = File64GetAbsPos(fp) + delta;
 #endif
 }
 
 
 // Return the current base location
 
-QWORD File64GetBase(void)
+QWORD File64GetBase(FILE64 *fp)
 {
-    return(SeekBase);
+    return(fp->SeekBase);
 }
 
 
-// Open a file using fopen() parameters and return a FILE pointer.
+// Open a file using fopen() parameters and return a FILE64 pointer,
+// or NULL if the file could not be opened.
+// Files opened for reading only are memory mapped if possible.
 
-FILE *File64Open(char *fname, char *mode)
+FILE64 *File64Open(char *fname, char *mode)
 {
-    FILE *fp = fopen(fname, mode);
+    FILE64 *fp;
+
+    fp = (FILE64 *) calloc(1, sizeof(FILE64));
+    if (fp == NULL) return(NULL);
 
-    SeekBase = 0;
+    fp->fp = fopen(fname, mode);
+    if (fp->fp == NULL)
+    {
+        free(fp);
+        return(NULL);
+    }
+
+    if (strchr(mode, 'w') == NULL && strchr(mode, 'a') == NULL &&
+        strchr(mode, '+') == NULL)
+            SelectMethod(fp);
+
+    fp->SeekBase = 0;
+    fp->Pos = 0;
     return(fp);
 }
 
 
 // Close a file pointer.
 
-void File64Close(FILE *fp)
+void File64Close(FILE64 *fp)
 {
-    fclose(fp);
+    UnmapWindow(fp);
+#if defined(__WIN32__)
+    if (fp->hMap) CloseHandle(fp->hMap);
+#endif
+    fclose(fp->fp);
+    free(fp);
 }
 
 
+// Stop using the memory mapping, so that the file can be cut shorter
+// through another handle, which Windows does not allow while it is
+// mapped.  Reads carry on with the normal method.
 
+void File64Unmap(FILE64 *fp)
+{
+    if (fp->Method != FILE64_MAPPED) return;
 
-// Read a block of bytes from a file.
+    UnmapWindow(fp);
+#if defined(__WIN32__)
+    if (fp->hMap) CloseHandle(fp->hMap);
+    fp->hMap = NULL;
+#endif
+
+#if defined(PREAD_FILES)
+    fp->Method = FILE64_PREAD;
+#else
+    fp->Method = FILE64_STREAM;
+    StreamSeek(fp, fp->Pos);
+#endif
+    fp->MapGen++;          // any old views are now invalid
+}
+
+
+// Copy bytes out of the mapping.  The read is clipped at the end of file
+// just like fread() would do.  Returns the number of bytes copied, or -1
+// if the window could not be mapped or the file was cut shorter while it
+// was copied, and the caller must fall back to another method.
+
+static int MapRead(FILE64 *fp, QWORD pos, void *buffer, int len)
+{
+    if (pos >= fp->FileSize) return(0);
+    if ((QWORD) len > fp->FileSize - pos)
+        len = (int)(fp->FileSize - pos);
+    if (len <= 0) return(0);
+
+    if (!MapWindow(fp, pos, len)) return(-1);
+
+    memcpy(buffer, fp->MapBase + (size_t)(pos - fp->MapStart), len);
+    if (MapChanged(fp)) return(-1);     // cut short while copying
+
+    return(len);
+}
+
+
+#if defined(PREAD_FILES)
+
+// Read len bytes at the absolute location pos without using or changing
+// any file pointer.  pread() may return less than asked for, even when
+// not at EOF, so keep going until everything is read.
+
+static int PosRead(FILE64 *fp, QWORD pos, void *buffer, int len)
+{
+    int fd = fileno(fp->fp), total = 0;
+    ssize_t cnt;
+
+    while (total < len)
+    {
+        cnt = pread(fd, (BYTE *) buffer + total, len - total,
+                    (off_t)(pos + total));
+        if (cnt < 0 && errno == EINTR) continue;
+        if (cnt <= 0) break;    // EOF or error
+        total += (int) cnt;
+    }
+
+    return(total);
+}
+
+#endif
+
+
+// Read a block of bytes from the stream's current file pointer.
 // Returns the number of bytes actually read.
 
-size_t File64Read(FILE *fp, void *buffer, int len)
+static size_t StreamRead(FILE64 *fp, void *buffer, int len)
 {
-#if defined(NO_HUGE_FILES)
-    return(fread(buffer, 1, (size_t) len, fp));
-#elif defined(__TINYC__)
-    return(fread(buffer, 1, (size_t) len, fp));
-#else
-    HANDLE hFile = (HANDLE)_get_osfhandle(fileno(fp));
+#if defined(WIN32_FILES)
+    HANDLE hFile = (HANDLE)_get_osfhandle(fileno(fp->fp));
     DWORD cnt = 0;
 
     ReadFile(hFile, buffer, len, &cnt, NULL);
 
     return(cnt);
+#else
+    return(fread(buffer, 1, (size_t) len, fp->fp));
+#endif
+}
+
+
+// Read a block of bytes from a file.
+// Returns the number of bytes actually read.
+
+size_t File64Read(FILE64 *fp, void *buffer, int len)
+{
+    int cnt;
+
+    if (fp->Method == FILE64_MAPPED)
+    {
+        cnt = MapRead(fp, fp->Pos, buffer, len);
+        if (cnt >= 0)
+        {
+            fp->Pos += cnt;
+            fp->BytesRead += cnt;
+            return(cnt);
+        }
+    }
+
+#if defined(PREAD_FILES)
+    if (fp->Method == FILE64_PREAD)
+    {
+        cnt = PosRead(fp, fp->Pos, buffer, len);
+        fp->Pos += cnt;
+        fp->BytesRead += cnt;
+        return(cnt);
+    }
+#endif
+
+    cnt = (int) StreamRead(fp, buffer, len);
+    fp->BytesRead += cnt;
+
+    return(cnt);
+}
+
+
+// Read a block of bytes from the absolute file location pos.
+// The file position is not changed, so mapped files and files using
+// positional reads can be read this way from several threads at once.
+// Returns the number of bytes actually read.
+
+size_t File64ReadAt(FILE64 *fp, QWORD pos, void *buffer, int len)
+{
+    QWORD SavePos;
+    int cnt;
+
+    if (fp->Method == FILE64_MAPPED)
+        cnt = MapRead(fp, pos, buffer, len);
+    else cnt = -1;
+
+#if defined(PREAD_FILES)
+    if (cnt < 0 && fp->Method == FILE64_PREAD)
+        cnt = PosRead(fp, pos, buffer, len);
+#endif
+
+    if (cnt < 0)
+    {
+        // must move the stream's file pointer and put it back
+        SavePos = StreamTell(fp);
+        StreamSeek(fp, pos);
+        cnt = (int) StreamRead(fp, buffer, len);
+        StreamSeek(fp, SavePos);
+    }
+    fp->BytesRead += cnt;
+
+    return(cnt);
+}
+
+
+// Write a block of bytes at the file's current position.  Only files
+// opened for writing get here, and they are never mapped.
+// Returns the number of bytes actually written.
+
+size_t File64Write(FILE64 *fp, void *buffer, int len)
+{
+#if defined(WIN32_FILES)
+    HANDLE hFile = (HANDLE)_get_osfhandle(fileno(fp->fp));
+    DWORD cnt = 0;
+
+    WriteFile(hFile, buffer, len, &cnt, NULL);
+
+    return(cnt);
+#else
+    return(fwrite(buffer, 1, (size_t) len, fp->fp));
+#endif
+}
+
+
+// Write a block of bytes at the absolute file location pos, leaving the
+// file position where it was.
+// Returns the number of bytes actually written.
+
+size_t File64WriteAt(FILE64 *fp, QWORD pos, void *buffer, int len)
+{
+    QWORD SavePos;
+    size_t cnt;
+
+    SavePos = StreamTell(fp);
+    StreamSeek(fp, pos);
+    cnt = File64Write(fp, buffer, len);
+    StreamSeek(fp, SavePos);
+
+    return(cnt);
+}
+
+
+// Cut the file off, or extend it, at the absolute location size.  The file
+// position is left at size.  Returns 0 on success.
+
+int File64Truncate(FILE64 *fp, QWORD size)
+{
+#if defined(WIN32_FILES)
+    HANDLE hFile = (HANDLE)_get_osfhandle(fileno(fp->fp));
+
+    StreamSeek(fp, size);
+    return(SetEndOfFile(hFile) ? 0 : -1);
+#else
+    fflush(fp->fp);
+    StreamSeek(fp, size);
+  #if defined(__WIN32__)
+    return(chsize(fileno(fp->fp), (long) size));
+  #else
+    return(ftruncate(fileno(fp->fp), (off_t) size));
+  #endif
+#endif
+}
+
+
+// Copy len bytes from the absolute location pos of in to the current
+// position of out, which must have been opened for writing and only
+// written with File64Write() and File64Copy().  buf holds buflen bytes,
+// for when the kernel cannot do the copy itself.  The position of in is
+// not changed.  Returns the number of bytes copied, which is less than
+// len only if in ends first or out cannot be written.
+
+QWORD File64Copy(FILE64 *out, FILE64 *in, QWORD pos, QWORD len, void *buf, int buflen)
+{
+    QWORD done = 0;
+    BYTE *p;
+    int n;
+#if defined(KERNEL_COPY)
+    loff_t from;
+    off_t offset;
+    ssize_t cnt;
+    size_t want;
+
+    // Both calls write at the file offset of out, which stdio does not
+    // move when its buffer is empty.
+
+    fflush(out->fp);
+    while (done < len)
+    {
+        want = (len - done > COPY_MAX) ? COPY_MAX : (size_t)(len - done);
+        from = (loff_t)(pos + done);
+        cnt = copy_file_range(fileno(in->fp), &from, fileno(out->fp), NULL, want, 0);
+        if (cnt <= 0)
+        {
+            // older kernels, other file systems, or out is a pipe
+
+            offset = (off_t)(pos + done);
+            cnt = sendfile(fileno(out->fp), fileno(in->fp), &offset, want);
+        }
+        if (cnt <= 0) break;
+        done += cnt;
+    }
 #endif
+
+    while (done < len)
+    {
+        n = (len - done > (QWORD) buflen) ? buflen : (int)(len - done);
+        p = (BYTE *) File64ViewAt(in, pos + done, buf, &n);
+        if (n <= 0) break;
+        n = (int) File64Write(out, p, n);
+        if (n <= 0) break;
+        done += n;
+    }
+
+    return(done);
+}
+
+
+// Return a pointer to the next len bytes of the file and advance the file
+// position past them.  If the file is mapped, the pointer is into the
+// mapping and no data is copied.  Otherwise the bytes are read into buffer,
+// which must hold at least len bytes, and buffer is returned.
+// Returns NULL if len bytes could not be read.
+// The pointer is only good until the next File64 call on this file, and
+// the data it points to must not be modified.  If the file is cut shorter
+// while the pointer is used, the missing bytes read as zeros and the next
+// call finds the new end of file.
+
+void *File64View(FILE64 *fp, void *buffer, int len)
+{
+    void *ptr;
+
+    if (fp->Method == FILE64_MAPPED && MapWindow(fp, fp->Pos, len))
+    {
+        ptr = fp->MapBase + (size_t)(fp->Pos - fp->MapStart);
+        fp->Pos += len;
+        fp->BytesRead += len;
+        return(ptr);
+    }
+
+    if ((int) File64Read(fp, buffer, len) != len) return(NULL);
+
+    return(buffer);
+}
+
+
+// Same as File64View() except that the bytes are at the absolute file
+// location pos and the file position is not changed.  On entry, *len is
+// the number of bytes wanted.  On return, it is the number of bytes that
+// the pointer points to, which is less than asked for only at EOF.
+
+void *File64ViewAt(FILE64 *fp, QWORD pos, void *buffer, int *len)
+{
+    if (fp->Method == FILE64_MAPPED)
+    {
+        if (pos >= fp->FileSize) *len = 0;
+        else if ((QWORD) *len > fp->FileSize - pos)
+            *len = (int)(fp->FileSize - pos);
+
+        if (*len > 0 && MapWindow(fp, pos, *len))
+        {
+            fp->BytesRead += *len;
+            return(fp->MapBase + (size_t)(pos - fp->MapStart));
+        }
+    }
+
+    *len = (int) File64ReadAt(fp, pos, buffer, *len);
+
+    return(buffer);
 }
 
 
@@ -123,27 +814,39 @@ size_t File64Read(FILE *fp, void *buffer, int len)
 // else it returns a non-zero value.
 // Note that Offset is based off SeekBase.
 
-int File64SetPos(FILE *fp, LONG offset, int whence)
+int File64SetPos(FILE64 *fp, LONG offset, int whence)
 {
-#if defined(NO_HUGE_FILES) || defined(__TINYC__)
+#if defined(STDIO_FILES)
     QWORD LongOffset = offset;
+#elif defined(WIN32_FILES)
+    LONG ret, SaveHigh, OfsHigh = 0, *pOffHigh = NULL;
+    HANDLE hFile = (HANDLE)_get_osfhandle(fileno(fp->fp));
+    QWORD AbsPos;
+#else
+    off_t LongOffset = offset;
+#endif
+
+    if (fp->Method != FILE64_STREAM)     // just move our own position
+    {
+        if (whence == SEEK_SET) fp->Pos = fp->SeekBase + offset;
+        else if (whence == SEEK_CUR) fp->Pos += offset;
+        else fp->Pos = fp->FileSize + offset;
+        return(0);
+    }
 
+#if defined(STDIO_FILES)
     // if whence is SEEK_SET (FILE_BEGIN) we must apply SeekBase
     if (whence == SEEK_SET)
     {
-        LongOffset += SeekBase;   // Seekbase is 32 bits when NO_HUGE_FILES is defined
+        LongOffset += fp->SeekBase;   // Seekbase is 32 bits when NO_HUGE_FILES is defined
     }
 
-    return(fseek(fp, (long int) LongOffset, whence));
-#else
-    LONG ret, SaveHigh, OfsHigh = 0, *pOffHigh = NULL;
-    HANDLE hFile = (HANDLE)_get_osfhandle(fileno(fp));
-    QWORD AbsPos;
-
+    return(fseek(fp->fp, (long int) LongOffset, whence));
+#elif defined(WIN32_FILES)
     // if whence is SEEK_SET (FILE_BEGIN) we must apply SeekBase
     if (whence == SEEK_SET)
     {
-        AbsPos = SeekBase + offset;
+        AbsPos = fp->SeekBase + offset;
         OfsHigh = (LONG)(AbsPos >> 32);
         offset = (LONG)(AbsPos & 0xFFFFFFFF);
         pOffHigh = &OfsHigh;
@@ -152,6 +855,11 @@ int File64SetPos(FILE *fp, LONG offset, int whence)
     ret = SetFilePointer(hFile, offset, pOffHigh, whence);
 
     return(ret != offset || SaveHigh != OfsHigh);
+#else
+    // if whence is SEEK_SET we must apply SeekBase
+    if (whence == SEEK_SET) LongOffset += (off_t) fp->SeekBase;
+
+    return(fseeko(fp->fp, LongOffset, whence));
 #endif
 }
 
@@ -162,34 +870,133 @@ int File64SetPos(FILE *fp, LONG offset, int whence)
 // SeekBase, then return -1 as an error code.
 // Note that this function will not change SeekBase.
 
-DWORD File64GetPos(FILE *fp)
+DWORD File64GetPos(FILE64 *fp)
 {
-#if defined(NO_HUGE_FILES) || defined(__TINYC__)
-    QWORD Offset = (QWORD) ftell(fp);   // Get 64 bit absolute offset
+    QWORD Pos = File64GetAbsPos(fp);
+#if !defined(NO_HUGE_FILES)
+    QWORD NewOfs;
 
-    return((DWORD)(Offset - SeekBase));
+    if (fp->SeekBase > Pos) return(-1);           // Out of bounds
+    NewOfs = Pos - fp->SeekBase;                  // calc diifference
+    if (NewOfs & 0xFFFFFFFF00000000) return(-1);  // Out of bounds
+    return((DWORD) NewOfs & 0xFFFFFFFF);
 #else
-    HANDLE hFile = (HANDLE)_get_osfhandle(fileno(fp));
-    DWORD Offset, OfsHigh = 0;
-    QWORD AbsPos, NewOfs;
+    return((DWORD)(Pos - fp->SeekBase));
+#endif
+}
 
 
-    // Get current file pos as high:low
-    Offset = SetFilePointer(hFile, 0, (LONG *) &OfsHigh, FILE_CURRENT);
+// Return the size of the file, or zero if it is not known, such as when
+// reading from a pipe.
 
-    AbsPos = ((QWORD) OfsHigh << 32) | Offset;      // Calculate absolute
-    if (SeekBase > AbsPos) return(-1);           // Out of bounds
-    NewOfs = AbsPos - SeekBase;                  // calc diifference
-    if (NewOfs & 0xFFFFFFFF00000000) return(-1);  // Out of bounds
-    return((DWORD) NewOfs & 0xFFFFFFFF);
+QWORD File64Size(FILE64 *fp)
+{
+    return(fp->FileSize);
+}
+
+
+// Return the time the file was last written, in whatever units the
+// system keeps it in, or 0 if it is not known.  It is only good for
+// telling whether the file has changed.
+
+QWORD File64MTime(FILE64 *fp)
+{
+#if defined(__WIN32__)
+    HANDLE hFile = (HANDLE)_get_osfhandle(fileno(fp->fp));
+    FILETIME ft;
+
+    if (!GetFileTime(hFile, NULL, NULL, &ft)) return(0);
+    return(((QWORD) ft.dwHighDateTime << 32) | ft.dwLowDateTime);
+#else
+    struct stat st;
+
+    if (fstat(fileno(fp->fp), &st) != 0) return(0);
+    return((QWORD) st.st_mtime);
 #endif
+}
+
+
+// Tell whether fname is the same file that fp has open, even when it is
+// named through another path or a link.  Used so that nothing is ever
+// written over the file being read.
+// Returns TRUE if it is, or FALSE if it is not or does not exist.
 
+int File64SameFile(FILE64 *fp, char *fname)
+{
+#if defined(__WIN32__)
+    HANDLE hFile = (HANDLE)_get_osfhandle(fileno(fp->fp)), hName;
+    BY_HANDLE_FILE_INFORMATION a, b;
+    int same;
+
+    hName = CreateFile(fname, 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hName == INVALID_HANDLE_VALUE) return(FALSE);
+
+    same = GetFileInformationByHandle(hFile, &a) && GetFileInformationByHandle(hName, &b) &&
+           a.dwVolumeSerialNumber == b.dwVolumeSerialNumber &&
+           a.nFileIndexHigh == b.nFileIndexHigh && a.nFileIndexLow == b.nFileIndexLow;
+    CloseHandle(hName);
+
+    return(same);
+#else
+    struct stat a, b;
+
+    if (fstat(fileno(fp->fp), &a) != 0 || stat(fname, &b) != 0) return(FALSE);
+
+    return(a.st_dev == b.st_dev && a.st_ino == b.st_ino);
+#endif
 }
 
 
+// Return the name that a new version of fname is written to, so that
+// fname is only replaced by File64Replace() once it is complete.  The
+// process id and a count of the names handed out are part of the name,
+// so two writers of the same file, in this process or another, never
+// share one.  The name is malloc()ed, or NULL if out of memory.
+
+#if defined(__WIN32__)
+static LONG TempCount;
+#else
+static unsigned long TempCount;
+static pthread_mutex_t TempLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+char *File64TempName(char *fname)
+{
+    char *tmpname;
+    unsigned long pid, count;
+    int len = strlen(fname) + 26;
+
+#if defined(__WIN32__)
+    pid = (unsigned long) GetCurrentProcessId();
+    count = (unsigned long) InterlockedIncrement(&TempCount);
+#else
+    pid = (unsigned long) getpid();
+    pthread_mutex_lock(&TempLock);
+    count = ++TempCount;
+    pthread_mutex_unlock(&TempLock);
+#endif
 
+    tmpname = (char *) malloc(len);
+    if (tmpname == NULL) return(NULL);
+    snprintf(tmpname, len, "%s.%lx-%lx.tmp", fname, pid & 0xFFFFFFFFUL,
+             count & 0xFFFFFFFFUL);
 
+    return(tmpname);
+}
 
 
+// Put the finished file tmpname in the place of fname.  On Unix rename()
+// does that in one step, so fname is never missing.  Windows' rename()
+// will not replace a file, so MoveFileEx() is used, and where that is
+// not there (Windows 9x) fname is removed first.  Returns 0 on success.
 
+int File64Replace(char *tmpname, char *fname)
+{
+#if defined(__WIN32__)
+    if (MoveFileEx(tmpname, fname, MOVEFILE_REPLACE_EXISTING)) return(0);
+    remove(fname);
+#endif
 
+    return(rename(tmpname, fname));
+}
@@ -20,56 +20,272 @@ used by others.
 */
 
 #include "rdavi2.h"
+#include <time.h>
+
+#if defined(__SSSE3__)
+  #include <tmmintrin.h>
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
 
 
 // Convert a quad word to a 16 byte hex string.
+// outstr must hold at least 17 chars and is also the return value.
 
-char *QWORD2HEX(QWORD val)
+char *QWORD2HEX(QWORD val, char *outstr)
 {
-    static char outstr[20];
-
 //    return(_ui64toa(val, outstr, 16));   // bug in borland library - prints as long not i64.
 
-    sprintf(outstr, "%08X%08X", *((DWORD *) &val + 1), *((DWORD *) &val + 0));
+    HexDword((DWORD) (val >> 32), outstr);
+    HexDword((DWORD) val, outstr + 8);
+    outstr[16] = 0;
 
     return(outstr);
 }
 
-LONG read_long(FILE *in)
+// Hex dump formatting.
+// HexRow() formats one 16 byte row of a hex dump.  hex gets 48 chars, each
+// byte as two hex digits and a space, and chr gets the 16 bytes as
+// characters with the unprintable ones changed to '.'.  Neither is null
+// terminated.  Builds for SSE2 and better CPUs do the whole row at once in
+// vector registers, otherwise a byte at a time with a table.
+
+static char HexDigits[] = "0123456789ABCDEF";
+
+void HexRow(BYTE *src, char *hex, char *chr)
 {
-    int c;
+#if defined(__SSE2__)
+    __m128i v, hi, lo, nib, ten, seven, zero, a, b, ok;
 
-    if (!in) return(-1);
-    File64Read(in, &c, sizeof(LONG));
+    v = _mm_loadu_si128((__m128i *) src);
+
+    // split into nibbles and turn each into '0'..'9' or 'A'..'F'
+    nib = _mm_set1_epi8(0x0F);
+    ten = _mm_set1_epi8(9);
+    seven = _mm_set1_epi8(7);
+    zero = _mm_set1_epi8('0');
+    hi = _mm_and_si128(_mm_srli_epi16(v, 4), nib);
+    lo = _mm_and_si128(v, nib);
+    hi = _mm_add_epi8(_mm_add_epi8(hi, zero),
+            _mm_and_si128(_mm_cmpgt_epi8(hi, ten), seven));
+    lo = _mm_add_epi8(_mm_add_epi8(lo, zero),
+            _mm_and_si128(_mm_cmpgt_epi8(lo, ten), seven));
+    a = _mm_unpacklo_epi8(hi, lo);      // digit pairs of bytes 0-7
+    b = _mm_unpackhi_epi8(hi, lo);      // digit pairs of bytes 8-15
+
+  #if defined(__SSSE3__)
+    {
+        // spread the digit pairs out to every third byte, then put spaces
+        // in the gaps.  -128 in a shuffle gives a zero byte.
+        __m128i r0, r1, r2;
+
+        r0 = _mm_shuffle_epi8(a, _mm_setr_epi8(0, 1, -128, 2, 3, -128, 4, 5,
+                                -128, 6, 7, -128, 8, 9, -128, 10));
+        r1 = _mm_or_si128(
+             _mm_shuffle_epi8(a, _mm_setr_epi8(11, -128, 12, 13, -128, 14, 15, -128,
+                                -128, -128, -128, -128, -128, -128, -128, -128)),
+             _mm_shuffle_epi8(b, _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128,
+                                0, 1, -128, 2, 3, -128, 4, 5)));
+        r2 = _mm_shuffle_epi8(b, _mm_setr_epi8(-128, 6, 7, -128, 8, 9, -128, 10,
+                                11, -128, 12, 13, -128, 14, 15, -128));
+        r0 = _mm_or_si128(r0, _mm_setr_epi8(0, 0, ' ', 0, 0, ' ', 0, 0,
+                                ' ', 0, 0, ' ', 0, 0, ' ', 0));
+        r1 = _mm_or_si128(r1, _mm_setr_epi8(0, ' ', 0, 0, ' ', 0, 0, ' ',
+                                0, 0, ' ', 0, 0, ' ', 0, 0));
+        r2 = _mm_or_si128(r2, _mm_setr_epi8(' ', 0, 0, ' ', 0, 0, ' ', 0,
+                                0, ' ', 0, 0, ' ', 0, 0, ' '));
+        _mm_storeu_si128((__m128i *) hex, r0);
+        _mm_storeu_si128((__m128i *) (hex + 16), r1);
+        _mm_storeu_si128((__m128i *) (hex + 32), r2);
+    }
+  #else
+    {
+        char pairs[32];
+        int i;
+
+        _mm_storeu_si128((__m128i *) pairs, a);
+        _mm_storeu_si128((__m128i *) (pairs + 16), b);
+        for (i = 0; i < 16; i++)
+        {
+            hex[i * 3] = pairs[i * 2];
+            hex[i * 3 + 1] = pairs[i * 2 + 1];
+            hex[i * 3 + 2] = ' ';
+        }
+    }
+  #endif
+
+    // printable is 0x20 to 0x7E.  Bytes above 0x7F are negative here.
+    ok = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1F)),
+                       _mm_cmplt_epi8(v, _mm_set1_epi8(0x7F)));
+    v = _mm_or_si128(_mm_and_si128(ok, v), _mm_andnot_si128(ok, _mm_set1_epi8('.')));
+    _mm_storeu_si128((__m128i *) chr, v);
+#else
+    int i;
+    BYTE ch;
+
+    for (i = 0; i < 16; i++)
+    {
+        ch = src[i];
+        hex[i * 3] = HexDigits[ch >> 4];
+        hex[i * 3 + 1] = HexDigits[ch & 15];
+        hex[i * 3 + 2] = ' ';
+        chr[i] = (char) ((ch >= 0x20 && ch < 0x7F) ? ch : '.');
+    }
+#endif
+}
+
+
+// Format one byte of a hex dump the same way HexRow() does, for rows that
+// are not complete.  No space is added after the hex digits.
 
-    return c;
+void HexByte(BYTE ch, char *hex, char *chr)
+{
+    hex[0] = HexDigits[ch >> 4];
+    hex[1] = HexDigits[ch & 15];
+    *chr = (char) ((ch >= 0x20 && ch < 0x7F) ? ch : '.');
 }
 
 
-// This function is only used if the compiler treats multi-character literals
-// as BIG ENDIAN order.
-// It reverses the order of a literal into Little Endian order and is called
-// by FIX_LIT() macro
+// Convert a DWORD to 8 hex digits.  No null is added.
 
+void HexDword(DWORD val, char *out)
+{
+    int i;
 
-#if defined(BE_MC_LIT)
+    for (i = 7; i >= 0; i--, val >>= 4)
+        out[i] = HexDigits[val & 15];
+}
 
-DWORD ReverseLiteral(DWORD val)
+
+LONG read_long(FILE64 *in)
 {
-    BYTE out[4], *in = (BYTE *) &val;
+    LONG c;
+    BYTE *p;
 
-    out[0] = in[3];
-    out[1] = in[2];
-    out[2] = in[1];
-    out[3] = in[0];
+    if (!in) return(-1);
+    p = (BYTE *) File64View(in, &c, sizeof(LONG));
+    if (p == NULL) return(-1);   // EOF
 
-    return(*(DWORD *) out);
+    return((LONG) GET_DWORD(p));
 }
 
-#endif
 
+// Tables for ParseFCC().  FccLead[] sorts the first of the two chars that
+// hold a stream number into a hex digit (0-15), white space or '+' (16),
+// '-' (17) or anything else (18), and FccLow[] sorts the second into a hex
+// digit or not (16).  FccNum[][] then gives the stream number for the pair,
+// which is the same as strtol(pair, NULL, 16) returns.
+// FccSuffix2[] and FccSuffix3[] have a bit for each of dc, db, wb, ix, tx
+// and pc (1, 2, 4, 8, 16 and 32) that the third or fourth char belongs
+// to, so the tag is a '##dc' like one when the two share a bit.  The 64
+// bit is for a fourth char of zero, which goes with any third char that
+// is in "dc,db,wb,ix,tx,pc,".
 
-// Read four chars from the file and convert to a Little Endian integer.
+static BYTE FccLead[256] =
+{
+    18,18,18,18,18,18,18,18,18,16,16,16,16,16,18,18,
+    18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,
+    16,18,18,18,18,18,18,18,18,18,18,16,18,17,18,18,
+     0, 1, 2, 3, 4, 5, 6, 7, 8, 9,18,18,18,18,18,18,
+    18,10,11,12,13,14,15,18,18,18,18,18,18,18,18,18,
+    18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,
+    18,10,11,12,13,14,15,18,18,18,18,18,18,18,18,18,
+    18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,
+    18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,
+    18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,
+    18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,
+    18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,
+    18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,
+    18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,
+    18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,
+    18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,18
+};
+
+static BYTE FccLow[256] =
+{
+    16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,
+    16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,
+    16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,
+     0, 1, 2, 3, 4, 5, 6, 7, 8, 9,16,16,16,16,16,16,
+    16,10,11,12,13,14,15,16,16,16,16,16,16,16,16,16,
+    16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,
+    16,10,11,12,13,14,15,16,16,16,16,16,16,16,16,16,
+    16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,
+    16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,
+    16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,
+    16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,
+    16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,
+    16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,
+    16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,
+    16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,
+    16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16
+};
+
+static short FccNum[19][17] =
+{
+    {   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,   0},
+    {  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,   1},
+    {  32,  33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,   2},
+    {  48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,   3},
+    {  64,  65,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,  77,  78,  79,   4},
+    {  80,  81,  82,  83,  84,  85,  86,  87,  88,  89,  90,  91,  92,  93,  94,  95,   5},
+    {  96,  97,  98,  99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111,   6},
+    { 112, 113, 114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124, 125, 126, 127,   7},
+    { 128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143,   8},
+    { 144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,   9},
+    { 160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,  10},
+    { 176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,  11},
+    { 192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207,  12},
+    { 208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223,  13},
+    { 224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,  14},
+    { 240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255,  15},
+    {   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,   0},
+    {   0,  -1,  -2,  -3,  -4,  -5,  -6,  -7,  -8,  -9, -10, -11, -12, -13, -14, -15,   0},
+    {   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0}
+};
+
+static BYTE FccSuffix2[256] =
+{
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,64, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0,64,64,67, 0, 0, 0, 0,72, 0, 0, 0, 0, 0, 0,
+    96, 0, 0, 0,80, 0, 0,68,64, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static BYTE FccSuffix3[256] =
+{
+    64, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 6,33, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0,24, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+
+// Convert the four chars at p to a Little Endian integer.
 // If StreamNum is not NULL, and the chars are ##db, ##dc, ##wb, ##tx, or ix##,
 // the stream number is returned in StreamNum.  Also, the FCC is converted
 // to a standard form like ##dc instead of the original like 00dc or 01dc.
@@ -78,48 +294,402 @@ DWORD ReverseLiteral(DWORD val)
 // not allowed to contain lower case hex digits (a-f), these must be uppercase
 // hex digits (A-F). If lower case was allowed, then a fourcc like 'dcdb'
 // would cause ambiguity.
+// This is called for every chunk and index entry, so the chars are sorted
+// with the tables above rather than with string functions.
 
-FOURCC ReadFCC(FILE *in, int *StreamNum)
+FOURCC ParseFCC(void *p, int *StreamNum)
 {
-    char Buf[15];
+    union
+    {
+        FOURCC val;
+        BYTE   c[4];
+    } u;
+    BYTE *n;
+    int ix, hit;
+
+    memcpy(&u.val, p, 4);   // val is LE when CPU is LE
+    if (!StreamNum) return(u.val);
+
+    // Note that both '##ix' and 'ix##' can exist.  For 'ix##' the stream
+    // number is in the last two chars, otherwise it is in the first two.
+    ix = (u.c[0] == 'i') & (u.c[1] == 'x');
+    hit = ix | ((FccSuffix2[u.c[2]] & FccSuffix3[u.c[3]]) != 0) | (u.c[2] == 0);
+    n = u.c + (ix << 1);
+
+    *StreamNum = FccNum[FccLead[n[0]]][FccLow[n[1]]] | (hit - 1);   // -1 if not hit
+    if (hit) n[0] = n[1] = '#';     // standardize FourCC
+
+    return(u.val);   // return FOURCC
+}
+
+
+// Do ParseFCC() for count tags, the first at p and each one stride bytes
+// after the one before, such as the ckid of every entry in a block of an
+// idx1 index.  The stream numbers go in StreamNum[] and, unless fcc is
+// NULL, the standard FourCCs go in fcc[].
+
+void ParseFCCs(void *p, int stride, int count, FOURCC *fcc, int *StreamNum)
+{
+    BYTE *b = (BYTE *) p;
     FOURCC val;
-    int  ret;
+    int i;
+
+    for (i = 0; i < count; i++, b += stride)
+    {
+        val = ParseFCC(b, StreamNum + i);
+        if (fcc) fcc[i] = val;
+    }
+}
+
+
+// Read four chars from the file and convert to a Little Endian integer.
+// See ParseFCC() for how StreamNum is handled.
+
+FOURCC ReadFCC(FILE64 *in, int *StreamNum)
+{
+    char Buf[4], *p;
 
-    memset(Buf, 0, sizeof(Buf));
-    if (!in)return(-1);  // no file to read
     if (StreamNum) *StreamNum = -1;
-    ret = File64Read(in, Buf, 4);
-    if (ret != 4) return(-1);    // EOF
+    if (!in)return(-1);  // no file to read
+    p = (char *) File64View(in, Buf, 4);
+    if (p == NULL) return(-1);    // EOF
+
+    return(ParseFCC(p, StreamNum));
+}
+
+
+// The chunk scanner walks the chunk headers of a list, such as 'movi',
+// without reading the file one header at a time.  The list is read in
+// blocks of SCAN_BLOCK bytes that start on a SCAN_ALIGN boundary, and the
+// headers are picked out of the block.  A new block is only read when the
+// next header is outside of the current one, which is to say when the
+// chunk payloads in between add up to more than the block.  When the file
+// is memory mapped, the block is just a view of the mapping.
+
+#define SCAN_BLOCK   0x00100000    // 1MB
+#define SCAN_ALIGN   0x00001000    // 4K
+
+
+// Get ready to scan the chunks from start up to end, both of which are
+// absolute file locations.
+// Returns 0 on success or -1 if out of memory.
+
+int ChunkScanOpen(CHUNKSCAN *cs, FILE64 *fp, QWORD start, QWORD end)
+{
+    memset(cs, 0, sizeof(CHUNKSCAN));
+    cs->Buf = (BYTE *) malloc(SCAN_BLOCK);
+    if (cs->Buf == NULL) return(-1);
+
+    cs->fp = fp;
+    cs->Next = start;
+    cs->End = end;
+
+    return(0);
+}
+
+
+// Release the scanner's buffer.
+
+void ChunkScanClose(CHUNKSCAN *cs)
+{
+    free(cs->Buf);
+    cs->Buf = NULL;
+    cs->Data = NULL;
+}
+
+
+// Return a pointer to the len bytes at the absolute file location pos,
+// reading a new block if they are not in the current one.
+// Returns NULL if the bytes are past the end of the scan or the file.
+// The pointer is good until the next call to the scanner.
+
+void *ChunkScanPeek(CHUNKSCAN *cs, QWORD pos, int len)
+{
+    QWORD start;
+    int   blen;
+
+    if (cs->Data && cs->MapGen == cs->fp->MapGen && pos >= cs->DataPos &&
+        pos + len <= cs->DataPos + cs->DataLen)
+            return(cs->Data + (size_t)(pos - cs->DataPos));
+
+    if (pos + len > cs->End) return(NULL);    // not part of the scan
+
+    // read the aligned block holding pos
+    start = pos & ~((QWORD) SCAN_ALIGN - 1);
+    blen = SCAN_BLOCK;
+    if (start + blen > cs->End) blen = (int)(cs->End - start);
+
+    cs->Data = (BYTE *) File64ViewAt(cs->fp, start, cs->Buf, &blen);
+    cs->DataPos = start;
+    cs->DataLen = blen;
+    cs->MapGen = cs->fp->MapGen;
+
+    if (pos + len > cs->DataPos + cs->DataLen) return(NULL);   // EOF
+
+    return(cs->Data + (size_t)(pos - cs->DataPos));
+}
+
+
+// Get the next chunk header, as long as it starts before end.
+// The FourCC and stream number are handled like ReadFCC() does.
+// Afterwards, the scanner is set to the chunk that follows, taking the
+// WORD alignment of chunks into account.
+// Returns 1 if a header was found, 0 if end was reached, or -1 on EOF.
+
+int ChunkScanNext(CHUNKSCAN *cs, QWORD end, CHUNKHDR *ck)
+{
+    BYTE *p;
+    DWORD FileSize;
+
+    if (cs->Next >= end) return(0);
+
+    p = (BYTE *) ChunkScanPeek(cs, cs->Next, 8);
+    if (p == NULL) return(-1);
+
+    ck->Pos = cs->Next;
+    ck->FCC = ParseFCC(p, &ck->StreamNum);
+    ck->Size = GET_DWORD(p + 4);
+
+    // There is a poorly documented fact regarding chunks that says they
+    // must be WORD aligned.  So Size refers to the size of the chunk
+    // and not to the number of bytes on the disk.
+    FileSize = ck->Size;
+    if (FileSize & 0x00000001) FileSize++;
+
+    cs->Next = ck->Pos + 8 + FileSize;
+
+    return(1);
+}
+
+
 
-    val = *((FOURCC *)Buf);  // val is LE when CPU is LE
+// Resync after damage.
+// ChunkResync() looks for the next chunk header that makes sense, so
+// that the chunks after a damaged part of a file can still be read.  A
+// header is first picked out by two of its letters, 'dc', 'db', 'wb',
+// 'tx' or 'pc' after the stream number, or 'ix', 'LI', 'RI' or 'id' at
+// the start, and only then looked at in full.  SSE2 and better CPUs test
+// 16 places at once in vector registers.  The file is gone through in
+// blocks of RESYNC_BLOCK bytes, which are views of the mapping when the
+// file is mapped, so garbage goes by about as fast as memory can be read.
 
+#define RESYNC_BLOCK    0x00400000      // 4MB
+#define RESYNC_HDR      12              // bytes of a header looked at
 
-    // Note that both '##ix' and 'ix##' can exist
-    if (StreamNum)   // attempt to get stream number
+
+static int IsHexDigit(BYTE ch)
+{
+    return((ch >= '0' && ch <= '9') || (ch >= 'A' && ch <= 'F'));
+}
+
+
+// Check the header at h, which is at the absolute file location pos and
+// is one of the RESYNC_* kinds.  Chunks must end by limit, but the size
+// of a 'LIST movi' or 'RIFF AVIX' is not looked at, as a capture that
+// was cut short never filled it in.
+
+static int ResyncCheck(BYTE *h, QWORD pos, QWORD limit, int kinds)
+{
+    DWORD size = GET_DWORD(h + 4);
+    int fits = (pos + 8 + size <= limit);
+
+    if (kinds & RESYNC_STREAM)
+    {
+        if (IsHexDigit(h[0]) && IsHexDigit(h[1]) &&
+            ((h[2] == 'd' && (h[3] == 'c' || h[3] == 'b')) ||
+             (h[2] == 'w' && h[3] == 'b') || (h[2] == 't' && h[3] == 'x') ||
+             (h[2] == 'p' && h[3] == 'c')))
+            return(fits);
+        if (h[0] == 'i' && h[1] == 'x' && IsHexDigit(h[2]) && IsHexDigit(h[3]))
+            return(fits && size >= sizeof(INDX_CHUNK));
+    }
+
+    if ((kinds & RESYNC_LIST) && memcmp(h, "LIST", 4) == 0)
     {
-        char *BufLeft = Buf + 5;
-        char *BufRight = Buf + 10;
-
-        // look for ##db, ##dc, ##wb, ##tx, ##ix or ix##
-        memcpy(BufLeft, Buf, 2);
-        memcpy(BufRight, Buf + 2, 2);
-        BufRight[2] = ',';
-        if (strcmp(BufLeft, "ix") == 0)   // special case for 'ix##'
+        if (memcmp(h + 8, "movi", 4) == 0) return(TRUE);
+        if (memcmp(h + 8, "rec ", 4) == 0) return(fits);
+    }
+
+    if ((kinds & RESYNC_RIFF) && memcmp(h, "RIFF", 4) == 0 && memcmp(h + 8, "AVIX", 4) == 0)
+        return(TRUE);
+
+    if ((kinds & RESYNC_IDX1) && memcmp(h, "idx1", 4) == 0)
+        return(fits && (size & 15) == 0);
+
+    return(FALSE);
+}
+
+
+#if defined(__SSE2__)
+
+// Return a bit for each of the 16 places from p that has the letters of
+// a header in the right place.  Reads the 19 bytes from p.
+
+static unsigned ResyncVector(BYTE *p)
+{
+    __m128i a, b, c, d, m;
+
+    a = _mm_loadu_si128((__m128i *) p);
+    b = _mm_loadu_si128((__m128i *) (p + 1));
+    c = _mm_loadu_si128((__m128i *) (p + 2));
+    d = _mm_loadu_si128((__m128i *) (p + 3));
+
+    // '##dc', '##db', '##wb', '##tx' and '##pc'
+    m = _mm_and_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('d')),
+            _mm_or_si128(_mm_cmpeq_epi8(d, _mm_set1_epi8('c')),
+                         _mm_cmpeq_epi8(d, _mm_set1_epi8('b'))));
+    m = _mm_or_si128(m, _mm_and_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('w')),
+                                      _mm_cmpeq_epi8(d, _mm_set1_epi8('b'))));
+    m = _mm_or_si128(m, _mm_and_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('t')),
+                                      _mm_cmpeq_epi8(d, _mm_set1_epi8('x'))));
+    m = _mm_or_si128(m, _mm_and_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('p')),
+                                      _mm_cmpeq_epi8(d, _mm_set1_epi8('c'))));
+
+    // 'ix##', 'idx1', 'LIST' and 'RIFF'
+    m = _mm_or_si128(m, _mm_and_si128(_mm_cmpeq_epi8(a, _mm_set1_epi8('i')),
+            _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('x')),
+                         _mm_cmpeq_epi8(b, _mm_set1_epi8('d')))));
+    m = _mm_or_si128(m, _mm_and_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('I')),
+            _mm_or_si128(_mm_cmpeq_epi8(a, _mm_set1_epi8('L')),
+                         _mm_cmpeq_epi8(a, _mm_set1_epi8('R')))));
+
+    return((unsigned) _mm_movemask_epi8(m));
+}
+
+#endif
+
+
+// Find the first header of one of the RESYNC_* kinds that starts from
+// pos up to end, both absolute file locations.  The chunks found must
+// end by limit, normally the end of the file.
+// Returns the location of the header, or end if there is none.
+
+QWORD ChunkResync(FILE64 *fp, QWORD pos, QWORD end, QWORD limit, int kinds)
+{
+    BYTE *buf, *p;
+    int n, i, last;
+#if defined(__SSE2__)
+    unsigned mask;
+    int k;
+#endif
+
+    buf = (BYTE *) malloc(RESYNC_BLOCK);
+    if (buf == NULL) return(end);
+
+    while (pos < end)
+    {
+        // a header may start at any of the places before end, and they
+        // need RESYNC_HDR bytes each
+        n = RESYNC_BLOCK;
+        if (end - pos + RESYNC_HDR - 1 < (QWORD) n)
+            n = (int)(end - pos + RESYNC_HDR - 1);
+        p = (BYTE *) File64ViewAt(fp, pos, buf, &n);
+        last = n - RESYNC_HDR;
+        if (last < 0) break;
+
+        i = 0;
+#if defined(__SSE2__)
+        for (; i + 19 <= n; i += 16)
         {
-            *StreamNum = strtol(BufRight, NULL, 16);
-            memcpy(Buf + 2, "##", 2);        // standardize FourCC
+            for (mask = ResyncVector(p + i); mask; mask &= mask - 1)
+            {
+                k = i + __builtin_ctz(mask);
+                if (k <= last && ResyncCheck(p + k, pos + k, limit, kinds))
+                {
+                    free(buf);
+                    return(pos + k);
+                }
+            }
         }
-        else if (strstr("dc,db,wb,ix,tx,pc,", BufRight))  // '##dc' etc
+#endif
+        for (; i <= last; i++)
         {
-            *StreamNum = strtol(BufLeft, NULL, 16);
-            memcpy(Buf, "##", 2);        // standardize FourCC
+            if (p[i + 2] != 'd' && p[i + 2] != 'w' && p[i + 2] != 't' && p[i + 2] != 'p' &&
+                p[i] != 'i' && p[i] != 'L' && p[i] != 'R')
+                continue;
+            if (ResyncCheck(p + i, pos + i, limit, kinds))
+            {
+                free(buf);
+                return(pos + i);
+            }
         }
-        val = *((FOURCC *)Buf);
+
+        pos += last + 1;
     }
 
-    return(val);   // return FOURCC
+    free(buf);
 
+    return(end);
 }
 
 
+// Start the clock and the byte count of lim for a parse of in.
+
+void LimitStart(AVILIMITS *lim, FILE64 *in)
+{
+    lim->Chunks = 0;
+    lim->StartBytes = in->BytesRead;
+    lim->StartTime = (DWORD) time(NULL);
+    lim->Hit = NULL;
+}
 
+
+// Count one more chunk header, at depth lists down, against lim.  Once a
+// limit is reached it stays reached, so the parse can unwind and stop.
+// Returns NULL to carry on, or what was reached.
+
+char *LimitCheck(AVILIMITS *lim, FILE64 *in, int depth)
+{
+    if (lim->Hit) return(lim->Hit);
+
+    lim->Chunks++;
+    if (lim->MaxDepth && depth > lim->MaxDepth)
+        lim->Hit = "Lists are nested too deeply";
+    else if (lim->MaxChunks && lim->Chunks > lim->MaxChunks)
+        lim->Hit = "Too many chunks";
+    else if (lim->MaxBytes && in->BytesRead - lim->StartBytes > lim->MaxBytes)
+        lim->Hit = "Too many bytes read";
+    else if (lim->MaxSeconds && (DWORD) time(NULL) - lim->StartTime > lim->MaxSeconds)
+        lim->Hit = "Out of time";       // time() is to the second, so never early
+
+    return(lim->Hit);
+}
+
+// Make a file name to write from pattern, with each * changed to the
+// name of the AVI file avi, without its directory or extension, so that
+// a batch of files each get their own.  size is the most chars the name
+// may use.  Returns the name in memory from malloc(), or NULL if out of
+// memory or the name would be too long.
+
+char *MakeFileName(char *pattern, char *avi, int size)
+{
+    char *base, *ext, *name, *p;
+    int len;
+
+    base = avi ? avi : "stdin";
+    for (p = base; *p; p++)
+        if (*p == '/' || *p == '\\' || *p == ':') base = p + 1;
+    ext = strrchr(base, '.');
+    len = ext ? (int)(ext - base) : (int) strlen(base);
+
+    name = (char *) malloc(size);
+    if (name == NULL) return(NULL);
+
+    for (p = name; *pattern; pattern++)
+    {
+        if (p - name + len + 1 >= size)
+        {
+            free(name);
+            return(NULL);
+        }
+        if (*pattern != '*') *p++ = *pattern;
+        else
+        {
+            memcpy(p, base, len);
+            p += len;
+        }
+    }
+    *p = 0;
+
+    return(name);
+}
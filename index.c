@@ -0,0 +1,339 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+Index reader.  Everything a summary of a file needs, such as how many
+chunks each stream has and how big they are, is already in its index.
+AviIndexRead() reads the headers, then gets the entries from the index
+without going anywhere near the chunks of the movi list, which can be
+spread over the whole of a very big file.
+
+When there is an Open-DML super index, each 'ix##' chunk that it points
+to is read straight from its file location.  Otherwise the 'idx1' chunk
+after the movi list is used.  Only when the file has neither is the movi
+list read chunk by chunk instead.  avih can claim an index that is not
+there, as when the file was cut short, and then the movi list is read
+after all.
+
+Every entry points at the data of its chunk, as the 'ix##' entries do.
+'idx1' offsets are meant to be from the 'movi' tag and to point at the
+chunk header, but some writers make them from the start of the file.
+Where the first entry points tells which, and the offsets are turned
+into file locations here, so nothing else has to care.
+
+Entries are handed over one at a time and nothing is kept, so any
+number of them can be read in a fixed amount of memory.
+
+A caller that wants to compare the indexes with each other, or with the
+movi list, can instead ask for any mix of them with Sources, and gets
+the entries of each one that the file has.
+
+*/
+
+#include "rdavi2.h"
+
+#define IX_BATCH        4096    // ix## entries read at once
+
+
+typedef struct
+{
+    FILE64   *in;
+    AVIINDEX *ix;
+    int       HaveSuper;        // an 'indx' was seen
+    int       InMovi;           // depth of the movi list being read, or 0
+    int       Idx1Checked;      // the first idx1 entry has been looked at
+    BYTE     *Buf;              // IX_BATCH entries of an ix## chunk
+} INDEXREAD;
+
+
+static void IndexError(INDEXREAD *ir, char *msg)
+{
+    if (ir->ix->Error) ir->ix->Error(ir->ix->arg, msg);
+}
+
+
+// Read the standard index chunk at pos, which the super index entry se
+// points to, and hand over its entries.
+
+static void IndexReadStd(INDEXREAD *ir, AVIENTRY *se)
+{
+    AVIENTRY e;
+    FIELDINDEXENTRY *fe;
+    BYTE hdr[8 + sizeof(INDX_CHUNK)];
+    INDX_CHUNK *idx = (INDX_CHUNK *) (hdr + 8);
+    DWORD size, irb, count, i, j, cnt;
+    QWORD pos;
+    int stream;
+
+    if (File64ReadAt(ir->in, se->Pos, hdr, sizeof(hdr)) != sizeof(hdr))
+    {
+        IndexError(ir, "Super index points past the end of the file");
+        return;
+    }
+
+    ParseFCC(hdr, &stream);
+    size = ((DWORD *) hdr)[1];
+    irb = idx->wLongsPerEntry * 4;
+    if (stream < 0 || idx->bIndexType != AVI_INDEX_OF_CHUNKS ||
+        irb < sizeof(STDINDEXENTRY) || irb > sizeof(FIELDINDEXENTRY) ||
+        size < sizeof(INDX_CHUNK))
+    {
+        IndexError(ir, "Super index does not point to a standard index");
+        return;
+    }
+
+    count = (size - sizeof(INDX_CHUNK)) / irb;
+    if (count > idx->nEntriesInUse) count = idx->nEntriesInUse;
+    ir->ix->IndexBytes += sizeof(hdr) + count * irb;
+
+    memset(&e, 0, sizeof(AVIENTRY));
+    e.Kind = (idx->bIndexSubType == AVI_INDEX_2FIELD) ? ENTRY_FIELD : ENTRY_STD;
+    e.FCC = idx->dwChunkId;
+    e.StreamNum = stream;
+
+    pos = se->Pos + sizeof(hdr);
+    for (i = 0; i < count; i += cnt, pos += cnt * irb)
+    {
+        cnt = count - i;
+        if (cnt > IX_BATCH) cnt = IX_BATCH;
+        if (File64ReadAt(ir->in, pos, ir->Buf, cnt * irb) != cnt * irb)
+        {
+            IndexError(ir, "Unexpected end of file");
+            return;
+        }
+
+        for (j = 0; j < cnt; j++)
+        {
+            fe = (FIELDINDEXENTRY *) (ir->Buf + j * irb);
+            e.Num = i + j;
+            e.Pos = idx->qwBaseOffset + fe->dwOffset;
+            e.Pos2 = (e.Kind == ENTRY_FIELD) ? idx->qwBaseOffset + fe->dwOffsetField2 : 0;
+            e.Size = fe->dwSize & 0x7FFFFFFF;
+            e.KeyFrame = !(fe->dwSize & 0x80000000);
+            ir->ix->EntryCount++;
+            ir->ix->Entry(ir->ix->arg, stream, &e);
+        }
+    }
+}
+
+
+// Sink functions for the chunk walker
+
+static int IndexOpen(void *arg, AVINODE *node)
+{
+    INDEXREAD *ir = (INDEXREAD *) arg;
+    AVIINDEX *ix = ir->ix;
+    AVIENTRY e;
+
+    switch (node->Kind)
+    {
+        case NODE_AVIH:
+            ix->Avih = *(MainAVIHeader *) node->Data;
+            ix->HasAvih = TRUE;
+            break;
+
+        case NODE_STRH:
+            if (ix->StreamCount < MAX_STREAMS)
+                ix->Strh[ix->StreamCount++] = *(AVIStreamHeader56 *) node->Data;
+            break;
+
+        case NODE_LIST:
+            if (node->Depth == 0 && ix->RiffEnd == 0)
+                ix->RiffEnd = node->Pos + 8 + node->Size;
+            if (node->Type != MKFCC('m','o','v','i')) break;
+            if (ix->MoviPos == 0) ix->MoviPos = node->Pos + 8;
+
+            // Only go into the movi list if there is no index to be had.
+
+            if (ix->Sources)
+            {
+                if (!(ix->Sources & INDEX_WANT(INDEX_MOVI))) return(1);
+                ix->Source = INDEX_MOVI;
+            }
+            else if (ix->Source == INDEX_NONE && !ir->HaveSuper &&
+                     !(ix->HasAvih && (ix->Avih.Flags & AVIF_HASINDEX)))
+                ix->Source = INDEX_MOVI;
+            if (ix->Source != INDEX_MOVI) return(1);
+            ir->InMovi = node->Depth + 1;
+            break;
+
+        case NODE_INDX:
+            // The ix## chunks are read by way of the super index, and an
+            // 'indx' in the stream header list is either a super index or,
+            // now and then, a standard index all by itself.
+
+            if (node->FCC != MKFCC('i','n','d','x')) return(1);
+            if (ix->Sources && !(ix->Sources & INDEX_WANT(INDEX_ODML))) return(1);
+            ir->HaveSuper = TRUE;
+            ix->Source = INDEX_ODML;
+            ix->IndexBytes += node->Size + 8;
+            return(0);
+
+        case NODE_IDX1:
+            if (ix->Sources)
+            {
+                if (!(ix->Sources & INDEX_WANT(INDEX_IDX1))) return(1);
+            }
+            else if (ix->Source == INDEX_MOVI || ir->HaveSuper) return(1);
+            ix->Source = INDEX_IDX1;
+            ix->IndexBytes += node->Size + 8;
+            return(0);
+
+        case NODE_CHUNK:
+            if (!ir->InMovi || node->StreamNum < 0) break;
+            memset(&e, 0, sizeof(AVIENTRY));
+            e.Kind = ENTRY_CHUNK;
+            e.FCC = node->FCC;
+            e.StreamNum = node->StreamNum;
+            e.Pos = node->Pos + 8;
+            e.Size = node->Size;
+            e.KeyFrame = FALSE;     // not known without the index
+            ix->EntryCount++;
+            ix->Entry(ix->arg, node->StreamNum, &e);
+            break;
+    }
+
+    return(0);
+}
+
+
+static void IndexEntry(void *arg, AVINODE *node, AVIENTRY *e)
+{
+    INDEXREAD *ir = (INDEXREAD *) arg;
+
+    if (e->Kind == ENTRY_SUPER)
+    {
+        if (e->Pos) IndexReadStd(ir, e);
+        return;
+    }
+
+    if (e->Kind == ENTRY_IDX1 && (e->Flags & AVIIF_LIST))
+        return;     // a 'rec ' list
+
+    if (e->StreamNum < 0) return;
+
+    if (e->Kind == ENTRY_IDX1)
+    {
+        if (!ir->Idx1Checked)
+        {
+            ir->Idx1Checked = TRUE;
+            ir->ix->Idx1Base = AviIdx1Base(ir->in, ir->ix->MoviPos, e->Pos, e->FCC);
+        }
+        e->Pos = e->Pos - ir->ix->MoviPos + ir->ix->Idx1Base + 8;
+    }
+
+    ir->ix->EntryCount++;
+    ir->ix->Entry(ir->ix->arg, e->StreamNum, e);
+}
+
+
+static void IndexClose(void *arg, AVINODE *node)
+{
+    INDEXREAD *ir = (INDEXREAD *) arg;
+
+    if (node->Kind == NODE_LIST && node->Depth + 1 == ir->InMovi)
+        ir->InMovi = 0;
+}
+
+
+static void IndexWalkError(void *arg, char *msg)
+{
+    IndexError((INDEXREAD *) arg, msg);
+}
+
+
+// Tell what the offsets of an idx1 index are from.  pos is where the
+// first entry points when its offset is taken from the 'movi' tag at
+// movi, and fcc is the chunk id it gives.  Returns movi, or 0 if the chunk
+// is only found with the offset taken from the start of the file.
+
+QWORD AviIdx1Base(FILE64 *in, QWORD movi, QWORD pos, FOURCC fcc)
+{
+    BYTE id[4];
+
+    if (File64ReadAt(in, pos, id, 4) == 4 && GET_DWORD(id) == fcc) return(movi);
+    if (pos >= movi && File64ReadAt(in, pos - movi, id, 4) == 4 && GET_DWORD(id) == fcc)
+        return(0);
+
+    return(movi);
+}
+
+
+static int IndexWalk(INDEXREAD *ir)
+{
+    AVIINDEX *ix = ir->ix;
+    AVISINK sink;
+
+    ir->HaveSuper = FALSE;
+    ir->InMovi = 0;
+    ir->Idx1Checked = FALSE;
+
+    ix->HasAvih = FALSE;
+    ix->StreamCount = 0;
+    ix->Source = INDEX_NONE;
+    ix->MoviPos = 0;
+    ix->RiffEnd = 0;
+    ix->Idx1Base = 0;
+    ix->EntryCount = 0;
+    ix->IndexBytes = 0;
+
+    sink.arg = ir;
+    sink.Open = IndexOpen;
+    sink.Entry = IndexEntry;
+    sink.Close = IndexClose;
+    sink.Error = IndexWalkError;
+
+    File64SetAbsPos(ir->in, 0);
+    return(AviWalk(ir->in, &sink, NULL));
+}
+
+
+// Read the headers and index of the file from the start, filling in ix
+// and calling ix->Entry() for every entry.  ix->Entry, ix->Error, ix->arg
+// and ix->Sources must be set, the rest is cleared first.  With Sources
+// 0, an index that gives no entries at all is passed over for the movi
+// list.
+// Returns 0 on success, -1 if the file ended early or is not a RIFF
+// file, or -2 if out of memory.
+
+int AviIndexRead(FILE64 *in, AVIINDEX *ix)
+{
+    INDEXREAD ir;
+    int ret;
+
+    memset(&ir, 0, sizeof(INDEXREAD));
+    ir.in = in;
+    ir.ix = ix;
+    ir.Buf = (BYTE *) malloc(IX_BATCH * sizeof(FIELDINDEXENTRY));
+    if (ir.Buf == NULL) return(-2);
+
+    ret = IndexWalk(&ir);
+
+    if (ix->Sources == 0 && ix->EntryCount == 0 && ix->Source != INDEX_MOVI && ret != -2)
+    {
+        ix->Sources = INDEX_WANT(INDEX_MOVI);
+        ret = IndexWalk(&ir);
+        ix->Sources = 0;
+    }
+
+    free(ir.Buf);
+
+    return(ret);
+}
+
@@ -0,0 +1,390 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+Compact index store.  An IXSTORE holds the index entries of one stream
+in a few bytes each, rather than the 16 or more of an AVIFRAME, so that
+the indexes of many files can be kept in memory at once.
+
+Entries are kept in blocks of IXSTORE_BLOCK.  Each block has an IXBLOCK
+with the absolute location of its first chunk, the frames before it and
+the smallest size in it.  The sizes are stored as the difference from
+that smallest size, bit-packed to the width of the biggest difference,
+with the key frame flag as the low bit.  The locations after the first
+are stored as the distance from the end of the chunk before, which in a
+movi list is little more than the chunk headers between them, as zigzag
+varints of a byte or two.
+
+A size can be read straight off.  A location takes decoding the varints
+of the block up to it, at most IXSTORE_BLOCK - 1 of them, and reading
+entries in order with IxStoreRead() decodes each varint only once.
+
+*/
+
+#include "rdavi2.h"
+
+
+// Entries of the block being added to, until it is full
+
+typedef struct
+{
+    QWORD   Pos[IXSTORE_BLOCK];
+    DWORD   Size[IXSTORE_BLOCK];
+    BYTE    Key[IXSTORE_BLOCK];
+    DWORD   Count;
+    QWORD   Start;      // frames before the first
+} IXPENDING;
+
+
+void IxStoreInit(IXSTORE *st, DWORD samplesize)
+{
+    memset(st, 0, sizeof(IXSTORE));
+    st->SampleSize = samplesize;
+}
+
+
+void IxStoreFree(IXSTORE *st)
+{
+    free(st->Block);
+    free(st->Data);
+    free(st->Pending);
+    IxStoreInit(st, st->SampleSize);
+}
+
+
+// Return the number of bytes of memory st takes.
+
+size_t IxStoreBytes(IXSTORE *st)
+{
+    return(sizeof(IXSTORE) + st->BlockAlloc * sizeof(IXBLOCK) + st->DataAlloc +
+           (st->Pending ? sizeof(IXPENDING) : 0));
+}
+
+
+// Make room for len more bytes of Data, and the few a packed size may
+// read past the end.  Returns FALSE if out of memory.
+
+static int IxStoreRoom(IXSTORE *st, DWORD len)
+{
+    BYTE *np;
+    DWORD alloc;
+
+    if (st->DataSize + len + 8 <= st->DataAlloc) return(TRUE);
+
+    alloc = st->DataAlloc ? st->DataAlloc : 4096;
+    while (alloc < st->DataSize + len + 8) alloc *= 2;
+    np = (BYTE *) realloc(st->Data, alloc);
+    if (np == NULL) return(FALSE);
+    memset(np + st->DataAlloc, 0, alloc - st->DataAlloc);
+    st->Data = np;
+    st->DataAlloc = alloc;
+
+    return(TRUE);
+}
+
+
+// Encode the pending entries as a new block.  Returns 0 on success or -1
+// if out of memory.
+
+static int IxStoreFlush(IXSTORE *st)
+{
+    IXPENDING *pe = st->Pending;
+    IXBLOCK *bl, *np;
+    QWORD end, z, acc;
+    DWORD i, maxd, width, nbits, len;
+    BYTE *p;
+
+    if (pe == NULL || pe->Count == 0) return(0);
+
+    if (st->BlockCount >= st->BlockAlloc)
+    {
+        np = (IXBLOCK *) realloc(st->Block, (st->BlockAlloc ? st->BlockAlloc * 2 : 64) *
+                                 sizeof(IXBLOCK));
+        if (np == NULL) return(-1);
+        st->Block = np;
+        st->BlockAlloc = st->BlockAlloc ? st->BlockAlloc * 2 : 64;
+    }
+    bl = st->Block + st->BlockCount;
+    bl->Pos = pe->Pos[0];
+    bl->Start = pe->Start;
+    bl->Data = st->DataSize;
+    bl->MinSize = pe->Size[0];
+    for (i = 1; i < pe->Count; i++)
+        if (pe->Size[i] < bl->MinSize) bl->MinSize = pe->Size[i];
+    for (maxd = 0, i = 0; i < pe->Count; i++)
+        if (pe->Size[i] - bl->MinSize > maxd) maxd = pe->Size[i] - bl->MinSize;
+    for (width = 0; width < 32 && (maxd >> width); width++)
+        ;
+    bl->Bits = (BYTE) width;
+
+    // worst case: a 32 bit field and a 10 byte varint an entry
+
+    if (!IxStoreRoom(st, pe->Count * 14)) return(-1);
+
+    // the sizes, packed
+
+    p = st->Data + st->DataSize;
+    width++;
+    acc = 0;
+    nbits = 0;
+    for (i = 0; i < pe->Count; i++)
+    {
+        acc |= (QWORD) (((pe->Size[i] - bl->MinSize) << 1) | pe->Key[i]) << nbits;
+        nbits += width;
+        while (nbits >= 8)
+        {
+            *p++ = (BYTE) acc;
+            acc >>= 8;
+            nbits -= 8;
+        }
+    }
+    if (nbits) *p++ = (BYTE) acc;
+
+    // then the distances from the end of the chunk before
+
+    for (i = 1; i < pe->Count; i++)
+    {
+        end = pe->Pos[i - 1] + pe->Size[i - 1];
+        z = (pe->Pos[i] >= end) ? (pe->Pos[i] - end) * 2 : (end - pe->Pos[i]) * 2 - 1;
+        while (z >= 0x80)
+        {
+            *p++ = (BYTE) (z | 0x80);
+            z >>= 7;
+        }
+        *p++ = (BYTE) z;
+    }
+
+    len = (DWORD) (p - (st->Data + st->DataSize));
+    st->DataSize += len;
+    st->BlockCount++;
+    pe->Count = 0;
+
+    return(0);
+}
+
+
+// Add the next entry: the location and size of its chunk's data, and
+// whether it is a key frame.  Returns 0 on success or -1 if out of memory.
+
+int IxStoreAdd(IXSTORE *st, QWORD pos, DWORD size, int key)
+{
+    IXPENDING *pe = st->Pending;
+
+    if (pe == NULL)
+    {
+        pe = st->Pending = (IXPENDING *) malloc(sizeof(IXPENDING));
+        if (pe == NULL) return(-1);
+        pe->Count = 0;
+    }
+    if (st->Count == 0xFFFFFFFFUL) return(-1);
+
+    size &= 0x7FFFFFFF;
+    if (pe->Count == 0) pe->Start = st->Frames;
+    pe->Pos[pe->Count] = pos;
+    pe->Size[pe->Count] = size;
+    pe->Key[pe->Count] = key ? 1 : 0;
+    st->Frames += st->SampleSize ? size / st->SampleSize : 1;
+    st->Count++;
+
+    if (++pe->Count == IXSTORE_BLOCK) return(IxStoreFlush(st));
+    return(0);
+}
+
+
+// Encode the last entries added and give back the memory used while
+// adding.  Returns 0 on success or -1 if out of memory.
+
+int IxStoreFinish(IXSTORE *st)
+{
+    IXBLOCK *np;
+
+    if (IxStoreFlush(st)) return(-1);
+    free(st->Pending);
+    st->Pending = NULL;
+
+    // trim the tables to what is used, keeping the slack after Data
+
+    if (st->BlockCount && st->BlockCount < st->BlockAlloc)
+    {
+        np = (IXBLOCK *) realloc(st->Block, st->BlockCount * sizeof(IXBLOCK));
+        if (np)
+        {
+            st->Block = np;
+            st->BlockAlloc = st->BlockCount;
+        }
+    }
+    if (st->DataSize + 8 < st->DataAlloc)
+    {
+        BYTE *dp = (BYTE *) realloc(st->Data, st->DataSize + 8);
+
+        if (dp)
+        {
+            st->Data = dp;
+            st->DataAlloc = st->DataSize + 8;
+        }
+    }
+
+    return(0);
+}
+
+
+// Read the packed size and key frame flag of entry i of block bl.
+
+static void IxStoreSize(IXSTORE *st, IXBLOCK *bl, DWORD i, AVIFRAME *f)
+{
+    DWORD width = bl->Bits + 1, bit = i * width;
+    BYTE *p = st->Data + bl->Data + bit / 8;
+    QWORD acc;
+    DWORD v;
+
+    acc = (QWORD) p[0] | ((QWORD) p[1] << 8) | ((QWORD) p[2] << 16) |
+          ((QWORD) p[3] << 24) | ((QWORD) p[4] << 32);
+    v = (DWORD) (acc >> (bit % 8));
+    if (width < 32) v &= (1UL << width) - 1;
+
+    f->Size = bl->MinSize + (v >> 1);
+    f->KeyFrame = v & 1;
+    f->Frames = st->SampleSize ? f->Size / st->SampleSize : 1;
+}
+
+
+// Return where the varints of block b start, after its packed sizes.
+
+static BYTE *IxStoreVarints(IXSTORE *st, DWORD b)
+{
+    IXBLOCK *bl = st->Block + b;
+    DWORD count = st->Count - b * IXSTORE_BLOCK;
+
+    if (count > IXSTORE_BLOCK) count = IXSTORE_BLOCK;
+
+    return(st->Data + bl->Data + (count * (bl->Bits + 1) + 7) / 8);
+}
+
+
+// Decode a zigzag varint at *p, moving *p past it, and add it to the
+// end of the chunk before to give a location.
+
+static QWORD IxStoreNextPos(BYTE **p, QWORD end)
+{
+    QWORD z = 0;
+    int shift = 0;
+
+    while (**p & 0x80)
+    {
+        z |= (QWORD) (*(*p)++ & 0x7F) << shift;
+        shift += 7;
+    }
+    z |= (QWORD) *(*p)++ << shift;
+
+    return((z & 1) ? end - (z + 1) / 2 : end + z / 2);
+}
+
+
+// Read count entries from entry first on, into f.  Each block's varints
+// are decoded once, in order.  Returns the number read, which is less
+// than count at the end of the store.
+
+DWORD IxStoreRead(IXSTORE *st, DWORD first, DWORD count, AVIFRAME *f)
+{
+    IXBLOCK *bl;
+    AVIFRAME prev;
+    BYTE *p = NULL;
+    QWORD pos = 0, start = 0;
+    DWORD n, i, j, done;
+
+    if (first >= st->Count) return(0);
+    if (count > st->Count - first) count = st->Count - first;
+
+    for (done = 0, n = first; done < count; done++, n++, f++)
+    {
+        bl = st->Block + n / IXSTORE_BLOCK;
+        i = n % IXSTORE_BLOCK;
+        memset(f, 0, sizeof(AVIFRAME));
+        IxStoreSize(st, bl, i, f);
+
+        if (i == 0 || done == 0)
+        {
+            // start the block, and decode up to i
+
+            p = IxStoreVarints(st, n / IXSTORE_BLOCK);
+            pos = bl->Pos;
+            start = bl->Start;
+            for (j = 0; j < i; j++)
+            {
+                IxStoreSize(st, bl, j, &prev);
+                pos = IxStoreNextPos(&p, pos + prev.Size);
+                start += prev.Frames;
+            }
+        }
+        else
+        {
+            pos = IxStoreNextPos(&p, pos + f[-1].Size);
+            start += f[-1].Frames;
+        }
+        f->Pos = pos;
+        f->Start = start;
+    }
+
+    return(done);
+}
+
+
+// Read entry n into f.  Returns 0 on success or -1 if there is no such
+// entry.
+
+int IxStoreGet(IXSTORE *st, DWORD n, AVIFRAME *f)
+{
+    return(IxStoreRead(st, n, 1, f) == 1 ? 0 : -1);
+}
+
+
+// Return the entry holding frame, or IXSTORE_NONE if it is past the end.
+
+DWORD IxStoreFind(IXSTORE *st, QWORD frame)
+{
+    IXBLOCK *bl;
+    AVIFRAME f;
+    DWORD lo = 0, hi = st->BlockCount, mid, n, end;
+    QWORD start;
+
+    if (frame >= st->Frames) return(IXSTORE_NONE);
+    if (st->SampleSize == 0) return((DWORD) frame);
+
+    while (hi - lo > 1)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (st->Block[mid].Start <= frame)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    bl = st->Block + lo;
+    start = bl->Start;
+    n = lo * IXSTORE_BLOCK;
+    end = (st->Count - n > IXSTORE_BLOCK) ? n + IXSTORE_BLOCK : st->Count;
+    for ( ; n < end; n++)
+    {
+        IxStoreSize(st, bl, n % IXSTORE_BLOCK, &f);
+        if (frame < start + f.Frames) return(n);
+        start += f.Frames;
+    }
+
+    return(IXSTORE_NONE);
+}
@@ -0,0 +1,391 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+JSON report.  The same RIFF, LIST and chunk tree that the text report
+shows is written as one JSON document, for programs to read.  It is
+written as the chunk walker finds each chunk, so nothing is held in
+memory and a movi list with millions of chunks is no harder than a small
+one.  Every chunk is an object in the "chunks" array of the list that
+holds it, and the entries of every index are in an "entries" array.
+Problems found along the way are written as {"error": "..."} objects in
+whatever array is open at the time, so the document always stays valid.
+
+*/
+
+#include "rdavi2.h"
+
+
+typedef struct
+{
+    OUTBUF *out;
+    int     Level;                      // innermost open array
+    int     Count[MAX_WALK_DEPTH + 2];  // elements written at each level
+} JSONSINK;
+
+
+// Write a string with the JSON escapes.  Bytes that are not plain ASCII
+// are written as \u00XX, as if the text were Latin-1.
+
+static void JsonString(OUTBUF *out, char *s, int len)
+{
+    int i, start;
+    BYTE ch;
+
+    OutChar(out, '"');
+    for (i = start = 0; i < len; i++)
+    {
+        ch = (BYTE) s[i];
+        if (ch >= 0x20 && ch < 0x7F && ch != '"' && ch != '\\') continue;
+
+        OutMem(out, s + start, i - start);
+        start = i + 1;
+        if (ch == '"' || ch == '\\')
+        {
+            OutChar(out, '\\');
+            OutChar(out, ch);
+        }
+        else
+        {
+            OutStr(out, "\\u00");
+            OutHex(out, ch, 2);
+        }
+    }
+    OutMem(out, s + start, i - start);
+    OutChar(out, '"');
+}
+
+
+// Write "name": with a comma in front of it if it is not the first.
+
+static void JsonName(OUTBUF *out, char *name, int first)
+{
+    if (!first) OutChar(out, ',');
+    OutChar(out, '"');
+    OutStr(out, name);
+    OutStr(out, "\":");
+}
+
+static void JsonNum(OUTBUF *out, char *name, QWORD val)
+{
+    JsonName(out, name, FALSE);
+    OutQDec(out, val);
+}
+
+static void JsonInt(OUTBUF *out, char *name, LONG val)
+{
+    JsonName(out, name, FALSE);
+    OutDec(out, val);
+}
+
+static void JsonFcc(OUTBUF *out, char *name, FOURCC fcc)
+{
+    JsonName(out, name, FALSE);
+    JsonString(out, (char *) &fcc, 4);
+}
+
+
+// Start a new element of the innermost array.
+
+static void JsonElement(JSONSINK *js)
+{
+    OutStr(js->out, js->Count[js->Level]++ ? ",\n" : "\n");
+}
+
+
+static void JsonAvih(OUTBUF *out, MainAVIHeader *h)
+{
+    JsonName(out, "avih", FALSE);
+    OutChar(out, '{');
+    JsonName(out, "MicroSecPerFrame", TRUE);
+    OutQDec(out, h->MicroSecPerFrame);
+    JsonNum(out, "MaxBytesPerSec", h->MaxBytesPerSec);
+    JsonNum(out, "PaddingGranularity", h->PaddingGranularity);
+    JsonNum(out, "Flags", h->Flags);
+    JsonNum(out, "TotalFrames", h->TotalFrames);
+    JsonNum(out, "InitialFrames", h->InitialFrames);
+    JsonNum(out, "NumStreams", h->NumStreams);
+    JsonNum(out, "SuggestedBufferSize", h->SuggestedBufferSize);
+    JsonNum(out, "Width", h->Width);
+    JsonNum(out, "Height", h->Height);
+    OutChar(out, '}');
+}
+
+
+static void JsonStrh(OUTBUF *out, AVIStreamHeader56 *h)
+{
+    JsonName(out, "strh", FALSE);
+    OutChar(out, '{');
+    JsonName(out, "fccType", TRUE);
+    JsonString(out, (char *) &h->fccType, 4);
+    JsonFcc(out, "fccHandler", h->fccHandler);
+    JsonNum(out, "Flags", h->Flags);
+    JsonNum(out, "Priority", h->Priority);
+    JsonNum(out, "Language", h->Language);
+    JsonNum(out, "InitialFrames", h->InitialFrames);
+    JsonNum(out, "TimeScale", h->TimeScale);
+    JsonNum(out, "Rate", h->Rate);
+    JsonNum(out, "StartTime", h->StartTime);
+    JsonNum(out, "Length", h->Length);
+    JsonNum(out, "SuggestedBufferSize", h->SuggestedBufferSize);
+    JsonNum(out, "Quality", h->Quality);
+    JsonNum(out, "SampleSize", h->SampleSize);
+    JsonName(out, "Frame", FALSE);
+    OutPrintf(out, "[%u,%u,%u,%u]}", h->Frame.Left, h->Frame.Top,
+              h->Frame.Right, h->Frame.Bottom);
+}
+
+
+static void JsonStrfVid(OUTBUF *out, STREAMFORMATVID *f)
+{
+    char *c = (char *) &f->biCompression;
+
+    JsonName(out, "strf", FALSE);
+    OutChar(out, '{');
+    JsonName(out, "header_size", TRUE);
+    OutQDec(out, f->header_size);
+    JsonInt(out, "biWidth", f->biWidth);
+    JsonInt(out, "biHeight", f->biHeight);
+    JsonNum(out, "biPlanes", f->biPlanes);
+    JsonNum(out, "bits_per_pixel", f->bits_per_pixel);
+    if (isprint(c[0]) && isprint(c[1]) && isprint(c[2]) && isprint(c[3]))
+        JsonFcc(out, "biCompression", f->biCompression);
+    else
+        JsonNum(out, "biCompression", f->biCompression);
+    JsonNum(out, "biSizeImage", f->biSizeImage);
+    JsonInt(out, "biXPelsPerMeter", f->biXPelsPerMeter);
+    JsonInt(out, "biYPelsPerMeter", f->biYPelsPerMeter);
+    JsonNum(out, "biClrUsed", f->biClrUsed);
+    JsonNum(out, "biClrImportant", f->biClrImportant);
+    OutChar(out, '}');
+}
+
+
+static void JsonStrfAud(OUTBUF *out, STREAMFORMATAUD *f)
+{
+    JsonName(out, "strf", FALSE);
+    OutChar(out, '{');
+    JsonName(out, "wFormatTag", TRUE);
+    OutQDec(out, f->wFormatTag);
+    JsonNum(out, "nChannels", f->nChannels);
+    JsonNum(out, "nSamplesPerSec", f->nSamplesPerSec);
+    JsonNum(out, "nAvgBytesPerSec", f->nAvgBytesPerSec);
+    JsonNum(out, "nBlockAlign", f->nBlockAlign);
+    JsonNum(out, "wBitsPerSample", f->wBitsPerSample);
+    JsonNum(out, "cbSize", f->cbSize);
+    OutChar(out, '}');
+}
+
+
+static void JsonVprp(OUTBUF *out, VideoPropHeader *v)
+{
+    JsonName(out, "vprp", FALSE);
+    OutChar(out, '{');
+    JsonName(out, "VideoFormatToken", TRUE);
+    OutQDec(out, v->VideoFormatToken);
+    JsonNum(out, "VideoStandard", v->VideoStandard);
+    JsonNum(out, "dwVerticalRefreshRate", v->dwVerticalRefreshRate);
+    JsonNum(out, "dwHTotalInT", v->dwHTotalInT);
+    JsonNum(out, "dwVTotalInLines", v->dwVTotalInLines);
+    JsonNum(out, "dwFrameAspectRatio", v->dwFrameAspectRatio);
+    JsonNum(out, "dwFrameWidthInPixels", v->dwFrameWidthInPixels);
+    JsonNum(out, "dwFrameHeightInLines", v->dwFrameHeightInLines);
+    JsonNum(out, "nbFieldPerFrame", v->nbFieldPerFrame);
+    OutChar(out, '}');
+}
+
+
+static void JsonIndx(OUTBUF *out, INDX_CHUNK *idx)
+{
+    JsonName(out, "index", FALSE);
+    OutChar(out, '{');
+    JsonName(out, "wLongsPerEntry", TRUE);
+    OutQDec(out, idx->wLongsPerEntry);
+    JsonNum(out, "bIndexSubType", idx->bIndexSubType);
+    JsonNum(out, "bIndexType", idx->bIndexType);
+    JsonNum(out, "nEntriesInUse", idx->nEntriesInUse);
+    JsonFcc(out, "dwChunkId", idx->dwChunkId);
+    JsonNum(out, "qwBaseOffset", idx->qwBaseOffset);
+    OutChar(out, '}');
+}
+
+
+// Sink functions for the chunk walker
+
+static int JsonOpen(void *arg, AVINODE *node)
+{
+    JSONSINK *js = (JSONSINK *) arg;
+    OUTBUF *out = js->out;
+
+    JsonElement(js);
+    OutChar(out, '{');
+    JsonName(out, "id", TRUE);
+    JsonString(out, (char *) &node->FCC, 4);
+    if (node->Kind == NODE_LIST) JsonFcc(out, "type", node->Type);
+    if (node->StreamNum >= 0) JsonInt(out, "stream", node->StreamNum);
+    JsonNum(out, "offset", node->Pos);
+    JsonNum(out, "size", node->Size);
+
+    switch (node->Kind)
+    {
+        case NODE_AVIH:     JsonAvih(out, (MainAVIHeader *) node->Data);          break;
+        case NODE_STRH:     JsonStrh(out, (AVIStreamHeader56 *) node->Data);      break;
+        case NODE_STRF_VID: JsonStrfVid(out, (STREAMFORMATVID *) node->Data);     break;
+        case NODE_STRF_AUD: JsonStrfAud(out, (STREAMFORMATAUD *) node->Data);     break;
+        case NODE_VPRP:     JsonVprp(out, (VideoPropHeader *) node->Data);        break;
+        case NODE_INDX:     JsonIndx(out, (INDX_CHUNK *) node->Data);             break;
+        case NODE_DMLH:
+            JsonNum(out, "dwTotalFrames", ((AVIEXTHEADER *) node->Data)->dwTotalFrames);
+            break;
+        case NODE_STRING:
+            JsonName(out, "text", FALSE);
+            JsonString(out, (char *) node->Data, strlen((char *) node->Data));
+            break;
+    }
+
+    if (node->Kind == NODE_LIST)
+    {
+        OutStr(out, ",\"chunks\":[");
+        js->Level = node->Depth + 1;
+        js->Count[js->Level] = 0;
+    }
+    else if (node->Kind == NODE_INDX || node->Kind == NODE_IDX1)
+    {
+        OutStr(out, ",\"entries\":[");
+        js->Level = node->Depth + 1;
+        js->Count[js->Level] = 0;
+    }
+
+    return(0);
+}
+
+
+static void JsonEntry(void *arg, AVINODE *node, AVIENTRY *e)
+{
+    JSONSINK *js = (JSONSINK *) arg;
+    OUTBUF *out = js->out;
+
+    JsonElement(js);
+    OutChar(out, '{');
+    if (e->Kind == ENTRY_IDX1)
+    {
+        JsonName(out, "id", TRUE);
+        JsonString(out, (char *) &e->FCC, 4);
+        JsonNum(out, "flags", e->Flags);
+        JsonName(out, "offset", FALSE);
+    }
+    else JsonName(out, "offset", TRUE);
+    OutQDec(out, e->Pos);
+    if (e->Kind == ENTRY_FIELD) JsonNum(out, "offset2", e->Pos2);
+    JsonNum(out, "size", e->Size);
+    if (e->Kind == ENTRY_SUPER)
+        JsonNum(out, "duration", e->Flags);
+    else
+        OutStr(out, e->KeyFrame ? ",\"key\":true" : ",\"key\":false");
+    OutChar(out, '}');
+}
+
+
+static void JsonClose(void *arg, AVINODE *node)
+{
+    JSONSINK *js = (JSONSINK *) arg;
+
+    if (node->Kind == NODE_LIST || node->Kind == NODE_INDX || node->Kind == NODE_IDX1)
+    {
+        OutStr(js->out, "\n]}");
+        js->Level = node->Depth;
+    }
+    else OutChar(js->out, '}');
+}
+
+
+static void JsonError(void *arg, char *msg)
+{
+    JSONSINK *js = (JSONSINK *) arg;
+
+    JsonElement(js);
+    OutStr(js->out, "{\"error\":");
+    JsonString(js->out, msg, strlen(msg));
+    OutChar(js->out, '}');
+}
+
+
+// Write the JSON report for the file in ctx.  The document is an object
+// holding the file name, if it is known, and the array of top level
+// chunks.  With a cache directory, the chunks come from the cached tree,
+// unless there are limits on the parse, as a tree cut short is no use.
+// Returns 0 on success or -1 if the file could not be read.
+
+int JsonReport(AVICTX *ctx)
+{
+    JSONSINK js;
+    AVISINK sink;
+    AVITREE *t = NULL;
+    int ret;
+
+    memset(&js, 0, sizeof(JSONSINK));
+    js.out = ctx->out;
+
+    sink.arg = &js;
+    sink.Open = JsonOpen;
+    sink.Entry = JsonEntry;
+    sink.Close = JsonClose;
+    sink.Error = JsonError;
+
+    OutChar(ctx->out, '{');
+    if (ctx->Name)
+    {
+        JsonName(ctx->out, "file", TRUE);
+        JsonString(ctx->out, ctx->Name, strlen(ctx->Name));
+        OutChar(ctx->out, ',');
+    }
+    OutStr(ctx->out, "\"chunks\":[");
+
+    if (ctx->CacheDir && ctx->Name && !LIMITS_SET(&ctx->Limits))
+        t = CacheTree(ctx->in, ctx->Name, ctx->CacheDir);
+
+    if (t)
+    {
+        ret = AviTreeWalk(t, &sink);
+        AviTreeFree(t);
+    }
+    else ret = AviWalk(ctx->in, &sink, &ctx->Limits);
+
+    OutStr(ctx->out, "\n]}\n");
+
+    return(ret);
+}
+
+
+// Write a JSON document for a file that could not be opened.
+
+void JsonFileError(FILE *fp, char *fname, char *msg)
+{
+    OUTBUF out;
+
+    OutInit(&out, fp);
+    OutChar(&out, '{');
+    JsonName(&out, "file", TRUE);
+    JsonString(&out, fname, strlen(fname));
+    JsonName(&out, "error", FALSE);
+    JsonString(&out, msg, strlen(msg));
+    OutStr(&out, "}\n");
+    OutClose(&out);
+}
+
@@ -0,0 +1,224 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+Key frame maps.  A KEYMAP holds one bit a chunk, set for key frames, and
+after KeyMapFinish() can say how many key frames come before any chunk
+(rank) and which chunk is the n-th key frame (select) without going
+through the bits one at a time.
+
+Rank keeps the number of set bits before every block of KEYMAP_BLOCK
+words, and in a byte the number before each word within its block, so a
+rank is two table reads and the count of one word.  Select keeps the
+word holding every KEYMAP_SAMPLE-th set bit, searches the blocks between
+two of those, and then the words of one block.  The tables add under
+half a bit a chunk to the bit itself, so a stream of ten million frames
+needs under 2MB.
+
+*/
+
+#include "rdavi2.h"
+
+#define KEYMAP_BLOCK    8       // words to a block, 256 bits, so SubRank fits a byte
+#define KEYMAP_SAMPLE   64      // set bits between Select entries
+
+
+// Count the set bits of a word.
+
+static DWORD KeyMapCount(DWORD w)
+{
+    w = w - ((w >> 1) & 0x55555555UL);
+    w = (w & 0x33333333UL) + ((w >> 2) & 0x33333333UL);
+    w = (w + (w >> 4)) & 0x0F0F0F0FUL;
+
+    return((DWORD) (w * 0x01010101UL) >> 24);
+}
+
+
+void KeyMapInit(KEYMAP *km)
+{
+    memset(km, 0, sizeof(KEYMAP));
+}
+
+
+void KeyMapFree(KEYMAP *km)
+{
+    free(km->Bits);
+    free(km->Rank);
+    free(km->SubRank);
+    free(km->Select);
+    KeyMapInit(km);
+}
+
+
+// Return the number of bytes of memory the bits and tables of km take.
+
+size_t KeyMapBytes(KEYMAP *km)
+{
+    DWORD words = (km->Count + 31) / 32;
+    size_t bytes = km->Alloc * sizeof(DWORD);
+
+    if (km->Rank)
+        bytes += (words / KEYMAP_BLOCK + 1) * sizeof(DWORD) + words + 1 +
+                 (km->Ones / KEYMAP_SAMPLE + 1) * sizeof(DWORD);
+
+    return(bytes);
+}
+
+
+// Add the bit for the next chunk, set if it is a key frame.  The tables
+// are out of date until KeyMapFinish() is called again.
+// Returns 0 on success or -1 if out of memory.
+
+int KeyMapAdd(KEYMAP *km, int key)
+{
+    DWORD *np, alloc;
+
+    if (km->Count == 0xFFFFFFFFUL) return(-1);
+    if (km->Count / 32 >= km->Alloc)
+    {
+        alloc = km->Alloc ? km->Alloc * 2 : 256;
+        np = (DWORD *) realloc(km->Bits, alloc * sizeof(DWORD));
+        if (np == NULL) return(-1);
+        memset(np + km->Alloc, 0, (alloc - km->Alloc) * sizeof(DWORD));
+        km->Bits = np;
+        km->Alloc = alloc;
+    }
+
+    if (key)
+    {
+        km->Bits[km->Count / 32] |= 1UL << (km->Count % 32);
+        km->Ones++;
+    }
+    km->Count++;
+
+    return(0);
+}
+
+
+// Build the rank and select tables from the bits added.
+// Returns 0 on success or -1 if out of memory.
+
+int KeyMapFinish(KEYMAP *km)
+{
+    DWORD words, blocks, w, ones = 0, n;
+
+    free(km->Rank);
+    free(km->SubRank);
+    free(km->Select);
+    km->Rank = NULL;
+    km->SubRank = NULL;
+    km->Select = NULL;
+
+    words = (km->Count + 31) / 32;
+    blocks = words / KEYMAP_BLOCK + 1;          // one more for the total
+    km->Rank = (DWORD *) malloc(blocks * sizeof(DWORD));
+    km->SubRank = (BYTE *) malloc(words + 1);
+    km->Select = (DWORD *) malloc((km->Ones / KEYMAP_SAMPLE + 1) * sizeof(DWORD));
+    if (km->Rank == NULL || km->SubRank == NULL || km->Select == NULL) return(-1);
+
+    for (w = 0; w < words; w++)
+    {
+        if (w % KEYMAP_BLOCK == 0) km->Rank[w / KEYMAP_BLOCK] = ones;
+        km->SubRank[w] = (BYTE) (ones - km->Rank[w / KEYMAP_BLOCK]);
+
+        // note the word of each KEYMAP_SAMPLE-th set bit
+
+        n = KeyMapCount(km->Bits[w]);
+        if ((ones + KEYMAP_SAMPLE - 1) / KEYMAP_SAMPLE != (ones + n + KEYMAP_SAMPLE - 1) / KEYMAP_SAMPLE)
+            km->Select[(ones + KEYMAP_SAMPLE - 1) / KEYMAP_SAMPLE] = w;
+        ones += n;
+    }
+    if (words % KEYMAP_BLOCK == 0) km->Rank[words / KEYMAP_BLOCK] = ones;
+
+    return(0);
+}
+
+
+// Return the number of key frames before chunk pos.
+
+DWORD KeyMapRank(KEYMAP *km, DWORD pos)
+{
+    DWORD w;
+
+    if (pos >= km->Count) return(km->Ones);
+    w = pos / 32;
+
+    return(km->Rank[w / KEYMAP_BLOCK] + km->SubRank[w] +
+           KeyMapCount(km->Bits[w] & ((1UL << (pos % 32)) - 1)));
+}
+
+
+// Return the chunk that is key frame number n, counting from 0, or
+// KEYMAP_NONE if there are not that many.
+
+DWORD KeyMapSelect(KEYMAP *km, DWORD n)
+{
+    DWORD lo, hi, mid, w, end, bits;
+
+    if (n >= km->Ones) return(KEYMAP_NONE);
+
+    // the sampled words either side bound the block it is in
+
+    lo = km->Select[n / KEYMAP_SAMPLE] / KEYMAP_BLOCK;
+    if (n / KEYMAP_SAMPLE + 1 < (km->Ones + KEYMAP_SAMPLE - 1) / KEYMAP_SAMPLE)
+        hi = km->Select[n / KEYMAP_SAMPLE + 1] / KEYMAP_BLOCK + 1;
+    else
+        hi = (km->Count + 31) / 32 / KEYMAP_BLOCK + 1;
+    while (hi - lo > 1)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (km->Rank[mid] <= n)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    // then the word within the block, and the bit within the word
+
+    n -= km->Rank[lo];
+    w = lo * KEYMAP_BLOCK;
+    end = w + KEYMAP_BLOCK;
+    if (end > (km->Count + 31) / 32) end = (km->Count + 31) / 32;
+    while (w + 1 < end && km->SubRank[w + 1] <= n) w++;
+    n -= km->SubRank[w];
+
+    for (bits = km->Bits[w]; n; n--)
+        bits &= bits - 1;           // drop the lowest set bit
+
+    return(w * 32 + KeyMapCount((bits & (0 - bits)) - 1));
+}
+
+
+// Return the last key frame at or before chunk pos, or KEYMAP_NONE.
+
+DWORD KeyMapPrev(KEYMAP *km, DWORD pos)
+{
+    DWORD n = KeyMapRank(km, pos + 1);
+
+    return(n ? KeyMapSelect(km, n - 1) : KEYMAP_NONE);
+}
+
+
+// Return the first key frame at or after chunk pos, or KEYMAP_NONE.
+
+DWORD KeyMapNext(KEYMAP *km, DWORD pos)
+{
+    return(KeyMapSelect(km, KeyMapRank(km, pos)));
+}
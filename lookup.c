@@ -0,0 +1,1086 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+Frame lookup.  AviLookupOpen() reads the headers of a file once and
+keeps just enough of the index to go straight to any frame later on.
+
+For an Open-DML file that is the super index of each stream: where each
+'ix##' chunk is and how many frames come before it, worked out from the
+dwDuration of the entries before it.  AviLookupFrame() finds the right
+'ix##' chunk with a binary search of those, then reads its header and
+the one entry it needs.  The movi list and 'idx1' are not read at all.
+
+For an older file the 'idx1' entries of each stream are found once, and
+only the entry numbers are kept.  A lookup then finds the entry number
+with a binary search, or straight off for video, and reads that entry.
+
+Frames are counted in the units of the stream header: one per chunk for
+video, and samples, or blocks of SampleSize bytes, for audio.
+
+With LOOKUP_KEYS every entry of the index is read once more when the
+file is opened, to build a KEYMAP of the key frames of each stream with
+one chunk a frame.  Going back to a key frame, the length of a GOP and
+counting key frames are then done from the map, without reading the
+index again.
+
+With LOOKUP_ENTRIES the entries read are kept too, packed in an IXSTORE
+for each stream, and lookups are done from those without reading the
+file at all.  That takes a few bytes a chunk.
+
+*/
+
+#include "rdavi2.h"
+
+#define LOOKUP_GROW     1024        // entries added to an array at a time
+#define LOOKUP_BATCH    512         // ix## entries read at once
+
+
+typedef struct
+{
+    AVIStreamHeader56 Strh;     // the stream header, if HasStrh
+    int     HasStrh;
+    DWORD   SuperCount;         // ix## chunks in the super index
+    DWORD   SuperAlloc;
+    QWORD  *SuperPos;           // location of each ix## chunk
+    QWORD  *SuperStart;         // frames before each
+    DWORD   Count;              // idx1 entries of this stream
+    DWORD   Alloc;
+    DWORD  *Idx1Num;            // entry number in idx1 of each
+    QWORD  *Idx1Start;          // frames before each, NULL if SampleSize is 0
+    QWORD   Frames;             // frames in the stream
+    KEYMAP  Keys;               // key frames, if HasKeys
+    int     HasKeys;
+    IXSTORE Store;              // every entry, if HasStore
+    int     HasStore;
+} LOOKUPSTREAM;
+
+struct AVILOOKUP
+{
+    FILE64       *in;
+    QWORD         MoviPos;      // location of the first 'movi' tag
+    QWORD         Idx1Pos;      // location of the first idx1 entry
+    QWORD         Idx1Base;     // what idx1 offsets are from
+    FOURCC        Idx1FCC;      // first idx1 entry, to check Idx1Base
+    QWORD         Idx1First;
+    int           HaveSuper;    // TRUE if any stream has a super index
+    int           Streams;      // stream headers seen
+    int           OutOfMemory;
+    int           Flags;        // LOOKUP_* options
+    LOOKUPSTREAM *Stream[MAX_STREAMS];
+};
+
+
+static LOOKUPSTREAM *LookupStream(AVILOOKUP *lk, int stream)
+{
+    LOOKUPSTREAM *ls;
+
+    if (stream < 0 || stream >= MAX_STREAMS) return(NULL);
+    if (lk->Stream[stream]) return(lk->Stream[stream]);
+
+    ls = (LOOKUPSTREAM *) malloc(sizeof(LOOKUPSTREAM));
+    if (ls == NULL)
+    {
+        lk->OutOfMemory = TRUE;
+        return(NULL);
+    }
+    memset(ls, 0, sizeof(LOOKUPSTREAM));
+    lk->Stream[stream] = ls;
+
+    return(ls);
+}
+
+
+// Make room for one more element in the arrays a and b, which hold count
+// elements of asize and bsize bytes, and have room for *alloc.  b may be
+// NULL.  Returns FALSE if out of memory.
+
+static int LookupGrow(void **a, size_t asize, void **b, size_t bsize, DWORD count,
+                      DWORD *alloc)
+{
+    void *np;
+
+    if (count < *alloc) return(TRUE);
+
+    np = realloc(*a, (*alloc + LOOKUP_GROW) * asize);
+    if (np == NULL) return(FALSE);
+    *a = np;
+    if (b)
+    {
+        np = realloc(*b, (*alloc + LOOKUP_GROW) * bsize);
+        if (np == NULL) return(FALSE);
+        *b = np;
+    }
+    *alloc += LOOKUP_GROW;
+
+    return(TRUE);
+}
+
+
+// Sink functions for the chunk walker
+
+static int LookupOpen(void *arg, AVINODE *node)
+{
+    AVILOOKUP *lk = (AVILOOKUP *) arg;
+    LOOKUPSTREAM *ls;
+
+    switch (node->Kind)
+    {
+        case NODE_STRH:
+            ls = LookupStream(lk, lk->Streams++);
+            if (ls)
+            {
+                ls->Strh = *(AVIStreamHeader56 *) node->Data;
+                ls->HasStrh = TRUE;
+            }
+            break;
+
+        case NODE_LIST:
+            if (node->Type != MKFCC('m','o','v','i')) break;
+            if (lk->MoviPos == 0) lk->MoviPos = node->Pos + 8;
+            return(1);
+
+        case NODE_INDX:
+            if (node->FCC != MKFCC('i','n','d','x') ||
+                ((INDX_CHUNK *) node->Data)->bIndexType != AVI_INDEX_OF_INDEXES)
+                return(1);
+            lk->HaveSuper = TRUE;
+            break;
+
+        case NODE_IDX1:
+            if (lk->HaveSuper) return(1);
+            lk->Idx1Pos = node->Pos + 8;
+            break;
+    }
+
+    return(0);
+}
+
+
+static void LookupEntry(void *arg, AVINODE *node, AVIENTRY *e)
+{
+    AVILOOKUP *lk = (AVILOOKUP *) arg;
+    LOOKUPSTREAM *ls;
+    int sampled;
+
+    if (e->Kind != ENTRY_SUPER && e->Kind != ENTRY_IDX1) return;
+    if (e->Kind == ENTRY_IDX1 && (e->Flags & AVIIF_LIST)) return;
+
+    ls = LookupStream(lk, e->StreamNum);
+    if (ls == NULL) return;
+
+    if (e->Kind == ENTRY_SUPER)
+    {
+        if (e->Pos == 0) return;    // unused entry
+        if (!LookupGrow((void **) &ls->SuperPos, sizeof(QWORD), (void **) &ls->SuperStart,
+                        sizeof(QWORD), ls->SuperCount, &ls->SuperAlloc))
+        {
+            lk->OutOfMemory = TRUE;
+            return;
+        }
+        ls->SuperPos[ls->SuperCount] = e->Pos;
+        ls->SuperStart[ls->SuperCount++] = ls->Frames;
+        ls->Frames += e->Flags;     // dwDuration
+        return;
+    }
+
+    if (e->Num == 0)
+    {
+        lk->Idx1FCC = e->FCC;
+        lk->Idx1First = e->Pos;
+    }
+
+    // the frames before each entry are kept too when it is not one a chunk
+    sampled = ls->HasStrh && ls->Strh.SampleSize;
+    if (!LookupGrow((void **) &ls->Idx1Num, sizeof(DWORD),
+                    sampled ? (void **) &ls->Idx1Start : NULL, sizeof(QWORD),
+                    ls->Count, &ls->Alloc))
+    {
+        lk->OutOfMemory = TRUE;
+        return;
+    }
+    if (sampled)
+    {
+        ls->Idx1Start[ls->Count] = ls->Frames;
+        ls->Frames += e->Size / ls->Strh.SampleSize;
+    }
+    else ls->Frames++;
+    ls->Idx1Num[ls->Count++] = e->Num;
+}
+
+
+static void LookupClose(void *arg, AVINODE *node)
+{
+}
+
+
+// Index entries, with LOOKUP_KEYS or LOOKUP_ENTRIES
+
+static void LookupLoadEntry(void *arg, int stream, AVIENTRY *e)
+{
+    AVILOOKUP *lk = (AVILOOKUP *) arg;
+    LOOKUPSTREAM *ls;
+
+    if (stream < 0 || stream >= MAX_STREAMS || (ls = lk->Stream[stream]) == NULL ||
+        !ls->HasStrh)
+        return;
+
+    if ((lk->Flags & LOOKUP_KEYS) && ls->Strh.SampleSize == 0 &&
+        KeyMapAdd(&ls->Keys, e->KeyFrame))
+        lk->OutOfMemory = TRUE;
+
+    if ((lk->Flags & LOOKUP_ENTRIES) && IxStoreAdd(&ls->Store, e->Pos, e->Size, e->KeyFrame))
+        lk->OutOfMemory = TRUE;
+}
+
+
+// Read every entry of the index into the key frame maps and the entry
+// stores.  One that does not have an entry for every frame is not used.
+// Returns 0 on success or -1 if out of memory.
+
+static int LookupLoad(AVILOOKUP *lk)
+{
+    AVIINDEX *ix;
+    LOOKUPSTREAM *ls;
+    int i;
+
+    ix = (AVIINDEX *) malloc(sizeof(AVIINDEX));
+    if (ix == NULL) return(-1);
+
+    for (i = 0; i < MAX_STREAMS; i++)
+        if ((ls = lk->Stream[i]) != NULL) IxStoreInit(&ls->Store, ls->Strh.SampleSize);
+
+    ix->arg = lk;
+    ix->Entry = LookupLoadEntry;
+    ix->Error = NULL;
+    ix->Sources = INDEX_WANT(lk->HaveSuper ? INDEX_ODML : INDEX_IDX1);
+    AviIndexRead(lk->in, ix);
+    free(ix);
+
+    for (i = 0; i < MAX_STREAMS; i++)
+    {
+        ls = lk->Stream[i];
+        if (ls == NULL) continue;
+        if (ls->Keys.Count == ls->Frames && ls->Frames && KeyMapFinish(&ls->Keys) == 0)
+            ls->HasKeys = TRUE;
+        else
+            KeyMapFree(&ls->Keys);
+        if (ls->Store.Frames == ls->Frames && ls->Frames && IxStoreFinish(&ls->Store) == 0)
+        {
+            // the idx1 entry numbers are not needed now
+
+            ls->HasStore = TRUE;
+            free(ls->Idx1Num);
+            free(ls->Idx1Start);
+            ls->Idx1Num = NULL;
+            ls->Idx1Start = NULL;
+            ls->Alloc = 0;
+        }
+        else IxStoreFree(&ls->Store);
+    }
+
+    return(lk->OutOfMemory ? -1 : 0);
+}
+
+
+// Read the headers and the super index or idx1 of a file, so that frames
+// can be looked up.  flags are LOOKUP_* options.  The file must stay
+// open until AviLookupClose().
+// Returns NULL if out of memory or no stream headers were found.
+
+AVILOOKUP *AviLookupOpen(FILE64 *in, int flags)
+{
+    AVILOOKUP *lk;
+    AVISINK sink;
+
+    lk = (AVILOOKUP *) malloc(sizeof(AVILOOKUP));
+    if (lk == NULL) return(NULL);
+    memset(lk, 0, sizeof(AVILOOKUP));
+    lk->in = in;
+    lk->Flags = flags;
+
+    sink.arg = lk;
+    sink.Open = LookupOpen;
+    sink.Entry = LookupEntry;
+    sink.Close = LookupClose;
+    sink.Error = NULL;
+
+    File64SetAbsPos(in, 0);
+    AviWalk(in, &sink, NULL);
+
+    // a truncated file is still looked up as far as it goes
+
+    if (lk->Streams == 0 || lk->OutOfMemory)
+    {
+        AviLookupClose(lk);
+        return(NULL);
+    }
+
+    // The walker makes idx1 offsets from the 'movi' tag, which is right
+    // unless the writer made them from the start of the file.
+
+    lk->Idx1Base = lk->MoviPos;
+    if (lk->Idx1Pos)
+        lk->Idx1Base = AviIdx1Base(in, lk->MoviPos, lk->Idx1First, lk->Idx1FCC);
+
+    if ((flags & (LOOKUP_KEYS | LOOKUP_ENTRIES)) && LookupLoad(lk))
+    {
+        AviLookupClose(lk);
+        return(NULL);
+    }
+
+    return(lk);
+}
+
+
+void AviLookupClose(AVILOOKUP *lk)
+{
+    LOOKUPSTREAM *ls;
+    int i;
+
+    if (lk == NULL) return;
+    for (i = 0; i < MAX_STREAMS; i++)
+    {
+        ls = lk->Stream[i];
+        if (ls == NULL) continue;
+        free(ls->SuperPos);
+        free(ls->SuperStart);
+        free(ls->Idx1Num);
+        free(ls->Idx1Start);
+        KeyMapFree(&ls->Keys);
+        IxStoreFree(&ls->Store);
+        free(ls);
+    }
+    free(lk);
+}
+
+
+// Return the stream header of stream, or NULL if there is none.
+
+AVIStreamHeader56 *AviLookupStrh(AVILOOKUP *lk, int stream)
+{
+    if (stream < 0 || stream >= MAX_STREAMS || lk->Stream[stream] == NULL ||
+        !lk->Stream[stream]->HasStrh)
+        return(NULL);
+
+    return(&lk->Stream[stream]->Strh);
+}
+
+
+// Find the last of count starting frames in start that is not after
+// frame.  start must be in order.
+
+static DWORD LookupSearch(QWORD *start, DWORD count, QWORD frame)
+{
+    DWORD lo = 0, hi = count, mid;
+
+    while (hi - lo > 1)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (start[mid] <= frame)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return(lo);
+}
+
+
+// Read the header of the ix## chunk at pos.  Fills in the bytes of each
+// entry and how many there are, and returns the location of the first
+// entry, or 0 if it is not a standard index.
+
+static QWORD LookupStdHeader(AVILOOKUP *lk, QWORD pos, QWORD *base, DWORD *irb,
+                             DWORD *count)
+{
+    BYTE hdr[8 + sizeof(INDX_CHUNK)];
+    INDX_CHUNK *idx = (INDX_CHUNK *) (hdr + 8);
+    DWORD size;
+
+    if (File64ReadAt(lk->in, pos, hdr, sizeof(hdr)) != sizeof(hdr)) return(0);
+
+    *irb = idx->wLongsPerEntry * 4;
+    size = ((DWORD *) hdr)[1];
+    if (idx->bIndexType != AVI_INDEX_OF_CHUNKS || *irb < sizeof(STDINDEXENTRY) ||
+        *irb > sizeof(FIELDINDEXENTRY) || size < sizeof(INDX_CHUNK))
+        return(0);
+    *count = (size - sizeof(INDX_CHUNK)) / *irb;
+    if (*count > idx->nEntriesInUse) *count = idx->nEntriesInUse;
+    *base = idx->qwBaseOffset;
+
+    return(pos + sizeof(hdr));
+}
+
+
+// Fill in f from an ix## entry.
+
+static void LookupStdFrame(LOOKUPSTREAM *ls, QWORD base, FIELDINDEXENTRY *fe, AVIFRAME *f)
+{
+    f->Pos = base + fe->dwOffset;
+    f->Size = fe->dwSize & 0x7FFFFFFF;
+    f->KeyFrame = !(fe->dwSize & 0x80000000);
+    f->Frames = ls->Strh.SampleSize ? f->Size / ls->Strh.SampleSize : 1;
+    f->Source = INDEX_ODML;
+}
+
+
+// Find frame in ix## chunk number chunk of the super index, filling in f
+// and the number of its entry.  Returns 0 on success or -1 if it is not
+// there.
+
+static int LookupStd(AVILOOKUP *lk, LOOKUPSTREAM *ls, DWORD chunk, QWORD frame,
+                     AVIFRAME *f, DWORD *entry)
+{
+    BYTE buf[LOOKUP_BATCH * sizeof(FIELDINDEXENTRY)];
+    QWORD pos, base, start = ls->SuperStart[chunk];
+    DWORD irb, count, i, j, cnt;
+
+    pos = LookupStdHeader(lk, ls->SuperPos[chunk], &base, &irb, &count);
+    if (pos == 0) return(-1);
+
+    // a frame to a chunk, so the entry can be read straight off
+
+    if (ls->Strh.SampleSize == 0)
+    {
+        if (frame - start >= count) return(-1);
+        i = (DWORD) (frame - start);
+        if (File64ReadAt(lk->in, pos + (QWORD) i * irb, buf, irb) != irb) return(-1);
+        LookupStdFrame(ls, base, (FIELDINDEXENTRY *) buf, f);
+        f->Start = frame;
+        *entry = i;
+        return(0);
+    }
+
+    // add up the samples of the chunks until frame is reached
+
+    for (i = 0; i < count; i += cnt, pos += cnt * irb)
+    {
+        cnt = count - i;
+        if (cnt > LOOKUP_BATCH) cnt = LOOKUP_BATCH;
+        if (File64ReadAt(lk->in, pos, buf, cnt * irb) != cnt * irb) return(-1);
+
+        for (j = 0; j < cnt; j++)
+        {
+            LookupStdFrame(ls, base, (FIELDINDEXENTRY *) (buf + j * irb), f);
+            if (frame < start + f->Frames)
+            {
+                f->Start = start;
+                *entry = i + j;
+                return(0);
+            }
+            start += f->Frames;
+        }
+    }
+
+    return(-1);
+}
+
+
+// Go back from entry of ix## chunk number chunk, which holds the chunk in
+// f, to the nearest key frame, and fill in f with that.  Returns 0 on
+// success or -1 if there is none.
+
+static int LookupStdKey(AVILOOKUP *lk, LOOKUPSTREAM *ls, DWORD chunk, DWORD entry,
+                        AVIFRAME *f)
+{
+    BYTE buf[LOOKUP_BATCH * sizeof(FIELDINDEXENTRY)];
+    QWORD pos, base, start = f->Start;
+    DWORD irb, count, cnt, j;
+
+    for (;;)
+    {
+        pos = LookupStdHeader(lk, ls->SuperPos[chunk], &base, &irb, &count);
+        if (pos == 0) return(-1);
+        if (entry > count) entry = count;
+
+        while (entry)
+        {
+            cnt = (entry > LOOKUP_BATCH) ? LOOKUP_BATCH : entry;
+            entry -= cnt;
+            if (File64ReadAt(lk->in, pos + (QWORD) entry * irb, buf, cnt * irb) != cnt * irb)
+                return(-1);
+
+            for (j = cnt; j-- > 0; )
+            {
+                LookupStdFrame(ls, base, (FIELDINDEXENTRY *) (buf + j * irb), f);
+                start -= f->Frames;
+                f->Start = start;
+                if (f->KeyFrame) return(0);
+            }
+        }
+
+        if (chunk-- == 0) return(-1);
+        entry = 0xFFFFFFFFUL;       // from the end of the one before
+    }
+}
+
+
+// Fill in f from the idx1 entry ie of a chunk of ls.
+
+static void LookupIdx1Frame(AVILOOKUP *lk, LOOKUPSTREAM *ls, AVIINDEXENTRY *ie, AVIFRAME *f)
+{
+    f->Pos = lk->Idx1Base + ie->dwChunkOffset + 8;
+    f->Size = ie->dwChunkLength;
+    f->KeyFrame = (ie->dwFlags & AVIIF_KEYFRAME) != 0;
+    f->Frames = ls->Idx1Start ? ie->dwChunkLength / ls->Strh.SampleSize : 1;
+    f->Source = INDEX_IDX1;
+}
+
+
+// Go back from the chunk numbered entry of ls in idx1 to the nearest key
+// frame, and fill in f with that.  The entries in between are read in
+// blocks of idx1, rather than one at a time.  Returns 0 on success or -1
+// if there is none.
+
+static int LookupIdx1Key(AVILOOKUP *lk, LOOKUPSTREAM *ls, DWORD entry, AVIFRAME *f)
+{
+    AVIINDEXENTRY buf[LOOKUP_BATCH];
+    DWORD first, last, cnt;
+
+    while (entry)
+    {
+        // the block ends with the entry before this one
+
+        last = ls->Idx1Num[entry - 1];
+        first = (last >= LOOKUP_BATCH - 1) ? last - (LOOKUP_BATCH - 1) : 0;
+        cnt = last - first + 1;
+        if (File64ReadAt(lk->in, lk->Idx1Pos + (QWORD) first * sizeof(AVIINDEXENTRY),
+                         buf, cnt * sizeof(AVIINDEXENTRY)) != cnt * sizeof(AVIINDEXENTRY))
+            return(-1);
+
+        while (entry && ls->Idx1Num[entry - 1] >= first)
+        {
+            entry--;
+            LookupIdx1Frame(lk, ls, buf + (ls->Idx1Num[entry] - first), f);
+            f->Start = ls->Idx1Start ? ls->Idx1Start[entry] : entry;
+            if (f->KeyFrame) return(0);
+        }
+    }
+
+    return(-1);
+}
+
+
+// Go back from entry number entry of the store of ls to the nearest key
+// frame, and fill in f with that.  Returns 0 on success or -1 if there is
+// none.
+
+static int LookupStoreKey(AVILOOKUP *lk, LOOKUPSTREAM *ls, DWORD entry, AVIFRAME *f)
+{
+    AVIFRAME buf[IXSTORE_BLOCK];
+    DWORD cnt, j;
+
+    while (entry)
+    {
+        cnt = (entry > IXSTORE_BLOCK) ? IXSTORE_BLOCK : entry;
+        entry -= cnt;
+        IxStoreRead(&ls->Store, entry, cnt, buf);
+        for (j = cnt; j-- > 0; )
+        {
+            if (!buf[j].KeyFrame) continue;
+            *f = buf[j];
+            f->Source = lk->HaveSuper ? INDEX_ODML : INDEX_IDX1;
+            return(0);
+        }
+    }
+
+    return(-1);
+}
+
+
+// Find frame of ls, filling in f and where it was found: the ix## chunk
+// number and its entry, or the number of the stream's entry in idx1 or
+// the store.
+// Returns 0 on success or -1 if there is no such frame.
+
+static int LookupFind(AVILOOKUP *lk, LOOKUPSTREAM *ls, QWORD frame, AVIFRAME *f,
+                      DWORD *chunk, DWORD *entry)
+{
+    AVIINDEXENTRY ie;
+    DWORD i;
+
+    memset(f, 0, sizeof(AVIFRAME));
+    if (frame >= ls->Frames) return(-1);
+
+    if (ls->HasStore)
+    {
+        *entry = IxStoreFind(&ls->Store, frame);
+        if (*entry == IXSTORE_NONE || IxStoreGet(&ls->Store, *entry, f)) return(-1);
+        f->Source = lk->HaveSuper ? INDEX_ODML : INDEX_IDX1;
+        return(0);
+    }
+
+    if (ls->SuperCount)
+    {
+        *chunk = LookupSearch(ls->SuperStart, ls->SuperCount, frame);
+        return(LookupStd(lk, ls, *chunk, frame, f, entry));
+    }
+
+    if (ls->Count == 0) return(-1);
+    if (ls->Idx1Start)
+        i = LookupSearch(ls->Idx1Start, ls->Count, frame);
+    else
+        i = (DWORD) frame;
+
+    if (File64ReadAt(lk->in, lk->Idx1Pos + (QWORD) ls->Idx1Num[i] * sizeof(AVIINDEXENTRY),
+                     &ie, sizeof(AVIINDEXENTRY)) != sizeof(AVIINDEXENTRY))
+        return(-1);
+    LookupIdx1Frame(lk, ls, &ie, f);
+    f->Start = ls->Idx1Start ? ls->Idx1Start[i] : i;
+    *entry = i;
+
+    return(0);
+}
+
+
+// Find frame of stream, filling in f.  At most the header and the one
+// entry of a single ix## chunk are read, or one idx1 entry, except for
+// streams with a sample size, where the ix## chunk is searched.  Nothing
+// is read for a stream whose entries are in a store.
+// Returns 0 on success or -1 if there is no such frame.
+
+int AviLookupFrame(AVILOOKUP *lk, int stream, QWORD frame, AVIFRAME *f)
+{
+    DWORD chunk, entry;
+
+    memset(f, 0, sizeof(AVIFRAME));
+    if (stream < 0 || stream >= MAX_STREAMS || lk->Stream[stream] == NULL) return(-1);
+
+    return(LookupFind(lk, lk->Stream[stream], frame, f, &chunk, &entry));
+}
+
+
+// Find the nearest key frame of stream at or before frame, filling in f.
+// Returns 0 on success or -1 if there is no such frame or no key frame
+// before it.
+
+int AviLookupKeyFrame(AVILOOKUP *lk, int stream, QWORD frame, AVIFRAME *f)
+{
+    LOOKUPSTREAM *ls;
+    DWORD chunk, entry;
+
+    memset(f, 0, sizeof(AVIFRAME));
+    if (stream < 0 || stream >= MAX_STREAMS || (ls = lk->Stream[stream]) == NULL)
+        return(-1);
+
+    // the map gives the key frame straight off
+
+    if (ls->HasKeys)
+    {
+        if (frame >= ls->Frames) return(-1);
+        frame = KeyMapPrev(&ls->Keys, (DWORD) frame);
+        if (frame == KEYMAP_NONE) return(-1);
+        return(LookupFind(lk, ls, frame, f, &chunk, &entry));
+    }
+
+    if (LookupFind(lk, ls, frame, f, &chunk, &entry)) return(-1);
+    if (f->KeyFrame) return(0);
+
+    if (ls->HasStore)
+        return(LookupStoreKey(lk, ls, entry, f));
+    if (ls->SuperCount)
+        return(LookupStdKey(lk, ls, chunk, entry, f));
+    return(LookupIdx1Key(lk, ls, entry, f));
+}
+
+
+// Return the bytes of memory taken by lk, with its maps and stores.
+
+size_t AviLookupBytes(AVILOOKUP *lk)
+{
+    LOOKUPSTREAM *ls;
+    size_t bytes = sizeof(AVILOOKUP);
+    int i;
+
+    for (i = 0; i < MAX_STREAMS; i++)
+    {
+        if ((ls = lk->Stream[i]) == NULL) continue;
+        bytes += sizeof(LOOKUPSTREAM) + ls->SuperAlloc * 2 * sizeof(QWORD) +
+                 ls->Alloc * (sizeof(DWORD) + (ls->Idx1Start ? sizeof(QWORD) : 0)) +
+                 KeyMapBytes(&ls->Keys);
+        if (ls->HasStore) bytes += IxStoreBytes(&ls->Store) - sizeof(IXSTORE);
+    }
+
+    return(bytes);
+}
+
+
+// Fill in g with the GOP of stream that frame is in, from the key frame
+// map.  Returns 0 on success or -1 if there is no map for stream, or
+// frame is not in it.
+
+int AviLookupGop(AVILOOKUP *lk, int stream, QWORD frame, AVIGOP *g)
+{
+    LOOKUPSTREAM *ls;
+    DWORD key, next;
+
+    memset(g, 0, sizeof(AVIGOP));
+    if (stream < 0 || stream >= MAX_STREAMS || (ls = lk->Stream[stream]) == NULL ||
+        !ls->HasKeys || frame >= ls->Frames)
+        return(-1);
+
+    g->Keys = ls->Keys.Ones;
+    g->KeyNum = KeyMapRank(&ls->Keys, (DWORD) frame + 1);
+    if (g->KeyNum == 0)
+    {
+        g->Key = KEYMAP_NONE;      // before the first key frame
+        next = KeyMapSelect(&ls->Keys, 0);
+        g->Next = (next == KEYMAP_NONE) ? ls->Frames : next;
+        return(0);
+    }
+
+    key = KeyMapSelect(&ls->Keys, --g->KeyNum);
+    next = KeyMapSelect(&ls->Keys, g->KeyNum + 1);
+    g->Key = key;
+    g->Next = (next == KEYMAP_NONE) ? ls->Frames : next;
+    g->Length = g->Next - key;
+
+    return(0);
+}
+
+
+// Count the key frames of stream from frame first to last, from the key
+// frame map.  Returns the count, or KEYMAP_NONE if there is no map for
+// stream.
+
+DWORD AviLookupKeyCount(AVILOOKUP *lk, int stream, QWORD first, QWORD last)
+{
+    LOOKUPSTREAM *ls;
+
+    if (stream < 0 || stream >= MAX_STREAMS || (ls = lk->Stream[stream]) == NULL ||
+        !ls->HasKeys)
+        return(KEYMAP_NONE);
+    if (first > last || first >= ls->Frames) return(0);
+    if (last >= ls->Frames) last = ls->Frames - 1;
+
+    return(KeyMapRank(&ls->Keys, (DWORD) last + 1) - KeyMapRank(&ls->Keys, (DWORD) first));
+}
+
+
+// Convert between the frames of stream, counted from the start of the
+// stream, and milliseconds from the start of the file.
+
+QWORD AviLookupFrameToMs(AVIStreamHeader56 *sh, QWORD frame)
+{
+    if (sh->Rate == 0) return(0);
+
+    return((frame + sh->StartTime) * sh->TimeScale * 1000 / sh->Rate);
+}
+
+
+QWORD AviLookupMsToFrame(AVIStreamHeader56 *sh, QWORD ms)
+{
+    QWORD tick;
+
+    if (sh->TimeScale == 0) return(0);
+    tick = ms * sh->Rate / ((QWORD) sh->TimeScale * 1000);
+
+    return((tick > sh->StartTime) ? tick - sh->StartTime : 0);
+}
+
+
+// Find where to start playing stream from at ms milliseconds into the
+// file: the nearest key frame at or before then, and the chunk of the
+// first audio stream, other than stream, that plays at the same time as
+// the key frame.  sk->AudioStream is -1 if there is no audio stream, or
+// its chunk could not be found.  Returns 0 on success or -1 if no key
+// frame was found.
+
+int AviLookupSeek(AVILOOKUP *lk, int stream, QWORD ms, AVISEEK *sk)
+{
+    AVIStreamHeader56 *sh, *ah;
+    QWORD frame;
+    int i;
+
+    memset(sk, 0, sizeof(AVISEEK));
+    sk->AudioStream = -1;
+
+    sh = AviLookupStrh(lk, stream);
+    if (sh == NULL || sh->Rate == 0) return(-1);
+
+    frame = AviLookupMsToFrame(sh, ms);
+    if (frame >= lk->Stream[stream]->Frames && lk->Stream[stream]->Frames)
+        frame = lk->Stream[stream]->Frames - 1;     // past the end, so the last one
+    if (AviLookupKeyFrame(lk, stream, frame, &sk->Key)) return(-1);
+    sk->KeyMs = AviLookupFrameToMs(sh, sk->Key.Start);
+
+    for (i = 0; i < lk->Streams; i++)
+    {
+        ah = AviLookupStrh(lk, i);
+        if (i == stream || ah == NULL || ah->fccType != MKFCC('a','u','d','s')) continue;
+        if (ah->TimeScale == 0) break;
+
+        // audio after its end is taken from its last chunk
+
+        frame = (QWORD) (sk->Key.Start + sh->StartTime) * sh->TimeScale * ah->Rate /
+                ((QWORD) sh->Rate * ah->TimeScale);
+        frame = (frame > ah->StartTime) ? frame - ah->StartTime : 0;
+        if (frame >= lk->Stream[i]->Frames && lk->Stream[i]->Frames)
+            frame = lk->Stream[i]->Frames - 1;
+        if (AviLookupFrame(lk, i, frame, &sk->Audio) == 0)
+        {
+            sk->AudioStream = i;
+            sk->AudioSample = frame;
+        }
+        break;
+    }
+
+    return(0);
+}
+
+
+// Read an unsigned decimal number from *s and move *s past it.
+// Returns FALSE if there is no number there.
+
+static int LookupNumber(char **s, QWORD *val)
+{
+    char *p = *s;
+
+    *val = 0;
+    while (*p >= '0' && *p <= '9')
+        *val = *val * 10 + (*p++ - '0');
+    if (p == *s) return(FALSE);
+    *s = p;
+
+    return(TRUE);
+}
+
+
+static void FrameLine(OUTBUF *out, char *label, QWORD val)
+{
+    OutPrintf(out, "%16s: ", label);
+    OutQDec(out, val);
+    OutChar(out, '\n');
+}
+
+
+// Report where the chunk in f is.
+
+static void FrameWhere(OUTBUF *out, AVIFRAME *f, char *prefix)
+{
+    char label[24];
+
+    sprintf(label, "%sOffset", prefix);
+    OutPrintf(out, "%16s: 0x", label);
+    OutHex64(out, f->Pos);
+    OutChar(out, '\n');
+    sprintf(label, "%sSize", prefix);
+    FrameLine(out, label, f->Size);
+}
+
+
+// Look up the frame given in ctx->Query as "stream:frame" and report
+// where it is.  Returns 0 if it was found, 1 if not, or -1 if the file
+// could not be read.
+
+int FrameReport(AVICTX *ctx)
+{
+    AVILOOKUP *lk;
+    AVIStreamHeader56 *sh;
+    AVIFRAME f;
+    OUTBUF *out = ctx->out;
+    QWORD stream, frame;
+    char *p = ctx->Query;
+
+    if (p == NULL || !LookupNumber(&p, &stream) || *p++ != ':' ||
+        !LookupNumber(&p, &frame) || *p || stream >= MAX_STREAMS)
+    {
+        OutPrintf(out, "*** Frame must be given as <stream>:<frame> ***\n");
+        return(-1);
+    }
+
+    lk = AviLookupOpen(ctx->in, 0);
+    if (lk == NULL)
+    {
+        OutPrintf(out, "*** No stream headers found, or out of memory ***\n");
+        return(-1);
+    }
+
+    OutPrintf(out, "Frame lookup\n");
+    OutPrintf(out, "%16s: %02X", "Stream", (int) stream);
+    sh = AviLookupStrh(lk, (int) stream);
+    if (sh) OutPrintf(out, " (%.4s)", (char *) &sh->fccType);
+    OutChar(out, '\n');
+    FrameLine(out, "Frame", frame);
+
+    if (AviLookupFrame(lk, (int) stream, frame, &f))
+    {
+        OutPrintf(out, "*** There is no such frame in the index ***\n");
+        AviLookupClose(lk);
+        return(1);
+    }
+
+    FrameWhere(out, &f, "");
+    OutPrintf(out, "%16s: %s\n", "Key Frame", f.KeyFrame ? "Yes" : "No");
+    if (f.Frames != 1)
+    {
+        FrameLine(out, "Chunk Start", f.Start);
+        FrameLine(out, "Chunk Frames", f.Frames);
+    }
+    OutPrintf(out, "%16s: %s\n", "Index", f.Source == INDEX_ODML ? "Open-DML" : "idx1");
+
+    AviLookupClose(lk);
+
+    return(0);
+}
+
+
+// Look up the time given in ctx->Query as "stream:seconds" and report
+// the key frame to start from and the audio chunk to go with it.
+// Returns 0 if it was found, 1 if not, or -1 if the file could not be
+// read.
+
+int SeekReport(AVICTX *ctx)
+{
+    AVILOOKUP *lk;
+    AVISEEK sk;
+    OUTBUF *out = ctx->out;
+    QWORD stream, secs, ms = 0, scale = 100;
+    char *p = ctx->Query;
+
+    if (p == NULL || !LookupNumber(&p, &stream) || *p++ != ':' ||
+        !LookupNumber(&p, &secs) || stream >= MAX_STREAMS)
+        p = NULL;
+    else if (*p == '.')     // milliseconds, any more digits are ignored
+    {
+        for (p++; *p >= '0' && *p <= '9'; p++, scale /= 10)
+            ms += (*p - '0') * scale;
+    }
+    if (p == NULL || *p)
+    {
+        OutPrintf(out, "*** Time must be given as <stream>:<seconds> ***\n");
+        return(-1);
+    }
+    ms += secs * 1000;
+
+    lk = AviLookupOpen(ctx->in, 0);
+    if (lk == NULL)
+    {
+        OutPrintf(out, "*** No stream headers found, or out of memory ***\n");
+        return(-1);
+    }
+
+    OutPrintf(out, "Seek\n");
+    OutPrintf(out, "%16s: %02X\n", "Stream", (int) stream);
+    FrameLine(out, "Time (ms)", ms);
+
+    if (AviLookupSeek(lk, (int) stream, ms, &sk))
+    {
+        OutPrintf(out, "*** No key frame found at or before then ***\n");
+        AviLookupClose(lk);
+        return(1);
+    }
+
+    FrameLine(out, "Key Frame", sk.Key.Start);
+    FrameLine(out, "Key Time (ms)", sk.KeyMs);
+    FrameWhere(out, &sk.Key, "");
+    if (sk.AudioStream >= 0)
+    {
+        OutPrintf(out, "%16s: %02X\n", "Audio Stream", sk.AudioStream);
+        FrameLine(out, "Audio Sample", sk.AudioSample);
+        FrameWhere(out, &sk.Audio, "Audio ");
+        FrameLine(out, "Chunk Start", sk.Audio.Start);
+    }
+    OutPrintf(out, "%16s: %s\n", "Index", sk.Key.Source == INDEX_ODML ? "Open-DML" : "idx1");
+
+    AviLookupClose(lk);
+
+    return(0);
+}
+
+
+// Report the GOP of the frame given in ctx->Query as "stream:frame", or
+// count the key frames in "stream:first-last".  Returns 0 on success, 1
+// if there is no key frame map for the stream, or -1 if the file could
+// not be read.
+
+int GopReport(AVICTX *ctx)
+{
+    AVILOOKUP *lk;
+    AVIGOP g;
+    OUTBUF *out = ctx->out;
+    QWORD stream, first, last;
+    DWORD keys;
+    char *p = ctx->Query;
+
+    if (p == NULL || !LookupNumber(&p, &stream) || *p++ != ':' ||
+        !LookupNumber(&p, &first) || stream >= MAX_STREAMS)
+        p = NULL;
+    else if (*p == '-')
+    {
+        p++;
+        if (!LookupNumber(&p, &last)) p = NULL;
+    }
+    else last = first;
+    if (p == NULL || *p)
+    {
+        OutPrintf(out, "*** Frames must be given as <stream>:<frame>[-<frame>] ***\n");
+        return(-1);
+    }
+
+    lk = AviLookupOpen(ctx->in, LOOKUP_KEYS);
+    if (lk == NULL)
+    {
+        OutPrintf(out, "*** No stream headers found, or out of memory ***\n");
+        return(-1);
+    }
+
+    OutPrintf(out, "Key frames\n");
+    OutPrintf(out, "%16s: %02X\n", "Stream", (int) stream);
+
+    keys = AviLookupKeyCount(lk, (int) stream, first, last);
+    if (keys == KEYMAP_NONE || AviLookupGop(lk, (int) stream, first, &g))
+    {
+        OutPrintf(out, "*** No key frames known for this frame of the stream ***\n");
+        AviLookupClose(lk);
+        return(1);
+    }
+
+    FrameLine(out, "Key Frames", g.Keys);
+    if (first != last)
+    {
+        OutPrintf(out, "%16s: ", "Frames");
+        OutQDec(out, first);
+        OutChar(out, '-');
+        OutQDec(out, last);
+        OutChar(out, '\n');
+        FrameLine(out, "In Range", keys);
+    }
+    else
+    {
+        FrameLine(out, "Frame", first);
+        if (g.Key == KEYMAP_NONE)
+            OutPrintf(out, "%16s: none before it\n", "Key Frame");
+        else
+        {
+            FrameLine(out, "Key Frame", g.Key);
+            FrameLine(out, "Key Frame Number", g.KeyNum);
+            FrameLine(out, "GOP Length", g.Length);
+        }
+        if (g.Key == KEYMAP_NONE ? g.Keys == 0 : g.KeyNum + 1 >= g.Keys)
+            OutPrintf(out, "%16s: none after it\n", "Next Key Frame");
+        else
+            FrameLine(out, "Next Key Frame", g.Next);
+    }
+
+    AviLookupClose(lk);
+
+    return(0);
+}
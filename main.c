@@ -0,0 +1,337 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+Command line front end.  Everything that reads AVI files is in the
+library (librdavi2), so that other programs can link it too.  This file
+only sorts out the command line and hands the work to it.
+
+*/
+
+#include "rdavi2.h"
+
+
+// Read a number for the --max options, which may end in K, M or G for
+// that many kilobytes, megabytes or gigabytes.
+
+static QWORD ParseCount(char *s)
+{
+    QWORD val = 0;
+
+    while (*s >= '0' && *s <= '9')
+        val = val * 10 + (*s++ - '0');
+
+    switch (toupper(*s))
+    {
+        case 'G': val <<= 10;   // fall through
+        case 'M': val <<= 10;   // fall through
+        case 'K': val <<= 10;
+    }
+
+    return(val);
+}
+
+
+// Show how to run the program, then quit.
+
+static void Usage(void)
+{
+    printf("Usage: rdavi2 [options] <filename> [<filename> ...]\n\n"
+           "A filename may also be a directory, in which case every .avi\n"
+           "file in it is read.  When more than one file is read, each\n"
+           "report starts with the name of the file.\n\n"
+           "Options:\n"
+           "  -c <dir>        Keep the chunk trees of the files read in dir,\n"
+           "                  and use them instead of reading a file again if\n"
+           "                  it has not changed.  Only used by --json.\n"
+           "  -f              Show every index entry and movi chunk, and the\n"
+           "                  whole of hex dumps, not only the first 16.\n"
+           "  -l <listfile>   Also read the files named in listfile, one per\n"
+           "                  line.  Use - to read the names from stdin.\n"
+           "  -r              After damage, look for the next chunk that makes\n"
+           "                  sense and carry on from there, rather than stop.\n"
+           "  -s              Read the RIFF segments of an Open-DML file at\n"
+           "                  the same time, instead of whole files.\n"
+           "  -t <threads>    Number of files or segments to read at once.\n"
+           "                  The default is one per CPU.\n"
+           "  --audit <file>  Write the CRC-32C of the data of every chunk to\n"
+           "                  the manifest file, using -t threads.\n"
+           "  --audit-check <file>\n"
+           "                  Check the chunks against the manifest file.\n"
+           "                  In either, * is the name of the AVI file.\n"
+           "  --demux <s>:<file>\n"
+           "                  Write the data of every chunk of stream s to\n"
+           "                  file.  In file, * is the name of the AVI file\n"
+           "                  and #### the chunk number, for a file each.\n"
+           "  --frame <s>:<n> Find frame n of stream s from the index, and show\n"
+           "                  where it is, its size and if it is a key frame.\n"
+           "                  Audio frames are samples.\n"
+           "  --gop <s>:<n>   Find the key frames of stream s either side of\n"
+           "                  frame n, or count those from frame n to m when\n"
+           "                  given as <s>:<n>-<m>.\n"
+           "  --json          Write the chunk tree as JSON, one document per\n"
+           "                  file, with the headers and index entries decoded.\n"
+           "  --max-bytes <n> Stop the chunk listing or JSON after reading n\n"
+           "                  bytes of a file.  n may end in K, M or G.\n"
+           "  --max-chunks <n>\n"
+           "                  Stop after n chunks.\n"
+           "  --max-depth <n> Stop at a chunk inside more than n lists.\n"
+           "  --max-time <s>  Stop after s seconds on one file.\n"
+           "  --repair <out>  Rebuild idx1 and the Open-DML indexes from the\n"
+           "                  movi list, leaving out anything torn off the\n"
+           "                  end, and write the repaired file to out.\n"
+           "  --repair-in-place\n"
+           "                  The same, but add the indexes to the file\n"
+           "                  itself.  Needs room for the super indexes if\n"
+           "                  there is more than one RIFF.\n"
+           "  --seek <s>:<t>  Find the key frame of stream s to start playing\n"
+           "                  from at t seconds, such as 12.5, and the audio\n"
+           "                  chunk that plays with it.\n"
+           "  --summary       Count the chunks, bytes and key frames of each\n"
+           "                  stream from the index alone, without reading\n"
+           "                  the movi list.\n"
+           "  --stats         The same with statistics for every stream: chunk\n"
+           "                  sizes, key frame spacing and data rates.\n"
+           "  --verify        Check idx1 and the Open-DML indexes against the\n"
+           "                  chunks that are really in the movi list.\n\n");
+    exit(0);
+}
+
+
+int main(int argc, char *argv[])
+{
+    FILE64 *in;
+    FILE *lf;
+    AVICTX ctx;
+    NAMELIST nl;
+    AVILIMITS lim;
+    int i, threads = 0, batch = FALSE, rc = 0, modes = 0;
+    DWORD flags = 0;
+    char *cachedir = NULL, *query = NULL;
+
+    // The banner would spoil the JSON, so look for --json first.
+
+    for (i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--json") == 0) flags |= AVI_JSON;
+
+    if (!(flags & AVI_JSON)) printf("\n"
+           "Display the contents and file structure of an AVI file.\n"
+           "This program will work on most AVI files including Open-DML\n"
+#if defined(NO_HUGE_FILES)
+             "files that are less than 2GB.\n\n"
+#else
+             "files that are bigger than 4GB.\n\n"
+#endif
+           "RdAvi2 - RIFF AVI 2 Format Reader (April 18, 2024) By Dennis Hawkins\n"
+           "Version 1.01 released on July 23, 2024.\n"
+           "Based on readavi by Michael Kohn (http://www.mikekohn.net)\n"
+           "Copyright 2024 by Dennis Hawkins, BSD License applies.\n\n");
+
+    memset(&nl, 0, sizeof(NAMELIST));
+    memset(&lim, 0, sizeof(AVILIMITS));
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+        {
+            i++;
+            lf = strcmp(argv[i], "-") ? fopen(argv[i], "r") : stdin;
+            if (lf == NULL)
+            {
+                printf("Could not open %s for input\n", argv[i]);
+                exit(1);
+            }
+            if (NameListRead(&nl, lf)) printf("*** Out of memory ***\n");
+            if (lf != stdin) fclose(lf);
+            batch = TRUE;
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            cachedir = argv[++i];
+        }
+        else if (strcmp(argv[i], "-s") == 0)
+        {
+            flags |= AVI_SEGMENTS;
+        }
+        else if (strcmp(argv[i], "-f") == 0)
+        {
+            flags |= AVI_FULLDUMP;
+        }
+        else if (strcmp(argv[i], "-r") == 0)
+        {
+            flags |= AVI_RESYNC;
+        }
+        else if (strcmp(argv[i], "--summary") == 0)
+        {
+            flags |= AVI_SUMMARY;
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            flags |= AVI_SUMMARY | AVI_STATS;
+        }
+        else if (strcmp(argv[i], "--verify") == 0)
+        {
+            flags |= AVI_VERIFY;
+        }
+        else if (strcmp(argv[i], "--frame") == 0 && i + 1 < argc)
+        {
+            modes++;
+            flags |= AVI_FRAME;
+            query = argv[++i];
+        }
+        else if (strcmp(argv[i], "--seek") == 0 && i + 1 < argc)
+        {
+            modes++;
+            flags |= AVI_SEEK;
+            query = argv[++i];
+        }
+        else if (strcmp(argv[i], "--gop") == 0 && i + 1 < argc)
+        {
+            modes++;
+            flags |= AVI_GOP;
+            query = argv[++i];
+        }
+        else if (strcmp(argv[i], "--repair") == 0 && i + 1 < argc)
+        {
+            modes++;
+            flags |= AVI_REPAIR;
+            query = argv[++i];
+        }
+        else if (strcmp(argv[i], "--repair-in-place") == 0)
+        {
+            modes++;
+            flags |= AVI_REPAIR;
+            query = NULL;
+        }
+        else if (strcmp(argv[i], "--demux") == 0 && i + 1 < argc)
+        {
+            modes++;
+            flags |= AVI_DEMUX;
+            query = argv[++i];
+        }
+        else if (strcmp(argv[i], "--audit") == 0 && i + 1 < argc)
+        {
+            modes++;
+            flags |= AVI_AUDIT;
+            query = argv[++i];
+        }
+        else if (strcmp(argv[i], "--audit-check") == 0 && i + 1 < argc)
+        {
+            modes++;
+            flags |= AVI_CHECK;
+            query = argv[++i];
+        }
+        else if (strcmp(argv[i], "--json") == 0)
+        {
+            // already seen
+        }
+        else if (strcmp(argv[i], "--max-bytes") == 0 && i + 1 < argc)
+        {
+            lim.MaxBytes = ParseCount(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-chunks") == 0 && i + 1 < argc)
+        {
+            lim.MaxChunks = (DWORD) ParseCount(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc)
+        {
+            lim.MaxDepth = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-time") == 0 && i + 1 < argc)
+        {
+            lim.MaxSeconds = (DWORD) ParseCount(argv[++i]);
+        }
+        else if (argv[i][0] == '-' && argv[i][1])
+        {
+            Usage();
+        }
+        else
+        {
+            if (nl.Count) batch = TRUE;
+            rc = NameListAdd(&nl, argv[i]);
+            if (rc < 0) printf("*** Out of memory ***\n");
+            if (rc) batch = TRUE;      // a directory
+        }
+    }
+
+    if (nl.Count == 0 && !batch) Usage();
+
+    // They all share ctx->Query, so only one can be done at a time.
+
+    if (modes > 1)
+    {
+        printf("Only one of --frame, --seek, --gop, --repair, --repair-in-place,\n"
+               "--demux, --audit and --audit-check can be given\n");
+        exit(1);
+    }
+
+    if ((flags & AVI_REPAIR) && query && batch)
+    {
+        printf("--repair writes one file, use --repair-in-place for more\n");
+        exit(1);
+    }
+
+    if ((flags & (AVI_DEMUX | AVI_AUDIT | AVI_CHECK)) && batch && query &&
+        strchr(query, '*') == NULL)
+    {
+        printf("The file name needs a * in it for more than one AVI file\n");
+        exit(1);
+    }
+
+    if (batch)
+    {
+        rc = BatchRun(&nl, threads, flags, cachedir, query, &lim);
+        NameListFree(&nl);
+        return(rc);
+    }
+
+    in = File64Open(nl.Name[0], "rb");
+    if (in == 0)
+    {
+        if (flags & AVI_JSON)
+            JsonFileError(stdout, nl.Name[0], "Could not open");
+        else
+            printf("Could not open %s for input\n", nl.Name[0]);
+        exit(1);
+    }
+
+    AviInitContext(&ctx, in, stdout, flags);
+    ctx.Name = nl.Name[0];
+    ctx.CacheDir = cachedir;
+    ctx.Query = query;
+    ctx.Threads = threads;
+    ctx.Limits = lim;
+    if (flags & AVI_SEGMENTS)
+        AviParseSegments(&ctx, nl.Name[0], threads);
+    else
+        AviParse(&ctx);
+
+    AviFreeContext(&ctx);
+    File64Close(in);
+    NameListFree(&nl);
+
+    return 0;
+}
+
+
+
@@ -0,0 +1,336 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+Buffered report output.  Reports can run to millions of lines when whole
+indexes are shown, and printf() spends most of its time working out the
+format string rather than writing.  Everything here is written into one
+large buffer that goes out in big fwrite() calls, and numbers are
+converted with simple table lookups.
+
+OutPrintf() takes the same format strings that were used with fprintf(),
+but only understands what this program uses: %d %u %x %X %c %s and %%,
+with the '-' and '0' flags, a field width, and a precision for %s.
+The busiest lines skip the format string and call OutStr(), OutDec() and
+OutHex() directly.
+
+*/
+
+#include "rdavi2.h"
+#include <stdarg.h>
+
+#define OUT_BUFSIZE     0x00040000      // 256K
+
+
+static char Digits[] = "0123456789ABCDEF0123456789abcdef";
+
+static char DecPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+
+// Set up an output buffer that will be written to fp.  If there is not
+// enough memory for the buffer, everything is written straight to fp.
+
+void OutInit(OUTBUF *ob, FILE *fp)
+{
+    ob->fp = fp;
+    ob->Len = 0;
+    ob->Buf = (char *) malloc(OUT_BUFSIZE);
+    ob->Size = ob->Buf ? OUT_BUFSIZE : 0;
+}
+
+
+// Write out whatever is in the buffer.
+
+void OutFlush(OUTBUF *ob)
+{
+    if (ob->Len)
+        fwrite(ob->Buf, 1, ob->Len, ob->fp);
+    ob->Len = 0;
+}
+
+
+// Flush the buffer and free it.  The stream is not closed.
+
+void OutClose(OUTBUF *ob)
+{
+    OutFlush(ob);
+    free(ob->Buf);
+    ob->Buf = NULL;
+    ob->Size = 0;
+}
+
+
+void OutMem(OUTBUF *ob, char *s, int len)
+{
+    if (ob->Len + len > ob->Size)
+    {
+        OutFlush(ob);
+        if ((size_t) len > ob->Size)    // too big to be worth buffering
+        {
+            fwrite(s, 1, len, ob->fp);
+            return;
+        }
+    }
+
+    memcpy(ob->Buf + ob->Len, s, len);
+    ob->Len += len;
+}
+
+
+void OutStr(OUTBUF *ob, char *s)
+{
+    OutMem(ob, s, strlen(s));
+}
+
+
+void OutChar(OUTBUF *ob, int ch)
+{
+    char c = (char) ch;
+
+    if (ob->Len < ob->Size)
+        ob->Buf[ob->Len++] = c;
+    else
+        OutMem(ob, &c, 1);
+}
+
+
+// Write len copies of ch.
+
+static void OutFill(OUTBUF *ob, int ch, int len)
+{
+    char tmp[32];
+
+    memset(tmp, ch, sizeof(tmp));
+    for ( ; len > (int) sizeof(tmp); len -= sizeof(tmp))
+        OutMem(ob, tmp, sizeof(tmp));
+    if (len > 0) OutMem(ob, tmp, len);
+}
+
+
+// Convert an unsigned number to decimal, working backwards from end, which
+// must have room for 10 digits in front of it.  Returns a pointer to the
+// first digit.
+
+static char *UDecStr(DWORD val, char *end)
+{
+    while (val >= 100)
+    {
+        end -= 2;
+        memcpy(end, DecPairs + (val % 100) * 2, 2);
+        val /= 100;
+    }
+
+    if (val >= 10)
+    {
+        end -= 2;
+        memcpy(end, DecPairs + val * 2, 2);
+    }
+    else *--end = (char) ('0' + val);
+
+    return(end);
+}
+
+
+// Same for hex.  lower is 16 for lower case digits or 0 for upper case.
+
+static char *HexStr(DWORD val, char *end, int lower)
+{
+    do
+    {
+        *--end = Digits[(val & 15) + lower];
+        val >>= 4;
+    } while (val);
+
+    return(end);
+}
+
+
+// Write a signed decimal number.
+
+void OutDec(OUTBUF *ob, LONG val)
+{
+    char num[12], *p;
+
+    if (val < 0)
+    {
+        p = UDecStr((DWORD) -val, num + sizeof(num));
+        *--p = '-';
+    }
+    else p = UDecStr((DWORD) val, num + sizeof(num));
+
+    OutMem(ob, p, num + sizeof(num) - p);
+}
+
+
+// Write digits upper case hex digits, with leading zeros.
+
+void OutHex(OUTBUF *ob, DWORD val, int digits)
+{
+    char num[8];
+    int i;
+
+    for (i = 7; i >= 0; i--, val >>= 4)
+        num[i] = Digits[val & 15];
+
+    if (digits > 8)
+    {
+        OutFill(ob, '0', digits - 8);
+        digits = 8;
+    }
+    OutMem(ob, num + 8 - digits, digits);
+}
+
+
+// Write a QWORD as 16 hex digits.
+
+void OutHex64(OUTBUF *ob, QWORD val)
+{
+    OutHex(ob, (DWORD) (val >> 32), 8);
+    OutHex(ob, (DWORD) val, 8);
+}
+
+
+// Write an unsigned 64 bit decimal number.
+
+void OutQDec(OUTBUF *ob, QWORD val)
+{
+    char num[24], *p = num + sizeof(num);
+    QWORD q;
+
+    while (val > 0xFFFFFFFFUL)
+    {
+        q = val / 10;
+        *--p = (char) ('0' + (int) (val - q * 10));
+        val = q;
+    }
+    p = UDecStr((DWORD) val, p);
+
+    OutMem(ob, p, num + sizeof(num) - p);
+}
+
+
+void OutPrintf(OUTBUF *ob, char *fmt, ...)
+{
+    va_list ap;
+    char num[12], *p, *s;
+    int left, zero, width, prec, len;
+    LONG d;
+
+    va_start(ap, fmt);
+    p = fmt;
+
+    while (*p)
+    {
+        // copy plain text up to the next %
+        for (s = p; *p && *p != '%'; p++);
+        if (p > s) OutMem(ob, s, p - s);
+        if (*p == 0) break;
+        p++;
+
+        // flags, width and precision
+        left = zero = FALSE;
+        width = 0;
+        prec = -1;
+        for ( ; *p == '-' || *p == '0'; p++)
+        {
+            if (*p == '-') left = TRUE;
+            else zero = TRUE;
+        }
+        for ( ; *p >= '0' && *p <= '9'; p++)
+            width = width * 10 + *p - '0';
+        if (*p == '.')
+        {
+            for (prec = 0, p++; *p >= '0' && *p <= '9'; p++)
+                prec = prec * 10 + *p - '0';
+        }
+        while (*p == 'l' || *p == 'h') p++;     // all ints are 32 bits
+
+        switch (*p)
+        {
+            case 'd':
+            case 'i':
+                d = va_arg(ap, LONG);
+                s = UDecStr(d < 0 ? (DWORD) -d : (DWORD) d, num + sizeof(num));
+                if (d < 0)
+                {
+                    if (zero && !left && width > 0)   // sign goes before zeros
+                    {
+                        OutChar(ob, '-');
+                        width--;
+                    }
+                    else *--s = '-';
+                }
+                len = num + sizeof(num) - s;
+                break;
+
+            case 'u':
+                s = UDecStr(va_arg(ap, DWORD), num + sizeof(num));
+                len = num + sizeof(num) - s;
+                break;
+
+            case 'x':
+            case 'X':
+                s = HexStr(va_arg(ap, DWORD), num + sizeof(num), *p == 'x' ? 16 : 0);
+                len = num + sizeof(num) - s;
+                break;
+
+            case 'c':
+                num[0] = (char) va_arg(ap, int);
+                s = num;
+                len = 1;
+                break;
+
+            case 's':
+                s = va_arg(ap, char *);
+                if (prec < 0)
+                    len = strlen(s);
+                else    // may not be null terminated, such as a FourCC
+                    for (len = 0; len < prec && s[len]; len++);
+                zero = FALSE;
+                break;
+
+            case 0:     // format ends in the middle of a conversion
+                continue;
+
+            default:    // %% and anything not understood
+                s = p;
+                len = 1;
+                zero = FALSE;
+                break;
+        }
+        p++;
+
+        if (!left && width > len) OutFill(ob, zero ? '0' : ' ', width - len);
+        OutMem(ob, s, len);
+        if (left && width > len) OutFill(ob, ' ', width - len);
+    }
+
+    va_end(ap);
+}
+
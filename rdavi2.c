@@ -1,5 +1,6 @@
 /*
-RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
 Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
 
 BSD License
@@ -23,48 +24,48 @@ used by others.
 #include "rdavi2.h"
 
 
-static DWORD G_movi_offset = 0;   // offset of the 'movi' tag
-static int Level = 0;
-static char indent[80] = {0};
 #define CHARS_PER_TAB   2
 
 
 
 // Take a numerical offset relative to the Base file address and return
-// a pointer to an ascii string representing the full 64bit file location.
+// an ascii string in tmpstr representing the full 64bit file location.
 // If the base is 0, then only the 32bit file location is returned.
 // For legacy files, this will always be 32bits.
-// Because the string is returned as a pointer to a static buffer, this
-// cannot be used more than once in a function call.
+// tmpstr must hold at least 20 chars and is also the return value.
 
-static char *GetOffsetStr(DWORD offset)
+static char *GetOffsetStr(AVICTX *ctx, DWORD offset, char *tmpstr)
 {
-    QWORD base = File64GetBase();
-    static char tmpstr[20];
+    QWORD base = File64GetBase(ctx->in);
 
     if (base)
-        strcpy(tmpstr, QWORD2HEX(base + (QWORD) offset));  // Use 64 bit base
-    else sprintf(tmpstr, "%08X", offset);    // 32 bit only
+        QWORD2HEX(base + (QWORD) offset, tmpstr);  // Use 64 bit base
+    else    // 32 bit only
+    {
+        HexDword(offset, tmpstr);
+        tmpstr[8] = 0;
+    }
 
     return(tmpstr);
 }
 
 
-// This function modifies the global string 'indent' by a making
-// a spring of (CHARS_PER_TAB X Level) number of spaces.  Level
-// is also a global.  The resulting string is used for output
-// formatting purposes.
+// Spaces for indenting.  The context's 'indent' points into the end of
+// this, so that it is (CHARS_PER_TAB X Level) spaces long.  The resulting
+// string is used for output formatting purposes.
+
+static char Spaces[] = "          " "          " "          " "          "
+                       "          " "          " "          " "        ";
 
-static char *MakeIndent(void)
+static char *MakeIndent(AVICTX *ctx)
 {
     int x;
 
-    memset(indent, ' ', sizeof(indent));
-    x = Level * CHARS_PER_TAB;
-    if (x >= sizeof(indent)) x = sizeof(indent) - 2;
-    indent[x] = 0;
+    x = ctx->Level * CHARS_PER_TAB;
+    if (x >= sizeof(Spaces) - 1) x = sizeof(Spaces) - 1;
+    ctx->indent = Spaces + sizeof(Spaces) - 1 - x;
 
-    return(indent);
+    return(ctx->indent);
 }
 
 
@@ -72,36 +73,38 @@ static char *MakeIndent(void)
 // after returning.  They will print an opening and closing bracket as
 // appropriate and adjust the nesting level.
 
-static void OpenLevel(void)
+static void OpenLevel(AVICTX *ctx)
 {
-    printf("%s{\n", indent);
-    Level++;
-    MakeIndent();
+    OutPrintf(ctx->out, "%s{\n", ctx->indent);
+    ctx->Level++;
+    MakeIndent(ctx);
 }
 
-static void CloseLevel(void)
+static void CloseLevel(AVICTX *ctx)
 {
-    Level--;
-    MakeIndent();
-    printf("%s}\n", indent);
+    ctx->Level--;
+    MakeIndent(ctx);
+    OutPrintf(ctx->out, "%s}\n", ctx->indent);
 }
 
 
 // Produce a HEX dump for an output.
 // Exactly chunk_len bytes are read and output.
 // Return 0 on success and -1 if EOF.
-// Output is suppressed after 16 lines.
+// Output is suppressed after 16 lines unless AVI_FULLDUMP is set.
 
 #define HEXSTART   (buf + 9)
 #define CHARSTART  (buf + 57)
 #define ENDNULL    73
 
-static int hex_dump_chunk(FILE *in, int chunk_len)
+static int hex_dump_chunk(AVICTX *ctx, int chunk_len)
 {
-    BYTE CharStr[17];
-    int n, i, linecnt = 0, bcnt, ret, printing = TRUE, poff;
+    FILE64 *in = ctx->in;
+    BYTE CharBuf[16], *CharStr;
+    int n, i, linecnt = 0, bcnt, printing = TRUE, poff;
     DWORD offset = File64GetPos(in);
-    char buf[80], tmpstr[32];
+    QWORD left;
+    char buf[80];
 
 /*
 00000000 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 1234567890123456
@@ -113,48 +116,62 @@ static int hex_dump_chunk(FILE *in, int chunk_len)
     for (n = 0; n < chunk_len; )
     {
         // eject the previous line
-        if (linecnt++ == 16) printing = FALSE;
+        if (linecnt++ == ctx->MaxLines)
+        {
+            printing = FALSE;
+
+            // nothing more gets printed, so skip the rest if it is there
+            left = chunk_len - n;
+            if (File64GetAbsPos(in) + left <= File64Size(in))
+            {
+                File64SetPos(in, (LONG) left, SEEK_CUR);
+                break;
+            }
+        }
 
         // start new line
         memset(buf, ' ', ENDNULL);      // clear print buffer
-        sprintf(tmpstr, "%08X ", offset & 0xFFFFFFF0);  // print address
-        memcpy(buf, tmpstr, 8);            // copy in address
+        HexDword(offset & 0xFFFFFFF0, buf);    // print address
 
         poff = (offset & 0x0000000F);
         bcnt = min(16 - poff, chunk_len - n);
         offset += bcnt;
         n += bcnt;
-        ret = File64Read(in, CharStr, bcnt);
-        if (ret != bcnt)
+        CharStr = (BYTE *) File64View(in, CharBuf, bcnt);
+        if (CharStr == NULL)
         {
-            printf("*** Unexpected EOF ***\n");
+            OutPrintf(ctx->out, "*** Unexpected EOF ***\n");
             return(-1);
         }
 
-        if (poff)    // fill in initial missing bytes
+        if (bcnt == 16)     // whole line at once
         {
-            for (i = 0; i < 16; i++)
-                memcpy(HEXSTART + i * 3, "<>", 2);
+            HexRow(CharStr, HEXSTART, CHARSTART);
         }
-
-        // add hex and char bytes to buffer
-        for (i = 0; i < bcnt; i++)
+        else
         {
-            BYTE ch = CharStr[i];
-            
-            sprintf(tmpstr, "%02X", (DWORD) ch);
-            memcpy(HEXSTART + (i + poff) * 3, tmpstr, 2);
-            CHARSTART[i + poff] = (char)
-                ((isprint(ch) && ch != 7 && ch < 128) ? ch : '.');
+            if (poff)    // fill in initial missing bytes
+            {
+                for (i = 0; i < 16; i++)
+                    memcpy(HEXSTART + i * 3, "<>", 2);
+            }
+
+            // add hex and char bytes to buffer
+            for (i = 0; i < bcnt; i++)
+                HexByte(CharStr[i], HEXSTART + (i + poff) * 3, CHARSTART + i + poff);
         }
 
         // print line
         if (printing)
-            printf("    %s\n", buf);  // print chars of previous line
+        {
+            buf[ENDNULL] = '\n';
+            OutStr(ctx->out, "    ");
+            OutMem(ctx->out, buf, ENDNULL + 1);  // print chars of previous line
+        }
     }
 
     // print anything left in buffer
-    if (!printing) printf("\n        **TRUNCATED**\n");
+    if (!printing) OutPrintf(ctx->out, "\n        **TRUNCATED**\n");
 
     return 0;
 }
@@ -162,55 +179,52 @@ static int hex_dump_chunk(FILE *in, int chunk_len)
 
 // Displays a legacy AVI index.
 // Returns 0 on success and non-zero on failure.
-// Output suppressed after 16 lines.
-
-
-#define AVIIF_LIST          0x00000001L // chunk is a 'LIST'
-#define AVIIF_KEYFRAME      0x00000010L // this frame is a key frame.
-#define AVIIF_FIRSTPART     0x00000020L // this frame is the start of a partial frame.
-#define AVIIF_LASTPART      0x00000040L // this frame is the end of a partial frame.
-#define AVIIF_NO_TIME	    0x00000100L // this frame doesn't take any time
-#define AVIIF_COMPUSE       0x0FFF0000L
+// Output suppressed after 16 lines unless AVI_FULLDUMP is set.
 
-
-static int parse_idx1(FILE *in, int chunk_len)
+static int parse_idx1(AVICTX *ctx, int chunk_len)
 {
-    AVIINDEXENTRY index_entry;
-    int t, br;
+    FILE64 *in = ctx->in;
+    AVIINDEXENTRY entrybuf, *index_entry;
+    OUTBUF *out = ctx->out;
+    int t;
     DWORD flags;
-    char buf[80];
 
-    printf("%sCkId  Flags                           Location    Length\n", indent);
-    printf("%s====  ==============================  ==========  ==========\n", indent);
+    OutPrintf(ctx->out, "%sCkId  Flags                           Location    Length\n", ctx->indent);
+    OutPrintf(ctx->out, "%s====  ==============================  ==========  ==========\n", ctx->indent);
 
     for (t = 0; t < (int)(chunk_len / sizeof(AVIINDEXENTRY)); t++)
     {
 
-        br = File64Read(in, &index_entry, sizeof(AVIINDEXENTRY));
-        if (br != sizeof(AVIINDEXENTRY))
+        index_entry = (AVIINDEXENTRY *)
+                    File64View(in, &entrybuf, sizeof(AVIINDEXENTRY));
+        if (index_entry == NULL)
         {
-            printf("*** Unexpected EOF ***\n");
+            OutPrintf(ctx->out, "*** Unexpected EOF ***\n");
             return(-1);
         }
 
-        if (t < 16)
+        if (t < ctx->MaxLines)
         {
-            buf[0] = 0;
-            printf("%s%.4s  ", indent, &index_entry.ckid);
-            flags = index_entry.dwFlags;
-            strcat(buf, (flags & AVIIF_KEYFRAME)  ? "KEYFRM " : "       ");
-            strcat(buf, (flags & AVIIF_LIST)     ? "RECLIST " : "        ");
-            strcat(buf, (flags & AVIIF_NO_TIME)  ? "NOTIME " : "       ");
-            strcat(buf, (flags & AVIIF_FIRSTPART) ? "1st " : "    ");
-            strcat(buf, (flags & AVIIF_LASTPART)  ? "LAST " : "     ");
-            printf("%s 0x%08X  0x%08X\n", buf,
-                G_movi_offset - 4 + index_entry.dwChunkOffset,
-                index_entry.dwChunkLength);
+            OutStr(out, ctx->indent);
+            OutMem(out, (char *) &index_entry->ckid, 4);
+            OutStr(out, "  ");
+            flags = index_entry->dwFlags;
+            OutStr(out, (flags & AVIIF_KEYFRAME)  ? "KEYFRM " : "       ");
+            OutStr(out, (flags & AVIIF_LIST)     ? "RECLIST " : "        ");
+            OutStr(out, (flags & AVIIF_NO_TIME)  ? "NOTIME " : "       ");
+            OutStr(out, (flags & AVIIF_FIRSTPART) ? "1st " : "    ");
+            OutStr(out, (flags & AVIIF_LASTPART)  ? "LAST " : "     ");
+            OutStr(out, " 0x");
+            OutHex(out, ctx->movi_offset - 4 + index_entry->dwChunkOffset, 8);
+            OutStr(out, "  0x");
+            OutHex(out, index_entry->dwChunkLength, 8);
+            OutChar(out, '\n');
         }
     }
 
-    if (t >= 16) printf("%s**Suppressed %d index entries**\n", indent, t - 16);
-    else printf("\n");
+    if (t >= ctx->MaxLines)
+        OutPrintf(ctx->out, "%s**Suppressed %d index entries**\n", ctx->indent, t - ctx->MaxLines);
+    else OutPrintf(ctx->out, "\n");
 
     return 0;
 }
@@ -221,19 +235,20 @@ static int parse_idx1(FILE *in, int chunk_len)
 // Read and print Main AVI Header.
 // Return 0 on success or non-zero if not.
 
-static int read_avi_header(FILE *in)
+static int read_avi_header(AVICTX *ctx)
 {
-    MainAVIHeader avi_header;
+    FILE64 *in = ctx->in;
+    MainAVIHeader hdrbuf, *avi_header;
     DWORD offset = File64GetPos(in);
-    DWORD flags, br;
+    DWORD flags;
     char flagstr[64];
 
     memset(flagstr, 0, sizeof(flagstr));
-    br = File64Read(in, &avi_header, sizeof(MainAVIHeader));
-    if (br != sizeof(MainAVIHeader)) return(-1);
+    avi_header = (MainAVIHeader *) File64View(in, &hdrbuf, sizeof(MainAVIHeader));
+    if (avi_header == NULL) return(-1);
 
     // Format flag string
-    flags = avi_header.Flags;
+    flags = avi_header->Flags;
     if (flags & AVIF_HASINDEX)       strcat(flagstr, "IDX ");    //4
     if (flags & AVIF_MUSTUSEINDEX)   strcat(flagstr, "IDXREQ "); //7
     if (flags & AVIF_ISINTERLEAVED)  strcat(flagstr, "INTLV ");  //6
@@ -242,17 +257,17 @@ static int read_avi_header(FILE *in)
     if (flags & AVIF_TRUSTCKTYPE)    strcat(flagstr, "CKOK ");   //5
     if (flags == 0) strcpy(flagstr, "No Flags");                 //9
 
-    printf("         offset=0x%lx\n", offset);
-    printf("             TimeBetweenFrames: %d\n", avi_header.MicroSecPerFrame);
-    printf("               MaximumDataRate: %d\n", avi_header.MaxBytesPerSec);
-    printf("            PaddingGranularity: %d\n", avi_header.PaddingGranularity);
-    printf("                         Flags: %08x - %s\n", avi_header.Flags, flagstr);
-    printf("           TotalNumberOfFrames: %d\n", avi_header.TotalFrames);
-    printf("         NumberOfInitialFrames: %d\n", avi_header.InitialFrames);
-    printf("               NumberOfStreams: %d\n", avi_header.NumStreams);
-    printf("           SuggestedBufferSize: %d\n", avi_header.SuggestedBufferSize);
-    printf("                         Width: %d\n", avi_header.Width);
-    printf("                        Height: %d\n", avi_header.Height);
+    OutPrintf(ctx->out, "         offset=0x%lx\n", offset);
+    OutPrintf(ctx->out, "             TimeBetweenFrames: %d\n", avi_header->MicroSecPerFrame);
+    OutPrintf(ctx->out, "               MaximumDataRate: %d\n", avi_header->MaxBytesPerSec);
+    OutPrintf(ctx->out, "            PaddingGranularity: %d\n", avi_header->PaddingGranularity);
+    OutPrintf(ctx->out, "                         Flags: %08x - %s\n", avi_header->Flags, flagstr);
+    OutPrintf(ctx->out, "           TotalNumberOfFrames: %d\n", avi_header->TotalFrames);
+    OutPrintf(ctx->out, "         NumberOfInitialFrames: %d\n", avi_header->InitialFrames);
+    OutPrintf(ctx->out, "               NumberOfStreams: %d\n", avi_header->NumStreams);
+    OutPrintf(ctx->out, "           SuggestedBufferSize: %d\n", avi_header->SuggestedBufferSize);
+    OutPrintf(ctx->out, "                         Width: %d\n", avi_header->Width);
+    OutPrintf(ctx->out, "                        Height: %d\n", avi_header->Height);
 
     return 0;
 }
@@ -263,11 +278,13 @@ static int read_avi_header(FILE *in)
 // StrType is 0 for Video and 1 for audio streams.
 // Return 0 if OK, or -1 on EOF.
 
-static int read_stream_header(FILE *in, DWORD size)
+static int read_stream_header(AVICTX *ctx, DWORD size)
 {
+    FILE64 *in = ctx->in;
     AVIStreamHeader56 stream_header;
+    AVIStreamHeader64 hdrbuf, *tHdr;
     DWORD offset = File64GetPos(in);
-    DWORD br, flags;
+    DWORD flags;
     char flagstr[32];
     SMALL_RECT r;
 
@@ -278,34 +295,33 @@ static int read_stream_header(FILE *in, DWORD size)
     memset(&stream_header, 0, sizeof(AVIStreamHeader56));
     if (size == sizeof(AVIStreamHeader48) || size == sizeof(AVIStreamHeader56))
     {
-        br = File64Read(in, &stream_header, size);
-        if (br != size)
+        tHdr = (AVIStreamHeader64 *) File64View(in, &hdrbuf, size);
+        if (tHdr == NULL)
         {
-            printf("**Unexpected End of File**\n");
+            OutPrintf(ctx->out, "**Unexpected End of File**\n");
             return(-1);
         }
+        memcpy(&stream_header, tHdr, size);
     }
     else if (size == sizeof(AVIStreamHeader64))
     {
-        AVIStreamHeader64 tHdr;
-
-        br = File64Read(in, &tHdr, sizeof(AVIStreamHeader64));
-        if (br != sizeof(AVIStreamHeader64))
+        tHdr = (AVIStreamHeader64 *) File64View(in, &hdrbuf, sizeof(AVIStreamHeader64));
+        if (tHdr == NULL)
         {
-            printf("**Unexpected End of File**\n");
+            OutPrintf(ctx->out, "**Unexpected End of File**\n");
             return(-1);
         }
 
         // convert to 56 byte version
-        memcpy(&stream_header, &tHdr, sizeof(AVIStreamHeader56));
-        stream_header.Frame.Top = (WORD) tHdr.Frame.top;
-        stream_header.Frame.Left = (WORD) tHdr.Frame.left;
-        stream_header.Frame.Bottom = (WORD) tHdr.Frame.bottom;
-        stream_header.Frame.Right = (WORD) tHdr.Frame.right;
+        memcpy(&stream_header, tHdr, sizeof(AVIStreamHeader56));
+        stream_header.Frame.Top = (WORD) tHdr->Frame.top;
+        stream_header.Frame.Left = (WORD) tHdr->Frame.left;
+        stream_header.Frame.Bottom = (WORD) tHdr->Frame.bottom;
+        stream_header.Frame.Right = (WORD) tHdr->Frame.right;
     }
     else
     {
-        printf("**Unknown structure type**\n");
+        OutPrintf(ctx->out, "**Unknown structure type**\n");
         return(-2);    // unexpected structure size
     }
 
@@ -316,31 +332,31 @@ static int read_stream_header(FILE *in, DWORD size)
     if (flags & AVISF_VIDEO_PALCHANGES) strcat(flagstr, "PALCHG");
     if (flags == 0) strcpy(flagstr, "No Flags Set");
 
-    printf("                offset=0x%lx\n", offset);
-    printf("         Stream Header Version: %.4s (%d byte) version\n",
+    OutPrintf(ctx->out, "                offset=0x%lx\n", offset);
+    OutPrintf(ctx->out, "         Stream Header Version: %.4s (%d byte) version\n",
                                   (char *)&stream_header.fccType, size);
-    printf("                   FourCC Type: %.4s\n", (char *)&stream_header.fccType);
-    if (FIX_LIT(stream_header.fccType) == 'auds')
+    OutPrintf(ctx->out, "                   FourCC Type: %.4s\n", (char *)&stream_header.fccType);
+    if (stream_header.fccType == MKFCC('a','u','d','s'))
     {
-        printf("                FourCC Handler: Not Used\n");
+        OutPrintf(ctx->out, "                FourCC Handler: Not Used\n");
     }
     else
     {
-        printf("                FourCC Handler: %.4s - %s\n",
+        OutPrintf(ctx->out, "                FourCC Handler: %.4s - %s\n",
                             (char *)&stream_header.fccHandler,
                             LookupFourCC(stream_header.fccHandler));
     }
-    printf("                         Flags: %08x - %s\n", stream_header.Flags, flagstr);
-    printf("                      Priority: %d\n", stream_header.Priority);
-    printf("                 InitialFrames: %d\n", stream_header.InitialFrames);
-    printf("                     TimeScale: %d\n", stream_header.TimeScale);
-    printf("                      DataRate: %d\n", stream_header.Rate);
-    printf("                     StartTime: %d\n", stream_header.StartTime);
-    printf("                    DataLength: %d\n", stream_header.Length);
-    printf("           SuggestedBufferSize: %d\n", stream_header.SuggestedBufferSize);
-    printf("                       Quality: %d\n", stream_header.Quality);
-    printf("                    SampleSize: %d\n", stream_header.SampleSize);
-    printf("                         Frame: { Top: %d, Left: %d, Bottom: %d, Right: %d }\n",
+    OutPrintf(ctx->out, "                         Flags: %08x - %s\n", stream_header.Flags, flagstr);
+    OutPrintf(ctx->out, "                      Priority: %d\n", stream_header.Priority);
+    OutPrintf(ctx->out, "                 InitialFrames: %d\n", stream_header.InitialFrames);
+    OutPrintf(ctx->out, "                     TimeScale: %d\n", stream_header.TimeScale);
+    OutPrintf(ctx->out, "                      DataRate: %d\n", stream_header.Rate);
+    OutPrintf(ctx->out, "                     StartTime: %d\n", stream_header.StartTime);
+    OutPrintf(ctx->out, "                    DataLength: %d\n", stream_header.Length);
+    OutPrintf(ctx->out, "           SuggestedBufferSize: %d\n", stream_header.SuggestedBufferSize);
+    OutPrintf(ctx->out, "                       Quality: %d\n", stream_header.Quality);
+    OutPrintf(ctx->out, "                    SampleSize: %d\n", stream_header.SampleSize);
+    OutPrintf(ctx->out, "                         Frame: { Top: %d, Left: %d, Bottom: %d, Right: %d }\n",
              r.Top, r.Left, r.Bottom, r.Right);
 
     return 0;
@@ -349,87 +365,95 @@ static int read_stream_header(FILE *in, DWORD size)
 
 // Read Video Stream Format
 
-static int read_stream_format_vid(FILE *in, DWORD size)
+static int read_stream_format_vid(AVICTX *ctx, DWORD size)
 {
-    STREAMFORMATVID stream_format;
-    VIDPALETTE pal[256];
+    FILE64 *in = ctx->in;
+    STREAMFORMATVID fmtbuf, stream_format;
+    VIDPALETTE palbuf[256], *pal = palbuf;
     DWORD offset = File64GetPos(in);
-    DWORD br, t;
+    DWORD t;
+    void *p;
 
     // Read structure
-    memset(pal, 0, sizeof(pal));
+    memset(palbuf, 0, sizeof(palbuf));
     if (size < sizeof(STREAMFORMATVID))
     {
-        printf("*** Unexpected short chunk ***\n");
+        OutPrintf(ctx->out, "*** Unexpected short chunk ***\n");
         return(-1);
     }
 
-    br = File64Read(in, &stream_format, sizeof(STREAMFORMATVID));
-    size -= br;
-    if (br != sizeof(STREAMFORMATVID))
+    p = File64View(in, &fmtbuf, sizeof(STREAMFORMATVID));
+    if (p == NULL)
     {
-        printf("*** Unexpected End of File ***\n");
+        OutPrintf(ctx->out, "*** Unexpected End of File ***\n");
         return(-1);
     }
+    memcpy(&stream_format, p, sizeof(STREAMFORMATVID));
+    size -= sizeof(STREAMFORMATVID);
 
     // Read Palette
     if (stream_format.biClrUsed != 0)
     {
-        // read palette but do not store
+        // look at the palette in place
         t = sizeof(VIDPALETTE) * stream_format.biClrUsed;
         if (size < t)
         {
-            printf("*** Unexpected short chunk ***\n");
+            OutPrintf(ctx->out, "*** Unexpected short chunk ***\n");
+            return(-1);
+        }
+        if (t > sizeof(palbuf))
+        {
+            OutPrintf(ctx->out, "*** Palette is too large ***\n");
             return(-1);
         }
 
-        br = File64Read(in, pal, t);
-        size -= br;
-        if (br != t)
+        pal = (VIDPALETTE *) File64View(in, palbuf, t);
+        if (pal == NULL)
         {
-            printf("**Unexpected End of File**\n");
+            OutPrintf(ctx->out, "**Unexpected End of File**\n");
             return(-1);
         }
+        size -= t;
     }
 
 
     // Print structure
-    printf("                offset=0x%lx\n", offset);
-    printf("                   header_size: %d\n", stream_format.header_size);
-    printf("                   image_width: %d\n", stream_format.biWidth);
-    printf("                  image_height: %d\n", stream_format.biHeight);
-    printf("              number_of_planes: %d\n", stream_format.biPlanes);
-    printf("                bits_per_pixel: %d\n", stream_format.bits_per_pixel);
-    printf("              compression_type: %.4s - %s\n",
+    OutPrintf(ctx->out, "                offset=0x%lx\n", offset);
+    OutPrintf(ctx->out, "                   header_size: %d\n", stream_format.header_size);
+    OutPrintf(ctx->out, "                   image_width: %d\n", stream_format.biWidth);
+    OutPrintf(ctx->out, "                  image_height: %d\n", stream_format.biHeight);
+    OutPrintf(ctx->out, "              number_of_planes: %d\n", stream_format.biPlanes);
+    OutPrintf(ctx->out, "                bits_per_pixel: %d\n", stream_format.bits_per_pixel);
+    OutPrintf(ctx->out, "              compression_type: %.4s - %s\n",
                        (char *) &stream_format.biCompression,
                        LookupFourCC(stream_format.biCompression));
-    printf("           image_size_in_bytes: %d\n", stream_format.biSizeImage);
-    printf("              x_pels_per_meter: %d\n", stream_format.biXPelsPerMeter);
-    printf("              y_pels_per_meter: %d\n", stream_format.biYPelsPerMeter);
-    printf("                   colors_used: %d\n", stream_format.biClrUsed);
-    printf("              colors_important: %d\n", stream_format.biClrImportant);
+    OutPrintf(ctx->out, "           image_size_in_bytes: %d\n", stream_format.biSizeImage);
+    OutPrintf(ctx->out, "              x_pels_per_meter: %d\n", stream_format.biXPelsPerMeter);
+    OutPrintf(ctx->out, "              y_pels_per_meter: %d\n", stream_format.biYPelsPerMeter);
+    OutPrintf(ctx->out, "                   colors_used: %d\n", stream_format.biClrUsed);
+    OutPrintf(ctx->out, "              colors_important: %d\n", stream_format.biClrImportant);
 
     // print palette
     if (stream_format.biClrUsed != 0)
     {
         int i;
 
-        printf("\n%sVideo Palette:\n%s", indent, indent);
-        printf("### RR:GG:BB    ### RR:GG:BB    ### RR:GG:BB    ### RR:GG:BB\n");
+        OutPrintf(ctx->out, "\n%sVideo Palette:\n%s", ctx->indent, ctx->indent);
+        OutPrintf(ctx->out, "### RR:GG:BB    ### RR:GG:BB    ### RR:GG:BB    ### RR:GG:BB\n");
 
         for (i = 0; i < (int) stream_format.biClrUsed; i++)
         {
-            printf("%3d %2X:%2X:%2X    ", i,
+            OutPrintf(ctx->out, "%3d %2X:%2X:%2X    ", i,
                 pal[i].rgbRed, pal[i].rgbGreen, pal[i].rgbBlue);
-            if (i % 4 == 3) printf("\n");
+            if (i % 4 == 3) OutPrintf(ctx->out, "\n");
         }
-        printf("\n");
+        OutPrintf(ctx->out, "\n");
     }
 
     if (size)    // error - extra stuff at end that we don't understand
     {
-        printf("%sUnrecognized Bitmap Header Extension!!\n", indent);
-        hex_dump_chunk(in, size);
+        OutPrintf(ctx->out, "%sUnrecognized Bitmap Header Extension!!\n", ctx->indent);
+        hex_dump_chunk(ctx, size);
 //        File64SetPos(in, size, SEEK_CUR);
 
     }
@@ -440,8 +464,9 @@ static int read_stream_format_vid(FILE *in, DWORD size)
 
 // Read stream format structure for audio
 
-static int read_stream_format_auds(FILE *in, int size)
+static int read_stream_format_auds(AVICTX *ctx, int size)
 {
+    FILE64 *in = ctx->in;
     STREAMFORMATAUD stream_format;
     MP3EXT mp3fmt;
     AUDIOEXTENSION extfmt;
@@ -460,20 +485,20 @@ static int read_stream_format_auds(FILE *in, int size)
     br = File64Read(in, &stream_format, rl);
     if (br != rl)
     {
-        printf("*** Unexpected End of File ***\n");
+        OutPrintf(ctx->out, "*** Unexpected End of File ***\n");
         return(-1);
     }
 
-    printf("                        offset=0x%lx\n", offset);
-    printf("                        format: 0x%04X - %s\n",
+    OutPrintf(ctx->out, "                        offset=0x%lx\n", offset);
+    OutPrintf(ctx->out, "                        format: 0x%04X - %s\n",
                   stream_format.wFormatTag,
                   LookupFormat(stream_format.wFormatTag));
-    printf("                      channels: %d\n", stream_format.nChannels);
-    printf("            samples_per_second: %d\n", stream_format.nSamplesPerSec);
-    printf("              bytes_per_second: %d\n", stream_format.nAvgBytesPerSec);
-    printf("            block_size_of_data: %d\n", stream_format.nBlockAlign);
-    printf("               bits_per_sample: %d\n", stream_format.wBitsPerSample);
-    printf("              Extensible bytes: %d\n", stream_format.cbSize);
+    OutPrintf(ctx->out, "                      channels: %d\n", stream_format.nChannels);
+    OutPrintf(ctx->out, "            samples_per_second: %d\n", stream_format.nSamplesPerSec);
+    OutPrintf(ctx->out, "              bytes_per_second: %d\n", stream_format.nAvgBytesPerSec);
+    OutPrintf(ctx->out, "            block_size_of_data: %d\n", stream_format.nBlockAlign);
+    OutPrintf(ctx->out, "               bits_per_sample: %d\n", stream_format.wBitsPerSample);
+    OutPrintf(ctx->out, "              Extensible bytes: %d\n", stream_format.cbSize);
 
     if (stream_format.cbSize)   // there are additional bytes that follow
     {
@@ -485,15 +510,15 @@ static int read_stream_format_auds(FILE *in, int size)
             br = File64Read(in, &mp3fmt, rl);
             if (br != rl)
             {
-                printf("*** Unexpected End of File ***\n");
+                OutPrintf(ctx->out, "*** Unexpected End of File ***\n");
                 return(-1);
             }
 
-            printf("                           wID: %d\n", mp3fmt.wID);
-            printf("                      fdwFlags: 0x%08X\n", mp3fmt.fdwFlags);
-            printf("                    nBlockSize: %d\n", mp3fmt.nBlockSize);
-            printf("               nFramesPerBlock: %d\n", mp3fmt.nFramesPerBlock);
-            printf("                   nCodecDelay: %d\n", mp3fmt.nCodecDelay);
+            OutPrintf(ctx->out, "                           wID: %d\n", mp3fmt.wID);
+            OutPrintf(ctx->out, "                      fdwFlags: 0x%08X\n", mp3fmt.fdwFlags);
+            OutPrintf(ctx->out, "                    nBlockSize: %d\n", mp3fmt.nBlockSize);
+            OutPrintf(ctx->out, "               nFramesPerBlock: %d\n", mp3fmt.nFramesPerBlock);
+            OutPrintf(ctx->out, "                   nCodecDelay: %d\n", mp3fmt.nCodecDelay);
         }
         else if (stream_format.cbSize == sizeof(AUDIOEXTENSION))
         {
@@ -506,17 +531,17 @@ static int read_stream_format_auds(FILE *in, int size)
             br = File64Read(in, &extfmt, rl);
             if (br != rl)
             {
-                printf("*** Unexpected End of File ***\n");
+                OutPrintf(ctx->out, "*** Unexpected End of File ***\n");
                 return(-1);
             }
 
-            printf("         Valid_Bits_per_Sample: %d\n", extfmt.Samples.wReserved);
-            printf("             Samples_per_Block: %d\n", extfmt.Samples.wReserved);
-            printf("                  Channel_Mask: %d\n", extfmt.dwChannelMask);
-            printf("                Subformat GUID: ");
+            OutPrintf(ctx->out, "         Valid_Bits_per_Sample: %d\n", extfmt.Samples.wReserved);
+            OutPrintf(ctx->out, "             Samples_per_Block: %d\n", extfmt.Samples.wReserved);
+            OutPrintf(ctx->out, "                  Channel_Mask: %d\n", extfmt.dwChannelMask);
+            OutPrintf(ctx->out, "                Subformat GUID: ");
 //                                                  {00000000-0000-0000-0000-000000000000 }
             t = extfmt.SubFormat;
-            printf("{%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X}",
+            OutPrintf(ctx->out, "{%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X}",
                     t.Data1, t.Data2, t.Data3,
                     t.Data4[0], t.Data4[1],
                     t.Data4[2], t.Data4[3],
@@ -525,7 +550,7 @@ static int read_stream_format_auds(FILE *in, int size)
         }
         else
         {
-            hex_dump_chunk(in, size);
+            hex_dump_chunk(ctx, size);
         }
     }
 
@@ -537,18 +562,20 @@ static int read_stream_format_auds(FILE *in, int size)
 // Read stream format for closed captioning
 // Placeholder - not really supported
 
-static int read_stream_format_txts(FILE *in, int size)
+static int read_stream_format_txts(AVICTX *ctx, int size)
 {
-    return(hex_dump_chunk(in, size));
+    return(hex_dump_chunk(ctx, size));
 
 }
 
 
 // Display an open-DML index
 
-static int ProcessIndx(FILE *in, int chunk_size)
+static int ProcessIndx(AVICTX *ctx, int chunk_size)
 {
+    FILE64 *in = ctx->in;
     INDX_CHUNK idx;   // Generic open-dml index header
+    OUTBUF *out = ctx->out;
     DWORD rb, irb, BytesLeft, br, pad, casetype;
     int i, max;
 
@@ -559,7 +586,7 @@ static int ProcessIndx(FILE *in, int chunk_size)
     br = File64Read(in, &idx, rb);
     if (br != rb)
     {
-        printf("*** Unexpected End of File.\n");
+        OutPrintf(ctx->out, "*** Unexpected End of File.\n");
         return(-1);
     }
 
@@ -576,122 +603,139 @@ static int ProcessIndx(FILE *in, int chunk_size)
     switch (casetype)
     {
         case AVI_INDEX_OF_INDEXES:
-            printf("%sThis is an Open-DML SuperIndex of Indexes", indent);
+            OutPrintf(ctx->out, "%sThis is an Open-DML SuperIndex of Indexes", ctx->indent);
             if (sizeof(SUPERINDEXENTRY) != irb)
             {
-                printf("%swLongsPerEntry is not correct for this type "
-                           "of index.\n", indent);
+                OutPrintf(ctx->out, "%swLongsPerEntry is not correct for this type "
+                           "of index.\n", ctx->indent);
                 irb = min(sizeof(SUPERINDEXENTRY), irb);
             }
-            printf(" for the stream '%.4s'.\n", (char *) &idx.dwChunkId);
+            OutPrintf(ctx->out, " for the stream '%.4s'.\n", (char *) &idx.dwChunkId);
 
-            printf("%sEach index entry has %d bytes ", indent, idx.wLongsPerEntry * 4);
-            printf("with %d entries in use.\n\n", idx.nEntriesInUse);
+            OutPrintf(ctx->out, "%sEach index entry has %d bytes ", ctx->indent, idx.wLongsPerEntry * 4);
+            OutPrintf(ctx->out, "with %d entries in use.\n\n", idx.nEntriesInUse);
 
-            printf("%sAbsolute Location   Size        Duration\n", indent);
-            printf("%s==================  ==========  ==========\n", indent);
+            OutPrintf(ctx->out, "%sAbsolute Location   Size        Duration\n", ctx->indent);
+            OutPrintf(ctx->out, "%s==================  ==========  ==========\n", ctx->indent);
             for (i = 0; i < (int) idx.nEntriesInUse; i++)
             {
-                SUPERINDEXENTRY entry;
+                SUPERINDEXENTRY buf, *entry;
 
-                memset(&entry, 0, sizeof(entry));
+                memset(&buf, 0, sizeof(buf));
                 BytesLeft -= irb;
-                br = File64Read(in, &entry, irb);
-                if (br != irb)
+                entry = (SUPERINDEXENTRY *) File64View(in, &buf, irb);
+                if (entry == NULL)
                 {
-                    printf("*** Unexpected End of File.\n");
+                    OutPrintf(ctx->out, "*** Unexpected End of File.\n");
                     return(-1);
                 }
-                printf("%s0x%s  0x%08X  0x%08X\n", indent,
-                    QWORD2HEX(entry.qwOffset),
-                    entry.dwSize, entry.dwDuration);
+                if (irb != sizeof(SUPERINDEXENTRY))   // short entry
+                    entry = (SUPERINDEXENTRY *) memmove(&buf, entry, irb);
+
+                OutStr(out, ctx->indent);
+                OutStr(out, "0x");
+                OutHex64(out, entry->qwOffset);
+                OutStr(out, "  0x");
+                OutHex(out, entry->dwSize, 8);
+                OutStr(out, "  0x");
+                OutHex(out, entry->dwDuration, 8);
+                OutChar(out, '\n');
             }
             break;
 
         case AVI_INDEX_OF_CHUNKS:   // standard index
             if (irb != sizeof(STDINDEXENTRY))
             {
-                printf("%swLongsPerEntry is not correct for this type "
-                           "of index.\n", indent);
+                OutPrintf(ctx->out, "%swLongsPerEntry is not correct for this type "
+                           "of index.\n", ctx->indent);
                 irb = min(sizeof(STDINDEXENTRY), irb);
             }
 
-            printf("%sAbsolute Location    Size        Keyframe\n", indent);
-            printf("%s==================   ==========  ========\n", indent);
-            max = min(16, idx.nEntriesInUse);
+            OutPrintf(ctx->out, "%sAbsolute Location    Size        Keyframe\n", ctx->indent);
+            OutPrintf(ctx->out, "%s==================   ==========  ========\n", ctx->indent);
+            max = min(ctx->MaxLines, idx.nEntriesInUse);
             for (i = 0; i < (int) max; i++)
             {
-                STDINDEXENTRY entry;
+                STDINDEXENTRY buf, *entry;
 
-                memset(&entry, 0, sizeof(entry));
+                memset(&buf, 0, sizeof(buf));
                 BytesLeft -= irb;
-                br = File64Read(in, &entry, irb);
-                if (br != irb)
+                entry = (STDINDEXENTRY *) File64View(in, &buf, irb);
+                if (entry == NULL)
                 {
-                    printf("*** Unexpected End of File.\n");
+                    OutPrintf(ctx->out, "*** Unexpected End of File.\n");
                     return(-1);
                 }
-                printf("%s0x%s   0x%08X  %s\n", indent,
-                    QWORD2HEX(idx.qwBaseOffset + (QWORD) entry.dwOffset),
-                    entry.dwSize & 0x7FFFFFFF,
-                    (entry.dwSize & 0x80000000) ? "NO" : "YES");
+                if (irb != sizeof(STDINDEXENTRY))   // short entry
+                    entry = (STDINDEXENTRY *) memmove(&buf, entry, irb);
+
+                OutStr(out, ctx->indent);
+                OutStr(out, "0x");
+                OutHex64(out, idx.qwBaseOffset + (QWORD) entry->dwOffset);
+                OutStr(out, "   0x");
+                OutHex(out, entry->dwSize & 0x7FFFFFFF, 8);
+                OutStr(out, (entry->dwSize & 0x80000000) ? "  NO\n" : "  YES\n");
             }
 
             if (max != (int) idx.nEntriesInUse)
-                printf("%s**Suppressed %d index entries**\n", indent, idx.nEntriesInUse - max);
+                OutPrintf(ctx->out, "%s**Suppressed %d index entries**\n", ctx->indent, idx.nEntriesInUse - max);
 
             break;
 
         case AVI_INDEX_OF_CHUNKS | (AVI_INDEX_2FIELD << 8):   // field index
             if (irb != sizeof(FIELDINDEXENTRY))
             {
-                printf("%swLongsPerEntry is not correct for this type "
-                           "of index.\n", indent);
+                OutPrintf(ctx->out, "%swLongsPerEntry is not correct for this type "
+                           "of index.\n", ctx->indent);
                 irb = min(sizeof(FIELDINDEXENTRY), irb);
             }
 
-            printf("%sAbsolute Location   2nd Field Loc       Size        Keyframe\n", indent);
-            printf("%s==================  ==================  ==========  ========\n", indent);
-            max = min(16, idx.nEntriesInUse);
+            OutPrintf(ctx->out, "%sAbsolute Location   2nd Field Loc       Size        Keyframe\n", ctx->indent);
+            OutPrintf(ctx->out, "%s==================  ==================  ==========  ========\n", ctx->indent);
+            max = min(ctx->MaxLines, idx.nEntriesInUse);
             for (i = 0; i < (int) max; i++)
             {
-                FIELDINDEXENTRY entry;
+                FIELDINDEXENTRY buf, *entry;
 
-                memset(&entry, 0, sizeof(entry));
+                memset(&buf, 0, sizeof(buf));
                 BytesLeft -= irb;
-                br = File64Read(in, &entry, irb);
-                if (br != irb)
+                entry = (FIELDINDEXENTRY *) File64View(in, &buf, irb);
+                if (entry == NULL)
                 {
-                    printf("*** Unexpected End of File.\n");
+                    OutPrintf(ctx->out, "*** Unexpected End of File.\n");
                     return(-1);
                 }
-                // QWORD2HEX() cannot be called more than once at a time.
-                printf("%s0x%s  ", indent,
-                    QWORD2HEX(idx.qwBaseOffset + (QWORD) entry.dwOffset));
-                printf("0x%s  0x%08X  %s\n",
-                    QWORD2HEX(idx.qwBaseOffset + (QWORD) entry.dwOffsetField2),
-                    entry.dwSize & 0x7FFFFFFF,
-                    (entry.dwSize & 0x80000000) ? "NO" : "YES");
+                if (irb != sizeof(FIELDINDEXENTRY))   // short entry
+                    entry = (FIELDINDEXENTRY *) memmove(&buf, entry, irb);
+
+                OutStr(out, ctx->indent);
+                OutStr(out, "0x");
+                OutHex64(out, idx.qwBaseOffset + (QWORD) entry->dwOffset);
+                OutStr(out, "  0x");
+                OutHex64(out, idx.qwBaseOffset + (QWORD) entry->dwOffsetField2);
+                OutStr(out, "  0x");
+                OutHex(out, entry->dwSize & 0x7FFFFFFF, 8);
+                OutStr(out, (entry->dwSize & 0x80000000) ? "  NO\n" : "  YES\n");
             }
 
             if (max != (int) idx.nEntriesInUse)
-                printf("%s**Suppressed %d index entries**\n", indent, idx.nEntriesInUse - max);
+                OutPrintf(ctx->out, "%s**Suppressed %d index entries**\n", ctx->indent, idx.nEntriesInUse - max);
 
             break;
 
         case AVI_INDEX_IS_DATA:   // not really supported
-            printf("Data containing Index\n");
+            OutPrintf(ctx->out, "Data containing Index\n");
             break;
 
         default:
-            printf("Index of an unknown type (0x%02X)", (DWORD) idx.bIndexType);
+            OutPrintf(ctx->out, "Index of an unknown type (0x%02X)", (DWORD) idx.bIndexType);
             break;
     }
 
 
-    printf("\n");
+    OutPrintf(ctx->out, "\n");
     if (pad)
-        printf("%sThis index contains %d extra bytes of padding.\n", indent, pad);
+        OutPrintf(ctx->out, "%sThis index contains %d extra bytes of padding.\n", ctx->indent, pad);
 
 
 
@@ -703,98 +747,251 @@ static int ProcessIndx(FILE *in, int chunk_size)
 }
 
 
-// Parse and display frames in the movi list.
-// It will call itself recursively is a 'LIST rec' is encountered.
+// With AVI_RESYNC, a chunk that makes no sense is taken to be damage.
+// Look for the next good chunk header of the RESYNC_* kinds after the
+// absolute file location pos, up to end, and report what was skipped.
+// Returns where to carry on, or end if nothing was found.
+
+static QWORD resync(AVICTX *ctx, QWORD pos, QWORD end, int kinds)
+{
+    QWORD next;
+    char hexstr[20], hexstr2[20];
+
+    next = ChunkResync(ctx->in, pos + 1, end, File64Size(ctx->in), kinds);
+    if (next < end)
+        OutPrintf(ctx->out, "%s*** Damage at 0x%s, resync at 0x%s ***\n", ctx->indent,
+                  QWORD2HEX(pos, hexstr), QWORD2HEX(next, hexstr2));
+    else
+        OutPrintf(ctx->out, "%s*** Damage at 0x%s, no good chunk found up to 0x%s ***\n",
+                  ctx->indent, QWORD2HEX(pos, hexstr), QWORD2HEX(end, hexstr2));
+
+    return(next);
+}
+
+
+// TRUE if the chunk header ck could be real, which is to say its id is
+// printable and it ends by end.
+
+static int plausible_chunk(FOURCC fcc, QWORD pos, DWORD size, QWORD end)
+{
+    BYTE *p = (BYTE *) &fcc;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        if (p[i] < 0x20 || p[i] > 0x7E) return(FALSE);
+
+    return(pos + 8 + size <= end);
+}
+
+
+// Count the chunk at depth lists down against the limits of the parse.
+// Returns 0 to carry on, or -1 once a limit has been reached, which is
+// reported the first time.
+
+static int over_limit(AVICTX *ctx, int depth)
+{
+    char *msg;
+
+    if (ctx->Limits.Hit) return(-1);
+    msg = LimitCheck(&ctx->Limits, ctx->in, depth);
+    if (msg == NULL) return(0);
+
+    OutPrintf(ctx->out, "%s*** Parse stopped: %s ***\n", ctx->indent, msg);
+    return(-1);
+}
+
+
+// Make room for one more level on a parser stack of levels size bytes
+// each, when depth of the alloc allocated are in use.  The stack doubles
+// each time, so a million levels are only copied about twice over.
+// Returns the stack, which may have moved, or NULL if out of memory.
+
+static void *push_level(void *stack, int *alloc, int depth, size_t size)
+{
+    void *p;
+    int n;
+
+    if (depth < *alloc) return(stack);
+
+    n = *alloc ? *alloc * 2 : 16;
+    p = realloc(stack, n * size);
+    if (p == NULL) return(NULL);
+    *alloc = n;
+
+    return(p);
+}
+
+
+// One list of a movi list being displayed by scan_movi(), with its own
+// counts of the chunks shown so far.
 
-static int parse_movi(FILE *in, DWORD size)
+typedef struct
 {
-    FOURCC movi_fcc, NewListName;
-    DWORD  movi_size, offset, file_movi_size;
-    QWORD  AbsLoc, filebase;
-    int    stream, adv, ret;
-    DWORD  cnt = 4;   // 4 for 'movi'
-    int    dcCnt, txCnt, wbCnt, pcCnt, ix2Cnt, defCnt;   // ix1Cnt,
-    char   fccbuf[8], *fccptr, ChunkDesc[64];
+    QWORD   End;        // absolute file location of the end of the list
+    int     dcCnt, txCnt, wbCnt, pcCnt, ix2Cnt, defCnt;   // ix1Cnt;
+} MOVILEVEL;
 
 
-    dcCnt = txCnt = wbCnt = pcCnt = ix2Cnt = defCnt = 0;  // ix1Cnt = 0;
-    filebase = File64GetBase();
+static void movi_header(AVICTX *ctx)
+{
+    OutPrintf(ctx->out, "\n%sCkId  Chunk Type                Absolute Location   Length\n", ctx->indent);
+    OutPrintf(ctx->out,   "%s====  ========================  ==================  ==========\n", ctx->indent);
+}
+
+
+// Display the chunks of a movi list from the scanner's current position
+// up to the absolute file location end.  The chunks are depth lists down.
+// A 'LIST rec' is descended into by pushing it on a stack of lists, not
+// by recursion, so lists nested a million deep only use up heap.
+// With AVI_RESYNC, the chunks after damage are found again, and a 'RIFF'
+// or 'idx1' ends the list, in case its size was never filled in.
+
+static int scan_movi(AVICTX *ctx, CHUNKSCAN *scan, QWORD end, int depth)
+{
+    FILE64 *in = ctx->in;
+    FOURCC NewListName;
+    DWORD  movi_size, file_movi_size;
+    QWORD  AbsLoc;
+    int    stream, ret, level, alloc = 0;
+    int    max = ctx->MaxLines, len;
+    char   fccbuf[8], *fccptr, *ChunkDesc, hexstr[20], ch;
+    OUTBUF *out = ctx->out;
+    MOVILEVEL *stack, *lv;
+    CHUNKHDR ck;
+    BYTE   *p;
+
+
+    stack = (MOVILEVEL *) push_level(NULL, &alloc, 0, sizeof(MOVILEVEL));
+    if (stack == NULL)
+    {
+        OutPrintf(ctx->out, "*** Out of memory ***\n");
+        return(-1);
+    }
+    memset(stack, 0, sizeof(MOVILEVEL));
+    stack[0].End = end;
+    level = 1;
 
-    // print header
-    printf("\n%sCkId  Chunk Type                Absolute Location   Length\n", indent);
-    printf(  "%s====  ========================  ==================  ==========\n", indent);
+    movi_header(ctx);
 
-    while (cnt < size)
+    while (level > 0)
     {
-        offset = File64GetPos(in);
+        lv = &stack[level - 1];
+        ret = ChunkScanNext(scan, lv->End, &ck);
+
+        if (ret == 1 && (ctx->Flags & AVI_RESYNC) &&
+            (ck.FCC == MKFCC('R','I','F','F') || ck.FCC == MKFCC('i','d','x','1')))
+        {
+            scan->Next = ck.Pos;
+            ret = 0;
+        }
 
-        movi_fcc = ReadFCC(in, &stream);
-        movi_size = read_long(in);
-        AbsLoc = filebase + (QWORD) offset;
+        if (ret < 0)
+        {
+            OutPrintf(ctx->out, "*** Unexpected End of File ***\n");
+            break;
+        }
+
+        if (ret == 0)       // end of this list
+        {
+            if (lv->dcCnt > max) OutPrintf(ctx->out, "%s**Suppressed %d video frames**\n", ctx->indent, lv->dcCnt - max);
+            if (lv->wbCnt > max) OutPrintf(ctx->out, "%s**Suppressed %d audio frames**\n", ctx->indent, lv->wbCnt - max);
+            OutPrintf(ctx->out, "\n");
+            if (--level == 0) break;
+            CloseLevel(ctx);
+            scan->Next = lv->End;
+            continue;
+        }
+
+        ret = over_limit(ctx, depth + level - 1);
+        if (ret) break;
+
+        if ((ctx->Flags & AVI_RESYNC) &&
+            !plausible_chunk(ck.FCC, ck.Pos, ck.Size, lv->End))
+        {
+            scan->Next = resync(ctx, ck.Pos, lv->End, RESYNC_STREAM | RESYNC_LIST |
+                                RESYNC_RIFF | RESYNC_IDX1);
+            continue;
+        }
+
+        stream = ck.StreamNum;
+        movi_size = ck.Size;
+        AbsLoc = ck.Pos;
 
         // reconstitute fourcc
-        fccptr = (char *) &movi_fcc;
+        fccptr = (char *) &ck.FCC;
         fccbuf[0] = 0;
         if (stream != -1)    // stream number included
         {
-            if (FIX_LIT(movi_fcc) == 'ix##')
-                sprintf(fccbuf, "ix%02X", stream);
+            if (ck.FCC == MKFCC('i','x','#','#'))
+            {
+                memcpy(fccbuf, "ix", 2);
+                HexByte((BYTE) stream, fccbuf + 2, &ch);
+            }
             else
-                sprintf(fccbuf, "%02X%.2s", stream, fccptr + 2);
+            {
+                HexByte((BYTE) stream, fccbuf, &ch);
+                memcpy(fccbuf + 2, fccptr + 2, 2);
+            }
+            fccbuf[4] = 0;
         }
         else    // stream number not included
         {
-            memcpy(fccbuf, &movi_fcc, 4);
+            memcpy(fccbuf, &ck.FCC, 4);
             fccbuf[4] = 0;
         }
 
-        // There is a poorly documented fact regarding chunks that says they
-        // must be WORD aligned.  So chunk_size refers to the size of the chunk
-        // and not to the number of bytes on the disk.  Bump up the file
-        // pointer by one byte if the chunk_size is an odd number.
+        // The scanner has already taken care of the WORD alignment, but
+        // the payload of the chunk takes up the padded size on disk.
+        file_movi_size = (DWORD)(scan->Next - ck.Pos - 8);
 
-        file_movi_size = movi_size;
-        if (file_movi_size & 0x00000001) file_movi_size++;
-        adv = file_movi_size + 8;   // default advance
+        ChunkDesc = NULL;
 
-        ChunkDesc[0] = 0;
-
-        switch (FIX_LIT(movi_fcc))
+        switch (ck.FCC)
         {
-            case 'LIST':
-                NewListName = ReadFCC(in, NULL);  // should be 'rec ', but we handle them all
-                printf("%sLIST '%.4s'      (Location=0x%s length=0x%08X)\n",
-                        indent, (char *)&NewListName,
-                        QWORD2HEX(File64GetBase() + (QWORD) offset), movi_size);
-                OpenLevel();
-                ret = parse_movi(in, file_movi_size);
-                CloseLevel();
-                adv = 0;   // file advancing already done
-                cnt += file_movi_size + 8;
-                if (ret) return(ret);
+            case MKFCC('L','I','S','T'):
+                // should be 'rec ', but we handle them all
+                p = (BYTE *) ChunkScanPeek(scan, ck.Pos + 8, 4);
+                NewListName = p ? GET_DWORD(p) : 0;
+                OutPrintf(ctx->out, "%sLIST '%.4s'      (Location=0x%s length=0x%08X)\n",
+                        ctx->indent, (char *)&NewListName,
+                        QWORD2HEX(AbsLoc, hexstr), movi_size);
+                lv = (MOVILEVEL *) push_level(stack, &alloc, level, sizeof(MOVILEVEL));
+                if (lv == NULL)
+                {
+                    OutPrintf(ctx->out, "*** Out of memory ***\n");
+                    ret = -1;
+                    break;
+                }
+                stack = lv;
+                lv = &stack[level++];
+                memset(lv, 0, sizeof(MOVILEVEL));
+                lv->End = ck.Pos + 8 + file_movi_size;
+                OpenLevel(ctx);
+                movi_header(ctx);
+                scan->Next = ck.Pos + 12;     // descend into the list
                 break;
 
-            case '##db':
-                if (dcCnt++ < 16) strcpy(ChunkDesc, "Uncompressed Video");
+            case MKFCC('#','#','d','b'):
+                if (lv->dcCnt++ < max) ChunkDesc = "Uncompressed Video";
                 break;
 
-            case '##dc':
-                if (dcCnt++ < 16) strcpy(ChunkDesc, "Compressed Video");
+            case MKFCC('#','#','d','c'):
+                if (lv->dcCnt++ < max) ChunkDesc = "Compressed Video";
                 break;
 
-            case '##tx':
-                if (txCnt++ < 16) strcpy(ChunkDesc, "Subtitle Text");
+            case MKFCC('#','#','t','x'):
+                if (lv->txCnt++ < max) ChunkDesc = "Subtitle Text";
                 break;
 
-            case '##wb':
-                if (wbCnt++ < 16) strcpy(ChunkDesc, "Audio");
+            case MKFCC('#','#','w','b'):
+                if (lv->wbCnt++ < max) ChunkDesc = "Audio";
                 break;
 
-            case '##pc':
-                if (pcCnt++ < 16) strcpy(ChunkDesc, "Palette Change");
+            case MKFCC('#','#','p','c'):
+                if (lv->pcCnt++ < max) ChunkDesc = "Palette Change";
                 break;
 
-            case 'ix##':
+            case MKFCC('i','x','#','#'):
                 // peek at index type
                 {
                     INDX_CHUNK idx;
@@ -804,71 +1001,109 @@ static int parse_movi(FILE *in, DWORD size)
                     // Read base structure if open-dml index
                     memset(&idx, 0, sizeof(idx));
                     rb = min(sizeof(idx), file_movi_size);
-                    rb = File64Read(in, &idx, rb);
+                    p = (BYTE *) ChunkScanPeek(scan, ck.Pos + 8, rb);
+                    if (p) memcpy(&idx, p, rb);
                     strcpy(tmpstr, "ODML Standard Index");
                     if (idx.bIndexSubType == AVI_INDEX_2FIELD)
                         strcpy(tmpstr, "ODML Frame Index");
-                    printf("%s%s  %.4s %-19s  0x%s  0x%08X\n",
-                          indent, fccbuf, (char *)&idx.dwChunkId,
-                          tmpstr, QWORD2HEX(AbsLoc), movi_size);
-
-                    // return to previous position
-                    File64SetPos(in, -rb, SEEK_CUR);
+                    OutPrintf(ctx->out, "%s%s  %.4s %-19s  0x%s  0x%08X\n",
+                          ctx->indent, fccbuf, (char *)&idx.dwChunkId,
+                          tmpstr, QWORD2HEX(AbsLoc, hexstr), movi_size);
                 }
 
-                OpenLevel();
-                ret = ProcessIndx(in, file_movi_size);
-//                ret = hex_dump_chunk(in, movi_size);
-                CloseLevel();
-                adv = 0;   // file advancing already done
-                cnt += file_movi_size + 8;
-                if (ret) return(ret);
+                // the index is read directly from the file
+                File64SetAbsPos(in, ck.Pos + 8);
+                OpenLevel(ctx);
+                ret = ProcessIndx(ctx, file_movi_size);
+//                ret = hex_dump_chunk(ctx, movi_size);
+                CloseLevel(ctx);
                 break;
 
-            case '##ix':
-                if (ix2Cnt++ < 16) strcpy(ChunkDesc, "Data chunk for timecode stream");
+            case MKFCC('#','#','i','x'):
+                if (lv->ix2Cnt++ < max) ChunkDesc = "Data chunk for timecode stream";
                 break;
 
-            case 'JUNK':
-                strcpy(ChunkDesc, "Wasted Space");
+            case MKFCC('J','U','N','K'):
+                ChunkDesc = "Wasted Space";
                 break;
 
             default:
-                if (defCnt++ < 16) strcpy(ChunkDesc, "Unsupported FourCC tag");
+                if (lv->defCnt++ < max) ChunkDesc = "Unsupported FourCC tag";
                 break;
 
         }
 
+        if (ret) break;
 
-        if (ChunkDesc[0])
+        if (ChunkDesc)
         {
-            printf("%s%s  %-24s  0x%s  0x%08X\n",
-                          indent, fccbuf, ChunkDesc, QWORD2HEX(AbsLoc), movi_size);
+            OutStr(out, ctx->indent);
+            OutStr(out, fccbuf);
+            OutStr(out, "  ");
+            len = strlen(ChunkDesc);
+            OutMem(out, ChunkDesc, len);
+            if (len < 24) OutMem(out, Spaces, 24 - len);
+            OutStr(out, "  0x");
+            OutHex64(out, AbsLoc);
+            OutStr(out, "  0x");
+            OutHex(out, movi_size, 8);
+            OutChar(out, '\n');
         }
+    }
 
+    // after an error, close the lists still open
 
-        if (adv)
-        {
-            cnt += adv;
-            File64SetPos(in, file_movi_size, SEEK_CUR);
-        }
+    while (level > 1)
+    {
+        scan->Next = stack[--level].End;
+        CloseLevel(ctx);
+    }
+    free(stack);
+
+    return(ret);
+}
+
+
+// Parse and display frames in the movi list.
+// The chunk headers are found with the block buffered chunk scanner, so
+// the file is only touched when the next header is outside of the block
+// that has already been read.
+
+static int parse_movi(AVICTX *ctx, DWORD size, int depth)
+{
+    FILE64 *in = ctx->in;
+    CHUNKSCAN scan;
+    QWORD start, end;
+    int ret;
 
+    start = File64GetAbsPos(in);
+    end = start + size - 4;      // 4 for 'movi'
 
+    // a capture cut short never filled in the size
+    if ((ctx->Flags & AVI_RESYNC) && (size < 4 || end > File64Size(in)))
+        end = File64Size(in);
+
+    if (ChunkScanOpen(&scan, in, start, end))
+    {
+        OutPrintf(ctx->out, "*** Out of memory ***\n");
+        return(-1);
     }
 
-    if (dcCnt > 16) printf("%s**Suppressed %d video frames**\n", indent, dcCnt - 16);
-    if (wbCnt > 16) printf("%s**Suppressed %d audio frames**\n", indent, wbCnt - 16);
-    printf("\n");
+    ret = scan_movi(ctx, &scan, end, depth);
 
+    // leave the file at the end of the list
+    File64SetAbsPos(in, scan.Next);
+    ChunkScanClose(&scan);
 
-    return(0);
+    return(ret);
 }
 
 
 // Display the VPRP Video Property Header
 
-static int ProcessVPRP(FILE *in, int chunk_size)
+static int ProcessVPRP(AVICTX *ctx, int chunk_size)
 {
+    FILE64 *in = ctx->in;
     DWORD i, s, t;
     VideoPropHeader vprp;
     VIDEO_FIELD_DESC vfld;
@@ -891,18 +1126,18 @@ static int ProcessVPRP(FILE *in, int chunk_size)
 
 
     t = vprp.VideoFormatToken;
-    printf("               Video Format Token: %d - %s\n", t, (t < 5) ? VidTokStr[t] : "INVALID");
+    OutPrintf(ctx->out, "               Video Format Token: %d - %s\n", t, (t < 5) ? VidTokStr[t] : "INVALID");
     t = vprp.VideoStandard;
-    printf("                   Video standard: %d - %s\n", t, (t < 4) ? VidStdStr[t] : "INVALID");
-    printf("            Vertical refresh rate: %d\n", vprp.dwVerticalRefreshRate);
-    printf("            Horizontal Total in T: %d\n", vprp.dwHTotalInT);
-    printf("          Vertical Total in Lines: %d\n", vprp.dwVTotalInLines);
+    OutPrintf(ctx->out, "                   Video standard: %d - %s\n", t, (t < 4) ? VidStdStr[t] : "INVALID");
+    OutPrintf(ctx->out, "            Vertical refresh rate: %d\n", vprp.dwVerticalRefreshRate);
+    OutPrintf(ctx->out, "            Horizontal Total in T: %d\n", vprp.dwHTotalInT);
+    OutPrintf(ctx->out, "          Vertical Total in Lines: %d\n", vprp.dwVTotalInLines);
     t = vprp.dwFrameAspectRatio;
-    printf("                FrameAspect Ratio: %d:%d\n", (t & 0xFFFF0000) >> 16, t & 0x0000FFFF);
+    OutPrintf(ctx->out, "                FrameAspect Ratio: %d:%d\n", (t & 0xFFFF0000) >> 16, t & 0x0000FFFF);
 
-    printf("    Active Frame Width in Pixels : %d\n", vprp.dwFrameWidthInPixels);
-    printf("    Active Frame Height in Lines : %d\n", vprp.dwFrameHeightInLines);
-    printf("      Number of Fields Per Frame : %d\n", vprp.nbFieldPerFrame);
+    OutPrintf(ctx->out, "    Active Frame Width in Pixels : %d\n", vprp.dwFrameWidthInPixels);
+    OutPrintf(ctx->out, "    Active Frame Height in Lines : %d\n", vprp.dwFrameHeightInLines);
+    OutPrintf(ctx->out, "      Number of Fields Per Frame : %d\n", vprp.nbFieldPerFrame);
 
     // Number of fields is usually one or two
     s = sizeof(VideoPropHeader);
@@ -913,12 +1148,12 @@ static int ProcessVPRP(FILE *in, int chunk_size)
 
         s += sizeof(VIDEO_FIELD_DESC);
 
-        printf("\n       Video Field #%d Description\n", i);
-        printf("     Compressed Bitmap Size (WxH): %d X %d\n", vfld.CompressedBMWidth, vfld.CompressedBMHeight);
-        printf("         Valid Bitmap Size (WxH) : %d X %d\n", vfld.ValidBMWidth, vfld.ValidBMHeight);
-        printf("         Valid Bitmap Offet (X,Y): %d, %d\n", vfld.ValidBMXOffset, vfld.ValidBMYOffset);
-        printf("             Valid X-Offset In T : %d\n", vfld.VideoXOffsetInT);
-        printf("              Valid Y Start Line : %d\n", vfld.VideoYValidStartLine);
+        OutPrintf(ctx->out, "\n       Video Field #%d Description\n", i);
+        OutPrintf(ctx->out, "     Compressed Bitmap Size (WxH): %d X %d\n", vfld.CompressedBMWidth, vfld.CompressedBMHeight);
+        OutPrintf(ctx->out, "         Valid Bitmap Size (WxH) : %d X %d\n", vfld.ValidBMWidth, vfld.ValidBMHeight);
+        OutPrintf(ctx->out, "         Valid Bitmap Offet (X,Y): %d, %d\n", vfld.ValidBMXOffset, vfld.ValidBMYOffset);
+        OutPrintf(ctx->out, "             Valid X-Offset In T : %d\n", vfld.VideoXOffsetInT);
+        OutPrintf(ctx->out, "              Valid Y Start Line : %d\n", vfld.VideoYValidStartLine);
 
     }
 
@@ -929,13 +1164,14 @@ static int ProcessVPRP(FILE *in, int chunk_size)
 // Read a null terminated string from the file and then display it.
 // Non-printable characters are converted to spaces.
 
-static int ProcessString(FILE *in, int chunk_size)
+static int ProcessString(AVICTX *ctx, int chunk_size)
 {
+    FILE64 *in = ctx->in;
     char buffer[32];
     int BytesLeft = chunk_size;
     int br, rt, i;
 
-    printf("\"");
+    OutPrintf(ctx->out, "\"");
     while (BytesLeft)
     {
         memset(buffer, 0, sizeof(buffer));
@@ -944,7 +1180,7 @@ static int ProcessString(FILE *in, int chunk_size)
         rt = File64Read(in, buffer, br);
         if (rt != br)    // EOF
         {
-            printf("*** Unexpected EOF\n");
+            OutPrintf(ctx->out, "*** Unexpected EOF\n");
             return(-1);
         }
 
@@ -952,9 +1188,9 @@ static int ProcessString(FILE *in, int chunk_size)
         for (i = 0; buffer[i]; i++)
             if (!isprint(buffer[i])) buffer[i] = ' ';
 
-        printf("%s", buffer);
+        OutPrintf(ctx->out, "%s", buffer);
     }
-    printf("\"\n");
+    OutPrintf(ctx->out, "\"\n");
 
     return(0);
 }
@@ -965,26 +1201,34 @@ static int ProcessString(FILE *in, int chunk_size)
 // As far as I can tell, there are several possible elements for the INFO
 // list and all of them are null terminated strings.
 
-static int ProcessINFO(FILE *in, int chunk_size)
+static int ProcessINFO(AVICTX *ctx, int chunk_size)
 {
+    FILE64 *in = ctx->in;
     DWORD offset = File64GetPos(in);
     DWORD end_of_chunk = offset + chunk_size - 4;
-    DWORD InfoName, InfoSize;
+    DWORD InfoName, InfoSize, last;
     int ret;
 
 
     while (offset < end_of_chunk)
     {
         InfoName = ReadFCC(in, NULL);
+        if (InfoName == (DWORD) -1)     // the file was cut off
+        {
+            OutPrintf(ctx->out, "%s*** Unexpected EOF ***\n", ctx->indent);
+            return(-1);
+        }
         InfoSize = read_long(in);    // length of list element
         if (InfoSize & 0x00000001) InfoSize++;
 
 
-        printf("%s%s(%.4s): ", indent, LookupINFO(InfoName), (char *)&InfoName);
-        ret = ProcessString(in, InfoSize);
+        OutPrintf(ctx->out, "%s%s(%.4s): ", ctx->indent, LookupINFO(InfoName), (char *)&InfoName);
+        ret = ProcessString(ctx, InfoSize);
         if (ret) return(ret);
 
+        last = offset;
         offset = File64GetPos(in);   // current offset
+        if (offset <= last) return(-1);     // a size that goes nowhere
     }
 
     return(0);
@@ -996,8 +1240,9 @@ static int ProcessINFO(FILE *in, int chunk_size)
 // every implementation also adds a 61 DWORD "reserved" field.  This function
 // will handle all sizes.
 
-static int ProcessDmlh(FILE *in, int chunk_size)
+static int ProcessDmlh(AVICTX *ctx, int chunk_size)
 {
+    FILE64 *in = ctx->in;
     AVIEXTHEADER rec;
     DWORD rb, BytesLeft, br;
 
@@ -1008,7 +1253,7 @@ static int ProcessDmlh(FILE *in, int chunk_size)
     br = File64Read(in, &rec, rb);
     if (br != rb)
     {
-        printf("*** Unexpected End of File.\n");
+        OutPrintf(ctx->out, "*** Unexpected End of File.\n");
         return(-1);
     }
 
@@ -1016,8 +1261,8 @@ static int ProcessDmlh(FILE *in, int chunk_size)
     if (BytesLeft)
         File64SetPos(in, BytesLeft, SEEK_CUR);
 
-    printf("%sGrand Total of All Frames in File: %u\n",
-            indent, rec.dwTotalFrames);
+    OutPrintf(ctx->out, "%sGrand Total of All Frames in File: %u\n",
+            ctx->indent, rec.dwTotalFrames);
 
     return(0);
 }
@@ -1026,360 +1271,632 @@ static int ProcessDmlh(FILE *in, int chunk_size)
 
 
 
-// Parse tags under a LIST chunk.
+// One list being parsed by parse_list()
+
+typedef struct
+{
+    FOURCC  ListName;   // type of the list
+    DWORD   End;        // offset of the end of the list
+    DWORD   StrhType;   // fccType of the last 'strh' in the list, for 'strf'
+} LISTLEVEL;
+
+
+// Parse tags under a LIST chunk.  The tags are depth lists down.
 // Title and indentation applied before calling.
-// This function is called recursively.
+// Lists inside the list are pushed on a stack of lists rather than
+// parsed by recursion, so lists nested a million deep only use up heap.
 
-static int parse_list(FILE *in, FOURCC ListName, DWORD ListLen)
+static int parse_list(AVICTX *ctx, FOURCC ListName, DWORD ListLen, int depth)
 {
-    DWORD NewListName, StrhType = 0;
-    int ret;  //, chunk_size, ret;
+    FILE64 *in = ctx->in;
+    DWORD NewListName;
+    int ret = 0, level, alloc = 0;
     DWORD ListElem, ListElemSize;
-    DWORD end_of_chunk;
     DWORD offset = File64GetPos(in);
-    DWORD FixedListName, FixedStrhType;
+    DWORD CurList, StrhType;
+    QWORD base, end;
+    LISTLEVEL *stack, *lv;
+    char ofsstr[20];
 
-    FixedListName = FIX_LIT(ListName);
-    if (FixedListName == 'movi')    // special case for movi lists
+    if (ListName == MKFCC('m','o','v','i'))    // special case for movi lists
     {
-        G_movi_offset = offset;     // changes with each new movi list
-        ret = parse_movi(in, ListLen);
+        ctx->movi_offset = offset;     // changes with each new movi list
+        ret = parse_movi(ctx, ListLen, depth);
         return(ret);
     }
-    else if (FixedListName == 'INFO')    // spcial case for INFO lists
+    else if (ListName == MKFCC('I','N','F','O'))    // spcial case for INFO lists
     {
-        ret = ProcessINFO(in, ListLen);
+        ret = ProcessINFO(ctx, ListLen);
        return(ret);
     }
 
-    end_of_chunk = offset + ListLen - 4;
+    stack = (LISTLEVEL *) push_level(NULL, &alloc, 0, sizeof(LISTLEVEL));
+    if (stack == NULL)
+    {
+        OutPrintf(ctx->out, "*** Out of memory ***\n");
+        return(-1);
+    }
+    stack[0].ListName = ListName;
+    stack[0].End = offset + ListLen - 4;
+    stack[0].StrhType = 0;
+    level = 1;
 
-    while (offset < end_of_chunk)
+    while (level > 0)
     {
+        lv = &stack[level - 1];
+        offset = File64GetPos(in);   // current offset
+        if (offset >= lv->End)       // end of this list
+        {
+            if (--level) CloseLevel(ctx);
+            continue;
+        }
+
+        ret = over_limit(ctx, depth + level - 1);
+        if (ret) break;
+
+        CurList = lv->ListName;
+        StrhType = lv->StrhType;
         ListElem = ReadFCC(in, NULL);    // get next list element
+        if (ListElem == (DWORD) -1)      // the file was cut off
+        {
+            OutPrintf(ctx->out, "%s*** Unexpected EOF ***\n", ctx->indent);
+            ret = -1;
+            break;
+        }
         ListElemSize = read_long(in);    // length of list element
 
-// printf("ListElem: %.4s\n", (char *)&ListElem);
+// OutPrintf(ctx->out, "ListElem: %.4s\n", (char *)&ListElem);
 
-        switch (FIX_LIT(ListElem))
+        switch (ListElem)
         {
-            case 'LIST':     // yep, its recursive
+            case MKFCC('L','I','S','T'):     // goes on the stack, unless it is movi or INFO
                 NewListName = ReadFCC(in, NULL);
-                printf("%sAVI LIST '%.4s' Element '%.4s' (Location=0x%s length=0x%06X)\n",
-                        indent, (char *)&ListName, (char *)&NewListName,
-                        GetOffsetStr(offset), ListElemSize);
-                OpenLevel();
-                ret = parse_list(in, NewListName, ListElemSize);
-                CloseLevel();
-                if (ret) return(ret);
+                OutPrintf(ctx->out, "%sAVI LIST '%.4s' Element '%.4s' (Location=0x%s length=0x%06X)\n",
+                        ctx->indent, (char *)&lv->ListName, (char *)&NewListName,
+                        GetOffsetStr(ctx, offset, ofsstr), ListElemSize);
+                if (NewListName == MKFCC('m','o','v','i') ||
+                    NewListName == MKFCC('I','N','F','O'))
+                {
+                    OpenLevel(ctx);
+                    ret = parse_list(ctx, NewListName, ListElemSize, depth + level);
+                    CloseLevel(ctx);
+                    break;
+                }
+                lv = (LISTLEVEL *) push_level(stack, &alloc, level, sizeof(LISTLEVEL));
+                if (lv == NULL)
+                {
+                    OutPrintf(ctx->out, "*** Out of memory ***\n");
+                    ret = -1;
+                    break;
+                }
+                stack = lv;
+                lv = &stack[level++];
+                lv->ListName = NewListName;
+                lv->End = File64GetPos(in) + ListElemSize - 4;
+                lv->StrhType = 0;
+                OpenLevel(ctx);
                 break;
 
-            case 'avih':     // AVI header
-                if (FixedListName != 'hdrl') goto syntax;
-                printf("%sAVI Main Header 'avih' (Location=0x%08X length=0x%06X)\n",
-                        indent, offset, ListElemSize);
-                OpenLevel();
-                ret = read_avi_header(in);
-                CloseLevel();
-                if (ret) return(ret);
+            case MKFCC('a','v','i','h'):     // AVI header
+                if (CurList != MKFCC('h','d','r','l')) goto syntax;
+                OutPrintf(ctx->out, "%sAVI Main Header 'avih' (Location=0x%08X length=0x%06X)\n",
+                        ctx->indent, offset, ListElemSize);
+                OpenLevel(ctx);
+                ret = read_avi_header(ctx);
+                CloseLevel(ctx);
                 break;
 
-            case 'strh':
-                if (FixedListName != 'strl') goto syntax;
+            case MKFCC('s','t','r','h'):
+                if (CurList != MKFCC('s','t','r','l')) goto syntax;
                 // Peek at stream type
-                StrhType = ReadFCC(in, NULL);    // should be  'vids' or 'auds'
-                FixedStrhType = FIX_LIT(StrhType); // used for strf
+                lv->StrhType = ReadFCC(in, NULL);    // should be  'vids' or 'auds'
+                StrhType = lv->StrhType; // used for strf
                 File64SetPos(in, -4, SEEK_CUR);   // move FP back
-                printf("%sAVI 'strh' Stream Header for '%.4s' (Location=0x%08X length=0x%06X)\n",
-                        indent, (char *)&StrhType,
+                OutPrintf(ctx->out, "%sAVI 'strh' Stream Header for '%.4s' (Location=0x%08X length=0x%06X)\n",
+                        ctx->indent, (char *)&lv->StrhType,
                         offset, ListElemSize);
-                OpenLevel();
-                if (FixedStrhType != 'vids' &&
-                    FixedStrhType != 'auds' &&
-                    FixedStrhType != 'txts')  // unknown
+                OpenLevel(ctx);
+                if (StrhType != MKFCC('v','i','d','s') &&
+                    StrhType != MKFCC('a','u','d','s') &&
+                    StrhType != MKFCC('t','x','t','s'))  // unknown
                 {
-                    printf("%sUnsupported Stream Header 'strh' type %.4s\n",
-                              indent, (char *)&StrhType);
+                    OutPrintf(ctx->out, "%sUnsupported Stream Header 'strh' type %.4s\n",
+                              ctx->indent, (char *)&lv->StrhType);
                     File64SetPos(in, ListElemSize, SEEK_CUR);
                     break;
                 }
 
-                ret = read_stream_header(in, ListElemSize);
-                CloseLevel();
-                if (ret) return(ret);
+                ret = read_stream_header(ctx, ListElemSize);
+                CloseLevel(ctx);
                 break;
 
-            case 'strf':
-                if (FixedListName != 'strl') goto syntax;
-                printf("%sAVI 'strf' Stream Format for '%.4s' (Location=0x%08X length=0x%06X)\n",
-                        indent, (char *)&StrhType,
+            case MKFCC('s','t','r','f'):
+                if (CurList != MKFCC('s','t','r','l')) goto syntax;
+                OutPrintf(ctx->out, "%sAVI 'strf' Stream Format for '%.4s' (Location=0x%08X length=0x%06X)\n",
+                        ctx->indent, (char *)&lv->StrhType,
                         offset, ListElemSize);
-                OpenLevel();
-                if (FixedStrhType == 'vids')  // video
+                OpenLevel(ctx);
+                if (StrhType == MKFCC('v','i','d','s'))  // video
                 {
-                    ret = read_stream_format_vid(in, ListElemSize);
-                    if (ret) return(ret);
+                    ret = read_stream_format_vid(ctx, ListElemSize);
+                    if (ret) break;
                 }
-                else if (FixedStrhType == 'auds')  // audio
+                else if (StrhType == MKFCC('a','u','d','s'))  // audio
                 {
-                    ret = read_stream_format_auds(in, ListElemSize);
-                    if (ret) return(ret);
+                    ret = read_stream_format_auds(ctx, ListElemSize);
+                    if (ret) break;
                 }
-                else if (FixedStrhType == 'txts')   // subtitles
+                else if (StrhType == MKFCC('t','x','t','s'))   // subtitles
                 {
-                    ret = read_stream_format_txts(in, ListElemSize);
-                    if (ret) return(ret);
+                    ret = read_stream_format_txts(ctx, ListElemSize);
+                    if (ret) break;
                 }
                 else    // unsupported
                 {
-                    if (StrhType == 0)
-                        printf("*** 'strf' without preceeding 'strh'\n");
-                    else printf("*** Unsupported Stream Format '%.4s'\n", (char *)&StrhType);
+                    if (lv->StrhType == 0)
+                        OutPrintf(ctx->out, "*** 'strf' without preceeding 'strh'\n");
+                    else OutPrintf(ctx->out, "*** Unsupported Stream Format '%.4s'\n", (char *)&lv->StrhType);
                     File64SetPos(in, ListElemSize, SEEK_CUR);
                 }
-                CloseLevel();
+                CloseLevel(ctx);
                 break;
 
-            case 'vprp':        // video properties header
-                if (FixedListName != 'strl') goto syntax;
-                printf("%sAVI 'vprp' Video Property Header (Location=0x%08X length=0x%06X)\n",
-                        indent, offset, ListElemSize);
-                OpenLevel();
-                ret = ProcessVPRP(in, ListElemSize);
-                if (ret) return(ret);
-                CloseLevel();
+            case MKFCC('v','p','r','p'):        // video properties header
+                if (CurList != MKFCC('s','t','r','l')) goto syntax;
+                OutPrintf(ctx->out, "%sAVI 'vprp' Video Property Header (Location=0x%08X length=0x%06X)\n",
+                        ctx->indent, offset, ListElemSize);
+                OpenLevel(ctx);
+                ret = ProcessVPRP(ctx, ListElemSize);
+                if (ret) break;
+                CloseLevel(ctx);
                 break;
 
-            case 'dmlh':
-                if (FixedListName != 'odml') goto syntax;
-                printf("%sAVI 'dmlh' Extended Header (Location=0x%08X length=0x%06X)\n",
-                        indent,
+            case MKFCC('d','m','l','h'):
+                if (CurList != MKFCC('o','d','m','l')) goto syntax;
+                OutPrintf(ctx->out, "%sAVI 'dmlh' Extended Header (Location=0x%08X length=0x%06X)\n",
+                        ctx->indent,
                         offset, ListElemSize);
-                OpenLevel();
-                ret = ProcessDmlh(in, ListElemSize);
-                if (ret) return(ret);
-                CloseLevel();
+                OpenLevel(ctx);
+                ret = ProcessDmlh(ctx, ListElemSize);
+                if (ret) break;
+                CloseLevel(ctx);
                 break;
 
-            case 'strn':      // null terminated string stream name
-                if (FixedListName != 'strl') goto syntax;
-                printf("%sStream Name(strn): ", indent);
-                ret = ProcessString(in, ListElemSize);
-                if (ret) return(ret);
+            case MKFCC('s','t','r','n'):      // null terminated string stream name
+                if (CurList != MKFCC('s','t','r','l')) goto syntax;
+                OutPrintf(ctx->out, "%sStream Name(strn): ", ctx->indent);
+                ret = ProcessString(ctx, ListElemSize);
                 break;
 
 
-            case 'strd':
-                if (FixedListName != 'strl') goto syntax;
-                printf("%sAVI 'strd' Stream Data (Location=0x%08X length=0x%06X)\n",
-                        indent,
+            case MKFCC('s','t','r','d'):
+                if (CurList != MKFCC('s','t','r','l')) goto syntax;
+                OutPrintf(ctx->out, "%sAVI 'strd' Stream Data (Location=0x%08X length=0x%06X)\n",
+                        ctx->indent,
                         offset, ListElemSize);
-                OpenLevel();
-                ret = hex_dump_chunk(in, ListElemSize);
-                if (ret) return(ret);
-                CloseLevel();
+                OpenLevel(ctx);
+                ret = hex_dump_chunk(ctx, ListElemSize);
+                if (ret) break;
+                CloseLevel(ctx);
                 break;
 
-            case 'indx':       // super DML index
-                printf("%sAVI 'indx' Open DML Index (Location=0x%08X length=0x%06X)\n",
-                        indent,
+            case MKFCC('i','n','d','x'):       // super DML index
+                OutPrintf(ctx->out, "%sAVI 'indx' Open DML Index (Location=0x%08X length=0x%06X)\n",
+                        ctx->indent,
                         offset, ListElemSize);
-                OpenLevel();
-//                ret = hex_dump_chunk(in, ListElemSize);
-                ret = ProcessIndx(in, ListElemSize);
-                if (ret) return(ret);
-                CloseLevel();
+                OpenLevel(ctx);
+//                ret = hex_dump_chunk(ctx, ListElemSize);
+                ret = ProcessIndx(ctx, ListElemSize);
+                if (ret) break;
+                CloseLevel(ctx);
                 break;
 
 
             case 0:  // special case for PRMI
-                if (FixedListName == 'PRMI')
+                if (CurList == MKFCC('P','R','M','I'))
                 {
-                    printf("%sPRMI: ", indent);
-                    ret = ProcessString(in, ListElemSize);
-                    if (ret) return(ret);
+                    OutPrintf(ctx->out, "%sPRMI: ", ctx->indent);
+                    ret = ProcessString(ctx, ListElemSize);
                     break;
                 }
 
 
-            case 'JUNK':
+            case MKFCC('J','U','N','K'):
             default:
-                printf("%sAVI '%.4s' Chunk (Location=0x%s length=0x%06X)\n",
-                        indent, (char *)&ListElem,
-                        GetOffsetStr(offset), ListElemSize);
-                OpenLevel();
-                printf("%sSkipping %d %.4s bytes.\n", indent,
+                if ((ctx->Flags & AVI_RESYNC) &&
+                    !plausible_chunk(ListElem, offset, ListElemSize, lv->End))
+                    goto syntax;
+                OutPrintf(ctx->out, "%sAVI '%.4s' Chunk (Location=0x%s length=0x%06X)\n",
+                        ctx->indent, (char *)&ListElem,
+                        GetOffsetStr(ctx, offset, ofsstr), ListElemSize);
+                OpenLevel(ctx);
+                OutPrintf(ctx->out, "%sSkipping %d %.4s bytes.\n", ctx->indent,
                     ListElemSize, (char *)&ListElem);
-                CloseLevel();
+                CloseLevel(ctx);
                 File64SetPos(in, ListElemSize, SEEK_CUR);
                 break;
         }
 
+        // a size that does not move the parse along would loop forever
+        if (ret == 0 && File64GetPos(in) <= offset)
+        {
+            OutPrintf(ctx->out, "%s*** Chunk size 0x%08X does not lead anywhere ***\n",
+                      ctx->indent, ListElemSize);
+            ret = -1;
+        }
+        if (ret) break;
+        continue;
 
-        offset = File64GetPos(in);   // current offset
+syntax:
+        OutPrintf(ctx->out, "*** A File syntax error was detected near offset 0x%X ***\n", offset);
+        if (!(ctx->Flags & AVI_RESYNC))
+        {
+            ret = -1;
+            break;
+        }
+
+        // Carry on from the next list or RIFF, as long as the offsets of
+        // this RIFF can still reach it, in the list holding this one.
+
+        base = File64GetBase(in);
+        end = File64Size(in);
+        if (end - base > 0xFFFFFFFFUL) end = base + 0xFFFFFFFFUL;
+        File64SetAbsPos(in, resync(ctx, base + offset, end,
+                                   RESYNC_LIST | RESYNC_RIFF | RESYNC_IDX1));
+        if (--level) CloseLevel(ctx);
     }
-    return(0);
 
-syntax:
-    printf("*** A File syntax error was detected near offset 0x%X ***\n", offset);
-    return(-1);
+    // after an error, close the lists still open
 
+    while (level-- > 1) CloseLevel(ctx);
+    free(stack);
 
+    return(ret);
 }
 
 
 // Process the AVI or AVIX file
 // We accept LIST and idx1, eveything else is treated as JUNK.
+// With AVI_RESYNC, a RIFF that runs past the end of the file, or was never
+// given a size, is read to the end of the file, and a chunk that makes no
+// sense is skipped over to the next list, idx1 or RIFF.
 
-static int ProcessAVI(FILE *in, DWORD riff_size)
+static int ProcessAVI(AVICTX *ctx, DWORD riff_size)
 {
+    FILE64 *in = ctx->in;
     DWORD fcc_id, chunk_size, ListName;
-    DWORD offset, endofs;
+    DWORD offset, last, endofs;
+    QWORD base, next, rest;
     int ret;
+    char ofsstr[20];
 
     offset = File64GetPos(in);   // get offset of the start of this chunk
     endofs = offset + riff_size - 4;
+    base = File64GetBase(in);
+
+    if ((ctx->Flags & AVI_RESYNC) &&
+        (riff_size < 4 || base + offset + riff_size - 4 > File64Size(in)))
+    {
+        rest = File64Size(in) - base;
+        endofs = (rest > 0xFFFFFFFFUL) ? 0xFFFFFFFFUL : (DWORD) rest;
+    }
 
 
     while (offset < endofs)
     {
+        if (over_limit(ctx, 1)) return(-1);
+
         fcc_id = ReadFCC(in, NULL);   // LIST, idx1, etc
+        if (fcc_id == (DWORD) -1)     // cut off, such as before the idx1
+        {
+            OutPrintf(ctx->out, "%s*** Unexpected EOF ***\n", ctx->indent);
+            return(-1);
+        }
         chunk_size = read_long(in);
 
-        switch (FIX_LIT(fcc_id))
+        switch (fcc_id)
         {
-            case 'LIST':         // get list type
+            case MKFCC('L','I','S','T'):         // get list type
                 ListName = ReadFCC(in, NULL);
 
-                printf("%sAVI LIST '%.4s' (Location=0x%s length=0x%06X)\n",
-                            indent, (char *)&ListName,
-                            GetOffsetStr(offset), chunk_size);
-                OpenLevel();
-                ret = parse_list(in, ListName, chunk_size);
-                CloseLevel();
+                OutPrintf(ctx->out, "%sAVI LIST '%.4s' (Location=0x%s length=0x%06X)\n",
+                            ctx->indent, (char *)&ListName,
+                            GetOffsetStr(ctx, offset, ofsstr), chunk_size);
+                OpenLevel(ctx);
+                ret = parse_list(ctx, ListName, chunk_size, 2);
+                CloseLevel(ctx);
                 if (ret) return(ret);
                 break;
 
-            case 'idx1':
-                printf("%sAVI Legacy Index 'idx1' (Location=0x%08X length=0x%06X)\n",
-                            indent, offset, chunk_size);
-                OpenLevel();
-                ret = parse_idx1(in, chunk_size);
-                CloseLevel();
+            case MKFCC('i','d','x','1'):
+                OutPrintf(ctx->out, "%sAVI Legacy Index 'idx1' (Location=0x%08X length=0x%06X)\n",
+                            ctx->indent, offset, chunk_size);
+                OpenLevel(ctx);
+                ret = parse_idx1(ctx, chunk_size);
+                CloseLevel(ctx);
                 if (ret) return(ret);
                 break;
 
-            case 'DISP':    // junk
-                printf("%sAVI 'DISP' Chunk (Location=0x%s length=0x%08X)\n",
-                        indent, GetOffsetStr(offset), chunk_size);
-                OpenLevel();
-                ret = hex_dump_chunk(in, chunk_size);
+            case MKFCC('D','I','S','P'):    // junk
+                OutPrintf(ctx->out, "%sAVI 'DISP' Chunk (Location=0x%s length=0x%08X)\n",
+                        ctx->indent, GetOffsetStr(ctx, offset, ofsstr), chunk_size);
+                OpenLevel(ctx);
+                ret = hex_dump_chunk(ctx, chunk_size);
                 if (ret) return(ret);
-                CloseLevel();
+                CloseLevel(ctx);
                 break;
 
-            case 'JUNK':    // junk
+            case MKFCC('R','I','F','F'):    // the next one, if the size of this one was wrong
+                if (!(ctx->Flags & AVI_RESYNC)) goto junk;
+                File64SetPos(in, -8, SEEK_CUR);
+                return(0);
+
+            case MKFCC('J','U','N','K'):    // junk
             default:  // unsupported
-                printf("%sAVI '%.4s' Chunk (Location=0x%s length=0x%08X)\n",
-                        indent, (char *)&fcc_id, GetOffsetStr(offset), chunk_size);
-                OpenLevel();
-                printf("%sSkipping %d '%.4s' bytes.\n", indent, chunk_size, (char *)&fcc_id);
-                CloseLevel();
+            junk:
+                if ((ctx->Flags & AVI_RESYNC) &&
+                    !plausible_chunk(fcc_id, offset, chunk_size, endofs))
+                {
+                    // offsets past the end of the RIFF would not fit
+                    next = resync(ctx, base + offset, base + endofs,
+                                  RESYNC_LIST | RESYNC_RIFF | RESYNC_IDX1);
+                    File64SetAbsPos(in, next);
+                    if (next >= base + endofs) return(0);
+                    break;
+                }
+                OutPrintf(ctx->out, "%sAVI '%.4s' Chunk (Location=0x%s length=0x%08X)\n",
+                        ctx->indent, (char *)&fcc_id, GetOffsetStr(ctx, offset, ofsstr), chunk_size);
+                OpenLevel(ctx);
+                OutPrintf(ctx->out, "%sSkipping %d '%.4s' bytes.\n", ctx->indent, chunk_size, (char *)&fcc_id);
+                CloseLevel(ctx);
                 File64SetPos(in, chunk_size, SEEK_CUR);
                 break;
         }
 
+        // a size that does not move the parse along would loop forever
+        last = offset;
         offset = File64GetPos(in);   // get offset of the start of this chunk
-
+        if (offset <= last)
+        {
+            OutPrintf(ctx->out, "%s*** Chunk size 0x%08X does not lead anywhere ***\n",
+                      ctx->indent, chunk_size);
+            return(-1);
+        }
     }
     return(0);
 }
 
 
 
-static void parse_riff(FILE *in)
+// Parse one RIFF segment, starting at its 'RIFF' tag.  riff_count is the
+// number of segments seen so far, and is bumped if this one is an AVI.
+// With AVI_RESYNC, garbage after a segment is skipped over to the next.
+// Returns 1 if there may be more segments to follow or 0 if not, or if a
+// limit of the parse has been reached.
+
+static int parse_segment(AVICTX *ctx, int *riff_count)
 {
-    int fcc_id, fcc_type, riff_size, riff_count = 0;
+    FILE64 *in = ctx->in;
+    int fcc_id, fcc_type, riff_size;
+    QWORD pos, next;
+    char hexstr[20];
 
-    while ((fcc_id = ReadFCC(in, NULL)) != -1)  // should be RIFF
-    {
-        riff_size = read_long(in);
+    pos = File64GetAbsPos(in);
+    if ((fcc_id = ReadFCC(in, NULL)) == -1) return(0);  // should be RIFF
+    if (over_limit(ctx, 0)) return(0);
+
+    riff_size = read_long(in);
 
-        if (FIX_LIT(fcc_id) != 'RIFF')
+    if (fcc_id != MKFCC('R','I','F','F'))
+    {
+        if (*riff_count == 0)
+            OutPrintf(ctx->out, "'RIFF' tag missing.  This is not a AVI/RIFF file.\n");
+        else if (ctx->Flags & AVI_RESYNC)
         {
-            if (riff_count == 0) printf("'RIFF' tag missing.  This is not a AVI/RIFF file.\n");
-            else printf("Unexpected garbage detected at end of file.\n");
-            return;
+            next = resync(ctx, pos, File64Size(in), RESYNC_RIFF);
+            File64SetAbsPos(in, next);
+            return(next < File64Size(in));
         }
+        else
+            OutPrintf(ctx->out, "Unexpected garbage detected at end of file.\n");
+        return(0);
+    }
 
-        fcc_type = ReadFCC(in, NULL);
-        switch (FIX_LIT(fcc_type))
-        {
-            case 'AVIX':
-                // Set current base file pointer
-                File64SetBase(in, -12);   // set to start of RIFF
-                // fall through
-
-            case 'AVI ':
-                riff_count++;
-                printf("%sRIFF#%d %.4s (Base=0x%s Length=0x%08X)\n", indent,
-                    riff_count, (char *)&fcc_type, QWORD2HEX(File64GetBase()),
-                    riff_size);
-                OpenLevel();      // increase nested level
-                ProcessAVI(in, riff_size); // Process AVI or AVIX
-                CloseLevel();      // decrease nexted level
-                break;
+    fcc_type = ReadFCC(in, NULL);
+    switch (fcc_type)
+    {
+        case MKFCC('A','V','I','X'):
+            // Set current base file pointer
+            File64SetBase(in, -12);   // set to start of RIFF
+            // fall through
+
+        case MKFCC('A','V','I',' '):
+            (*riff_count)++;
+            OutPrintf(ctx->out, "%sRIFF#%d %.4s (Base=0x%s Length=0x%08X)\n", ctx->indent,
+                *riff_count, (char *)&fcc_type, QWORD2HEX(File64GetBase(in), hexstr),
+                riff_size);
+            OpenLevel(ctx);      // increase nested level
+            ProcessAVI(ctx, riff_size); // Process AVI or AVIX
+            CloseLevel(ctx);      // decrease nexted level
+            if (ctx->Limits.Hit) return(0);
+            break;
 
-            default:
-                printf("Unknown RIFF chunk.  Are you sure this is an AVI file?\n");
-                break;
-        }
+        default:
+            OutPrintf(ctx->out, "Unknown RIFF chunk.  Are you sure this is an AVI file?\n");
+            break;
     }
 
-    return;
+    return(1);
 }
 
 
+static int parse_riff(AVICTX *ctx)
+{
+    int riff_count = 0;
 
+    while (parse_segment(ctx, &riff_count));
 
-int main(int argc, char *argv[])
+    return(riff_count ? 0 : -1);
+}
+
+
+// Segment jobs for AviParseSegments()
+
+typedef struct
 {
-    FILE *in ;
-
-    printf("\n"
-           "Display the contents and file structure of an AVI file.\n"
-           "This program will work on most AVI files including Open-DML\n"
-#if defined(NO_HUGE_FILES)
-             "files that are less than 2GB.\n\n"
-#else
-             "files that are bigger than 4GB.\n\n"
-#endif
-           "RdAvi2 - RIFF AVI 2 Format Reader (April 18, 2024) By Dennis Hawkins\n"
-           "Version 1.01 released on July 23, 2024.\n"
-           "Based on readavi by Michael Kohn (http://www.mikekohn.net)\n"
-           "Copyright 2024 by Dennis Hawkins, BSD License applies.\n\n");
-
-    if (argc != 2)
+    char   *fname;      // file to open
+    QWORD  *SegPos;     // file location of each 'RIFF' tag
+    DWORD   Flags;      // report options
+} SEGJOBS;
+
+
+// Parse segment number num with a file handle and context of its own.
+
+static int SegmentJob(void *arg, int num, FILE *out)
+{
+    SEGJOBS *sj = (SEGJOBS *) arg;
+    FILE64 *in;
+    AVICTX ctx;
+    int riff_count = num;
+
+    in = File64Open(sj->fname, "rb");
+    if (in == 0)
     {
-        printf("Usage: rdavi2 <filename>\n\n");
-        printf("Currently, there are no command line options defined.\n\n");
-        exit(0);
+        fprintf(out, "Could not open %s for input\n", sj->fname);
+        return(-1);
     }
 
-    in = File64Open(argv[1], "rb");
-    if (in == 0)
+    AviInitContext(&ctx, in, out, sj->Flags);
+    File64SetAbsPos(in, sj->SegPos[num]);
+    parse_segment(&ctx, &riff_count);
+
+    AviFreeContext(&ctx);
+    File64Close(in);
+
+    return(0);
+}
+
+
+// Set up a parser context for the file in.  The report will be written
+// to out.  flags are the AVI_* report options.
+
+void AviInitContext(AVICTX *ctx, FILE64 *in, FILE *out, DWORD flags)
+{
+    memset(ctx, 0, sizeof(AVICTX));
+    ctx->in = in;
+    ctx->out = &ctx->OutBuf;
+    ctx->Flags = flags;
+    ctx->MaxLines = (flags & AVI_FULLDUMP) ? 0x7FFFFFFF : 16;
+    OutInit(ctx->out, out);
+    MakeIndent(ctx);
+}
+
+
+// Write out anything still buffered and free the context's memory.
+
+void AviFreeContext(AVICTX *ctx)
+{
+    OutClose(ctx->out);
+}
+
+
+// Parse the file and write the report.  Every bit of state lives in ctx,
+// so different files can be parsed by different threads at the same time.
+// Returns 0 on success or -1 if this is not a RIFF file.
+
+int AviParse(AVICTX *ctx)
+{
+    int ret;
+
+    if (File64Size(ctx->in) == 0)
+        ctx->Flags &= ~AVI_RESYNC;      // nothing to go by
+
+    LimitStart(&ctx->Limits, ctx->in);
+
+    if (ctx->Flags & AVI_REPAIR)
+        ret = RepairReport(ctx);
+    else if (ctx->Flags & AVI_DEMUX)
+        ret = DemuxReport(ctx);
+    else if (ctx->Flags & (AVI_AUDIT | AVI_CHECK))
+        ret = AuditReport(ctx);
+    else if (ctx->Flags & AVI_FRAME)
+        ret = FrameReport(ctx);
+    else if (ctx->Flags & AVI_SEEK)
+        ret = SeekReport(ctx);
+    else if (ctx->Flags & AVI_GOP)
+        ret = GopReport(ctx);
+    else if (ctx->Flags & AVI_VERIFY)
+        ret = VerifyReport(ctx);
+    else if (ctx->Flags & AVI_SUMMARY)
+        ret = SummaryReport(ctx);
+    else if (ctx->Flags & AVI_JSON)
+        ret = JsonReport(ctx);
+    else
+        ret = parse_riff(ctx);
+
+    OutFlush(ctx->out);
+
+    return(ret);
+}
+
+
+// Same as AviParse(), except that the RIFF segments of an Open-DML file
+// are parsed at the same time by threads threads, or one per CPU if it
+// is 0.  Each segment stands alone, so the 'RIFF' headers are hopped over
+// first to find them all.  Then every segment is parsed with a handle of
+// its own opened from fname, and the reports are put back together in
+// file order.  The JSON report, the index summary, the verification, the
+// repair, the demux and the audit are not split up by segment, so they
+// are always done by AviParse(), the audit on ctx->Threads threads.  So
+// is a damaged file with AVI_RESYNC, as the segments cannot be trusted,
+// and a parse with limits, which are for the whole file.
+// Returns 0 on success or -1 if this is not a RIFF file.
+
+int AviParseSegments(AVICTX *ctx, char *fname, int threads)
+{
+    FILE64 *in = ctx->in;
+    SEGJOBS sj;
+    QWORD pos, *p;
+    DWORD hdr[2];
+    int count = 0, alloc = 0, riff_count;
+
+    sj.fname = fname;
+    sj.SegPos = NULL;
+    sj.Flags = ctx->Flags;
+    pos = File64GetAbsPos(in);
+
+    while (File64ReadAt(in, pos, hdr, 8) == 8 && hdr[0] == MKFCC('R','I','F','F'))
     {
-        printf("Could not open %s for input\n", argv[1]);
-        exit(1);
+        if (count == alloc)
+        {
+            p = (QWORD *) realloc(sj.SegPos, (alloc + 64) * sizeof(QWORD));
+            if (p == NULL) break;
+            sj.SegPos = p;
+            alloc += 64;
+        }
+        sj.SegPos[count++] = pos;
+        pos += 8 + (QWORD) hdr[1] + (hdr[1] & 1);
     }
 
+    if (count < 2 || LIMITS_SET(&ctx->Limits) ||
+        (ctx->Flags & (AVI_JSON | AVI_SUMMARY | AVI_VERIFY | AVI_FRAME | AVI_SEEK |
+                       AVI_GOP | AVI_REPAIR | AVI_DEMUX | AVI_AUDIT | AVI_CHECK |
+                       AVI_RESYNC)))
+    {
+        free(sj.SegPos);
+        return(AviParse(ctx));
+    }
 
-    parse_riff(in);
+    OutFlush(ctx->out);
+    ThreadRunOrdered(count, threads, SegmentJob, &sj, ctx->out->fp);
+    free(sj.SegPos);
 
-    File64Close(in);
+    // anything after the last segment gets the usual treatment
 
-    return 0;
-}
-
-
-
+    riff_count = count;
+    File64SetAbsPos(in, pos);
+    while (parse_segment(ctx, &riff_count));
+    OutFlush(ctx->out);
+
+    return(0);
+}
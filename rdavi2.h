@@ -19,23 +19,12 @@ Although not required, attribution is requested for any source code
 used by others.
 */
 
-#if defined(__GNUC__)
-#error GCC is not tested.  Comment out this line and compile at your own risk.
-#define __TINYC__
-#endif
-
-#if defined(__clang__)
-#error clang is not tested.  Comment out this line and compile at your own risk.
-#define __TINYC__
-#endif
-
-#if defined(__TINYC__)
-  // TINYC is a 64 bit compiler.
-  #pragma pack(push, 1)
-  #define NO_HUGE_FILES
+#if defined(__TINYC__) || defined(__GNUC__) || defined(__clang__)
+  // TINYC, GCC and clang are 64 bit compilers.  They are all treated alike.
   #define min(X, Y) (((X) < (Y)) ? (X) : (Y))
   typedef unsigned long long QWORD;   // different
 
+  #define _FILE_OFFSET_BITS 64        // 64 bit off_t for fseeko() and pread()
 #endif
 
 #if defined(__BORLANDC__)
@@ -54,6 +43,7 @@ used by others.
   #include <ctype.h>
   #include <sys/types.h>
   #include <sys/stat.h>
+  #include <pthread.h>
   #define FALSE  0
   #define TRUE   !FALSE
 
@@ -94,23 +84,28 @@ used by others.
 //#define NO_HUGE_FILES
 
 
-// Test whether compiler uses LE or BE order for multi-character literals
-#if '0123' == 0x33323130
-  #define LE_MC_LIT   // Borland LE
-#else
-  #define BE_MC_LIT   // Most other compilers BE
-#endif
+// Build a FourCC from its four chars, in the order they are in the file.
+// Multi-character literals like 'RIFF' are not used, since compilers
+// do not agree on their byte order.  This is a constant, so it can be
+// used for case labels and in tables.
+#define MKFCC(a, b, c, d)   ((DWORD)(BYTE)(a) | ((DWORD)(BYTE)(b) << 8) | \
+                             ((DWORD)(BYTE)(c) << 16) | ((DWORD)(BYTE)(d) << 24))
 
-#if defined(BE_MC_LIT)    // make sure literal is in Little Endian Order
-  // must reverse
-  #define FIX_LIT(x)  ReverseLiteral((DWORD)(x))
-#else
-  #define FIX_LIT(x)  ((DWORD)(x))
-#endif
+// Read a little endian DWORD or FourCC at any byte offset.  Chunks only
+// have to be word aligned in the file, so a header in a buffer or in the
+// mapping cannot be loaded through a DWORD pointer.
+#define GET_DWORD(p)        MKFCC(((BYTE *)(p))[0], ((BYTE *)(p))[1], \
+                              ((BYTE *)(p))[2], ((BYTE *)(p))[3])
 
 #define WAVE_FORMAT_EXTENSIBLE 0xFFFE
 
 
+
+// The structures from here to SUPERINDEXENTRY are laid out exactly as they
+// are in the file, so they are packed.  Nothing else is, as structures
+// that hold pointers, mutexes and the like need their natural alignment.
+
+#pragma pack(push, 1)
 
 typedef struct
 {
@@ -275,6 +270,14 @@ typedef struct     // legacy index structure
     DWORD dwChunkLength;
 } AVIINDEXENTRY;
 
+// dwFlags for AVIINDEXENTRY
+#define AVIIF_LIST          0x00000001L // chunk is a 'LIST'
+#define AVIIF_KEYFRAME      0x00000010L // this frame is a key frame.
+#define AVIIF_FIRSTPART     0x00000020L // this frame is the start of a partial frame.
+#define AVIIF_LASTPART      0x00000040L // this frame is the end of a partial frame.
+#define AVIIF_NO_TIME	    0x00000100L // this frame doesn't take any time
+#define AVIIF_COMPUSE       0x0FFF0000L
+
 typedef struct
 {
     DWORD CompressedBMHeight;
@@ -353,6 +356,8 @@ typedef struct
     DWORD dwDuration; // time span in stream ticks
 } SUPERINDEXENTRY;
 
+#pragma pack(pop)
+
 
 // codecs.c prototypes
 
@@ -361,22 +366,597 @@ char *LookupFormat(DWORD FmtNum);
 char *LookupINFO(DWORD Info);
 
 
+// File64.c file handle
+// Method tells how the file is being read.  For FILE64_MAPPED and
+// FILE64_PREAD, Pos is the absolute file position and the stream's own file
+// pointer is not used.  For FILE64_STREAM everything goes through fp.
+
+#define FILE64_STREAM   0       // fread() or ReadFile()
+#define FILE64_MAPPED   1       // memory mapped window
+#define FILE64_PREAD    2       // 64 bit positional reads
+
+typedef struct
+{
+    FILE   *fp;         // stdio stream, always open
+    int     Method;     // one of the FILE64_* codes
+    QWORD   SeekBase;   // base of file pos, gets added to seeks
+    QWORD   FileSize;   // size of the file, or 0 if not known
+    QWORD   Pos;        // absolute file position, unless FILE64_STREAM
+    BYTE   *MapBase;    // first byte of the current map window or NULL
+    QWORD   MapStart;   // absolute file location of MapBase
+    size_t  MapLen;     // number of bytes in the map window
+    size_t  WinSize;    // preferred size of a map window
+    DWORD   MapGen;     // changes each time the window is moved
+    QWORD   BytesRead;  // bytes read or viewed so far, for parse limits
+#if defined(__WIN32__)
+    HANDLE  hMap;       // file mapping object
+#else
+    int     Faults;     // MapFaults when the file size was last checked
+#endif
+} FILE64;
+
+
 // File64.c prototypes
 
-void   File64SetBase(FILE *fp, int delta);
-QWORD  File64GetBase(void);
-FILE  *File64Open(char *fname, char *mode);
-void   File64Close(FILE *fp);
-size_t File64Read(FILE *fp, void *buffer, int len);
-int    File64SetPos(FILE *fp, LONG offset, int whence);
-DWORD  File64GetPos(FILE *fp);
-DWORD  ReverseLiteral(DWORD val);
+void    File64SetBase(FILE64 *fp, int delta);
+QWORD   File64GetBase(FILE64 *fp);
+FILE64 *File64Open(char *fname, char *mode);
+void    File64Close(FILE64 *fp);
+void    File64Unmap(FILE64 *fp);
+size_t  File64Read(FILE64 *fp, void *buffer, int len);
+size_t  File64ReadAt(FILE64 *fp, QWORD pos, void *buffer, int len);
+size_t  File64Write(FILE64 *fp, void *buffer, int len);
+size_t  File64WriteAt(FILE64 *fp, QWORD pos, void *buffer, int len);
+int     File64Truncate(FILE64 *fp, QWORD size);
+QWORD   File64Copy(FILE64 *out, FILE64 *in, QWORD pos, QWORD len, void *buf, int buflen);
+void   *File64View(FILE64 *fp, void *buffer, int len);
+void   *File64ViewAt(FILE64 *fp, QWORD pos, void *buffer, int *len);
+int     File64SetPos(FILE64 *fp, LONG offset, int whence);
+DWORD   File64GetPos(FILE64 *fp);
+void    File64SetAbsPos(FILE64 *fp, QWORD pos);
+QWORD   File64GetAbsPos(FILE64 *fp);
+QWORD   File64Size(FILE64 *fp);
+QWORD   File64MTime(FILE64 *fp);
+int     File64SameFile(FILE64 *fp, char *fname);
+char   *File64TempName(char *fname);
+int     File64Replace(char *tmpname, char *fname);
+
+
+// FileUtil.c chunk scanner
+
+typedef struct
+{
+    QWORD   Pos;        // absolute file location of the chunk header
+    FOURCC  FCC;        // standardized FourCC, see ParseFCC()
+    int     StreamNum;  // stream number or -1
+    DWORD   Size;       // chunk size from the header
+} CHUNKHDR;
+
+typedef struct
+{
+    FILE64 *fp;
+    QWORD   Next;       // absolute file location of the next chunk header
+    QWORD   End;        // absolute file location of the end of the scan
+    BYTE   *Data;       // current block, either in Buf or in the mapping
+    QWORD   DataPos;    // absolute file location of Data
+    DWORD   DataLen;    // number of bytes at Data
+    DWORD   MapGen;     // fp->MapGen when Data was set up
+    BYTE   *Buf;        // block buffer
+} CHUNKSCAN;
+
+
+// FileUtil.c resync after damage, kinds of header ChunkResync() looks for
+
+#define RESYNC_STREAM   0x0001  // '##dc', '##db', '##wb', '##tx', '##pc' and 'ix##'
+#define RESYNC_LIST     0x0002  // 'LIST' of 'movi' or 'rec '
+#define RESYNC_RIFF     0x0004  // 'RIFF' of 'AVIX'
+#define RESYNC_IDX1     0x0008  // 'idx1'
+
+
+// FileUtil.c parse limits
+// Bounds on how much work a parse may do, so that a hostile or broken
+// file cannot run it for ever.  A maximum of 0 is no limit.  Depth is the
+// number of lists a chunk is inside of, so the 'RIFF' chunks are at 0.
+
+typedef struct
+{
+    int     MaxDepth;   // deepest chunk allowed
+    DWORD   MaxChunks;  // chunk headers looked at
+    QWORD   MaxBytes;   // bytes read from the file
+    DWORD   MaxSeconds; // wall clock time
+    DWORD   Chunks;     // chunk headers looked at so far
+    QWORD   StartBytes; // BytesRead of the file when the parse started
+    DWORD   StartTime;  // time() when the parse started
+    char   *Hit;        // the limit that stopped the parse, or NULL
+} AVILIMITS;
+
+#define LIMITS_SET(l)   ((l)->MaxDepth || (l)->MaxChunks || (l)->MaxBytes || (l)->MaxSeconds)
 
 
 // FileUtil.c prototypes
 
-char *QWORD2HEX(QWORD val);
-LONG read_long(FILE *in);
-FOURCC ReadFCC(FILE *in, int *StreamNum);
-
-
+char *QWORD2HEX(QWORD val, char *outstr);
+void  HexRow(BYTE *src, char *hex, char *chr);
+void  HexByte(BYTE ch, char *hex, char *chr);
+void  HexDword(DWORD val, char *out);
+LONG read_long(FILE64 *in);
+FOURCC ParseFCC(void *p, int *StreamNum);
+void  ParseFCCs(void *p, int stride, int count, FOURCC *fcc, int *StreamNum);
+FOURCC ReadFCC(FILE64 *in, int *StreamNum);
+int   ChunkScanOpen(CHUNKSCAN *cs, FILE64 *fp, QWORD start, QWORD end);
+void  ChunkScanClose(CHUNKSCAN *cs);
+void *ChunkScanPeek(CHUNKSCAN *cs, QWORD pos, int len);
+int   ChunkScanNext(CHUNKSCAN *cs, QWORD end, CHUNKHDR *ck);
+QWORD ChunkResync(FILE64 *fp, QWORD pos, QWORD end, QWORD limit, int kinds);
+void  LimitStart(AVILIMITS *lim, FILE64 *in);
+char *LimitCheck(AVILIMITS *lim, FILE64 *in, int depth);
+char *MakeFileName(char *pattern, char *avi, int size);
+
+
+// Thread.c types
+// Windows threads and pthreads hidden behind the same names.
+
+#if defined(__WIN32__)
+  typedef HANDLE            THREAD;
+  typedef CRITICAL_SECTION  MUTEX;
+  typedef HANDLE            SEMA;
+#else
+  typedef pthread_t         THREAD;
+  typedef pthread_mutex_t   MUTEX;
+  typedef struct
+  {
+      pthread_mutex_t mx;
+      pthread_cond_t  cv;
+      int             count;
+  } SEMA;
+#endif
+
+
+// Thread.c ordered job runner
+// A job writes its report for job number num to out, and returns 0 on
+// success.
+
+typedef int (*ORDEREDJOB)(void *arg, int num, FILE *out);
+
+
+// Thread.c prototypes
+
+int  ThreadStart(THREAD *th, void (*fn)(void *), void *arg);
+void ThreadJoin(THREAD th);
+int  ThreadCpuCount(void);
+void MutexInit(MUTEX *mx);
+void MutexLock(MUTEX *mx);
+void MutexUnlock(MUTEX *mx);
+void MutexFree(MUTEX *mx);
+void SemaInit(SEMA *sm, int count);
+void SemaWait(SEMA *sm);
+void SemaPost(SEMA *sm);
+void SemaFree(SEMA *sm);
+int  ThreadRunOrdered(int count, int threads, ORDEREDJOB job, void *arg, FILE *out);
+
+
+// Output.c buffered output
+
+typedef struct
+{
+    FILE   *fp;         // where the buffer is written
+    char   *Buf;        // the buffer, or NULL to write straight to fp
+    size_t  Len;        // bytes in the buffer
+    size_t  Size;       // size of the buffer
+} OUTBUF;
+
+
+// Output.c prototypes
+
+void OutInit(OUTBUF *ob, FILE *fp);
+void OutFlush(OUTBUF *ob);
+void OutClose(OUTBUF *ob);
+void OutMem(OUTBUF *ob, char *s, int len);
+void OutStr(OUTBUF *ob, char *s);
+void OutChar(OUTBUF *ob, int ch);
+void OutDec(OUTBUF *ob, LONG val);
+void OutHex(OUTBUF *ob, DWORD val, int digits);
+void OutHex64(OUTBUF *ob, QWORD val);
+void OutQDec(OUTBUF *ob, QWORD val);
+void OutPrintf(OUTBUF *ob, char *fmt, ...);
+
+
+// RdAvi2.c parser context
+// Everything needed while parsing one file is kept here rather than in
+// globals, so that several files can be parsed at once in one process.
+
+#define AVI_FULLDUMP    0x0001  // show everything, do not stop at 16 lines
+#define AVI_SEGMENTS    0x0002  // read the RIFF segments on threads
+#define AVI_JSON        0x0004  // write the report as JSON
+#define AVI_SUMMARY     0x0008  // summary from the index only
+#define AVI_STATS       0x0010  // statistics in the summary too
+#define AVI_VERIFY      0x0020  // check the indexes against the movi list
+#define AVI_FRAME       0x0040  // look up the frame in Query
+#define AVI_SEEK        0x0080  // look up the time in Query
+#define AVI_GOP         0x0100  // look up the GOP of the frame in Query
+#define AVI_REPAIR      0x0200  // rebuild the indexes, into the file in Query
+#define AVI_DEMUX       0x0400  // write the chunks of the stream in Query
+#define AVI_AUDIT       0x0800  // write a checksum of every chunk to Query
+#define AVI_CHECK       0x1000  // check the chunks against the checksums in Query
+#define AVI_RESYNC      0x2000  // look for the next good chunk after damage
+
+typedef struct
+{
+    FILE64 *in;             // file being parsed
+    char   *Name;           // file name for the report, or NULL
+    char   *CacheDir;       // where chunk trees are cached, or NULL
+    OUTBUF *out;            // where the report is written
+    DWORD   Flags;          // AVI_* report options
+    DWORD   movi_offset;    // offset of the current 'movi' tag
+    int     Level;          // output nesting level
+    char   *indent;         // Level converted to spaces
+    int     MaxLines;       // lines shown before the rest are suppressed
+    char   *Query;          // "stream:frame", "stream:seconds", "stream:file", a file name or NULL
+    int     Threads;        // for work split up within the file, 0 for one per CPU
+    AVILIMITS Limits;       // how far the chunk listing or JSON may go
+    OUTBUF  OutBuf;         // out points here
+} AVICTX;
+
+
+// RdAvi2.c prototypes
+
+void AviInitContext(AVICTX *ctx, FILE64 *in, FILE *out, DWORD flags);
+void AviFreeContext(AVICTX *ctx);
+int  AviParse(AVICTX *ctx);
+int  AviParseSegments(AVICTX *ctx, char *fname, int threads);
+
+
+// Walk.c chunk events
+// AviWalk() reads the file from top to bottom and hands each chunk to a
+// sink as it is found, so that reports other than the text one can be
+// built without holding the file in memory.  Open() is called for every
+// chunk with its decoded header, if it has one, in Data.  Data only lives
+// until the call returns.  Open() returns non-zero to skip the contents of
+// a list or index.  Each entry of an index is passed to Entry(), and
+// Close() is called after the contents of every chunk.
+
+#define MAX_WALK_DEPTH  64      // deepest nesting of lists followed
+
+#define NODE_CHUNK      0       // any chunk not decoded
+#define NODE_LIST       1       // 'RIFF' or 'LIST', Type holds the list type
+#define NODE_AVIH       2       // Data is MainAVIHeader
+#define NODE_STRH       3       // Data is AVIStreamHeader56
+#define NODE_STRF_VID   4       // Data is STREAMFORMATVID
+#define NODE_STRF_AUD   5       // Data is STREAMFORMATAUD
+#define NODE_INDX       6       // 'indx' or 'ix##', Data is INDX_CHUNK
+#define NODE_IDX1       7       // legacy index, no Data
+#define NODE_DMLH       8       // Data is AVIEXTHEADER
+#define NODE_STRING     9       // 'strn' or INFO text, Data is the string
+#define NODE_VPRP       10      // Data is VideoPropHeader
+#define NODE_ERROR      11      // tree only, Data is the message
+
+#define ENTRY_IDX1      0       // AVIINDEXENTRY
+#define ENTRY_SUPER     1       // SUPERINDEXENTRY
+#define ENTRY_STD       2       // STDINDEXENTRY
+#define ENTRY_FIELD     3       // FIELDINDEXENTRY
+#define ENTRY_CHUNK     4       // a chunk of the movi list, no index
+
+typedef struct
+{
+    FOURCC  FCC;        // chunk id, as returned by ParseFCC()
+    FOURCC  Type;       // list type for NODE_LIST
+    int     StreamNum;  // stream number from the id, or -1
+    int     Kind;       // one of the NODE_* codes
+    int     Depth;      // 0 for the RIFF chunks
+    QWORD   Pos;        // absolute file location of the chunk header
+    DWORD   Size;       // size from the chunk header
+    void   *Data;       // decoded header, see Kind
+} AVINODE;
+
+typedef struct
+{
+    int     Kind;       // one of the ENTRY_* codes
+    FOURCC  FCC;        // chunk id
+    int     StreamNum;  // stream number from FCC, or -1
+    DWORD   Num;        // entry number within the index
+    QWORD   Pos;        // absolute file location of what is indexed
+    QWORD   Pos2;       // second field of ENTRY_FIELD
+    DWORD   Size;       // size with the keyframe bit removed
+    DWORD   Flags;      // dwFlags for idx1, dwDuration for ENTRY_SUPER
+    int     KeyFrame;   // TRUE if this is a keyframe
+} AVIENTRY;
+
+typedef struct
+{
+    void   *arg;        // passed to each function
+    int   (*Open)(void *arg, AVINODE *node);
+    void  (*Entry)(void *arg, AVINODE *node, AVIENTRY *e);
+    void  (*Close)(void *arg, AVINODE *node);
+    void  (*Error)(void *arg, char *msg);
+} AVISINK;
+
+
+// Walk.c prototypes
+
+int AviWalk(FILE64 *in, AVISINK *sink, AVILIMITS *lim);
+
+
+// Tree.c arena
+// Memory handed out from big blocks and freed all at once.
+
+typedef struct ARENABLOCK ARENABLOCK;
+
+typedef struct
+{
+    ARENABLOCK *Head;       // newest block, the one being used
+    size_t      Total;      // bytes in all blocks
+} ARENA;
+
+
+// Tree.c chunk tree
+// One node per chunk.  Data and Entry point into the tree's arena and
+// last as long as the tree does.
+
+typedef struct AVITREENODE
+{
+    struct AVITREENODE *Parent;     // list holding this chunk
+    struct AVITREENODE *Child;      // first chunk in this list or NULL
+    struct AVITREENODE *Next;       // next chunk in the same list or NULL
+    FOURCC  FCC;        // chunk id as stored in the file
+    FOURCC  Type;       // list type for NODE_LIST
+    int     StreamNum;  // stream number from the id, or -1
+    int     Kind;       // one of the NODE_* codes
+    int     Depth;      // 0 for the RIFF chunks, -1 for the root
+    QWORD   Pos;        // absolute file location of the chunk header
+    DWORD   Size;       // size from the chunk header
+    void   *Data;       // copy of the decoded header, see Kind
+    DWORD   Num;        // node number in file order, 0 for the root
+    AVIENTRY *Entry;    // index entries for NODE_INDX and NODE_IDX1
+    DWORD   EntryCount; // entries in use
+    DWORD   EntryAlloc; // entries allocated
+} AVITREENODE;
+
+typedef struct
+{
+    AVITREENODE *Root;      // stands for the whole file
+    QWORD   FileSize;       // size of the file, or 0 if not known
+    DWORD   NodeCount;      // nodes below the root
+    int     Result;         // what AviWalk() returned
+    int     OutOfMemory;    // TRUE if the arena could not grow
+    ARENA   Arena;          // everything in the tree lives here
+} AVITREE;
+
+
+// Tree.c prototypes
+
+void *ArenaAlloc(ARENA *a, size_t size);
+void  ArenaFree(ARENA *a);
+AVITREE     *AviTreeBuild(FILE64 *in);
+void         AviTreeFree(AVITREE *t);
+AVITREENODE *AviTreeNext(AVITREENODE *n);
+AVITREENODE *AviTreeFind(AVITREENODE *n, FOURCC fcc, FOURCC type);
+int          AviTreeWalk(AVITREE *t, AVISINK *sink);
+size_t       AviTreeDataSize(int kind, void *data);
+
+
+// Cache.c prototypes
+
+AVITREE *CacheTree(FILE64 *in, char *fname, char *dir);
+
+
+// Index.c index reader
+// AviIndexRead() fills this in from the headers of a file and passes each
+// index entry to Entry(), with the number of the stream it belongs to.
+
+#define MAX_STREAMS     256     // stream numbers are two hex digits
+
+#define INDEX_NONE      0       // no index was found
+#define INDEX_IDX1      1       // legacy 'idx1'
+#define INDEX_ODML      2       // Open-DML super and standard indexes
+#define INDEX_MOVI      3       // no index, the movi list was read instead
+
+#define INDEX_WANT(x)   (1 << (x))  // bits of Sources
+
+typedef struct
+{
+    void   *arg;        // passed to Entry() and Error()
+    void  (*Entry)(void *arg, int stream, AVIENTRY *e);
+    void  (*Error)(void *arg, char *msg);
+    int     Sources;                    // 0 for the best index, else INDEX_WANT() bits
+    int     HasAvih;                    // TRUE if Avih was found
+    MainAVIHeader Avih;
+    int     StreamCount;                // number of strh found
+    AVIStreamHeader56 Strh[MAX_STREAMS];   // in stream number order
+    int     Source;                     // INDEX_* the entries came from, the last one if Sources
+    QWORD   MoviPos;                    // location of the first 'movi' tag
+    QWORD   RiffEnd;                    // end of the first RIFF chunk
+    QWORD   Idx1Base;                   // what idx1 offsets are from, 0 for the file start
+    QWORD   EntryCount;                 // entries passed to Entry()
+    QWORD   IndexBytes;                 // bytes of index read
+} AVIINDEX;
+
+
+// Index.c prototypes
+
+int AviIndexRead(FILE64 *in, AVIINDEX *ix);
+QWORD AviIdx1Base(FILE64 *in, QWORD movi, QWORD pos, FOURCC fcc);
+
+
+// Summary.c prototypes
+
+int SummaryReport(AVICTX *ctx);
+
+
+// Verify.c prototypes
+
+int VerifyReport(AVICTX *ctx);
+
+
+// KeyMap.c key frame bitmap
+// One bit a chunk of a stream, set for key frames, with the tables that
+// KeyMapFinish() builds to count and find key frames in constant time.
+
+#define KEYMAP_NONE     0xFFFFFFFFUL    // no such key frame
+
+typedef struct
+{
+    DWORD   Count;      // bits added
+    DWORD   Ones;       // of them set
+    DWORD   Alloc;      // words allocated for Bits
+    DWORD  *Bits;       // bit n of word n / 32 is chunk n
+    DWORD  *Rank;       // set bits before each block of words
+    BYTE   *SubRank;    // set bits before each word, from its block
+    DWORD  *Select;     // word holding every 64th set bit
+} KEYMAP;
+
+
+// KeyMap.c prototypes
+
+void  KeyMapInit(KEYMAP *km);
+void  KeyMapFree(KEYMAP *km);
+size_t KeyMapBytes(KEYMAP *km);
+int   KeyMapAdd(KEYMAP *km, int key);
+int   KeyMapFinish(KEYMAP *km);
+DWORD KeyMapRank(KEYMAP *km, DWORD pos);
+DWORD KeyMapSelect(KEYMAP *km, DWORD n);
+DWORD KeyMapPrev(KEYMAP *km, DWORD pos);
+DWORD KeyMapNext(KEYMAP *km, DWORD pos);
+
+
+// Lookup.c frame lookup
+// AviLookupOpen() keeps the super index, or where each stream's entries
+// are in idx1, so that AviLookupFrame() can find any frame by reading
+// one or two index entries.  Frames are in the units of the stream
+// header, samples for audio with a SampleSize.  With LOOKUP_KEYS, the key
+// frames of streams with a frame to a chunk are kept in a KEYMAP too, and
+// with LOOKUP_ENTRIES the whole index is kept packed in memory.
+
+#define LOOKUP_KEYS     0x0001  // build key frame maps
+#define LOOKUP_ENTRIES  0x0002  // keep every entry in an IXSTORE
+
+typedef struct AVILOOKUP AVILOOKUP;
+
+typedef struct
+{
+    QWORD   Pos;        // location of the chunk data
+    DWORD   Size;       // bytes of chunk data
+    int     KeyFrame;   // TRUE if the chunk is a key frame
+    QWORD   Start;      // first frame in the chunk
+    DWORD   Frames;     // frames in the chunk
+    int     Source;     // INDEX_* the chunk was found in
+} AVIFRAME;
+
+typedef struct
+{
+    AVIFRAME Key;           // key frame to start from
+    QWORD    KeyMs;         // when it plays, in ms from the start of the file
+    int      AudioStream;   // audio stream number, or -1 if none
+    QWORD    AudioSample;   // audio frame that plays with Key
+    AVIFRAME Audio;         // the audio chunk holding it
+} AVISEEK;
+
+typedef struct
+{
+    QWORD   Key;        // key frame the GOP starts with, KEYMAP_NONE if none
+    QWORD   Next;       // next key frame, or the frames in the stream
+    QWORD   Length;     // frames in the GOP
+    DWORD   KeyNum;     // number of the key frame, from 0
+    DWORD   Keys;       // key frames in the stream
+} AVIGOP;
+
+
+// Lookup.c prototypes
+
+AVILOOKUP *AviLookupOpen(FILE64 *in, int flags);
+void AviLookupClose(AVILOOKUP *lk);
+size_t AviLookupBytes(AVILOOKUP *lk);
+AVIStreamHeader56 *AviLookupStrh(AVILOOKUP *lk, int stream);
+int  AviLookupFrame(AVILOOKUP *lk, int stream, QWORD frame, AVIFRAME *f);
+int  AviLookupKeyFrame(AVILOOKUP *lk, int stream, QWORD frame, AVIFRAME *f);
+QWORD AviLookupFrameToMs(AVIStreamHeader56 *sh, QWORD frame);
+QWORD AviLookupMsToFrame(AVIStreamHeader56 *sh, QWORD ms);
+int  AviLookupSeek(AVILOOKUP *lk, int stream, QWORD ms, AVISEEK *sk);
+int  AviLookupGop(AVILOOKUP *lk, int stream, QWORD frame, AVIGOP *g);
+DWORD AviLookupKeyCount(AVILOOKUP *lk, int stream, QWORD first, QWORD last);
+int  FrameReport(AVICTX *ctx);
+int  SeekReport(AVICTX *ctx);
+int  GopReport(AVICTX *ctx);
+
+
+// IxStore.c compact index
+// The entries of one stream's index, packed into blocks of IXSTORE_BLOCK
+// to a few bytes each, and read back as AVIFRAMEs.
+
+#define IXSTORE_BLOCK   64              // entries to a block
+#define IXSTORE_NONE    0xFFFFFFFFUL    // no such entry
+
+typedef struct
+{
+    QWORD   Pos;        // location of the first chunk's data
+    QWORD   Start;      // frames before the block
+    DWORD   Data;       // offset of the block in Data
+    DWORD   MinSize;    // smallest chunk in the block
+    BYTE    Bits;       // bits of each size above MinSize
+} IXBLOCK;
+
+typedef struct
+{
+    DWORD   SampleSize;     // of the stream, 0 for a frame to a chunk
+    DWORD   Count;          // entries added
+    QWORD   Frames;         // frames in them
+    DWORD   BlockCount;
+    DWORD   BlockAlloc;
+    IXBLOCK *Block;
+    DWORD   DataSize;       // bytes of packed sizes and varints
+    DWORD   DataAlloc;
+    BYTE   *Data;
+    void   *Pending;        // entries not yet packed, while adding
+} IXSTORE;
+
+
+// IxStore.c prototypes
+
+void   IxStoreInit(IXSTORE *st, DWORD samplesize);
+void   IxStoreFree(IXSTORE *st);
+size_t IxStoreBytes(IXSTORE *st);
+int    IxStoreAdd(IXSTORE *st, QWORD pos, DWORD size, int key);
+int    IxStoreFinish(IXSTORE *st);
+DWORD  IxStoreRead(IXSTORE *st, DWORD first, DWORD count, AVIFRAME *f);
+int    IxStoreGet(IXSTORE *st, DWORD n, AVIFRAME *f);
+DWORD  IxStoreFind(IXSTORE *st, QWORD frame);
+
+
+// Repair.c prototypes
+
+int RepairReport(AVICTX *ctx);
+
+
+// Demux.c prototypes
+
+int DemuxReport(AVICTX *ctx);
+
+
+// Audit.c prototypes
+
+int AuditReport(AVICTX *ctx);
+
+
+// Json.c prototypes
+
+int  JsonReport(AVICTX *ctx);
+void JsonFileError(FILE *fp, char *fname, char *msg);
+
+
+// Batch.c file list
+// Names of the files to be reported on, in the order given.
+
+typedef struct
+{
+    char  **Name;       // array of file names
+    int     Count;      // number of names in use
+    int     Alloc;      // number of names allocated
+} NAMELIST;
+
+
+// Batch.c prototypes
+
+int  NameListAdd(NAMELIST *nl, char *name);
+int  NameListRead(NAMELIST *nl, FILE *fp);
+void NameListFree(NAMELIST *nl);
+int  BatchRun(NAMELIST *nl, int threads, DWORD flags, char *cachedir, char *query,
+              AVILIMITS *lim);
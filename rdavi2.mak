@@ -38,7 +38,8 @@ BOptsAt_rdavi2dexe = $(BLocalOptsAtC32_rdavi2dexe)
 # Dependency List
 #
 Dep_rdavi2 = \
-   rdavi2.exe
+   rdavi2.exe\
+   librdavi2.lib
 
 rdavi2 : BccW32.cfg $(Dep_rdavi2)
   echo MakeNode
@@ -47,7 +48,24 @@ Dep_rdavi2dexe = \
    rdavi2.obj\
    codecs.obj\
    file64.obj\
-   fileutil.obj
+   fileutil.obj\
+   thread.obj\
+   batch.obj\
+   output.obj\
+   walk.obj\
+   json.obj\
+   tree.obj\
+   cache.obj\
+   index.obj\
+   summary.obj\
+   verify.obj\
+   lookup.obj\
+   keymap.obj\
+   ixstore.obj\
+   repair.obj\
+   demux.obj\
+   audit.obj\
+   main.obj
 
 rdavi2.exe : $(Dep_rdavi2dexe)
   $(ILINK32) @&&|
@@ -56,14 +74,77 @@ C:\BC5\LIB\c0x32.obj+
 rdavi2.obj+
 codecs.obj+
 file64.obj+
-fileutil.obj
+fileutil.obj+
+thread.obj+
+batch.obj+
+output.obj+
+walk.obj+
+json.obj+
+tree.obj+
+cache.obj+
+index.obj+
+summary.obj+
+verify.obj+
+lookup.obj+
+keymap.obj+
+ixstore.obj+
+repair.obj+
+demux.obj+
+audit.obj+
+main.obj
 $<,$*
 C:\BC5\LIB\import32.lib+
-C:\BC5\LIB\cw32.lib
+C:\BC5\LIB\cw32mt.lib
 
 
 
 |
+Dep_librdavi2dlib = \
+   rdavi2.obj\
+   codecs.obj\
+   file64.obj\
+   fileutil.obj\
+   thread.obj\
+   batch.obj\
+   output.obj\
+   walk.obj\
+   json.obj\
+   tree.obj\
+   cache.obj\
+   index.obj\
+   summary.obj\
+   verify.obj\
+   lookup.obj\
+   keymap.obj\
+   ixstore.obj\
+   repair.obj\
+   demux.obj\
+   audit.obj
+
+librdavi2.lib : $(Dep_librdavi2dlib)
+  $(TLIB) $< /P64 @&&|
+-+rdavi2.obj &
+-+codecs.obj &
+-+file64.obj &
+-+fileutil.obj &
+-+thread.obj &
+-+batch.obj &
+-+output.obj &
+-+walk.obj &
+-+json.obj &
+-+tree.obj &
+-+cache.obj &
+-+index.obj &
+-+summary.obj &
+-+verify.obj &
+-+lookup.obj &
+-+keymap.obj &
+-+ixstore.obj &
+-+repair.obj &
+-+demux.obj &
+-+audit.obj
+|
+
 Dep_rdavi2dobj = \
    rdavi2.h\
    rdavi2.c
@@ -88,13 +169,98 @@ fileutil.obj :  fileutil.c
  $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ fileutil.c
 |
 
+thread.obj :  thread.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ thread.c
+|
+
+batch.obj :  batch.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ batch.c
+|
+
+output.obj :  output.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ output.c
+|
+
+walk.obj :  walk.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ walk.c
+|
+
+json.obj :  json.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ json.c
+|
+
+tree.obj :  tree.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ tree.c
+|
+
+cache.obj :  cache.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ cache.c
+|
+
+index.obj :  index.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ index.c
+|
+
+summary.obj :  summary.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ summary.c
+|
+
+verify.obj :  verify.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ verify.c
+|
+
+lookup.obj :  lookup.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ lookup.c
+|
+
+keymap.obj :  keymap.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ keymap.c
+|
+
+ixstore.obj :  ixstore.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ ixstore.c
+|
+
+repair.obj :  repair.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ repair.c
+|
+
+demux.obj :  demux.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ demux.c
+|
+
+audit.obj :  audit.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ audit.c
+|
+
+main.obj :  main.c
+  $(BCC32) -P- -c @&&|
+ $(CompOptsAt_rdavi2dexe) $(CompInheritOptsAt_rdavi2dexe) -o$@ main.c
+|
+
 # Compiler configuration file
 BccW32.cfg :
    Copy &&|
 -w
 -R
 -v
--WM-
+-WM
 -vi
 -H
 -H=readavi.csm
@@ -0,0 +1,1568 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+Index repair.  A capture cut short by a crash or a full disk leaves a
+movi list with no 'idx1' or 'ix##' indexes after it, and usually RIFF and
+LIST sizes that were never filled in, so players either refuse the file
+or read all of it before they can seek.
+
+RepairReport() reads the movi lists once with the chunk scanner and keeps
+every chunk in an IXSTORE, stopping at the first chunk header that makes
+no sense, which is where the writer was cut off.  Key frames are not
+marked in the movi list, so they are taken from whatever index the file
+still has, with AviIndexRead().  Only for the chunks that no index entry
+covers is the start of each video chunk looked at: an MPEG-4 VOP or an
+H.264 slice tells what kind of frame it is.  Chunks of any other codec
+are taken to be key frames.  In place, a file whose index already covers
+every chunk, as it should, is left alone.
+
+Then the indexes are written, either into a new file or into the file
+itself.  A new file gets the headers and chunks copied, cut into RIFF
+segments of at most REPAIR_SEGMENT bytes of chunks, with an 'ix##' for
+each stream at the end of every movi list, an 'indx' super index in each
+stream header list and 'idx1' after the first movi list.  Where
+everything goes is worked out before anything is written, so the new
+file is written from front to back, the chunks copied in runs through
+one REPAIR_BUFFER sized buffer.
+
+In place, the chunks stay where they are and the indexes are written
+after the last one.  'idx1' can only be added when there is one RIFF,
+and Open-DML indexes only when each stream header list already has an
+'indx' or 'JUNK' chunk big enough for the super index.
+
+*/
+
+#include "rdavi2.h"
+
+#define REPAIR_SEGMENT  0x40000000UL    // most bytes of chunks in a RIFF written
+#define REPAIR_BUFFER   0x00400000UL    // copy and write buffer, 4MB
+#define REPAIR_PEEK     256             // bytes of a video chunk looked at
+#define REPAIR_HDRL     0x01000000UL    // biggest hdrl list read
+#define REPAIR_EXTRA    8               // other chunks kept before movi
+#define REPAIR_BATCH    256             // chunks read from the store at a time
+#define REPAIR_GROW     0x10000         // chunk ids added at a time
+#define DMLH_SIZE       248             // size of 'dmlh' as everybody writes it
+
+#define SNIFF_NONE      0       // every chunk is a key frame
+#define SNIFF_MPEG4     1       // MPEG-4 part 2, look for the VOP
+#define SNIFF_H264      2       // H.264, look for the first slice
+
+#define KIND_COUNT      5
+static char RepairKinds[] = "dcdbwbtxpc";   // chunk kinds, two letters each
+
+
+typedef struct
+{
+    QWORD   RiffPos;    // location of the RIFF header
+    QWORD   MoviPos;    // location of the 'movi' tag, base of the ix## offsets
+    QWORD   End;        // end of the chunks
+    QWORD   IxPos;      // location of the first ix## chunk
+    QWORD   MoviEnd;    // end of the movi list
+    QWORD   RiffEnd;    // end of the RIFF chunk
+    QWORD   Bytes;      // bytes of chunks, headers and pad bytes included
+    DWORD   First;      // number of the first chunk
+    DWORD   Count;      // chunks
+    DWORD   RiffSize;   // sizes found in the headers
+    DWORD   MoviSize;
+} REPAIRSEG;
+
+typedef struct
+{
+    FOURCC  Type;       // fccType from the stream header
+    DWORD   SampleSize;
+    int     Sniff;      // SNIFF_* key frame test
+    char    Digits[3];  // stream number as written in the chunk ids
+    int     Kind;       // kind of chunk the stream is made of
+    DWORD   StrhOff;    // offset of the strh data in the header, or 0
+    DWORD   IndxOff;    // offset of the 'indx' chunk header in the header
+    DWORD   IndxSize;   // its size
+    int     HasIndx;    // TRUE if there is room for a super index
+    DWORD   OldIndx;    // offset of the 'indx' found in place, or 0
+    QWORD   Chunks;     // chunks found
+    QWORD   Frames;     // frames in them
+    QWORD   Keys;       // key frames among them
+} REPAIRSTREAM;
+
+typedef struct
+{
+    QWORD   Pos;        // file location of the chunk data
+    DWORD   Size;
+    DWORD   Key;        // TRUE if a key frame
+} REPAIRKEY;
+
+typedef struct
+{
+    AVICTX *ctx;
+    FILE64 *in;
+    FILE64 *out;            // file being written
+    QWORD   FileSize;
+    BYTE   *Hdrl;           // contents of the hdrl list, after the list type
+    DWORD   HdrlSize;
+    QWORD   HdrlPos;        // location of Hdrl in the file
+    DWORD   AvihOff;        // offsets of the avih and dmlh data in the header
+    DWORD   DmlhOff;
+    int     ExtraCount;     // other chunks of the first RIFF, before movi
+    QWORD   ExtraPos[REPAIR_EXTRA];
+    DWORD   ExtraSize[REPAIR_EXTRA];
+    int     Streams;
+    REPAIRSTREAM Stream[MAX_STREAMS];
+    IXSTORE All;            // every chunk, in file order
+    REPAIRKEY *Known;       // entries of the old index, by file location
+    DWORD   KnownCount;
+    DWORD   KnownAlloc;
+    DWORD   KnownNext;      // first one not yet passed by the chunks
+    DWORD   KnownFound;     // chunks that an old entry was found for
+    int     KnownBad;       // an old entry has the wrong size, or the index is damaged
+    WORD   *Id;             // stream number | kind << 8 for each chunk
+    DWORD   IdAlloc;
+    int     SegCount;       // RIFF segments found
+    int     SegAlloc;
+    REPAIRSEG *Seg;
+    int     OutCount;       // RIFF segments written
+    int     OutAlloc;
+    REPAIRSEG *Out;
+    DWORD  *SegEntries;     // chunks of each stream in each segment written
+    DWORD  *SegFrames;      // and the frames in them
+    QWORD   Tail;           // end of the last good chunk
+    QWORD   Torn;           // where the file stops making sense, or 0
+    int     Idx1;           // TRUE to write idx1
+    int     Odml;           // TRUE to write indx and ix##
+    DWORD   MoviOff;        // offset of the movi list header in a new file
+    BYTE   *Buf;            // write buffer
+    DWORD   BufLen;
+    QWORD   OutPos;         // file location of the next byte written
+    QWORD   RunPos;         // chunks waiting to be copied
+    QWORD   RunLen;
+    int     OutOfMemory;
+    int     ReadError;
+    int     WriteError;
+} REPAIR;
+
+
+static void RepairError(REPAIR *rp, char *msg)
+{
+    OutPrintf(rp->ctx->out, "*** %s ***\n", msg);
+}
+
+
+// Build a FourCC from two pairs of characters, in file order.
+
+static FOURCC RepairFCC(char *a, char *b)
+{
+    char c[4];
+    FOURCC fcc;
+
+    c[0] = a[0];
+    c[1] = a[1];
+    c[2] = b[0];
+    c[3] = b[1];
+    memcpy(&fcc, c, 4);
+
+    return(fcc);
+}
+
+
+// Store a little endian DWORD or FourCC at any byte offset, the way
+// GET_DWORD() reads one.
+
+static void RepairSet(BYTE *p, DWORD val)
+{
+    p[0] = (BYTE) val;
+    p[1] = (BYTE)(val >> 8);
+    p[2] = (BYTE)(val >> 16);
+    p[3] = (BYTE)(val >> 24);
+}
+
+
+// Get the header of the chunk at offset off of a list held in memory, as
+// long as all of the chunk is before end.  Returns FALSE if it is not.
+
+static int RepairChunk(BYTE *buf, DWORD end, DWORD off, FOURCC *id, DWORD *size)
+{
+    if (off + 8 > end || off + 8 < off) return(FALSE);
+    *id = GET_DWORD(buf + off);
+    *size = GET_DWORD(buf + off + 4);
+
+    return(*size <= end - off - 8);
+}
+
+
+static DWORD RepairSkip(DWORD off, DWORD size)
+{
+    return(off + 8 + size + (size & 1));
+}
+
+
+// Pick the key frame test for a video codec.
+
+static int RepairSniffType(FOURCC fcc)
+{
+    static char *mpeg4[] = {"DIVX", "DX50", "XVID", "FMP4", "MP4V", "3IV2",
+                            "M4S2", "MP4S", "DIVF", NULL};
+    static char *h264[] = {"H264", "X264", "AVC1", "DAVC", "VSSH", NULL};
+    char name[5];
+    int i;
+
+    memcpy(name, &fcc, 4);
+    name[4] = 0;
+    for (i = 0; i < 4; i++)
+        name[i] = (char) toupper(name[i]);
+
+    for (i = 0; mpeg4[i]; i++)
+        if (strcmp(name, mpeg4[i]) == 0) return(SNIFF_MPEG4);
+    for (i = 0; h264[i]; i++)
+        if (strcmp(name, h264[i]) == 0) return(SNIFF_H264);
+
+    return(SNIFF_NONE);
+}
+
+
+// Tell whether the video chunk starting with the len bytes at p, of size
+// bytes in all, is a key frame.  An MPEG-4 VOP is an I-VOP when its
+// coding type, the two bits after the start code, is 0.  An H.264 frame
+// is a key frame if its first slice is an IDR slice, NAL unit type 5,
+// whether the units have start codes or 4 byte lengths in front of them.
+// When the bytes looked at say nothing, a chunk that was looked at in
+// full holds no picture and is not a key frame, otherwise it is taken to
+// be one.
+
+static int RepairSniff(int sniff, BYTE *p, DWORD len, DWORD size)
+{
+    DWORD i, n;
+    int type;
+
+    if (size == 0) return(FALSE);       // a dropped frame
+    if (sniff == SNIFF_NONE || p == NULL) return(TRUE);
+
+    if (sniff == SNIFF_MPEG4)
+    {
+        for (i = 0; i + 4 < len; i++)
+        {
+            if (p[i] == 0 && p[i+1] == 0 && p[i+2] == 1 && p[i+3] == 0xB6)
+                return((p[i+4] & 0xC0) == 0);
+        }
+    }
+    else if (len >= 4 && p[0] == 0 && p[1] == 0 && (p[2] == 1 || (p[2] == 0 && p[3] == 1)))
+    {
+        for (i = 0; i + 3 < len; i++)
+        {
+            if (p[i] != 0 || p[i+1] != 0 || p[i+2] != 1) continue;
+            type = p[i+3] & 0x1F;
+            if (type == 5) return(TRUE);
+            if (type >= 1 && type <= 4) return(FALSE);
+        }
+    }
+    else
+    {
+        for (i = 0; i + 4 < len; i += 4 + n)
+        {
+            n = ((DWORD) p[i] << 24) | ((DWORD) p[i+1] << 16) | ((DWORD) p[i+2] << 8) | p[i+3];
+            type = p[i+4] & 0x1F;
+            if (type == 5) return(TRUE);
+            if (type >= 1 && type <= 4) return(FALSE);
+            if (n > size) break;
+        }
+    }
+
+    return(len < size);
+}
+
+
+// Pick the streams out of the hdrl list.
+
+static int RepairStreams(REPAIR *rp)
+{
+    REPAIRSTREAM *st;
+    BYTE *h = rp->Hdrl;
+    DWORD off, end, off2, size, size2;
+    FOURCC id, id2, compression;
+
+    for (off = 0; RepairChunk(h, rp->HdrlSize, off, &id, &size); off = RepairSkip(off, size))
+    {
+        if (id == MKFCC('a','v','i','h') && size >= sizeof(MainAVIHeader))
+            rp->AvihOff = off + 8;
+        if (id != MKFCC('L','I','S','T') || size < 4) continue;
+
+        end = off + 8 + size;
+        if (GET_DWORD(h + off + 8) == MKFCC('o','d','m','l'))
+        {
+            for (off2 = off + 12; RepairChunk(h, end, off2, &id2, &size2); off2 = RepairSkip(off2, size2))
+                if (id2 == MKFCC('d','m','l','h') && size2 >= sizeof(AVIEXTHEADER))
+                    rp->DmlhOff = off2 + 8;
+            continue;
+        }
+        if (GET_DWORD(h + off + 8) != MKFCC('s','t','r','l') || rp->Streams == MAX_STREAMS)
+            continue;
+
+        st = rp->Stream + rp->Streams;
+        sprintf(st->Digits, "%02X", rp->Streams);
+        rp->Streams++;
+        compression = 0;
+
+        for (off2 = off + 12; RepairChunk(h, end, off2, &id2, &size2); off2 = RepairSkip(off2, size2))
+        {
+            if (id2 == MKFCC('s','t','r','h') && size2 >= sizeof(AVIStreamHeader48))
+            {
+                st->StrhOff = off2 + 8;
+                st->Type = ((AVIStreamHeader48 *)(h + off2 + 8))->fccType;
+                st->SampleSize = ((AVIStreamHeader48 *)(h + off2 + 8))->SampleSize;
+                compression = ((AVIStreamHeader48 *)(h + off2 + 8))->fccHandler;
+            }
+            else if (id2 == MKFCC('s','t','r','f') && st->Type == MKFCC('v','i','d','s') &&
+                     size2 >= 20 && GET_DWORD(h + off2 + 8 + 16))
+                compression = GET_DWORD(h + off2 + 8 + 16);
+            else if (id2 == MKFCC('i','n','d','x') || id2 == MKFCC('J','U','N','K'))
+            {
+                // an old super index is used if it is big enough,
+                // otherwise a JUNK chunk that is
+
+                if (id2 == MKFCC('i','n','d','x')) st->OldIndx = off2;
+                if (size2 >= 24 + 16 && (id2 == MKFCC('i','n','d','x') || !st->HasIndx))
+                {
+                    st->IndxOff = off2;
+                    st->IndxSize = size2;
+                    st->HasIndx = TRUE;
+                }
+            }
+        }
+
+        st->Kind = st->Type == MKFCC('a','u','d','s') ? 2 :
+                   st->Type == MKFCC('t','x','t','s') ? 3 : 0;
+        if (st->Type == MKFCC('v','i','d','s')) st->Sniff = RepairSniffType(compression);
+    }
+
+    return(rp->Streams ? 0 : -1);
+}
+
+
+// Work out the stream and kind of the chunk whose id is at p.
+// Returns the kind, or -1 if it is not a chunk of a stream in the header.
+
+static int RepairKind(REPAIR *rp, BYTE *p, int *stream)
+{
+    char hex[3];
+    int k;
+
+    if (!isxdigit(p[0]) || !isxdigit(p[1])) return(-1);
+    for (k = 0; k < KIND_COUNT; k++)
+        if (p[2] == RepairKinds[2 * k] && p[3] == RepairKinds[2 * k + 1]) break;
+    if (k == KIND_COUNT) return(-1);
+
+    hex[0] = p[0];
+    hex[1] = p[1];
+    hex[2] = 0;
+    *stream = (int) strtol(hex, NULL, 16);
+
+    return(*stream < rp->Streams ? k : -1);
+}
+
+
+// Keep a chunk found in the movi list.  Returns 0 on success or -1 if
+// out of memory.
+
+static int RepairAdd(REPAIR *rp, CHUNKHDR *ck, BYTE *id, int stream, int kind, int key)
+{
+    REPAIRSTREAM *st = rp->Stream + stream;
+    WORD *np;
+    DWORD n = rp->All.Count;
+
+    if (n == rp->IdAlloc)
+    {
+        np = (WORD *) realloc(rp->Id, (rp->IdAlloc + REPAIR_GROW) * sizeof(WORD));
+        if (np == NULL) return(-1);
+        rp->Id = np;
+        rp->IdAlloc += REPAIR_GROW;
+    }
+    if (IxStoreAdd(&rp->All, ck->Pos + 8, ck->Size, key)) return(-1);
+    rp->Id[n] = (WORD)(stream | (kind << 8));
+
+    // palette changes are not what the stream is made of
+    if (st->Chunks == 0 || st->Kind == 4)
+    {
+        st->Digits[0] = id[0];
+        st->Digits[1] = id[1];
+        st->Kind = kind;
+    }
+    st->Chunks++;
+    st->Frames += st->SampleSize ? ck->Size / st->SampleSize : 1;
+    if (key) st->Keys++;
+
+    return(0);
+}
+
+
+static void RepairKnownEntry(void *arg, int stream, AVIENTRY *e)
+{
+    REPAIR *rp = (REPAIR *) arg;
+    REPAIRKEY *np;
+
+    if (e->Kind == ENTRY_CHUNK || rp->OutOfMemory) return;     // no index after all
+
+    if (rp->KnownCount == rp->KnownAlloc)
+    {
+        np = (REPAIRKEY *) realloc(rp->Known, (rp->KnownAlloc + REPAIR_GROW) * sizeof(REPAIRKEY));
+        if (np == NULL)
+        {
+            rp->OutOfMemory = TRUE;
+            return;
+        }
+        rp->Known = np;
+        rp->KnownAlloc += REPAIR_GROW;
+    }
+    np = rp->Known + rp->KnownCount++;
+    np->Pos = e->Pos;
+    np->Size = e->Size;
+    np->Key = e->KeyFrame;
+}
+
+
+static void RepairKnownError(void *arg, char *msg)
+{
+    ((REPAIR *) arg)->KnownBad = TRUE;
+}
+
+
+static int RepairKnownCompare(const void *a, const void *b)
+{
+    QWORD pa = ((REPAIRKEY *) a)->Pos, pb = ((REPAIRKEY *) b)->Pos;
+
+    return(pa < pb ? -1 : pa > pb);
+}
+
+
+// Keep the entries of the index the file has, if any, sorted by where
+// their chunks are.  What is there of a damaged index is used too.
+// Returns 0 on success or -1 if out of memory.
+
+static int RepairKnown(REPAIR *rp)
+{
+    AVIINDEX *ix;
+
+    ix = (AVIINDEX *) malloc(sizeof(AVIINDEX));
+    if (ix == NULL) return(-1);
+
+    ix->arg = rp;
+    ix->Entry = RepairKnownEntry;
+    ix->Error = RepairKnownError;
+    ix->Sources = 0;
+    if (AviIndexRead(rp->in, ix) == -2) rp->OutOfMemory = TRUE;
+    free(ix);
+
+    if (rp->OutOfMemory) return(-1);
+    if (rp->KnownCount)
+        qsort(rp->Known, rp->KnownCount, sizeof(REPAIRKEY), RepairKnownCompare);
+
+    return(0);
+}
+
+
+// Tell whether the file needs no repair: the index it has lists every
+// chunk and nothing else, at the right size, and the RIFF and movi sizes
+// were filled in.
+
+static int RepairWhole(REPAIR *rp)
+{
+    REPAIRSEG *sg;
+    int k;
+
+    if (rp->Torn || rp->KnownBad || rp->KnownFound != rp->All.Count ||
+        rp->KnownCount != rp->All.Count)
+        return(FALSE);
+
+    for (k = 0; k < rp->SegCount; k++)
+    {
+        sg = rp->Seg + k;
+        if (sg->RiffSize < 4 || sg->RiffPos + 8 + sg->RiffSize > rp->FileSize ||
+            sg->MoviSize < 4 || sg->MoviPos + sg->MoviSize > rp->FileSize)
+            return(FALSE);
+    }
+
+    return(TRUE);
+}
+
+
+// Look up the chunk whose data is at pos in the old index.  The chunks
+// come in file order, so the entries are gone through just once.
+// Returns the key frame flag of its entry, or -1 if it has none.
+
+static int RepairKnownKey(REPAIR *rp, QWORD pos, DWORD size)
+{
+    REPAIRKEY *k;
+
+    while (rp->KnownNext < rp->KnownCount && rp->Known[rp->KnownNext].Pos < pos)
+        rp->KnownNext++;
+    if (rp->KnownNext == rp->KnownCount) return(-1);
+
+    k = rp->Known + rp->KnownNext;
+    if (k->Pos != pos) return(-1);
+    rp->KnownNext++;
+    rp->KnownFound++;
+    if (k->Size != size) rp->KnownBad = TRUE;
+
+    return(k->Key != 0);
+}
+
+
+// Read the chunks of the movi list from start up to end.  'rec ' lists
+// are looked into, and old indexes and JUNK are passed over.
+// Returns where the chunks stopped making sense, or end.
+
+static QWORD RepairMovi(REPAIR *rp, REPAIRSEG *sg, QWORD start, QWORD end)
+{
+    CHUNKSCAN cs;
+    CHUNKHDR ck;
+    REPAIRSTREAM *st;
+    BYTE *p, id[4];
+    DWORD len;
+    int ret, stream, kind, key;
+
+    sg->End = start;
+    if (ChunkScanOpen(&cs, rp->in, start, end))
+    {
+        rp->OutOfMemory = TRUE;
+        return(start);
+    }
+
+    while ((ret = ChunkScanNext(&cs, end, &ck)) > 0)
+    {
+        if (ck.Pos + 8 + ck.Size > end) break;     // cut off
+        memcpy(id, ChunkScanPeek(&cs, ck.Pos, 4), 4);
+
+        if (ck.FCC == MKFCC('L','I','S','T'))
+        {
+            p = (BYTE *) ChunkScanPeek(&cs, ck.Pos + 8, 4);
+            if (p == NULL || ck.Size < 4 || GET_DWORD(p) != MKFCC('r','e','c',' ')) break;
+            cs.Next = ck.Pos + 12;
+            continue;
+        }
+        if (ck.FCC == MKFCC('J','U','N','K') || ck.FCC == MKFCC('i','x','#','#') ||
+            ck.FCC == MKFCC('#','#','i','x'))
+                continue;
+
+        kind = RepairKind(rp, id, &stream);
+        if (kind < 0) break;
+
+        st = rp->Stream + stream;
+        key = RepairKnownKey(rp, ck.Pos + 8, ck.Size);
+        if (key < 0 && st->Type == MKFCC('v','i','d','s'))
+        {
+            len = ck.Size < REPAIR_PEEK ? ck.Size : REPAIR_PEEK;
+            key = RepairSniff(st->Sniff, (BYTE *) ChunkScanPeek(&cs, ck.Pos + 8, len),
+                              len, ck.Size);
+        }
+        else if (key < 0) key = TRUE;
+        if (RepairAdd(rp, &ck, id, stream, kind, key))
+        {
+            rp->OutOfMemory = TRUE;
+            break;
+        }
+        sg->Count++;
+        sg->End = ck.Pos + 8 + ck.Size + (ck.Size & 1);
+        if (sg->End > rp->FileSize) sg->End = rp->FileSize;
+    }
+
+    ChunkScanClose(&cs);
+
+    if (ret > 0) return(ck.Pos);
+    return(ret < 0 ? cs.Next : end);
+}
+
+
+// Make room for one more segment in *seg.  Returns NULL if out of memory.
+
+static REPAIRSEG *RepairNewSeg(REPAIRSEG **seg, int *count, int *alloc)
+{
+    REPAIRSEG *np;
+
+    if (*count == *alloc)
+    {
+        np = (REPAIRSEG *) realloc(*seg, (*alloc + 16) * sizeof(REPAIRSEG));
+        if (np == NULL) return(NULL);
+        *seg = np;
+        *alloc += 16;
+    }
+    np = *seg + (*count)++;
+    memset(np, 0, sizeof(REPAIRSEG));
+
+    return(np);
+}
+
+
+// Read the hdrl list whose header is at pos.
+
+static int RepairReadHdrl(REPAIR *rp, QWORD pos, DWORD size)
+{
+    if (size < 4 || size - 4 > REPAIR_HDRL) return(-1);
+
+    rp->HdrlSize = size - 4;
+    rp->HdrlPos = pos + 12;
+    rp->Hdrl = (BYTE *) malloc(rp->HdrlSize + 1);
+    if (rp->Hdrl == NULL)
+    {
+        rp->OutOfMemory = TRUE;
+        return(-1);
+    }
+    if (File64ReadAt(rp->in, rp->HdrlPos, rp->Hdrl, rp->HdrlSize) != rp->HdrlSize)
+        return(-1);
+
+    return(RepairStreams(rp));
+}
+
+
+// Find the RIFF chunks, the stream headers and the chunks of each movi
+// list.  A size of 0, or one that goes past the end of the file, is taken
+// to mean that the writer never filled it in, and that the chunk runs to
+// the end of the file.  Returns 0 if any chunks were found.
+
+static int RepairScan(REPAIR *rp)
+{
+    REPAIRSEG *sg;
+    QWORD pos = 0, next, end, p, lend, stop;
+    BYTE hdr[12];
+    FOURCC id, type;
+    DWORD size, riffsize;
+    int done = FALSE;
+
+    while (!done && pos + 12 <= rp->FileSize)
+    {
+        if (File64ReadAt(rp->in, pos, hdr, 12) != 12) break;
+        id = GET_DWORD(hdr);
+        type = GET_DWORD(hdr + 8);
+        riffsize = GET_DWORD(hdr + 4);
+        if (id != MKFCC('R','I','F','F') ||
+            (type != MKFCC('A','V','I',' ') && type != MKFCC('A','V','I','X'))) break;
+
+        end = pos + 8 + riffsize;
+        if (riffsize < 4 || end > rp->FileSize) end = rp->FileSize;
+        next = 0;
+
+        for (p = pos + 12; !done && !next && p + 12 <= end; p = lend + (lend & 1))
+        {
+            if (File64ReadAt(rp->in, p, hdr, 12) != 12) break;
+            id = GET_DWORD(hdr);
+            size = GET_DWORD(hdr + 4);
+            type = GET_DWORD(hdr + 8);
+            lend = p + 8 + size;
+
+            if (id == MKFCC('L','I','S','T') && type == MKFCC('m','o','v','i') && rp->Hdrl)
+            {
+                if (size < 4 || lend > end) lend = end;
+                sg = RepairNewSeg(&rp->Seg, &rp->SegCount, &rp->SegAlloc);
+                if (sg == NULL)
+                {
+                    rp->OutOfMemory = TRUE;
+                    return(-1);
+                }
+                sg->RiffPos = pos;
+                sg->MoviPos = p + 8;
+                sg->First = rp->All.Count;
+                sg->RiffSize = riffsize;
+                sg->MoviSize = size;
+
+                stop = RepairMovi(rp, sg, p + 12, lend);
+                if (rp->OutOfMemory) return(-1);
+
+                // Either the next RIFF starts here because the sizes were
+                // never filled in, or this is where the writer stopped.
+
+                if (stop < lend)
+                {
+                    if (File64ReadAt(rp->in, stop, hdr, 4) == 4 &&
+                        GET_DWORD(hdr) == MKFCC('R','I','F','F'))
+                            next = stop;
+                    else
+                    {
+                        rp->Torn = stop;
+                        done = TRUE;
+                    }
+                }
+                continue;
+            }
+
+            if (lend > end) break;
+            if (id == MKFCC('L','I','S','T') && type == MKFCC('h','d','r','l') && rp->Hdrl == NULL)
+            {
+                if (RepairReadHdrl(rp, p, size))
+                {
+                    if (!rp->OutOfMemory) RepairError(rp, "The stream headers could not be read");
+                    return(-1);
+                }
+            }
+            else if (rp->Hdrl && rp->SegCount == 0 && id != MKFCC('J','U','N','K') &&
+                     id != MKFCC('i','d','x','1') && rp->ExtraCount < REPAIR_EXTRA)
+            {
+                rp->ExtraPos[rp->ExtraCount] = p;
+                rp->ExtraSize[rp->ExtraCount++] = size + 8;
+            }
+        }
+
+        pos = next ? next : end + (end & 1);
+    }
+
+    if (rp->Hdrl == NULL)
+    {
+        RepairError(rp, "No stream headers found");
+        return(-1);
+    }
+    if (rp->All.Count == 0)
+    {
+        RepairError(rp, "No chunks found in the movi list");
+        return(-1);
+    }
+    if (IxStoreFinish(&rp->All))
+    {
+        rp->OutOfMemory = TRUE;
+        return(-1);
+    }
+    rp->Tail = rp->Seg[rp->SegCount - 1].End;
+
+    return(0);
+}
+
+
+// Make room for one more segment to write, and its counts.
+
+static REPAIRSEG *RepairOutSeg(REPAIR *rp)
+{
+    DWORD *ne, *nf;
+    size_t old, len;
+
+    if (rp->OutCount == rp->OutAlloc)
+    {
+        old = (size_t) rp->OutAlloc * rp->Streams * sizeof(DWORD);
+        len = old + 16 * rp->Streams * sizeof(DWORD);
+        ne = (DWORD *) realloc(rp->SegEntries, len);
+        if (ne) rp->SegEntries = ne;
+        nf = (DWORD *) realloc(rp->SegFrames, len);
+        if (nf) rp->SegFrames = nf;
+        if (ne == NULL || nf == NULL) return(NULL);
+        memset((BYTE *) ne + old, 0, len - old);
+        memset((BYTE *) nf + old, 0, len - old);
+    }
+
+    return(RepairNewSeg(&rp->Out, &rp->OutCount, &rp->OutAlloc));
+}
+
+
+// Decide which segment written each chunk goes in, and count the chunks
+// and frames of each stream in each segment.  In place, the segments are
+// the ones found.  Otherwise a new one is started when the chunks, and
+// the indexes that go with them, would come to more than REPAIR_SEGMENT.
+
+static int RepairPlan(REPAIR *rp, int inplace)
+{
+    AVIFRAME f[REPAIR_BATCH];
+    REPAIRSEG *sg = NULL;
+    REPAIRSTREAM *st;
+    QWORD span;
+    DWORD i, j, n, got;
+    int s, k = inplace ? 0 : -1, S = rp->Streams;
+
+    for (i = 0; i < rp->All.Count; i += got)
+    {
+        got = IxStoreRead(&rp->All, i, REPAIR_BATCH, f);
+        if (got == 0) return(-1);
+
+        for (j = 0; j < got; j++)
+        {
+            n = i + j;
+            s = rp->Id[n] & 0xFF;
+            st = rp->Stream + s;
+            span = 8 + (QWORD) f[j].Size + (f[j].Size & 1);
+
+            if (inplace)
+            {
+                while (n >= rp->Out[k].First + rp->Out[k].Count) k++;
+            }
+            else if (sg == NULL || (sg->Count && sg->Bytes + span + S * 32 +
+                     (QWORD)(sg->Count + 1) * (k ? 8 : 24) > REPAIR_SEGMENT))
+            {
+                if (RepairOutSeg(rp) == NULL)
+                {
+                    rp->OutOfMemory = TRUE;
+                    return(-1);
+                }
+                rp->Out[++k].First = n;
+            }
+
+            sg = rp->Out + k;
+            sg->Bytes += span;
+            if (!inplace) sg->Count++;
+            rp->SegEntries[k * S + s]++;
+            rp->SegFrames[k * S + s] += st->SampleSize ? f[j].Size / st->SampleSize : 1;
+        }
+    }
+
+    return(0);
+}
+
+
+// Bytes of the ix## chunks of the first streams streams of segment k.
+
+static QWORD RepairIxBytes(REPAIR *rp, int k, int streams)
+{
+    QWORD bytes = 0;
+    DWORD n;
+    int s;
+
+    for (s = 0; s < streams; s++)
+    {
+        n = rp->SegEntries[k * rp->Streams + s];
+        if (n) bytes += 32 + 8 * (QWORD) n;
+    }
+
+    return(bytes);
+}
+
+
+// Work out where everything goes in a new file whose first hlen bytes
+// are the headers up to the first movi tag.
+
+static void RepairLayout(REPAIR *rp, DWORD hlen)
+{
+    REPAIRSEG *sg;
+    QWORD pos = 0;
+    int k;
+
+    for (k = 0; k < rp->OutCount; k++)
+    {
+        sg = rp->Out + k;
+        sg->RiffPos = pos;
+        sg->MoviPos = pos + (k ? 24 : hlen) - 4;
+        sg->End = sg->IxPos = sg->MoviPos + 4 + sg->Bytes;
+        sg->MoviEnd = sg->IxPos + RepairIxBytes(rp, k, rp->Streams);
+        sg->RiffEnd = sg->MoviEnd;
+        if (k == 0) sg->RiffEnd += 8 + 16 * (QWORD) sg->Count;
+        pos = sg->RiffEnd;
+    }
+}
+
+
+// Work out what can be written in place and where it goes: the ix##
+// chunks of every segment after the last chunk, in the last movi list,
+// and 'idx1' after that if there is just one RIFF.  Returns -1 if
+// neither index fits.
+
+static int RepairLayoutInPlace(REPAIR *rp)
+{
+    REPAIRSEG *sg;
+    QWORD pos = rp->Tail;
+    DWORD used;
+    int k, s;
+
+    rp->Odml = TRUE;
+    for (s = 0; s < rp->Streams; s++)
+    {
+        for (used = 0, k = 0; k < rp->OutCount; k++)
+            if (rp->SegEntries[k * rp->Streams + s]) used++;
+        if (!rp->Stream[s].HasIndx || (rp->Stream[s].IndxSize - 24) / 16 < used)
+            rp->Odml = FALSE;
+    }
+
+    for (k = 0; k < rp->OutCount; k++)
+    {
+        sg = rp->Out + k;
+        if (sg->End - sg->MoviPos > 0xFFFFFFFFUL) rp->Odml = FALSE;
+        if (k + 1 < rp->OutCount && rp->Out[k + 1].RiffPos == sg->RiffPos)
+        {
+            RepairError(rp, "A RIFF has two movi lists, it can only be repaired into a new file");
+            return(-1);
+        }
+    }
+    rp->Idx1 = rp->OutCount == 1 && rp->Tail - rp->Out[0].MoviPos <= 0xFFFFFFFFUL;
+
+    if (!rp->Odml && !rp->Idx1)
+    {
+        RepairError(rp, "There is no room for the indexes, the file can only be repaired into a new file");
+        return(-1);
+    }
+
+    for (k = 0; k < rp->OutCount; k++)
+    {
+        sg = rp->Out + k;
+        sg->IxPos = pos;
+        if (rp->Odml) pos += RepairIxBytes(rp, k, rp->Streams);
+
+        // keep the sizes of segments before the last if they make sense
+
+        if (k + 1 < rp->OutCount)
+        {
+            sg->RiffEnd = rp->Out[k + 1].RiffPos;
+            if (sg->RiffSize >= 4 && sg->RiffPos + 8 + sg->RiffSize <= sg->RiffEnd)
+                sg->RiffEnd = sg->RiffPos + 8 + sg->RiffSize;
+            sg->MoviEnd = sg->MoviPos + sg->MoviSize;
+            if (sg->MoviSize < 4 || sg->MoviEnd < sg->End || sg->MoviEnd > sg->RiffEnd)
+                sg->MoviEnd = sg->End;
+        }
+    }
+
+    sg = rp->Out + rp->OutCount - 1;
+    sg->MoviEnd = pos;
+    if (rp->Idx1) pos += 8 + 16 * (QWORD) sg->Count;
+    sg->RiffEnd = pos;
+
+    for (k = 0; k < rp->OutCount; k++)
+    {
+        if (rp->Out[k].RiffEnd - rp->Out[k].RiffPos - 8 > 0xFFFFFFFFUL)
+        {
+            RepairError(rp, "A RIFF would be over 4GB, the file can only be repaired into a new file");
+            return(-1);
+        }
+    }
+
+    return(0);
+}
+
+
+// Put a chunk header into buf at *o.  Returns its offset.
+
+static DWORD RepairPut(BYTE *buf, DWORD *o, FOURCC id, DWORD size)
+{
+    DWORD at = *o;
+
+    RepairSet(buf + at, id);
+    RepairSet(buf + at + 4, size);
+    *o += 8;
+
+    return(at);
+}
+
+
+// Start a list in buf at *o.  Returns the offset of its header, for
+// RepairEnd() to fill in the size.
+
+static DWORD RepairList(BYTE *buf, DWORD *o, FOURCC id, FOURCC type)
+{
+    DWORD at = RepairPut(buf, o, id, 0);
+
+    RepairSet(buf + *o, type);
+    *o += 4;
+
+    return(at);
+}
+
+
+static void RepairEnd(BYTE *buf, DWORD at, DWORD o)
+{
+    RepairSet(buf + at + 4, o - at - 8);
+}
+
+
+// Copy the chunk at src, with size bytes of data, into buf at *o.
+
+static void RepairCopyChunk(BYTE *buf, DWORD *o, BYTE *src, DWORD size)
+{
+    memcpy(buf + *o, src, 8 + size);
+    *o += 8 + size;
+    if (size & 1) buf[(*o)++] = 0;
+}
+
+
+// Build the headers of a new file, up to the first movi tag, from the
+// ones read.  Old super indexes and JUNK are left out, and each stream
+// header list gets an 'indx' with room for an entry for every segment.
+// Returns the headers, with their length in *len, or NULL if out of
+// memory.
+
+static BYTE *RepairHeader(REPAIR *rp, DWORD *len)
+{
+    REPAIRSTREAM *st;
+    BYTE *buf, *h = rp->Hdrl;
+    DWORD alloc, o = 0, off, off2, end, size, size2, hdrl, list;
+    FOURCC id, id2, type;
+    int s = 0, i;
+
+    alloc = 64 + rp->HdrlSize + DMLH_SIZE + rp->Streams * (48 + 16 * rp->OutCount);
+    for (i = 0; i < rp->ExtraCount; i++)
+        alloc += rp->ExtraSize[i] + 1;
+    buf = (BYTE *) calloc(alloc, 1);
+    if (buf == NULL) return(NULL);
+
+    rp->AvihOff = rp->DmlhOff = 0;
+    RepairList(buf, &o, MKFCC('R','I','F','F'), MKFCC('A','V','I',' '));
+    hdrl = RepairList(buf, &o, MKFCC('L','I','S','T'), MKFCC('h','d','r','l'));
+
+    for (off = 0; RepairChunk(h, rp->HdrlSize, off, &id, &size); off = RepairSkip(off, size))
+    {
+        type = size >= 4 ? GET_DWORD(h + off + 8) : 0;
+        end = off + 8 + size;
+        if (id == MKFCC('J','U','N','K')) continue;
+
+        if (id == MKFCC('L','I','S','T') && type == MKFCC('s','t','r','l') && s < rp->Streams)
+        {
+            st = rp->Stream + s++;
+            st->StrhOff = st->OldIndx = 0;
+            list = RepairList(buf, &o, MKFCC('L','I','S','T'), MKFCC('s','t','r','l'));
+            for (off2 = off + 12; RepairChunk(h, end, off2, &id2, &size2); off2 = RepairSkip(off2, size2))
+            {
+                if (id2 == MKFCC('i','n','d','x') || id2 == MKFCC('J','U','N','K')) continue;
+                if (id2 == MKFCC('s','t','r','h') && size2 >= sizeof(AVIStreamHeader48) &&
+                    st->StrhOff == 0)
+                    st->StrhOff = o + 8;
+                RepairCopyChunk(buf, &o, h + off2, size2);
+            }
+            st->IndxSize = 24 + 16 * rp->OutCount;
+            st->IndxOff = RepairPut(buf, &o, MKFCC('i','n','d','x'), st->IndxSize);
+            st->HasIndx = TRUE;
+            o += st->IndxSize;
+            RepairEnd(buf, list, o);
+            continue;
+        }
+
+        if (id == MKFCC('a','v','i','h') && size >= sizeof(MainAVIHeader)) rp->AvihOff = o + 8;
+        if (id == MKFCC('L','I','S','T') && type == MKFCC('o','d','m','l'))
+        {
+            for (off2 = off + 12; RepairChunk(h, end, off2, &id2, &size2); off2 = RepairSkip(off2, size2))
+                if (id2 == MKFCC('d','m','l','h') && size2 >= sizeof(AVIEXTHEADER))
+                    rp->DmlhOff = o + off2 - off + 8;
+        }
+        RepairCopyChunk(buf, &o, h + off, size);
+    }
+
+    if (rp->DmlhOff == 0)
+    {
+        list = RepairList(buf, &o, MKFCC('L','I','S','T'), MKFCC('o','d','m','l'));
+        RepairPut(buf, &o, MKFCC('d','m','l','h'), DMLH_SIZE);
+        rp->DmlhOff = o;
+        o += DMLH_SIZE;
+        RepairEnd(buf, list, o);
+    }
+    RepairEnd(buf, hdrl, o);
+
+    for (i = 0; i < rp->ExtraCount; i++)
+    {
+        if (File64ReadAt(rp->in, rp->ExtraPos[i], buf + o, rp->ExtraSize[i]) != rp->ExtraSize[i])
+            rp->ReadError = TRUE;
+        o += rp->ExtraSize[i] + (rp->ExtraSize[i] & 1);
+    }
+
+    rp->MoviOff = RepairList(buf, &o, MKFCC('L','I','S','T'), MKFCC('m','o','v','i'));
+    *len = o;
+
+    return(buf);
+}
+
+
+// Fill in the frame counts, the index flag and the super indexes of the
+// headers in buf, at the offsets found for them.
+
+static void RepairPatch(REPAIR *rp, BYTE *buf)
+{
+    REPAIRSTREAM *st;
+    INDX_CHUNK *ic;
+    SUPERINDEXENTRY *se;
+    DWORD n;
+    int s, k, video = -1;
+
+    for (s = rp->Streams - 1; s >= 0; s--)
+        if (rp->Stream[s].Type == MKFCC('v','i','d','s')) video = s;
+
+    if (rp->AvihOff)
+    {
+        if (video >= 0) ((MainAVIHeader *)(buf + rp->AvihOff))->TotalFrames = rp->SegFrames[video];
+        if (rp->Idx1) ((MainAVIHeader *)(buf + rp->AvihOff))->Flags |= AVIF_HASINDEX;
+    }
+    if (rp->DmlhOff && video >= 0)
+        ((AVIEXTHEADER *)(buf + rp->DmlhOff))->dwTotalFrames = (DWORD) rp->Stream[video].Frames;
+
+    for (s = 0; s < rp->Streams; s++)
+    {
+        st = rp->Stream + s;
+        if (st->StrhOff) ((AVIStreamHeader48 *)(buf + st->StrhOff))->Length = (DWORD) st->Frames;
+
+        // an old super index that is not being written is stale
+        if (st->OldIndx && (!rp->Odml || st->OldIndx != st->IndxOff))
+            RepairSet(buf + st->OldIndx, MKFCC('J','U','N','K'));
+        if (!rp->Odml) continue;
+
+        RepairSet(buf + st->IndxOff, MKFCC('i','n','d','x'));
+        memset(buf + st->IndxOff + 8, 0, st->IndxSize);
+        ic = (INDX_CHUNK *)(buf + st->IndxOff + 8);
+        ic->wLongsPerEntry = 4;
+        ic->bIndexType = AVI_INDEX_OF_INDEXES;
+        ic->dwChunkId = RepairFCC(st->Digits, RepairKinds + 2 * st->Kind);
+        se = (SUPERINDEXENTRY *)(ic + 1);
+
+        for (k = 0; k < rp->OutCount; k++)
+        {
+            n = rp->SegEntries[k * rp->Streams + s];
+            if (n == 0) continue;
+            se->qwOffset = rp->Out[k].IxPos + RepairIxBytes(rp, k, s);
+            se->dwSize = 32 + 8 * n;
+            se->dwDuration = rp->SegFrames[k * rp->Streams + s];
+            se++;
+            ic->nEntriesInUse++;
+        }
+    }
+}
+
+
+// Write the buffer out.
+
+static void RepairFlush(REPAIR *rp)
+{
+    if (rp->BufLen && File64Write(rp->out, rp->Buf, (int) rp->BufLen) != rp->BufLen)
+        rp->WriteError = TRUE;
+    rp->OutPos += rp->BufLen;
+    rp->BufLen = 0;
+}
+
+
+static void RepairWrite(REPAIR *rp, void *data, DWORD len)
+{
+    DWORD n;
+
+    while (len)
+    {
+        if (rp->BufLen == REPAIR_BUFFER) RepairFlush(rp);
+        n = REPAIR_BUFFER - rp->BufLen;
+        if (n > len) n = len;
+        memcpy(rp->Buf + rp->BufLen, data, n);
+        rp->BufLen += n;
+        data = (BYTE *) data + n;
+        len -= n;
+    }
+}
+
+
+// Copy len bytes at pos in the file read to the file written, reading
+// straight into the write buffer.
+
+static void RepairCopy(REPAIR *rp, QWORD pos, QWORD len)
+{
+    DWORD n;
+
+    while (len)
+    {
+        if (rp->BufLen == REPAIR_BUFFER) RepairFlush(rp);
+        n = REPAIR_BUFFER - rp->BufLen;
+        if (n > len) n = (DWORD) len;
+        if (File64ReadAt(rp->in, pos, rp->Buf + rp->BufLen, (int) n) != n)
+            rp->ReadError = TRUE;
+        rp->BufLen += n;
+        pos += n;
+        len -= n;
+    }
+}
+
+
+static void RepairRunFlush(REPAIR *rp)
+{
+    RepairCopy(rp, rp->RunPos, rp->RunLen);
+    rp->RunLen = 0;
+}
+
+
+// Add the chunk whose header is at pos, with size bytes of data, to the
+// run of chunks to be copied.  The run is copied first if the chunk does
+// not follow on from it.
+
+static void RepairRun(REPAIR *rp, QWORD pos, DWORD size)
+{
+    static BYTE pad = 0;
+
+    if (rp->RunLen && rp->RunPos + rp->RunLen != pos) RepairRunFlush(rp);
+    if (rp->RunLen == 0) rp->RunPos = pos;
+    rp->RunLen += 8 + (QWORD) size;
+
+    if (size & 1)
+    {
+        if (rp->RunPos + rp->RunLen < rp->FileSize) rp->RunLen++;
+        else
+        {
+            RepairRunFlush(rp);     // the last chunk of the file has no pad byte
+            RepairWrite(rp, &pad, 1);
+        }
+    }
+}
+
+
+// Write segment k: for a new file its headers and chunks, and in both
+// cases its ix## chunks and, for the first, 'idx1'.  The index entries
+// are made as the chunks go by, with the locations they are written to.
+
+static int RepairSegment(REPAIR *rp, int k, int inplace)
+{
+    REPAIRSEG *sg = rp->Out + k;
+    AVIFRAME f[REPAIR_BATCH];
+    STDINDEXENTRY *ix, *e;
+    AVIINDEXENTRY *idx1 = NULL, *ie;
+    INDX_CHUNK ic;
+    DWORD fill[MAX_STREAMS];
+    DWORD i, j, n, got, id, size;
+    QWORD hpos, cur;
+    BYTE hdr[24];
+    int s, S = rp->Streams;
+
+    ix = (STDINDEXENTRY *) malloc(sg->Count * sizeof(STDINDEXENTRY) + 1);
+    if (k == 0 && rp->Idx1)
+        idx1 = (AVIINDEXENTRY *) malloc(sg->Count * sizeof(AVIINDEXENTRY) + 1);
+    if (ix == NULL || (k == 0 && rp->Idx1 && idx1 == NULL))
+    {
+        free(ix);
+        free(idx1);
+        rp->OutOfMemory = TRUE;
+        return(-1);
+    }
+
+    for (n = 0, s = 0; s < S; s++)
+    {
+        fill[s] = n;
+        n += rp->SegEntries[k * S + s];
+    }
+
+    if (!inplace && k)
+    {
+        RepairSet(hdr, MKFCC('R','I','F','F'));
+        RepairSet(hdr + 4, (DWORD)(sg->RiffEnd - sg->RiffPos - 8));
+        RepairSet(hdr + 8, MKFCC('A','V','I','X'));
+        RepairSet(hdr + 12, MKFCC('L','I','S','T'));
+        RepairSet(hdr + 16, (DWORD)(sg->MoviEnd - sg->MoviPos));
+        RepairSet(hdr + 20, MKFCC('m','o','v','i'));
+        RepairWrite(rp, hdr, 24);
+    }
+
+    cur = sg->MoviPos + 4;
+    for (i = 0; i < sg->Count; i += got)
+    {
+        n = sg->Count - i;
+        got = IxStoreRead(&rp->All, sg->First + i, n < REPAIR_BATCH ? n : REPAIR_BATCH, f);
+        if (got == 0) break;
+
+        for (j = 0; j < got; j++)
+        {
+            id = rp->Id[sg->First + i + j];
+            s = id & 0xFF;
+            size = f[j].Size;
+
+            if (inplace) hpos = f[j].Pos - 8;
+            else
+            {
+                hpos = cur;
+                cur += 8 + (QWORD) size + (size & 1);
+                RepairRun(rp, f[j].Pos - 8, size);
+            }
+
+            e = ix + fill[s]++;
+            e->dwOffset = (DWORD)(hpos + 8 - sg->MoviPos);
+            e->dwSize = size | (f[j].KeyFrame ? 0 : 0x80000000UL);
+
+            if (idx1)
+            {
+                ie = idx1 + i + j;
+                ie->ckid = RepairFCC(rp->Stream[s].Digits, RepairKinds + 2 * (id >> 8));
+                ie->dwFlags = f[j].KeyFrame ? AVIIF_KEYFRAME : 0;
+                ie->dwChunkOffset = (DWORD)(hpos - sg->MoviPos);
+                ie->dwChunkLength = size;
+            }
+        }
+    }
+    if (!inplace) RepairRunFlush(rp);
+
+    if (i < sg->Count || rp->OutPos + rp->BufLen != sg->IxPos)
+    {
+        free(ix);
+        free(idx1);
+        RepairError(rp, "The chunks did not come out where they were meant to");
+        return(-1);
+    }
+
+    for (n = 0, s = 0; rp->Odml && s < S; s++)
+    {
+        j = rp->SegEntries[k * S + s];
+        if (j == 0) continue;
+
+        RepairSet(hdr, RepairFCC("ix", rp->Stream[s].Digits));
+        RepairSet(hdr + 4, sizeof(INDX_CHUNK) + j * sizeof(STDINDEXENTRY));
+        RepairWrite(rp, hdr, 8);
+
+        memset(&ic, 0, sizeof(INDX_CHUNK));
+        ic.wLongsPerEntry = 2;
+        ic.bIndexType = AVI_INDEX_OF_CHUNKS;
+        ic.nEntriesInUse = j;
+        ic.dwChunkId = RepairFCC(rp->Stream[s].Digits, RepairKinds + 2 * rp->Stream[s].Kind);
+        ic.qwBaseOffset = sg->MoviPos;
+        RepairWrite(rp, &ic, sizeof(INDX_CHUNK));
+        RepairWrite(rp, ix + n, j * sizeof(STDINDEXENTRY));
+        n += j;
+    }
+
+    if (idx1)
+    {
+        RepairSet(hdr, MKFCC('i','d','x','1'));
+        RepairSet(hdr + 4, sg->Count * sizeof(AVIINDEXENTRY));
+        RepairWrite(rp, hdr, 8);
+        RepairWrite(rp, idx1, sg->Count * sizeof(AVIINDEXENTRY));
+    }
+
+    free(ix);
+    free(idx1);
+
+    return(0);
+}
+
+
+// Write the repaired file to fname.  It is written under a temporary
+// name first and only renamed to fname when it is complete, so that a
+// failed repair never leaves half a file, and neither name may be the
+// file being repaired, however it is reached.
+
+static int RepairNewFile(REPAIR *rp, char *fname)
+{
+    BYTE *hdr;
+    DWORD hlen;
+    char *tmpname;
+    int k, ret = 0;
+
+    tmpname = File64TempName(fname);
+    if (tmpname == NULL)
+    {
+        rp->OutOfMemory = TRUE;
+        return(-1);
+    }
+    if (File64SameFile(rp->in, fname) || File64SameFile(rp->in, tmpname))
+    {
+        RepairError(rp, "The repaired file must have another name, or be repaired in place");
+        free(tmpname);
+        return(-1);
+    }
+
+    if (RepairPlan(rp, FALSE))
+    {
+        free(tmpname);
+        return(-1);
+    }
+    rp->Idx1 = rp->Odml = TRUE;
+    hdr = RepairHeader(rp, &hlen);
+    if (hdr == NULL)
+    {
+        rp->OutOfMemory = TRUE;
+        free(tmpname);
+        return(-1);
+    }
+    RepairLayout(rp, hlen);
+    RepairPatch(rp, hdr);
+    RepairSet(hdr + 4, (DWORD)(rp->Out[0].RiffEnd - 8));
+    RepairSet(hdr + rp->MoviOff + 4, (DWORD)(rp->Out[0].MoviEnd - rp->Out[0].MoviPos));
+
+    rp->out = File64Open(tmpname, "wb");
+    if (rp->out == NULL)
+    {
+        free(hdr);
+        OutPrintf(rp->ctx->out, "*** Could not create %s ***\n", tmpname);
+        free(tmpname);
+        return(-1);
+    }
+
+    RepairWrite(rp, hdr, hlen);
+    free(hdr);
+    for (k = 0; k < rp->OutCount && ret == 0; k++)
+        ret = RepairSegment(rp, k, FALSE);
+    RepairFlush(rp);
+
+    if (fflush(rp->out->fp)) rp->WriteError = TRUE;
+    File64Close(rp->out);
+    rp->out = NULL;
+
+    if (ret || rp->WriteError) remove(tmpname);
+    else if (File64Replace(tmpname, fname))
+    {
+        // the repaired file is still there under the temporary name
+        OutPrintf(rp->ctx->out, "*** Could not rename %s to %s ***\n", tmpname, fname);
+        ret = -1;
+    }
+    free(tmpname);
+
+    return(ret);
+}
+
+
+static void RepairWriteAt(REPAIR *rp, QWORD pos, DWORD val)
+{
+    if (File64WriteAt(rp->out, pos, &val, 4) != 4) rp->WriteError = TRUE;
+}
+
+
+// Add the indexes to the file itself.  They are written first, then the
+// sizes and the headers are changed to match, and last of all whatever
+// was after the last chunk is cut off.
+
+static int RepairInPlace(REPAIR *rp)
+{
+    REPAIRSEG *sg;
+    DWORD size;
+    int k, ret = 0;
+
+    if (rp->ctx->Name == NULL)
+    {
+        RepairError(rp, "The file name is not known");
+        return(-1);
+    }
+
+    for (k = 0; k < rp->SegCount; k++)
+    {
+        sg = RepairOutSeg(rp);
+        if (sg == NULL)
+        {
+            rp->OutOfMemory = TRUE;
+            return(-1);
+        }
+        *sg = rp->Seg[k];
+    }
+    if (RepairPlan(rp, TRUE) || RepairLayoutInPlace(rp)) return(-1);
+
+    rp->out = File64Open(rp->ctx->Name, "r+b");
+    if (rp->out == NULL)
+    {
+        OutPrintf(rp->ctx->out, "*** Could not open %s for writing ***\n", rp->ctx->Name);
+        return(-1);
+    }
+
+    File64SetAbsPos(rp->out, rp->Tail);
+    rp->OutPos = rp->Tail;
+    for (k = 0; k < rp->OutCount && ret == 0; k++)
+        ret = RepairSegment(rp, k, TRUE);
+    RepairFlush(rp);
+
+    if (ret == 0 && !rp->WriteError)
+    {
+        for (k = 0; k < rp->OutCount; k++)
+        {
+            sg = rp->Out + k;
+            size = (DWORD)(sg->RiffEnd - sg->RiffPos - 8);
+            if (size != sg->RiffSize) RepairWriteAt(rp, sg->RiffPos + 4, size);
+            size = (DWORD)(sg->MoviEnd - sg->MoviPos);
+            if (size != sg->MoviSize) RepairWriteAt(rp, sg->MoviPos - 4, size);
+        }
+
+        RepairPatch(rp, rp->Hdrl);
+        if (File64WriteAt(rp->out, rp->HdrlPos, rp->Hdrl, (int) rp->HdrlSize) != rp->HdrlSize)
+            rp->WriteError = TRUE;
+
+        if (rp->OutPos < rp->FileSize)
+        {
+            File64Unmap(rp->in);
+            if (File64Truncate(rp->out, rp->OutPos)) rp->WriteError = TRUE;
+        }
+    }
+
+    File64Close(rp->out);
+    rp->out = NULL;
+
+    return(ret);
+}
+
+
+static void RepairLine(OUTBUF *out, char *label, QWORD val)
+{
+    OutPrintf(out, "%16s: ", label);
+    OutQDec(out, val);
+    OutChar(out, '\n');
+}
+
+
+// Rebuild the indexes of the file in ctx, into the file named by
+// ctx->Query, or into the file itself if that is NULL.
+// Returns 0 on success or -1 if the file could not be repaired.
+
+int RepairReport(AVICTX *ctx)
+{
+    REPAIR *rp;
+    REPAIRSTREAM *st;
+    OUTBUF *out = ctx->out;
+    FOURCC type;
+    char label[24];
+    int ret, s, whole = FALSE;
+
+    rp = (REPAIR *) calloc(1, sizeof(REPAIR));
+    if (rp == NULL)
+    {
+        OutPrintf(out, "*** Out of memory ***\n");
+        return(-1);
+    }
+    rp->ctx = ctx;
+    rp->in = ctx->in;
+    rp->FileSize = File64Size(ctx->in);
+    IxStoreInit(&rp->All, 0);
+
+    OutPrintf(out, "Index repair\n");
+
+    if (rp->FileSize == 0)
+    {
+        RepairError(rp, "The size of the file is not known");
+        ret = -1;
+    }
+    else if (RepairKnown(rp)) ret = -1;
+    else ret = RepairScan(rp);
+
+    if (ret == 0)
+    {
+        RepairLine(out, "Chunks Found", rp->All.Count);
+        for (s = 0; s < rp->Streams; s++)
+        {
+            st = rp->Stream + s;
+            type = st->Type;
+            sprintf(label, "Stream %.2s", st->Digits);
+            OutPrintf(out, "%16s: %.4s, ", label, (char *) &type);
+            OutQDec(out, st->Chunks);
+            OutStr(out, " chunks, ");
+            OutQDec(out, st->Keys);
+            OutStr(out, " key frames\n");
+        }
+        if (rp->Torn) RepairLine(out, "Bytes Torn Off", rp->FileSize - rp->Torn);
+
+        whole = ctx->Query == NULL && RepairWhole(rp);
+        rp->Buf = (BYTE *) malloc(REPAIR_BUFFER);
+        if (whole)
+            OutPrintf(out, "The index lists every chunk, the file is left as it is\n");
+        else if (rp->Buf == NULL)
+        {
+            rp->OutOfMemory = TRUE;
+            ret = -1;
+        }
+        else if (ctx->Query) ret = RepairNewFile(rp, ctx->Query);
+        else ret = RepairInPlace(rp);
+    }
+
+    if (rp->OutOfMemory) RepairError(rp, "Out of memory");
+    else if (rp->ReadError) RepairError(rp, "The file could not be read");
+    else if (rp->WriteError) RepairError(rp, "The repaired file could not be written");
+    else if (ret == 0 && !whole)
+    {
+        OutPrintf(out, "%16s: %s\n", "Index Written", !rp->Odml ? "idx1" :
+                  rp->Idx1 ? "idx1 and Open-DML" : "Open-DML");
+        RepairLine(out, "RIFF Segments", rp->OutCount);
+        OutPrintf(out, "%16s: %s\n", "Written To", ctx->Query ? ctx->Query : ctx->Name);
+    }
+    if (rp->OutOfMemory || rp->ReadError || rp->WriteError) ret = -1;
+
+    IxStoreFree(&rp->All);
+    free(rp->Known);
+    free(rp->Id);
+    free(rp->Hdrl);
+    free(rp->Seg);
+    free(rp->Out);
+    free(rp->SegEntries);
+    free(rp->SegFrames);
+    free(rp->Buf);
+    free(rp);
+
+    return(ret);
+}
@@ -0,0 +1,271 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+Index summary.  A short report of how many chunks, bytes and key frames
+each stream has, worked out from the index alone with AviIndexRead(),
+so that even a huge file only needs its headers and index read.
+
+With AVI_STATS, the same pass over the entries also keeps the smallest
+and biggest chunk, the spacing of the key frames and the busiest second
+of each stream.  Only running totals are kept, so tens of millions of
+entries take no more memory than a few.
+
+*/
+
+#include "rdavi2.h"
+
+
+typedef struct
+{
+    QWORD   Chunks;         // index entries
+    QWORD   Bytes;          // total of their sizes
+    QWORD   KeyFrames;      // entries marked as key frames
+    DWORD   MinSize;        // smallest entry
+    DWORD   MaxSize;        // biggest entry
+    DWORD   OverBuffer;     // entries bigger than SuggestedBufferSize
+    QWORD   FirstKey;       // chunk number of the first key frame
+    QWORD   LastKey;        // chunk number of the last key frame
+    QWORD   MinGap;         // fewest chunks from one key frame to the next
+    QWORD   MaxGap;         // most chunks from one key frame to the next
+    QWORD   Units;          // stream length so far, in strh units
+    QWORD   Second;         // the second the last entry started in
+    QWORD   SecBytes;       // bytes that started in that second
+    QWORD   PeakBytes;      // most bytes that started in any one second
+} STREAMSUM;
+
+typedef struct
+{
+    OUTBUF   *out;
+    AVIINDEX *ix;                   // for the stream headers
+    int       Streams;              // highest stream number seen + 1
+    STREAMSUM Sum[MAX_STREAMS];
+} SUMMARY;
+
+
+static void SummaryEntry(void *arg, int stream, AVIENTRY *e)
+{
+    SUMMARY *sm = (SUMMARY *) arg;
+    AVIStreamHeader56 *sh;
+    STREAMSUM *ss;
+    QWORD sec;
+
+    if (stream >= MAX_STREAMS) return;
+    if (stream >= sm->Streams) sm->Streams = stream + 1;
+
+    ss = sm->Sum + stream;
+    if (ss->Chunks == 0 || e->Size < ss->MinSize) ss->MinSize = e->Size;
+    if (e->Size > ss->MaxSize) ss->MaxSize = e->Size;
+
+    if (e->KeyFrame)
+    {
+        if (ss->KeyFrames)
+        {
+            if (ss->KeyFrames == 1 || ss->Chunks - ss->LastKey < ss->MinGap)
+                ss->MinGap = ss->Chunks - ss->LastKey;
+            if (ss->Chunks - ss->LastKey > ss->MaxGap)
+                ss->MaxGap = ss->Chunks - ss->LastKey;
+        }
+        else ss->FirstKey = ss->Chunks;
+        ss->LastKey = ss->Chunks;
+        ss->KeyFrames++;
+    }
+
+    // Time goes by a frame per chunk, or for streams with a sample size
+    // such as audio, by the samples in the chunk.
+
+    if (stream < sm->ix->StreamCount)
+    {
+        sh = sm->ix->Strh + stream;
+        if (sh->SuggestedBufferSize && e->Size > sh->SuggestedBufferSize)
+            ss->OverBuffer++;
+
+        if (sh->Rate)
+        {
+            sec = ss->Units * sh->TimeScale / sh->Rate;
+            if (sec != ss->Second)
+            {
+                ss->Second = sec;
+                ss->SecBytes = 0;
+            }
+            ss->SecBytes += e->Size;
+            if (ss->SecBytes > ss->PeakBytes) ss->PeakBytes = ss->SecBytes;
+        }
+        ss->Units += sh->SampleSize ? e->Size / sh->SampleSize : 1;
+    }
+
+    ss->Chunks++;
+    ss->Bytes += e->Size;
+}
+
+
+static void SummaryError(void *arg, char *msg)
+{
+    OutPrintf(((SUMMARY *) arg)->out, "*** %s ***\n", msg);
+}
+
+
+static void SummaryLine(OUTBUF *out, char *label, QWORD val)
+{
+    OutPrintf(out, "%16s: ", label);
+    OutQDec(out, val);
+    OutChar(out, '\n');
+}
+
+
+// Write the statistics of one stream.  Returns its average bytes per
+// second, or 0 if it is not known.
+
+static double StatsStream(OUTBUF *out, STREAMSUM *ss, AVIStreamHeader56 *sh, int source)
+{
+    double secs = 0, rate = 0;
+
+    if (ss->Chunks == 0) return(0);
+
+    SummaryLine(out, "Min Size", ss->MinSize);
+    SummaryLine(out, "Max Size", ss->MaxSize);
+    SummaryLine(out, "Mean Size", ss->Bytes / ss->Chunks);
+
+    if (source != INDEX_MOVI && ss->KeyFrames > 1)
+    {
+        SummaryLine(out, "Min Key Gap", ss->MinGap);
+        SummaryLine(out, "Max Key Gap", ss->MaxGap);
+        SummaryLine(out, "Mean Key Gap", (ss->LastKey - ss->FirstKey) / (ss->KeyFrames - 1));
+    }
+
+    if (sh == NULL) return(0);
+
+    if (sh->SuggestedBufferSize)
+    {
+        SummaryLine(out, "Buffer Size", sh->SuggestedBufferSize);
+        SummaryLine(out, "Over Buffer", ss->OverBuffer);
+    }
+
+    if (sh->Rate && sh->TimeScale && ss->Units)
+    {
+        secs = (double) ss->Units * sh->TimeScale / sh->Rate;
+        rate = ss->Bytes / secs;
+        SummaryLine(out, "Duration (ms)", (QWORD) (secs * 1000 + 0.5));
+        SummaryLine(out, "Bit Rate", (QWORD) (rate * 8 + 0.5));
+        SummaryLine(out, "Peak Bytes/Sec", ss->PeakBytes);
+    }
+
+    return(rate);
+}
+
+
+// Write the index summary of the file in ctx, and the statistics too if
+// AVI_STATS is set.
+// Returns 0 on success or -1 if the file could not be read.
+
+int SummaryReport(AVICTX *ctx)
+{
+    static char *SourceName[] =
+    {
+        "no index",
+        "the idx1 index",
+        "the Open-DML indexes",
+        "the movi list, there is no index"
+    };
+    SUMMARY *sm;
+    AVIINDEX *ix;
+    AVIStreamHeader56 *sh;
+    OUTBUF *out = ctx->out;
+    double rate = 0;
+    int i, ret;
+
+    sm = (SUMMARY *) malloc(sizeof(SUMMARY));
+    ix = (AVIINDEX *) malloc(sizeof(AVIINDEX));
+    if (sm == NULL || ix == NULL)
+    {
+        free(sm);
+        free(ix);
+        OutPrintf(out, "*** Out of memory ***\n");
+        return(-1);
+    }
+
+    memset(sm, 0, sizeof(SUMMARY));
+    sm->out = out;
+    sm->ix = ix;
+    ix->arg = sm;
+    ix->Sources = 0;
+    ix->Entry = SummaryEntry;
+    ix->Error = SummaryError;
+
+    ret = AviIndexRead(ctx->in, ix);
+
+    OutPrintf(out, "Index summary from %s\n", SourceName[ix->Source]);
+
+    // AviIndexRead() went to the movi list after all
+
+    if (ix->Source == INDEX_MOVI && ix->HasAvih && (ix->Avih.Flags & AVIF_HASINDEX))
+        OutPrintf(out, "*** avih claims an index that is not there ***\n");
+    SummaryLine(out, "Index Bytes Read", ix->IndexBytes);
+    if (ix->HasAvih)
+    {
+        SummaryLine(out, "Total Frames", ix->Avih.TotalFrames);
+        SummaryLine(out, "Streams", ix->Avih.NumStreams);
+    }
+
+    if (sm->Streams < ix->StreamCount) sm->Streams = ix->StreamCount;
+    for (i = 0; i < sm->Streams; i++)
+    {
+        OutPrintf(out, "\nStream %02X", i);
+        sh = NULL;
+        if (i < ix->StreamCount)
+        {
+            sh = ix->Strh + i;
+            OutPrintf(out, ": %.4s", (char *) &sh->fccType);
+            if (sh->fccType != MKFCC('a','u','d','s'))
+                OutPrintf(out, " %.4s - %s", (char *) &sh->fccHandler,
+                          LookupFourCC(sh->fccHandler));
+            OutChar(out, '\n');
+            SummaryLine(out, "Length", sh->Length);
+        }
+        else OutPrintf(out, ": no stream header\n");
+
+        SummaryLine(out, "Chunks", sm->Sum[i].Chunks);
+        SummaryLine(out, "Bytes", sm->Sum[i].Bytes);
+        if (ix->Source == INDEX_MOVI)
+            OutPrintf(out, "%16s: not known without an index\n", "Key Frames");
+        else
+            SummaryLine(out, "Key Frames", sm->Sum[i].KeyFrames);
+
+        if (ctx->Flags & AVI_STATS)
+            rate += StatsStream(out, sm->Sum + i, sh, ix->Source);
+    }
+
+    // The streams together should stay under what avih says is the most
+    // the file needs each second.
+
+    if ((ctx->Flags & AVI_STATS) && ix->HasAvih && rate > 0)
+    {
+        OutChar(out, '\n');
+        SummaryLine(out, "All Bytes/Sec", (QWORD) (rate + 0.5));
+        SummaryLine(out, "MaxBytesPerSec", ix->Avih.MaxBytesPerSec);
+        if (ix->Avih.MaxBytesPerSec && rate > ix->Avih.MaxBytesPerSec)
+            OutPrintf(out, "*** The streams need more than MaxBytesPerSec ***\n");
+    }
+
+    free(sm);
+    free(ix);
+
+    return(ret);
+}
+
@@ -0,0 +1,388 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+This file is a thin layer over the Windows and POSIX thread calls, so
+that the rest of the program does not have to care which one it is
+running on.  Only what the program needs is here: threads, mutexes,
+counting semaphores, and a runner that does a list of jobs on a pool of
+threads while keeping their output in order.  Borland must be set up
+for the multithreaded run time library (-WM) for this to work.
+
+*/
+
+#include "rdavi2.h"
+
+#if !defined(__WIN32__)
+  #include <unistd.h>
+#endif
+
+
+// The real thread function and its argument are passed through here,
+// because Windows and pthreads each want a different kind of function.
+
+typedef struct
+{
+    void (*fn)(void *);
+    void *arg;
+} THREADSTART;
+
+#if defined(__WIN32__)
+static DWORD WINAPI ThreadEntry(LPVOID param)
+#else
+static void *ThreadEntry(void *param)
+#endif
+{
+    THREADSTART ts = *(THREADSTART *) param;
+
+    free(param);
+    ts.fn(ts.arg);
+
+    return(0);
+}
+
+
+// Start a new thread running fn(arg).
+// Returns 0 on success or -1 if the thread could not be started.
+
+int ThreadStart(THREAD *th, void (*fn)(void *), void *arg)
+{
+    THREADSTART *ts = (THREADSTART *) malloc(sizeof(THREADSTART));
+#if defined(__WIN32__)
+    DWORD id;
+#endif
+
+    if (ts == NULL) return(-1);
+    ts->fn = fn;
+    ts->arg = arg;
+
+#if defined(__WIN32__)
+    *th = CreateThread(NULL, 0, ThreadEntry, ts, 0, &id);
+    if (*th == NULL)
+    {
+        free(ts);
+        return(-1);
+    }
+#else
+    if (pthread_create(th, NULL, ThreadEntry, ts) != 0)
+    {
+        free(ts);
+        return(-1);
+    }
+#endif
+
+    return(0);
+}
+
+
+// Wait for a thread to finish.
+
+void ThreadJoin(THREAD th)
+{
+#if defined(__WIN32__)
+    WaitForSingleObject(th, INFINITE);
+    CloseHandle(th);
+#else
+    pthread_join(th, NULL);
+#endif
+}
+
+
+// Return the number of CPUs that can run threads, or 1 if unknown.
+
+int ThreadCpuCount(void)
+{
+#if defined(__WIN32__)
+    SYSTEM_INFO si;
+
+    GetSystemInfo(&si);
+    return(si.dwNumberOfProcessors ? (int) si.dwNumberOfProcessors : 1);
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return(n > 0 ? (int) n : 1);
+#endif
+}
+
+
+// Mutexes
+
+void MutexInit(MUTEX *mx)
+{
+#if defined(__WIN32__)
+    InitializeCriticalSection(mx);
+#else
+    pthread_mutex_init(mx, NULL);
+#endif
+}
+
+void MutexLock(MUTEX *mx)
+{
+#if defined(__WIN32__)
+    EnterCriticalSection(mx);
+#else
+    pthread_mutex_lock(mx);
+#endif
+}
+
+void MutexUnlock(MUTEX *mx)
+{
+#if defined(__WIN32__)
+    LeaveCriticalSection(mx);
+#else
+    pthread_mutex_unlock(mx);
+#endif
+}
+
+void MutexFree(MUTEX *mx)
+{
+#if defined(__WIN32__)
+    DeleteCriticalSection(mx);
+#else
+    pthread_mutex_destroy(mx);
+#endif
+}
+
+
+// Counting semaphores.
+// POSIX unnamed semaphores are not available everywhere, so on Unix they
+// are made from a mutex and a condition variable.
+
+void SemaInit(SEMA *sm, int count)
+{
+#if defined(__WIN32__)
+    *sm = CreateSemaphore(NULL, count, 0x7FFFFFFF, NULL);
+#else
+    pthread_mutex_init(&sm->mx, NULL);
+    pthread_cond_init(&sm->cv, NULL);
+    sm->count = count;
+#endif
+}
+
+void SemaWait(SEMA *sm)
+{
+#if defined(__WIN32__)
+    WaitForSingleObject(*sm, INFINITE);
+#else
+    pthread_mutex_lock(&sm->mx);
+    while (sm->count <= 0)
+        pthread_cond_wait(&sm->cv, &sm->mx);
+    sm->count--;
+    pthread_mutex_unlock(&sm->mx);
+#endif
+}
+
+void SemaPost(SEMA *sm)
+{
+#if defined(__WIN32__)
+    ReleaseSemaphore(*sm, 1, NULL);
+#else
+    pthread_mutex_lock(&sm->mx);
+    sm->count++;
+    pthread_cond_signal(&sm->cv);
+    pthread_mutex_unlock(&sm->mx);
+#endif
+}
+
+void SemaFree(SEMA *sm)
+{
+#if defined(__WIN32__)
+    CloseHandle(*sm);
+#else
+    pthread_cond_destroy(&sm->cv);
+    pthread_mutex_destroy(&sm->mx);
+#endif
+}
+
+
+
+// Ordered job runner.
+// Jobs 0 to count-1 are run by a pool of threads.  Each job writes to a
+// report stream of its own, and the reports are copied to out in job
+// order as soon as they are ready, so the output is the same as if the
+// jobs had been run one after the other.  A report is held in memory, or
+// in a temporary file on Windows which has no memory streams.
+
+#define REPORTS_PER_THREAD 4    // finished reports allowed to wait per thread
+
+typedef struct
+{
+    FILE   *fp;         // report stream, NULL when not in use
+    char   *buf;        // memory stream buffer
+    size_t  len;        // memory stream length
+    int     rc;         // what the job returned
+} REPORT;
+
+
+// State shared by the workers.
+// Only the next job number is changed by more than one thread, and it is
+// protected by Lock.  Report slots are handed from a worker to the writer
+// through the Done semaphores, and the Window semaphore keeps workers
+// from getting more than WinSize jobs ahead of the writer.
+
+typedef struct
+{
+    ORDEREDJOB job;     // the job function
+    void     *arg;      // passed to the job function
+    int       Count;    // number of jobs
+    int       Next;     // next job number to give out
+    MUTEX     Lock;     // protects Next
+    SEMA      Window;   // free report slots
+    SEMA     *Done;     // one per slot, posted when the report is ready
+    REPORT   *Report;   // one per slot
+    int       WinSize;  // number of slots
+} ORDERED;
+
+
+static void ReportOpen(REPORT *rp)
+{
+#if defined(__WIN32__)
+    rp->fp = tmpfile();
+#else
+    rp->buf = NULL;
+    rp->len = 0;
+    rp->fp = open_memstream(&rp->buf, &rp->len);
+#endif
+}
+
+
+// Copy a finished report to out and free it.
+
+static void ReportWrite(REPORT *rp, FILE *out)
+{
+#if defined(__WIN32__)
+    char buf[16384];
+    size_t n;
+
+    if (rp->fp == NULL) return;
+    rewind(rp->fp);
+    while ((n = fread(buf, 1, sizeof(buf), rp->fp)) > 0)
+        fwrite(buf, 1, n, out);
+    fclose(rp->fp);
+#else
+    if (rp->fp == NULL) return;
+    fclose(rp->fp);
+    fwrite(rp->buf, 1, rp->len, out);
+    free(rp->buf);
+    rp->buf = NULL;
+#endif
+    rp->fp = NULL;
+}
+
+
+// Worker thread.  Takes jobs in order until there are none left.
+
+static void OrderedWorker(void *arg)
+{
+    ORDERED *od = (ORDERED *) arg;
+    REPORT *rp;
+    int i;
+
+    for (;;)
+    {
+        SemaWait(&od->Window);
+
+        MutexLock(&od->Lock);
+        i = od->Next++;
+        MutexUnlock(&od->Lock);
+
+        if (i >= od->Count)
+        {
+            SemaPost(&od->Window);  // let the other workers see the end too
+            break;
+        }
+
+        rp = &od->Report[i % od->WinSize];
+        ReportOpen(rp);
+        rp->rc = rp->fp ? od->job(od->arg, i, rp->fp) : -1;
+        SemaPost(&od->Done[i % od->WinSize]);
+    }
+}
+
+
+// Run count jobs on threads threads, or one per CPU if threads is 0, and
+// write their reports to out in order.
+// Returns 0 if every job returned 0, otherwise -1.
+
+int ThreadRunOrdered(int count, int threads, ORDEREDJOB job, void *arg, FILE *out)
+{
+    ORDERED od;
+    THREAD *th;
+    int i, slot, started = 0, rc = 0;
+
+    if (threads <= 0) threads = ThreadCpuCount();
+    if (threads > count) threads = count;
+
+    memset(&od, 0, sizeof(ORDERED));
+    od.job = job;
+    od.arg = arg;
+    od.Count = count;
+    od.WinSize = threads * REPORTS_PER_THREAD;
+    od.Done = (SEMA *) malloc(od.WinSize * sizeof(SEMA));
+    od.Report = (REPORT *) calloc(od.WinSize, sizeof(REPORT));
+    th = (THREAD *) malloc(threads * sizeof(THREAD));
+
+    if (threads > 1 && od.Done && od.Report && th)
+    {
+        MutexInit(&od.Lock);
+        SemaInit(&od.Window, od.WinSize);
+        for (i = 0; i < od.WinSize; i++)
+            SemaInit(&od.Done[i], 0);
+
+        for (i = 0; i < threads; i++)
+            if (ThreadStart(&th[started], OrderedWorker, &od) == 0) started++;
+    }
+
+    if (started == 0)   // one thread, or threads could not be had
+    {
+        for (i = 0; i < count; i++)
+            if (job(arg, i, out)) rc = -1;
+    }
+    else
+    {
+        for (i = 0; i < count; i++)
+        {
+            slot = i % od.WinSize;
+            SemaWait(&od.Done[slot]);
+            if (od.Report[slot].fp == NULL)
+                fprintf(out, "*** Out of memory ***\n");
+            if (od.Report[slot].rc) rc = -1;
+            ReportWrite(&od.Report[slot], out);
+            SemaPost(&od.Window);
+        }
+
+        for (i = 0; i < started; i++)
+            ThreadJoin(th[i]);
+    }
+
+    if (threads > 1 && od.Done && od.Report && th)
+    {
+        for (i = 0; i < od.WinSize; i++)
+            SemaFree(&od.Done[i]);
+        SemaFree(&od.Window);
+        MutexFree(&od.Lock);
+    }
+
+    free(th);
+    free(od.Report);
+    free(od.Done);
+
+    return(rc);
+}
+
@@ -0,0 +1,414 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+Chunk tree.  AviTreeBuild() reads a file with the chunk walker and keeps
+every chunk as a node of a tree, so that a program can look things up
+after the file has been read instead of only printing it.  Each node
+has the chunk id, its absolute 64 bit file location, its size, its
+parent and children, a copy of its decoded header and, for an index, its
+entries.
+
+Everything is taken from an arena: memory is handed out from big blocks
+by bumping a pointer, and the whole tree goes back in one go when it is
+freed.  The blocks double in size as they fill, so even a movi list with
+a million chunks takes only a handful of calls to malloc().
+
+*/
+
+#include "rdavi2.h"
+
+#define ARENA_FIRST     0x10000         // size of the first arena block
+#define ARENA_MAX       0x4000000       // blocks stop doubling at this size
+#define ARENA_ALIGN     8               // every allocation is aligned to this
+
+
+struct ARENABLOCK
+{
+    ARENABLOCK *Next;       // block allocated before this one
+    size_t      Size;       // bytes of data in the block
+    size_t      Used;       // bytes handed out so far
+};
+
+
+typedef struct
+{
+    AVITREE     *t;
+    AVITREENODE *Cur;                           // list or index being filled
+    AVITREENODE *Tail[MAX_WALK_DEPTH + 2];      // last child at each depth
+} TREEBUILD;
+
+
+// Get size bytes from the arena, or NULL if out of memory.  The memory is
+// not cleared.
+
+void *ArenaAlloc(ARENA *a, size_t size)
+{
+    ARENABLOCK *b = a->Head;
+    size_t bsize;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+    if (b == NULL || b->Size - b->Used < size)
+    {
+        bsize = b ? b->Size * 2 : ARENA_FIRST;
+        if (bsize > ARENA_MAX) bsize = ARENA_MAX;
+        if (bsize < size) bsize = size;
+
+        b = (ARENABLOCK *) malloc(sizeof(ARENABLOCK) + ARENA_ALIGN + bsize);
+        if (b == NULL) return(NULL);
+        b->Next = a->Head;
+        b->Size = bsize;
+        b->Used = 0;
+        a->Head = b;
+        a->Total += bsize;
+    }
+
+    b->Used += size;
+
+    // the data starts at the first aligned spot after the block header
+
+    return((BYTE *) b + ((sizeof(ARENABLOCK) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+           + b->Used - size);
+}
+
+
+// Give back every block of the arena.
+
+void ArenaFree(ARENA *a)
+{
+    ARENABLOCK *b, *next;
+
+    for (b = a->Head; b; b = next)
+    {
+        next = b->Next;
+        free(b);
+    }
+    a->Head = NULL;
+    a->Total = 0;
+}
+
+
+// Return the size of the decoded header Data of a node of type kind.
+
+size_t AviTreeDataSize(int kind, void *data)
+{
+    switch (kind)
+    {
+        case NODE_AVIH:     return(sizeof(MainAVIHeader));
+        case NODE_STRH:     return(sizeof(AVIStreamHeader56));
+        case NODE_STRF_VID: return(sizeof(STREAMFORMATVID));
+        case NODE_STRF_AUD: return(sizeof(STREAMFORMATAUD));
+        case NODE_INDX:     return(sizeof(INDX_CHUNK));
+        case NODE_DMLH:     return(sizeof(AVIEXTHEADER));
+        case NODE_VPRP:     return(sizeof(VideoPropHeader));
+        case NODE_STRING:
+        case NODE_ERROR:    return(data ? strlen((char *) data) + 1 : 0);
+    }
+
+    return(0);
+}
+
+
+// Allocate a new node and hang it below the node being filled.
+
+static AVITREENODE *TreeAddNode(TREEBUILD *tb, int depth)
+{
+    AVITREENODE *n;
+
+    n = (AVITREENODE *) ArenaAlloc(&tb->t->Arena, sizeof(AVITREENODE));
+    if (n == NULL)
+    {
+        tb->t->OutOfMemory = TRUE;
+        return(NULL);
+    }
+
+    memset(n, 0, sizeof(AVITREENODE));
+    n->Parent = tb->Cur;
+    if (tb->Tail[depth])
+        tb->Tail[depth]->Next = n;
+    else
+        tb->Cur->Child = n;
+    tb->Tail[depth] = n;
+    n->Num = ++tb->t->NodeCount;
+
+    return(n);
+}
+
+
+// Copy len bytes into the arena.
+
+static void *TreeCopy(TREEBUILD *tb, void *src, size_t len)
+{
+    void *p = ArenaAlloc(&tb->t->Arena, len);
+
+    if (p == NULL)
+        tb->t->OutOfMemory = TRUE;
+    else
+        memcpy(p, src, len);
+
+    return(p);
+}
+
+
+// Sink functions for the chunk walker
+
+static int TreeOpen(void *arg, AVINODE *node)
+{
+    TREEBUILD *tb = (TREEBUILD *) arg;
+    AVITREENODE *n;
+    INDX_CHUNK *idx;
+    size_t len;
+    DWORD count = 0;
+
+    if (tb->t->OutOfMemory) return(1);
+    n = TreeAddNode(tb, node->Depth);
+    if (n == NULL) return(1);
+
+    n->FCC = node->FCC;
+    n->Type = node->Type;
+    n->StreamNum = node->StreamNum;
+    n->Kind = node->Kind;
+    n->Depth = node->Depth;
+    n->Pos = node->Pos;
+    n->Size = node->Size;
+
+    len = AviTreeDataSize(node->Kind, node->Data);
+    if (len) n->Data = TreeCopy(tb, node->Data, len);
+
+    // Make room for the entries of an index up front, as many as the
+    // header claims, but no more than fit in the chunk.
+
+    if (node->Kind == NODE_INDX)
+    {
+        idx = (INDX_CHUNK *) node->Data;
+        count = idx->nEntriesInUse;
+        if (idx->wLongsPerEntry && node->Size >= 24 &&
+            count > (node->Size - 24) / (idx->wLongsPerEntry * 4))
+            count = (node->Size - 24) / (idx->wLongsPerEntry * 4);
+    }
+    else if (node->Kind == NODE_IDX1)
+        count = node->Size / sizeof(AVIINDEXENTRY);
+
+    if (count)
+    {
+        n->Entry = (AVIENTRY *) ArenaAlloc(&tb->t->Arena, count * sizeof(AVIENTRY));
+        if (n->Entry == NULL)
+        {
+            tb->t->OutOfMemory = TRUE;
+            return(1);
+        }
+        n->EntryAlloc = count;
+    }
+
+    if (node->Kind == NODE_LIST || node->Kind == NODE_INDX || node->Kind == NODE_IDX1)
+    {
+        tb->Cur = n;
+        tb->Tail[node->Depth + 1] = NULL;
+    }
+
+    return(tb->t->OutOfMemory);
+}
+
+
+static void TreeEntry(void *arg, AVINODE *node, AVIENTRY *e)
+{
+    TREEBUILD *tb = (TREEBUILD *) arg;
+    AVITREENODE *n = tb->Cur;
+
+    if (n->EntryCount < n->EntryAlloc)
+        n->Entry[n->EntryCount++] = *e;
+}
+
+
+static void TreeClose(void *arg, AVINODE *node)
+{
+    TREEBUILD *tb = (TREEBUILD *) arg;
+
+    // Open() may have run out of memory before the node was made, in
+    // which case Cur was never moved down to it.
+
+    if ((node->Kind == NODE_LIST || node->Kind == NODE_INDX || node->Kind == NODE_IDX1) &&
+        tb->Cur->Depth == node->Depth && tb->Cur->Pos == node->Pos)
+        tb->Cur = tb->Cur->Parent;
+}
+
+
+static void TreeError(void *arg, char *msg)
+{
+    TREEBUILD *tb = (TREEBUILD *) arg;
+    AVITREENODE *n;
+
+    if (tb->t->OutOfMemory) return;
+    n = TreeAddNode(tb, tb->Cur->Depth + 1);
+    if (n == NULL) return;
+
+    n->Kind = NODE_ERROR;
+    n->StreamNum = -1;
+    n->Depth = tb->Cur->Depth + 1;
+    n->Pos = tb->Cur->Pos;
+    n->Data = TreeCopy(tb, msg, strlen(msg) + 1);
+}
+
+
+// Read the file from its current position and build the chunk tree.  The
+// top node of the tree stands for the whole file, with the RIFF chunks as
+// its children.  Problems found in the file become NODE_ERROR nodes where
+// they were found.
+// Returns the tree, or NULL if out of memory.
+
+AVITREE *AviTreeBuild(FILE64 *in)
+{
+    TREEBUILD tb;
+    AVISINK sink;
+    AVITREE *t;
+
+    t = (AVITREE *) malloc(sizeof(AVITREE));
+    if (t == NULL) return(NULL);
+    memset(t, 0, sizeof(AVITREE));
+
+    t->Root = (AVITREENODE *) ArenaAlloc(&t->Arena, sizeof(AVITREENODE));
+    if (t->Root == NULL)
+    {
+        free(t);
+        return(NULL);
+    }
+    memset(t->Root, 0, sizeof(AVITREENODE));
+    t->Root->Kind = NODE_LIST;
+    t->Root->StreamNum = -1;
+    t->Root->Depth = -1;
+    t->Root->Pos = File64GetAbsPos(in);
+    t->FileSize = File64Size(in);
+
+    memset(&tb, 0, sizeof(TREEBUILD));
+    tb.t = t;
+    tb.Cur = t->Root;
+
+    sink.arg = &tb;
+    sink.Open = TreeOpen;
+    sink.Entry = TreeEntry;
+    sink.Close = TreeClose;
+    sink.Error = TreeError;
+
+    t->Result = AviWalk(in, &sink, NULL);
+
+    if (t->OutOfMemory)
+    {
+        AviTreeFree(t);
+        return(NULL);
+    }
+
+    return(t);
+}
+
+
+void AviTreeFree(AVITREE *t)
+{
+    if (t == NULL) return;
+    ArenaFree(&t->Arena);
+    free(t);
+}
+
+
+// Step to the next node in file order: children first, then the next
+// node on the same level, then back up.
+// Returns NULL after the last node.
+
+AVITREENODE *AviTreeNext(AVITREENODE *n)
+{
+    if (n->Child) return(n->Child);
+
+    while (n)
+    {
+        if (n->Next) return(n->Next);
+        n = n->Parent;
+    }
+
+    return(NULL);
+}
+
+
+// Find the first node at or after n, in file order, with the chunk id fcc
+// and, if type is not 0, the list type type.  Both are given as they are
+// stored in the file, such as MKFCC('L','I','S','T').
+// Returns NULL if there is none.
+
+AVITREENODE *AviTreeFind(AVITREENODE *n, FOURCC fcc, FOURCC type)
+{
+    for ( ; n; n = AviTreeNext(n))
+    {
+        if (n->FCC == fcc && (type == 0 || n->Type == type))
+            return(n);
+    }
+
+    return(NULL);
+}
+
+
+
+// Hand the children of n and everything below them to a sink, the same
+// way that AviWalk() would have when the tree was built.
+
+static void TreeReplay(AVITREENODE *n, AVISINK *sink)
+{
+    AVINODE node;
+    DWORD i;
+
+    for (n = n->Child; n; n = n->Next)
+    {
+        if (n->Kind == NODE_ERROR)
+        {
+            if (sink->Error) sink->Error(sink->arg, (char *) n->Data);
+            continue;
+        }
+
+        node.FCC = n->FCC;
+        node.Type = n->Type;
+        node.StreamNum = n->StreamNum;
+        node.Kind = n->Kind;
+        node.Depth = n->Depth;
+        node.Pos = n->Pos;
+        node.Size = n->Size;
+        node.Data = n->Data;
+
+        if (!sink->Open(sink->arg, &node))
+        {
+            if (sink->Entry)
+            {
+                for (i = 0; i < n->EntryCount; i++)
+                    sink->Entry(sink->arg, &node, n->Entry + i);
+            }
+            TreeReplay(n, sink);
+        }
+        sink->Close(sink->arg, &node);
+    }
+}
+
+
+// Same as AviWalk(), but the chunks come from the tree instead of the
+// file.
+// Returns what AviWalk() returned when the tree was built.
+
+int AviTreeWalk(AVITREE *t, AVISINK *sink)
+{
+    TreeReplay(t->Root, sink);
+
+    return(t->Result);
+}
+
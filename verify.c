@@ -0,0 +1,337 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+Index verification.  Players trust the index to find the chunks of the
+movi list, and stall when 'idx1', the Open-DML 'ix##' indexes and the
+chunks that are really there do not agree.  This checks all three
+against each other.
+
+The entries of both indexes are kept as arrays of 64 bit keys, each the
+file location of the chunk data shifted up by 8 bits with the stream
+number in the low byte, and the sizes in arrays alongside.  That is 12
+bytes an entry, so ten million entries take 120MB per index.  The arrays
+are radix sorted unless they are already in order, as they mostly are.
+Then the movi list is read, and since its chunks come in file order they
+are joined with both sorted arrays as they go by, the same way as two
+sorted lists are merged, without keeping the chunks themselves.
+
+*/
+
+#include "rdavi2.h"
+
+#define VIEW_GROW       0x10000     // entries added to a view at a time
+#define RADIX_BITS      8
+
+
+typedef struct
+{
+    char   *Name;       // for the report
+    QWORD  *Key;        // data location << 8 | stream number
+    DWORD  *Size;       // chunk size for each key
+    DWORD   Count;      // entries in use
+    DWORD   Alloc;      // entries allocated
+    DWORD   Cur;        // next entry to join with the movi list
+    int     Sorted;     // TRUE while the keys are in order
+    int     OutOfMemory;
+    DWORD   Problems;   // mismatches found
+} VIEW;
+
+typedef struct
+{
+    AVICTX *ctx;
+    QWORD   RiffEnd;    // idx1 only covers the first RIFF chunk
+    VIEW    View[2];    // idx1 and ix##
+    QWORD   Chunks;     // chunks in the movi list
+} VERIFY;
+
+
+static void ViewAdd(VIEW *w, QWORD pos, int stream, DWORD size)
+{
+    QWORD key = (pos << 8) | (stream & 0xFF);
+    QWORD *k;
+    DWORD *s;
+
+    if (w->OutOfMemory) return;
+    if (w->Count == w->Alloc)
+    {
+        k = (QWORD *) realloc(w->Key, (w->Alloc + VIEW_GROW) * sizeof(QWORD));
+        if (k) w->Key = k;
+        s = (DWORD *) realloc(w->Size, (w->Alloc + VIEW_GROW) * sizeof(DWORD));
+        if (s) w->Size = s;
+        if (k == NULL || s == NULL)
+        {
+            w->OutOfMemory = TRUE;
+            return;
+        }
+        w->Alloc += VIEW_GROW;
+    }
+
+    if (w->Count && key < w->Key[w->Count - 1]) w->Sorted = FALSE;
+    w->Key[w->Count] = key;
+    w->Size[w->Count++] = size;
+}
+
+
+// Sort the view by key, a digit of RADIX_BITS at a time starting with the
+// lowest.  Digits that are the same in every key are skipped.
+// Returns 0 on success or -1 if out of memory.
+
+static int ViewSort(VIEW *w)
+{
+    DWORD count[1 << RADIX_BITS], i, sum, n;
+    QWORD *k2, *kt, high = 0;
+    DWORD *s2, *st;
+    int shift, d;
+
+    if (w->Sorted) return(0);
+
+    k2 = (QWORD *) malloc(w->Count * sizeof(QWORD));
+    s2 = (DWORD *) malloc(w->Count * sizeof(DWORD));
+    if (k2 == NULL || s2 == NULL)
+    {
+        free(k2);
+        free(s2);
+        return(-1);
+    }
+
+    for (i = 0; i < w->Count; i++)
+        high |= w->Key[i];
+
+    for (shift = 0; shift < 64 && (high >> shift); shift += RADIX_BITS)
+    {
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < w->Count; i++)
+            count[(DWORD) (w->Key[i] >> shift) & ((1 << RADIX_BITS) - 1)]++;
+
+        if (count[(DWORD) (w->Key[0] >> shift) & ((1 << RADIX_BITS) - 1)] == w->Count)
+            continue;       // all the same
+
+        for (d = 0, sum = 0; d < (1 << RADIX_BITS); d++)
+        {
+            n = count[d];
+            count[d] = sum;
+            sum += n;
+        }
+
+        for (i = 0; i < w->Count; i++)
+        {
+            n = count[(DWORD) (w->Key[i] >> shift) & ((1 << RADIX_BITS) - 1)]++;
+            k2[n] = w->Key[i];
+            s2[n] = w->Size[i];
+        }
+
+        kt = w->Key; w->Key = k2; k2 = kt;
+        st = w->Size; w->Size = s2; s2 = st;
+    }
+
+    free(k2);
+    free(s2);
+    w->Sorted = TRUE;
+
+    return(0);
+}
+
+
+// Report one mismatch, unless too many have been shown already.
+
+static void VerifyProblem(VERIFY *v, VIEW *w, char *what, QWORD key, DWORD size, char *more)
+{
+    OUTBUF *out = v->ctx->out;
+    char hex[17];
+
+    if (w->Problems++ == (DWORD) v->ctx->MaxLines)
+        OutPrintf(out, "*** %s: the rest of the problems are not shown ***\n", w->Name);
+    if (w->Problems > (DWORD) v->ctx->MaxLines) return;
+
+    OutPrintf(out, "*** %s: %s %02X at 0x%s size %u%s ***\n", w->Name, what,
+              (int) (key & 0xFF), QWORD2HEX(key >> 8, hex), size, more);
+}
+
+
+// Join the chunk at key with the next entries of the view.
+
+static void VerifyJoin(VERIFY *v, VIEW *w, QWORD key, DWORD size)
+{
+    QWORD pos = key >> 8;
+    char more[64];
+
+    // entries before this chunk do not point at any chunk
+
+    while (w->Cur < w->Count && (w->Key[w->Cur] >> 8) < pos)
+    {
+        VerifyProblem(v, w, "entry for stream", w->Key[w->Cur], w->Size[w->Cur],
+                      ", there is no chunk there");
+        w->Cur++;
+    }
+
+    if (w->Cur == w->Count || (w->Key[w->Cur] >> 8) != pos)
+    {
+        VerifyProblem(v, w, "missing entry for the chunk of stream", key, size, "");
+        return;
+    }
+
+    if (w->Key[w->Cur] != key)
+    {
+        sprintf(more, ", the chunk is for stream %02X", (int) (key & 0xFF));
+        VerifyProblem(v, w, "entry for stream", w->Key[w->Cur], w->Size[w->Cur], more);
+    }
+    else if (w->Size[w->Cur] != size)
+    {
+        sprintf(more, ", the chunk is %u bytes", size);
+        VerifyProblem(v, w, "entry for stream", w->Key[w->Cur], w->Size[w->Cur], more);
+    }
+    w->Cur++;
+
+    while (w->Cur < w->Count && (w->Key[w->Cur] >> 8) == pos)
+    {
+        VerifyProblem(v, w, "second entry for stream", w->Key[w->Cur], w->Size[w->Cur],
+                      " for the same chunk");
+        w->Cur++;
+    }
+}
+
+
+// Entries of the indexes, on the first pass
+
+static void VerifyIndexEntry(void *arg, int stream, AVIENTRY *e)
+{
+    VERIFY *v = (VERIFY *) arg;
+
+    ViewAdd(v->View + (e->Kind == ENTRY_IDX1 ? 0 : 1), e->Pos, stream, e->Size);
+}
+
+
+// Chunks of the movi list, on the second pass
+
+static void VerifyChunk(void *arg, int stream, AVIENTRY *e)
+{
+    VERIFY *v = (VERIFY *) arg;
+    QWORD key = (e->Pos << 8) | (stream & 0xFF);
+
+    v->Chunks++;
+    if (v->View[0].Count && e->Pos < v->RiffEnd) VerifyJoin(v, v->View, key, e->Size);
+    if (v->View[1].Count) VerifyJoin(v, v->View + 1, key, e->Size);
+}
+
+
+static void VerifyError(void *arg, char *msg)
+{
+    OutPrintf(((VERIFY *) arg)->ctx->out, "*** %s ***\n", msg);
+}
+
+
+static void VerifyLine(OUTBUF *out, char *label, QWORD val)
+{
+    OutPrintf(out, "%16s: ", label);
+    OutQDec(out, val);
+    OutChar(out, '\n');
+}
+
+
+// Compare idx1, the ix## indexes and the chunks of the movi list of the
+// file in ctx with each other, and report where they differ.
+// Returns 0 if they agree, 1 if not, or -1 if the file could not be read.
+
+int VerifyReport(AVICTX *ctx)
+{
+    VERIFY v;
+    AVIINDEX *ix;
+    OUTBUF *out = ctx->out;
+    char label[24];
+    int ret, n;
+
+    ix = (AVIINDEX *) malloc(sizeof(AVIINDEX));
+    if (ix == NULL)
+    {
+        OutPrintf(out, "*** Out of memory ***\n");
+        return(-1);
+    }
+
+    memset(&v, 0, sizeof(VERIFY));
+    v.ctx = ctx;
+    v.View[0].Name = "idx1";
+    v.View[1].Name = "ix##";
+    v.View[0].Sorted = v.View[1].Sorted = TRUE;
+
+    OutPrintf(out, "Index verification\n");
+
+    ix->arg = &v;
+    ix->Entry = VerifyIndexEntry;
+    ix->Error = VerifyError;
+    ix->Sources = INDEX_WANT(INDEX_IDX1) | INDEX_WANT(INDEX_ODML);
+    ret = AviIndexRead(ctx->in, ix);
+    v.RiffEnd = ix->RiffEnd;
+
+    // AviIndexRead() has made the idx1 offsets into file locations
+
+    if (ret == 0 && v.View[0].Count && ix->Idx1Base == 0)
+        OutPrintf(out, "idx1 offsets are from the start of the file\n");
+
+    for (n = 0; n < 2; n++)
+    {
+        if (v.View[n].OutOfMemory || ViewSort(v.View + n))
+        {
+            OutPrintf(out, "*** Out of memory ***\n");
+            ret = -1;
+        }
+    }
+
+    if (ret == 0)
+    {
+        ix->Entry = VerifyChunk;
+        ix->Sources = INDEX_WANT(INDEX_MOVI);
+        ret = AviIndexRead(ctx->in, ix);
+
+        // whatever is left over points past the last chunk
+
+        for (n = 0; n < 2; n++)
+        {
+            for ( ; v.View[n].Cur < v.View[n].Count; v.View[n].Cur++)
+                VerifyProblem(&v, v.View + n, "entry for stream",
+                              v.View[n].Key[v.View[n].Cur], v.View[n].Size[v.View[n].Cur],
+                              ", there is no chunk there");
+        }
+
+        VerifyLine(out, "movi Chunks", v.Chunks);
+        for (n = 0; n < 2; n++)
+        {
+            if (v.View[n].Count == 0)
+            {
+                OutPrintf(out, "%16s: none\n", v.View[n].Name);
+                continue;
+            }
+            sprintf(label, "%s Entries", v.View[n].Name);
+            VerifyLine(out, label, v.View[n].Count);
+            sprintf(label, "%s Problems", v.View[n].Name);
+            VerifyLine(out, label, v.View[n].Problems);
+        }
+    }
+
+    for (n = 0; n < 2; n++)
+    {
+        free(v.View[n].Key);
+        free(v.View[n].Size);
+    }
+    free(ix);
+
+    if (ret) return(-1);
+    return(v.View[0].Problems || v.View[1].Problems);
+}
+
@@ -0,0 +1,437 @@
+/*
+RdAvi2.exe - Copyright (c) 2024 by Dennis Hawkins. All rights reserved.
+Inspired by: ReadAvi.exe by Michael Kohn<mike@mikekohn.net> (http://www.mikekohn.net/)
+
+BSD License
+
+Redistribution and use in source and binary forms are permitted provided
+that the above copyright notice and this paragraph are duplicated in all
+such forms and that any documentation, advertising materials, and other
+materials related to such distribution and use acknowledge that the
+software was developed by the copyright holder. The name of the copyright
+holder may not be used to endorse or promote products derived from this
+software without specific prior written permission.  THIS SOFTWARE IS
+PROVIDED `'AS IS? AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE.
+
+Although not required, attribution is requested for any source code
+used by others.
+
+Chunk walker.  AviWalk() goes through every chunk of a file in the order
+they are stored and tells a sink about each one as it is found: where it
+is, how big it is, and what is in it for the headers that are understood.
+The entries of every index are passed along one at a time too.  Nothing
+is kept after the sink has been told, so files with millions of chunks
+take no more memory than small ones.
+
+The chunk headers are read with the block buffered chunk scanner, so the
+file is only touched once for every megabyte or so.
+
+*/
+
+#include "rdavi2.h"
+
+#define MAX_STRING      256     // longest strn or INFO text passed along
+#define IDX1_BATCH      256     // idx1 entries classified at once
+
+
+// A list being walked.  Level 0 is the file itself and has no node.
+
+typedef struct
+{
+    AVINODE   Node;         // what was passed to Open() for the list
+    QWORD     End;          // absolute file location of the end
+} WALKLEVEL;
+
+typedef struct
+{
+    FILE64   *in;
+    AVISINK  *sink;
+    AVILIMITS *Limits;      // stop early, or NULL
+    CHUNKSCAN scan;
+    FOURCC    StrhType;     // fccType of the last 'strh'
+    QWORD     MoviPos;      // location of the last 'movi' tag, for idx1
+    WALKLEVEL Level[MAX_WALK_DEPTH];    // the lists being walked
+} WALK;
+
+
+static void WalkError(WALK *w, char *msg)
+{
+    if (w->sink->Error) w->sink->Error(w->sink->arg, msg);
+}
+
+
+// Copy up to len bytes of the chunk data at pos into buf, which holds
+// size bytes.  Whatever is not in the chunk is zeroed.
+// Returns a pointer to buf, or NULL at the end of the file.
+
+static void *WalkPeek(WALK *w, QWORD pos, DWORD len, void *buf, int size)
+{
+    void *p;
+
+    memset(buf, 0, size);
+    if (len > (DWORD) size) len = size;
+    if (len == 0) return(buf);
+
+    p = ChunkScanPeek(&w->scan, pos, len);
+    if (p == NULL) return(NULL);
+    memcpy(buf, p, len);
+
+    return(buf);
+}
+
+
+// Pass along the entries of an 'indx' or 'ix##' index.
+
+static int WalkIndx(WALK *w, AVINODE *node, INDX_CHUNK *idx)
+{
+    AVIENTRY e;
+    QWORD pos = node->Pos + 8 + sizeof(INDX_CHUNK);
+    QWORD end = node->Pos + 8 + node->Size;
+    DWORD irb = idx->wLongsPerEntry * 4, i;
+    BYTE buf[16];
+
+    if (irb == 0) return(0);
+
+    memset(&e, 0, sizeof(AVIENTRY));
+    e.FCC = idx->dwChunkId;
+    ParseFCC(&idx->dwChunkId, &e.StreamNum);
+
+    if (idx->bIndexType == AVI_INDEX_OF_INDEXES)
+        e.Kind = ENTRY_SUPER;
+    else if (idx->bIndexType == AVI_INDEX_OF_CHUNKS)
+        e.Kind = (idx->bIndexSubType == AVI_INDEX_2FIELD) ? ENTRY_FIELD : ENTRY_STD;
+    else return(0);     // nothing else is understood
+
+    for (i = 0; i < idx->nEntriesInUse && pos + irb <= end; i++, pos += irb)
+    {
+        if (WalkPeek(w, pos, irb, buf, sizeof(buf)) == NULL)
+        {
+            WalkError(w, "Unexpected end of file");
+            return(-1);
+        }
+
+        e.Num = i;
+        if (e.Kind == ENTRY_SUPER)
+        {
+            SUPERINDEXENTRY *se = (SUPERINDEXENTRY *) buf;
+
+            e.Pos = se->qwOffset;
+            e.Size = se->dwSize;
+            e.Flags = se->dwDuration;
+            e.KeyFrame = FALSE;
+        }
+        else
+        {
+            FIELDINDEXENTRY *fe = (FIELDINDEXENTRY *) buf;
+
+            e.Pos = idx->qwBaseOffset + fe->dwOffset;
+            e.Pos2 = (e.Kind == ENTRY_FIELD) ? idx->qwBaseOffset + fe->dwOffsetField2 : 0;
+            e.Size = fe->dwSize & 0x7FFFFFFF;
+            e.Flags = 0;
+            e.KeyFrame = !(fe->dwSize & 0x80000000);
+        }
+        w->sink->Entry(w->sink->arg, node, &e);
+    }
+
+    return(0);
+}
+
+
+// Pass along the entries of a legacy 'idx1' index.  The entries are
+// copied out IDX1_BATCH at a time, since the sink may read the file too,
+// and their chunk ids are classified together.
+
+static int WalkIdx1(WALK *w, AVINODE *node)
+{
+    AVIENTRY e;
+    AVIINDEXENTRY blk[IDX1_BATCH], *ie;
+    int stream[IDX1_BATCH];
+    QWORD pos = node->Pos + 8;
+    DWORD i, j, cnt, count = node->Size / sizeof(AVIINDEXENTRY);
+
+    memset(&e, 0, sizeof(AVIENTRY));
+    e.Kind = ENTRY_IDX1;
+
+    for (i = 0; i < count; i += cnt, pos += cnt * sizeof(AVIINDEXENTRY))
+    {
+        cnt = count - i;
+        if (cnt > IDX1_BATCH) cnt = IDX1_BATCH;
+        ie = (AVIINDEXENTRY *) ChunkScanPeek(&w->scan, pos, cnt * sizeof(AVIINDEXENTRY));
+        if (ie == NULL)     // near the end of the file, go one at a time
+        {
+            cnt = 1;
+            ie = (AVIINDEXENTRY *) ChunkScanPeek(&w->scan, pos, sizeof(AVIINDEXENTRY));
+        }
+        if (ie == NULL)
+        {
+            WalkError(w, "Unexpected end of file");
+            return(-1);
+        }
+
+        memcpy(blk, ie, cnt * sizeof(AVIINDEXENTRY));
+        ParseFCCs(&blk->ckid, sizeof(AVIINDEXENTRY), (int) cnt, NULL, stream);
+
+        for (j = 0, ie = blk; j < cnt; j++, ie++)
+        {
+            e.Num = i + j;
+            e.FCC = ie->ckid;
+            e.StreamNum = stream[j];
+            e.Pos = w->MoviPos + ie->dwChunkOffset;
+            e.Size = ie->dwChunkLength;
+            e.Flags = ie->dwFlags;
+            e.KeyFrame = (ie->dwFlags & AVIIF_KEYFRAME) != 0;
+            w->sink->Entry(w->sink->arg, node, &e);
+        }
+    }
+
+    return(0);
+}
+
+
+// Walk the chunks from the scanner's current position up to the absolute
+// file location end, which is the whole of the file.  The lists are kept
+// on w->Level rather than walked by recursion, so the depth is bounded by
+// MAX_WALK_DEPTH and nothing else.
+// Returns 0 on success or -1 if the file ended early or a limit was hit.
+
+static int WalkList(WALK *w, QWORD end)
+{
+    AVINODE node;
+    WALKLEVEL *lv;
+    CHUNKHDR ck;
+    QWORD next;
+    BYTE *fp;
+    char *msg;
+    int ret, skip, len, depth = 0;
+    union
+    {
+        MainAVIHeader     avih;
+        AVIStreamHeader64 strh64;
+        AVIStreamHeader56 strh;
+        STREAMFORMATVID   vid;
+        STREAMFORMATAUD   aud;
+        INDX_CHUNK        indx;
+        AVIEXTHEADER      dmlh;
+        DWORD             vprp[9];
+        char              str[MAX_STRING];
+    } data;
+
+    w->Level[0].End = end;
+
+    for (;;)
+    {
+        lv = &w->Level[depth];
+        ret = ChunkScanNext(&w->scan, lv->End, &ck);
+        if (ret != 1)
+        {
+            if (depth == 0) return(0);
+            if (ret < 0)
+            {
+                WalkError(w, "Unexpected end of file");
+                ret = -1;
+                break;
+            }
+
+            // end of this list, carry on with the one holding it
+            w->sink->Close(w->sink->arg, &lv->Node);
+            w->scan.Next = lv->End;
+            depth--;
+            continue;
+        }
+
+        if (w->Limits && (msg = LimitCheck(w->Limits, w->in, depth)) != NULL)
+        {
+            WalkError(w, msg);
+            ret = -1;
+            break;
+        }
+
+        next = w->scan.Next;
+        if (next > lv->End) next = lv->End;     // chunk runs past its list
+
+        memset(&node, 0, sizeof(AVINODE));
+        fp = (BYTE *) ChunkScanPeek(&w->scan, ck.Pos, 4);
+        node.FCC = fp ? GET_DWORD(fp) : ck.FCC;
+        node.StreamNum = ck.StreamNum;
+        node.Kind = NODE_CHUNK;
+        node.Depth = depth;
+        node.Pos = ck.Pos;
+        node.Size = ck.Size;
+
+        if (depth == 0 && ck.FCC != MKFCC('R','I','F','F'))
+        {
+            WalkError(w, "Unexpected garbage detected at end of file");
+            return(0);
+        }
+
+        switch (ck.FCC)
+        {
+            case MKFCC('R','I','F','F'):
+            case MKFCC('L','I','S','T'):
+                fp = (BYTE *) ChunkScanPeek(&w->scan, ck.Pos + 8, 4);
+                node.Kind = NODE_LIST;
+                node.Type = fp ? GET_DWORD(fp) : 0;
+                if (node.Type == MKFCC('m','o','v','i')) w->MoviPos = ck.Pos + 8;
+
+                skip = w->sink->Open(w->sink->arg, &node);
+                if (!skip && depth + 1 >= MAX_WALK_DEPTH)
+                    WalkError(w, "Lists are nested too deeply");
+                else if (!skip)
+                {
+                    lv = &w->Level[++depth];
+                    lv->Node = node;
+                    lv->End = next;
+                    w->scan.Next = ck.Pos + 12;     // descend into the list
+                    continue;
+                }
+                w->sink->Close(w->sink->arg, &node);
+                w->scan.Next = next;
+                continue;
+
+            case MKFCC('a','v','i','h'):
+                node.Kind = NODE_AVIH;
+                node.Data = WalkPeek(w, ck.Pos + 8, ck.Size, &data.avih, sizeof(data.avih));
+                break;
+
+            case MKFCC('s','t','r','h'):
+                node.Kind = NODE_STRH;
+                node.Data = WalkPeek(w, ck.Pos + 8, ck.Size, &data.strh64, sizeof(data.strh64));
+                if (node.Data && ck.Size == sizeof(AVIStreamHeader64))
+                {
+                    // convert to 56 byte version, like the report does
+                    AVIStreamHeader64 h = data.strh64;
+
+                    memcpy(&data.strh, &h, sizeof(AVIStreamHeader56));
+                    data.strh.Frame.Top = (WORD) h.Frame.top;
+                    data.strh.Frame.Left = (WORD) h.Frame.left;
+                    data.strh.Frame.Bottom = (WORD) h.Frame.bottom;
+                    data.strh.Frame.Right = (WORD) h.Frame.right;
+                }
+                if (node.Data) w->StrhType = data.strh.fccType;
+                break;
+
+            case MKFCC('s','t','r','f'):
+                if (w->StrhType == MKFCC('v','i','d','s'))
+                {
+                    node.Kind = NODE_STRF_VID;
+                    node.Data = WalkPeek(w, ck.Pos + 8, ck.Size, &data.vid, sizeof(data.vid));
+                }
+                else if (w->StrhType == MKFCC('a','u','d','s'))
+                {
+                    node.Kind = NODE_STRF_AUD;
+                    node.Data = WalkPeek(w, ck.Pos + 8, ck.Size, &data.aud, sizeof(data.aud));
+                }
+                break;
+
+            case MKFCC('d','m','l','h'):
+                node.Kind = NODE_DMLH;
+                node.Data = WalkPeek(w, ck.Pos + 8, ck.Size, &data.dmlh, sizeof(data.dmlh));
+                break;
+
+            case MKFCC('v','p','r','p'):
+                node.Kind = NODE_VPRP;
+                node.Data = WalkPeek(w, ck.Pos + 8, ck.Size, data.vprp, sizeof(data.vprp));
+                break;
+
+            case MKFCC('i','n','d','x'):
+            case MKFCC('i','x','#','#'):
+                node.Kind = NODE_INDX;
+                node.Data = WalkPeek(w, ck.Pos + 8, ck.Size, &data.indx, sizeof(data.indx));
+                break;
+
+            case MKFCC('i','d','x','1'):
+                node.Kind = NODE_IDX1;
+                break;
+
+            case MKFCC('s','t','r','n'):
+                node.Kind = NODE_STRING;
+                break;
+
+            default:
+                if (lv->Node.Type == MKFCC('I','N','F','O') ||
+                    lv->Node.Type == MKFCC('P','R','M','I'))
+                    node.Kind = NODE_STRING;
+                break;
+        }
+
+        if (node.Kind == NODE_STRING)
+        {
+            len = (int) min(ck.Size, MAX_STRING - 1);
+            node.Data = WalkPeek(w, ck.Pos + 8, len, data.str, sizeof(data.str));
+        }
+
+        if (node.Kind != NODE_CHUNK && node.Kind != NODE_IDX1 && node.Data == NULL)
+        {
+            WalkError(w, "Unexpected end of file");
+            ret = -1;
+            break;
+        }
+
+        skip = w->sink->Open(w->sink->arg, &node);
+        ret = 0;
+        if (!skip && w->sink->Entry)
+        {
+            if (node.Kind == NODE_INDX)
+                ret = WalkIndx(w, &node, &data.indx);
+            else if (node.Kind == NODE_IDX1)
+                ret = WalkIdx1(w, &node);
+        }
+        w->sink->Close(w->sink->arg, &node);
+        if (ret) break;
+    }
+
+    // after an error, close the lists still open
+
+    for (; depth > 0; depth--)
+    {
+        w->sink->Close(w->sink->arg, &w->Level[depth].Node);
+        w->scan.Next = w->Level[depth].End;
+    }
+
+    return(ret);
+}
+
+
+// Walk the whole file, from the current position to the end.  lim, if
+// not NULL, are the limits of the parse, already started by LimitStart().
+// Returns 0 on success, -1 if the file ended early, a limit was reached
+// or it is not a RIFF file.
+
+int AviWalk(FILE64 *in, AVISINK *sink, AVILIMITS *lim)
+{
+    WALK w;
+    QWORD start, end;
+    BYTE *p;
+    int ret;
+
+    memset(&w, 0, sizeof(WALK));
+    w.in = in;
+    w.sink = sink;
+    w.Limits = lim;
+
+    start = File64GetAbsPos(in);
+    end = File64Size(in);
+    if (end == 0) end = (QWORD) -1;     // size not known, go until EOF
+
+    if (ChunkScanOpen(&w.scan, in, start, end))
+    {
+        WalkError(&w, "Out of memory");
+        return(-1);
+    }
+
+    p = (BYTE *) ChunkScanPeek(&w.scan, start, 4);
+    if (p == NULL || GET_DWORD(p) != MKFCC('R','I','F','F'))
+    {
+        WalkError(&w, "'RIFF' tag missing.  This is not a AVI/RIFF file.");
+        ret = -1;
+    }
+    else ret = WalkList(&w, end);
+
+    File64SetAbsPos(in, w.scan.Next < end ? w.scan.Next : end);
+    ChunkScanClose(&w.scan);
+
+    return(ret);
+}
+